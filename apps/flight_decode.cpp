@@ -0,0 +1,109 @@
+#include <algorithm>
+#include <cstdint>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "infra/flight_recorder.hpp"
+
+// flight_decode.cpp turns a metrics.flight_recorder file into CSV or a Chrome trace, and prints a per-stage summary
+// The summary's LAST column is how long before the newest record each stage finished its last frame, after a hang the
+// stage that stopped first stands out. Works on a file the pipeline is still writing. Links dcp_flight (libc) only.
+//   flight_decode <file> [--csv out.csv] [--trace out.json]     "-" writes to stdout, without either only the summary
+
+static int Usage() {
+  std::cerr << "usage: flight_decode <file> [--csv out.csv] [--trace out.json]\n";
+  return 2;
+}
+
+// Opens path for writing, or stdout for "-"
+static bool WithOutput(const std::string& path, const char* what, void (*write)(const dcp::FlightDump&, std::ostream&),
+                       const dcp::FlightDump& dump) {
+  if (path == "-") {
+    write(dump, std::cout);
+    return true;
+  }
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out) {
+    std::cerr << "flight_decode: cannot write " << what << " to '" << path << "'\n";
+    return false;
+  }
+  write(dump, out);
+  std::cerr << "wrote " << what << " " << path << "\n";
+  return true;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) return Usage();
+  const std::string path = argv[1];
+  std::string csv_path, trace_path;
+  for (int i = 2; i < argc; ++i) {
+    const std::string a = argv[i];
+    if (a == "--csv" && i + 1 < argc) csv_path = argv[++i];
+    else if (a == "--trace" && i + 1 < argc) trace_path = argv[++i];
+    else return Usage();
+  }
+
+  dcp::FlightDump dump;
+  try {
+    dump = dcp::ReadFlightFile(path);
+  } catch (const std::runtime_error& e) {
+    std::cerr << e.what() << "\n";
+    return 1;
+  }
+
+  bool ok = true;
+  if (!csv_path.empty()) ok = WithOutput(csv_path, "CSV", dcp::WriteFlightCsv, dump) && ok;
+  if (!trace_path.empty()) ok = WithOutput(trace_path, "trace", dcp::WriteFlightTrace, dump) && ok;
+  if (csv_path == "-" || trace_path == "-") return ok ? 0 : 1;
+
+  // Summary
+  const std::time_t started = static_cast<std::time_t>(dump.start_realtime_ns / 1'000'000'000);
+  char when[32] = "?";
+  if (std::tm tm{}; ::localtime_r(&started, &tm)) std::strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &tm);
+  std::cout << path << ": pid " << dump.writer_pid << ", started " << when << ", " << dump.written << " records written, "
+            << dump.events.size() << " kept (ring of " << dump.capacity << ")";
+  if (dump.torn > 0) std::cout << ", " << dump.torn << " torn";
+  std::cout << "\n";
+  if (dump.events.empty()) return ok ? 0 : 1;
+
+  struct Row {
+    std::uint64_t n{0};
+    std::int64_t sum_ns{0};
+    std::int64_t max_ns{0};
+    std::uint32_t max_depth{0};
+    std::int64_t last_end_ns{0};
+  };
+  std::vector<Row> rows(dump.stages.size());
+  std::int64_t first_ns = dump.events.front().start_ns, newest_ns = 0;
+  for (const auto& e : dump.events) {
+    first_ns = std::min(first_ns, e.start_ns);
+    newest_ns = std::max(newest_ns, e.end_ns);
+    if (e.stage >= rows.size()) continue;
+    Row& r = rows[e.stage];
+    const std::int64_t d = e.end_ns - e.start_ns;
+    ++r.n;
+    r.sum_ns += d;
+    r.max_ns = std::max(r.max_ns, d);
+    r.max_depth = std::max<std::uint32_t>(r.max_depth, e.queue_depth);
+    r.last_end_ns = std::max(r.last_end_ns, e.end_ns);
+  }
+  std::cout << "covers " << std::fixed << std::setprecision(1) << static_cast<double>(newest_ns - first_ns) / 1e9
+            << " s, up to " << static_cast<double>(newest_ns - dump.start_monotonic_ns) / 1e9 << " s after start\n\n";
+
+  std::cout << std::left << std::setw(20) << "STAGE" << std::setw(10) << "FRAMES" << std::setw(12) << "AVG(ms)"
+            << std::setw(12) << "MAX(ms)" << std::setw(10) << "MAXQ" << std::setw(12) << "LAST(ms)" << "\n";
+  for (std::size_t i = 0; i < rows.size(); ++i) {
+    const Row& r = rows[i];
+    if (r.n == 0) continue;
+    std::cout << std::setw(20) << dump.stages[i] << std::setw(10) << r.n << std::setw(12) << std::setprecision(2)
+              << static_cast<double>(r.sum_ns) / static_cast<double>(r.n) / 1e6 << std::setw(12)
+              << static_cast<double>(r.max_ns) / 1e6 << std::setw(10) << r.max_depth << std::setw(12) << std::setprecision(1)
+              << static_cast<double>(newest_ns - r.last_end_ns) / 1e6 << "\n";
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,119 @@
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <exception>
+#include <iostream>
+#include <vector>
+
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/prctl.h>
+#endif
+
+#include "core/config_loader.hpp"
+#include "core/core_budget.hpp"
+#include "core/yolo_dnn.hpp"
+#include "infra/shm_infer_channel.hpp"
+#include "infra/thread_tuning.hpp"
+
+// inference_worker.cpp is started by live_pipeline when inference.worker.enabled is set, not by hand
+// Loads the model from the pipeline's YAML and answers inference requests over the shared-memory channel until the
+// pipeline asks it to exit or goes away. Frames are used in place, nothing is copied or serialized on this side.
+//   inference_worker <config.yaml> <shm_name>
+// Exit codes: 0 = asked to exit, 1 = bad arguments/config/channel, 2 = model failed to load
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    std::cerr << "usage: inference_worker <config.yaml> <shm_name>\n";
+    return 1;
+  }
+
+  // Ctrl-C reaches the whole process group, the pipeline decides when the worker stops
+  std::signal(SIGINT, SIG_IGN);
+  const pid_t parent = ::getppid();
+#if defined(__linux__)
+  ::prctl(PR_SET_PDEATHSIG, SIGKILL);
+#endif
+
+  try {
+    const dcp::AppConfig cfg = dcp::LoadConfigFromYamlFile(argv[1]);
+    dcp::ApplyCoreBudget(cfg, dcp::PipelineMode::Worker);
+    std::cout << "[thread] " << dcp::FormatThreadReport(dcp::ApplyThreadConfig("inference_worker", cfg.threads.inference)) << std::endl;
+
+    dcp::ShmInferServer server(argv[2]);
+
+    dcp::YoloDnn::Params p;
+    p.onnx_path = cfg.inference.model.path;
+    p.input_w = cfg.inference.model.input_width;
+    p.input_h = cfg.inference.model.input_height;
+    p.conf_thresh = cfg.inference.confidence_threshold;
+    p.nms_thresh = 0.45f;
+    dcp::YoloDnn yolo(std::move(p));
+    if (!yolo.is_loaded()) {
+      server.set_failed();
+      std::cerr << "inference_worker: model '" << cfg.inference.model.path << "' failed to load\n";
+      return 2;
+    }
+    server.set_ready(yolo.supports_batch());
+
+    // Mat headers over the request slots, rebuilt per request. Results are filled in place like in-process
+    std::vector<dcp::PreprocessedFrame> frames;
+    std::vector<dcp::Detections> results;
+    frames.reserve(dcp::kShmInferMaxBatch);
+    results.resize(dcp::kShmInferMaxBatch);
+
+    while (!server.shutdown_requested() && ::getppid() == parent) {
+      if (!server.wait_request(200'000'000)) continue;
+      const auto t0 = std::chrono::steady_clock::now();
+
+      const std::size_t n = server.request_count();
+      frames.resize(n);
+      for (std::size_t k = 0; k < n; ++k) {
+        const dcp::ShmInferFrame& f = server.frame(k);
+        dcp::PreprocessedFrame& pf = frames[k];
+        pf.source_frame_id = f.source_frame_id;
+        pf.capture_time = dcp::TimePoint(std::chrono::nanoseconds(f.capture_ns));
+        pf.image = cv::Mat(f.height, f.width, f.type, const_cast<std::uint8_t*>(server.pixels(k)), static_cast<std::size_t>(f.stride));
+        pf.info.roi_applied = f.roi_applied != 0;
+        pf.info.roi = cv::Rect(f.roi_x, f.roi_y, f.roi_w, f.roi_h);
+        pf.info.resize_width = f.resize_width;
+        pf.info.resize_height = f.resize_height;
+      }
+
+      std::int32_t status = 0;
+      try {
+        if (n == 1) {
+          yolo.infer_into(frames.front(), results.front());
+        } else {
+          yolo.infer_batch_into(frames, results);
+        }
+      } catch (const std::exception& e) {
+        std::cerr << "inference_worker: run failed: " << e.what() << "\n";
+        status = 1;
+      }
+
+      for (std::size_t k = 0; status == 0 && k < n; ++k) {
+        const auto& items = results[k].items;
+        dcp::ShmInferResult& r = server.result(k);
+        dcp::ShmDetection* out = server.detections(k);
+        const std::size_t count = std::min(items.size(), server.max_detections());
+        for (std::size_t i = 0; i < count; ++i) {
+          out[i] = dcp::ShmDetection{items[i].bbox.x, items[i].bbox.y, items[i].bbox.w, items[i].bbox.h, items[i].class_id, items[i].confidence};
+        }
+        r.source_frame_id = results[k].source_frame_id;
+        r.detection_count = static_cast<std::uint32_t>(count);
+        r.truncated = static_cast<std::uint32_t>(items.size() - count);
+      }
+
+      const auto run_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+      server.complete(status == 0 ? n : 0, status, run_ns);
+    }
+
+  } catch (const std::exception& e) {
+    std::cerr << "inference_worker: " << e.what() << "\n";
+    return 1;
+  }
+
+  return 0;
+}
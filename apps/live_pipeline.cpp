@@ -1,85 +1,157 @@
 #include <iostream>
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <csignal>
+#include <cstdint>
+#include <filesystem>
 #include <thread>
-#include <iomanip>
+#include <memory>
+#include <string>
+#include <vector>
 
 // Utilities
 #include "core/config_loader.hpp"
+#include "core/core_budget.hpp"
 #include "core/frame.hpp"
 #include "core/preprocessed_frame.hpp"
 #include "core/detections.hpp"
+#include "core/inference_worker.hpp"
 #include "core/render_frame.hpp"
+#include "infra/flight_recorder.hpp"
 #include "infra/metrics.hpp"
+#include "infra/perf_counters.hpp"
 #include "apps/ansi_dashboard.hpp"
-#include "apps/hud_overlay.hpp"
+#include "apps/metrics_http_server.hpp"
 
 #include "infra/stop_token.hpp"
 
 // Resources
 #include "infra/bounded_queue.hpp"
+#include "infra/demand_signal.hpp"
 #include "infra/latest_store.hpp"
+#include "infra/async_writer.hpp"
+#include "infra/task_executor.hpp"
 
 // Stages
 #include "stages/camera_stage.hpp"
 #include "stages/preprocess_stage.hpp"
 #include "stages/inference_stage.hpp"
 #include "stages/tracking_stage.hpp"
-
+#include "stages/render_stage.hpp"
+#include "stages/track_log_stage.hpp"
+#include "stages/recording_stage.hpp"
+#include "stages/loop_recorder_stage.hpp"
+#include "stages/shm_publisher_stage.hpp"
+#include "stages/track_stream_stage.hpp"
+
+// Windows only exist in builds with DCP_WITH_HIGHGUI. Without it the binary doesn't link opencv_highgui and always runs
+// headless, the Ui* helpers below are then no-ops
+#ifdef DCP_WITH_HIGHGUI
 #include <opencv2/highgui.hpp>  // cv::namedWindow, cv::imshow, cv::waitKey
-#include <opencv2/imgproc.hpp>
-
-#include "core/labels/general_labels.hpp"
-#include "core/labels/car_labels.hpp"
+static constexpr bool kHaveHighgui = true;
+#else
+static constexpr bool kHaveHighgui = false;
+#endif
 
 static std::atomic_bool g_sigint{false};
+static std::atomic_bool g_event{false};
 
 static void HandleSigint(int) {
   g_sigint.store(true, std::memory_order_relaxed);
 }
 
-static void DrawTracks(cv::Mat& img, const dcp::WorldState& ws) {
-    for (const auto& tr : ws.tracks) {
-        // Choose color
-        cv::Scalar color;
-        if (tr.missed_frames == 0) {
-            color = cv::Scalar(0, 255, 0);   // green = matched this frame
-        } else {
-            color = cv::Scalar(0, 0, 255);   // red = not matched
-        }
+// SIGUSR1 is the external event trigger for the loop recorder (e.g. from a G-sensor or button daemon)
+static void HandleSigusr1(int) {
+  g_event.store(true, std::memory_order_relaxed);
+}
 
-        // Bounding box
-        cv::Rect r(
-            static_cast<int>(tr.bbox.x),
-            static_cast<int>(tr.bbox.y),
-            static_cast<int>(tr.bbox.w),
-            static_cast<int>(tr.bbox.h)
-        );
-
-        // Draw rectangle
-        cv::rectangle(img, r, color, 2);
-
-        // Label
-        std::ostringstream label;
-        label << dcp::GeneralClassName(tr.class_id)
-        << " " << std::fixed << std::setprecision(2)
-        << tr.confidence;
-
-        cv::putText(
-            img,
-            label.str(),
-            cv::Point(r.x, std::max(12, r.y - 6)),
-            cv::FONT_HERSHEY_SIMPLEX,
-            0.45,
-            color,
-            1,
-            cv::LINE_AA
-        );
-    }
+#ifdef DCP_WITH_HIGHGUI
+static void UiOpen(const std::string& window) { cv::namedWindow(window, cv::WINDOW_AUTOSIZE); }
+static void UiShow(const std::string& window, const cv::Mat& img) { cv::imshow(window, img); }
+static int UiPollKey() { return cv::waitKey(1); }
+static void UiClose(const std::string& window) { cv::destroyWindow(window); }
+#else
+static void UiOpen(const std::string&) {}
+static void UiShow(const std::string&, const cv::Mat&) {}
+static int UiPollKey() { return -1; }
+static void UiClose(const std::string&) {}
+#endif
+
+// logs/tracks.csv -> logs/tracks_<stream>.csv, so streams never share an output file
+static std::string StreamOutputPath(const std::string& path, const std::string& stream) {
+  const auto slash = path.find_last_of('/');
+  const auto dot = path.find_last_of('.');
+  if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) return path + "_" + stream;
+  return path.substr(0, dot) + "_" + stream + path.substr(dot);
+}
+
+template <typename T>
+static std::shared_ptr<dcp::BoundedQueue<T>> MakeQueue(const dcp::QueueConfig& qc) {
+  return std::make_shared<dcp::BoundedQueue<T>>(qc.capacity, qc.drop_policy, std::chrono::milliseconds(qc.max_age_ms),
+                                                qc.max_mb * 1024 * 1024);
+}
+
+// Build a MEMORY panel view into a BoundedQueue or LatestStore
+template <typename T>
+static dcp::MemoryView MakeMemoryView(std::string name, const std::shared_ptr<dcp::BoundedQueue<T>>& q) {
+  return {std::move(name), [q]() { return q->bytes(); }, [q]() { return q->max_bytes(); }};
 }
 
+template <typename T>
+static dcp::MemoryView MakeMemoryView(std::string name, const std::shared_ptr<dcp::LatestStore<T>>& s) {
+  return {std::move(name), [s]() { return s->bytes(); }, nullptr};
+}
+
+// Build a dashboard view into any BoundedQueue
+template <typename T>
+static dcp::QueueView MakeQueueView(std::string name, const std::shared_ptr<dcp::BoundedQueue<T>>& q) {
+  return {
+    std::move(name),
+    [q]() { return q->size(); },
+    [q]() { return q->capacity(); },
+    [q]() { return q->drops_total(); },
+    [q]() { return q->expired_total(); }
+  };
+}
+
+// Everything one camera stream owns. Inference is the only stage shared between streams
+struct StreamChain {
+  std::string name;
+  std::string window_name;
+
+  std::shared_ptr<dcp::BoundedQueue<dcp::Frame>> camera_to_preprocess_queue;
+  std::shared_ptr<dcp::BoundedQueue<dcp::Frame>> preprocess_to_tracking_queue;
+  std::shared_ptr<dcp::LatestStore<dcp::PreprocessedFrame>> preprocessed_latest_store;
+  std::shared_ptr<dcp::LatestStore<dcp::Detections>> detections_latest_store;
+  std::shared_ptr<dcp::BoundedQueue<dcp::RenderFrame>> tracking_to_visualization_queue; // Null when headless
+  std::shared_ptr<dcp::BoundedQueue<dcp::RenderFrame>> tracking_to_track_log_queue;      // Null unless sinks.track_log
+  std::shared_ptr<dcp::BoundedQueue<dcp::RenderFrame>> recording_queue;                  // Null unless recording, fed by tracking (raw) or render (annotated)
+  std::shared_ptr<dcp::BoundedQueue<dcp::RenderFrame>> tracking_to_loop_queue;           // Null unless sinks.loop_recorder
+  std::shared_ptr<dcp::BoundedQueue<dcp::RenderFrame>> tracking_to_shm_queue;            // Null unless sinks.shm
+  std::shared_ptr<dcp::BoundedQueue<dcp::RenderFrame>> tracking_to_stream_queue;         // Null unless sinks.track_stream
+  std::shared_ptr<dcp::DemandSignal> inference_demand; // Null when preprocessing for inference is not demand driven
+
+  std::unique_ptr<dcp::CameraStage> camera_stage;
+  std::unique_ptr<dcp::PreprocessStage> preprocess_stage;
+  std::unique_ptr<dcp::TrackingStage> tracking_stage;
+  std::unique_ptr<dcp::TrackLogStage> track_log_stage;
+  std::unique_ptr<dcp::RecordingStage> recording_stage;
+  std::unique_ptr<dcp::LoopRecorderStage> loop_recorder_stage;
+  std::unique_ptr<dcp::ShmPublisherStage> shm_stage;
+  std::unique_ptr<dcp::TrackStreamStage> track_stream_stage;
+
+  // Composed frames, the UI thread only shows the newest one. All null when headless
+  std::shared_ptr<dcp::LatestStore<dcp::Frame>> display_store;
+  std::unique_ptr<dcp::RenderStage> render_stage;
+  dcp::StageMetrics* render_metrics{nullptr};
+  dcp::StageMetrics* display_metrics{nullptr};
+
+  dcp::Frame shown;
+  std::uint64_t shown_version{0};
+};
+
 // live_pipeline.cpp is my full system MVP
 // Starting point for running the whole pipeline
 
@@ -90,75 +162,329 @@ int main(int argc, char** argv) {
     dcp::AppConfig cfg = dcp::LoadConfigFromYamlFile(cfg_path);
     std::cout << "Loaded config OK: " << cfg_path << "\n";
     std::cout << "ROI enabled: : " << cfg.preprocess.crop_roi.enabled << "\n";
+    std::cout << "Streams: " << cfg.streams.size() << "\n";
+
+    // Size OpenCV/ORT pools from the budget before any stage or ORT session exists, and print the layout
+    dcp::ApplyCoreBudget(cfg, dcp::PipelineMode::Live);
+
+    // Before any stage metrics exist, they only register the hardware counter series when this is on
+    dcp::EnablePerfCounters(cfg.metrics.perf_counters);
 
     std::signal(SIGINT, HandleSigint);
+    std::signal(SIGUSR1, HandleSigusr1);
     const auto start = std::chrono::steady_clock::now();
     const auto max_runtime = std::chrono::seconds(500); // test value
 
     dcp::StopSource global_stop;
 
+    // Headless: no render stages, no display queue, no windows. Tracking results only go to the sinks
+    const bool ui = cfg.visualization.enabled && kHaveHighgui;
+    if (cfg.visualization.enabled && !kHaveHighgui) {
+      std::cout << "Built without DCP_WITH_HIGHGUI, ignoring visualization.enabled and running headless\n";
+    }
+    std::cout << "Mode: " << (ui ? "windowed" : "headless") << "\n";
+    const auto& rec = cfg.visualization.recording;
+    const bool record_annotated = rec.enabled && rec.source == "annotated" && ui;
+    if (rec.enabled && rec.source == "annotated" && !ui) {
+      std::cout << "Recording annotated frames needs the display, recording raw frames instead\n";
+    }
+    const auto& loop_cfg = cfg.sinks.loop_recorder;
+    const auto& shm_cfg = cfg.sinks.shm;
+    const auto& stream_cfg = cfg.sinks.track_stream;
+    if (!ui && !cfg.sinks.track_log.enabled && !rec.enabled && !loop_cfg.enabled && !shm_cfg.enabled && !stream_cfg.enabled) {
+      std::cout << "Note: headless with no sinks enabled, tracking results are only counted\n";
+    }
+
     // Actual pipeline logic starts here
 
-    // Begin by creating all resources (queues/lateststores) needed
-    auto camera_to_preprocess_queue = std::make_shared<dcp::BoundedQueue<dcp::Frame>>(cfg.buffering.queues.camera_to_preprocess.capacity, cfg.buffering.queues.camera_to_preprocess.drop_policy);
-    auto preprocess_to_tracking_queue = std::make_shared<dcp::BoundedQueue<dcp::Frame>>(cfg.buffering.queues.preprocess_to_tracking.capacity, cfg.buffering.queues.preprocess_to_tracking.drop_policy);
-    auto preprocessed_latest_store = std::make_shared<dcp::LatestStore<dcp::PreprocessedFrame>>();
-    auto detections_latest_store = std::make_shared<dcp::LatestStore<dcp::Detections>>();
-    auto tracking_to_visualization_queue = std::make_shared<dcp::BoundedQueue<dcp::RenderFrame>>(cfg.buffering.queues.tracking_to_visualization.capacity, cfg.buffering.queues.tracking_to_visualization.drop_policy);
+    // Names only get a stream prefix when there is more than one stream, so the single camera layout is unchanged
+    const bool multi = cfg.streams.size() > 1;
+    const auto& qcfg = cfg.buffering.queues;
+
+    // Declared before the registry, which hands it to every stage made below, so it outlives them
+    std::unique_ptr<dcp::FlightRecorder> flight;
+    if (cfg.metrics.flight_recorder.enabled) {
+      const auto& fcfg = cfg.metrics.flight_recorder;
+      flight = std::make_unique<dcp::FlightRecorder>(fcfg.path, static_cast<std::size_t>(fcfg.records), fcfg.flush_interval_ms);
+      std::cout << "flight recorder: " << flight->path() << ", " << flight->capacity() << " records ("
+                << flight->total_bytes() / (1024 * 1024) << " MB)" << std::endl;
+    }
 
-    // Create stage metrics
     dcp::Metrics metrics;
-    auto* camera_metrics = metrics.make_stage("camera");
-    auto* preprocess_metrics = metrics.make_stage("preprocess");
+    metrics.set_flight_recorder(flight.get());
+    std::vector<dcp::QueueView> qviews;
+    std::vector<dcp::MemoryView> mviews;
+    std::vector<dcp::RateView> rviews;
+    std::vector<dcp::InferenceStream> inference_streams;
+    std::vector<std::unique_ptr<StreamChain>> chains;
+
+    // One asynchronous writer shared by every file sink. Its row: LAT = submit to completed write
+    std::shared_ptr<dcp::AsyncWriter> io_writer;
+    if (cfg.sinks.track_log.enabled || loop_cfg.enabled) {
+      io_writer = std::make_shared<dcp::AsyncWriter>(dcp::MakeWriterOptions(cfg.io), metrics.make_stage("io"), cfg.threads.io);
+      std::cout << "io: " << io_writer->backend() << (io_writer->registered_buffers() ? " with registered buffers" : "") << ", "
+                << io_writer->buffer_count() << " x " << io_writer->buffer_size() / 1024 << " KB buffers" << std::endl;
+
+      // Buffers held by sinks or in flight, drops are refused writes. Memory is what's submitted and not yet on disk
+      const auto* w = io_writer.get();
+      qviews.push_back({
+        "io",
+        [w]() { return w->buffers_in_use(); },
+        [w]() { return w->buffer_count(); },
+        [w]() { return w->rejected_total(); },
+        nullptr
+      });
+      mviews.push_back({"io in-flight", [w]() { return w->in_flight_bytes(); }, [w]() { return w->max_in_flight_bytes(); }});
+    }
+
+    // Begin by creating all resources (queues/lateststores) and stages for each stream
+    for (const auto& scfg : cfg.streams) {
+      auto c = std::make_unique<StreamChain>();
+      const std::string prefix = multi ? scfg.name + ":" : "";
+      // Rows keep the prefixed name, the series are labelled by stage kind and, with several streams, camera
+      auto stage_labels = [&](const std::string& kind, dcp::MetricLabels extra = {}) {
+        dcp::MetricLabels labels{{"stage", kind}};
+        if (multi) labels.emplace_back("camera", scfg.name);
+        labels.insert(labels.end(), extra.begin(), extra.end());
+        return labels;
+      };
+      c->name = scfg.name;
+      c->window_name = multi ? cfg.visualization.window_name + " - " + scfg.name : cfg.visualization.window_name;
+
+      c->camera_to_preprocess_queue = MakeQueue<dcp::Frame>(qcfg.camera_to_preprocess);
+      c->preprocess_to_tracking_queue = MakeQueue<dcp::Frame>(qcfg.preprocess_to_tracking);
+      c->preprocessed_latest_store = std::make_shared<dcp::LatestStore<dcp::PreprocessedFrame>>();
+      c->detections_latest_store = std::make_shared<dcp::LatestStore<dcp::Detections>>();
+      if (ui) {
+        c->tracking_to_visualization_queue = MakeQueue<dcp::RenderFrame>(qcfg.tracking_to_visualization);
+        c->display_store = std::make_shared<dcp::LatestStore<dcp::Frame>>();
+      }
+      if (cfg.sinks.track_log.enabled) c->tracking_to_track_log_queue = MakeQueue<dcp::RenderFrame>(cfg.sinks.track_log.queue);
+      if (rec.enabled) c->recording_queue = MakeQueue<dcp::RenderFrame>(rec.queue);
+      if (loop_cfg.enabled) c->tracking_to_loop_queue = MakeQueue<dcp::RenderFrame>(loop_cfg.queue);
+      if (shm_cfg.enabled) c->tracking_to_shm_queue = MakeQueue<dcp::RenderFrame>(shm_cfg.queue);
+      if (stream_cfg.enabled) c->tracking_to_stream_queue = MakeQueue<dcp::RenderFrame>(stream_cfg.queue);
+      if (cfg.inference.demand_driven) c->inference_demand = std::make_shared<dcp::DemandSignal>();
+
+      // Create stage metrics
+      auto* camera_metrics = metrics.make_stage(prefix + "camera", stage_labels("camera"));
+      auto* preprocess_metrics = metrics.make_stage(prefix + "preprocess", stage_labels("preprocess"));
+      auto* tracking_metrics = metrics.make_stage(prefix + "tracking", stage_labels("tracking"));
+      if (ui) {
+        c->render_metrics = metrics.make_stage(prefix + "render", stage_labels("render"));
+        c->display_metrics = metrics.make_stage(prefix + "display", stage_labels("display")); // imshow on the UI thread, AGE = glass latency
+      }
+
+      // Per-stream inference rate/staleness. With one stream the shared inference row already says it all
+      auto* stream_inference_metrics = multi ? metrics.make_stage(prefix + "inference", stage_labels("inference")) : nullptr;
+
+      // Create views into the queues
+      qviews.push_back(MakeQueueView(prefix + "cam->pre", c->camera_to_preprocess_queue));
+      qviews.push_back(MakeQueueView(prefix + "pre->trk", c->preprocess_to_tracking_queue));
+      if (c->tracking_to_visualization_queue) qviews.push_back(MakeQueueView(prefix + "trk->vis", c->tracking_to_visualization_queue));
+      if (c->tracking_to_track_log_queue) qviews.push_back(MakeQueueView(prefix + "trk->log", c->tracking_to_track_log_queue));
+      if (c->recording_queue) qviews.push_back(MakeQueueView(prefix + (record_annotated ? "ren->rec" : "trk->rec"), c->recording_queue));
+      if (c->tracking_to_loop_queue) qviews.push_back(MakeQueueView(prefix + "trk->loop", c->tracking_to_loop_queue));
+      if (c->tracking_to_shm_queue) qviews.push_back(MakeQueueView(prefix + "trk->shm", c->tracking_to_shm_queue));
+      if (c->tracking_to_stream_queue) qviews.push_back(MakeQueueView(prefix + "trk->stream", c->tracking_to_stream_queue));
+
+      // Bytes held by each queue and store
+      mviews.push_back(MakeMemoryView(prefix + "cam->pre", c->camera_to_preprocess_queue));
+      mviews.push_back(MakeMemoryView(prefix + "pre->trk", c->preprocess_to_tracking_queue));
+      if (c->tracking_to_visualization_queue) mviews.push_back(MakeMemoryView(prefix + "trk->vis", c->tracking_to_visualization_queue));
+      if (c->tracking_to_track_log_queue) mviews.push_back(MakeMemoryView(prefix + "trk->log", c->tracking_to_track_log_queue));
+      if (c->recording_queue) mviews.push_back(MakeMemoryView(prefix + (record_annotated ? "ren->rec" : "trk->rec"), c->recording_queue));
+      if (c->tracking_to_loop_queue) mviews.push_back(MakeMemoryView(prefix + "trk->loop", c->tracking_to_loop_queue));
+      if (c->tracking_to_shm_queue) mviews.push_back(MakeMemoryView(prefix + "trk->shm", c->tracking_to_shm_queue));
+      if (c->tracking_to_stream_queue) mviews.push_back(MakeMemoryView(prefix + "trk->stream", c->tracking_to_stream_queue));
+      mviews.push_back(MakeMemoryView(prefix + "pre->inf", c->preprocessed_latest_store));
+      mviews.push_back(MakeMemoryView(prefix + "inf->trk", c->detections_latest_store));
+      if (c->display_store) mviews.push_back(MakeMemoryView(prefix + "ren->ui", c->display_store));
+
+      // Create stages and pass references of resources to appropriate stages
+      const std::string stage_prefix = multi ? scfg.name + "/" : "";
+      c->camera_stage = std::make_unique<dcp::CameraStage>(camera_metrics, scfg.camera, c->camera_to_preprocess_queue, stage_prefix + "camera_stage");
+      c->preprocess_stage = std::make_unique<dcp::PreprocessStage>(preprocess_metrics, cfg.preprocess, c->camera_to_preprocess_queue, c->preprocess_to_tracking_queue, c->preprocessed_latest_store, c->inference_demand, stage_prefix + "preprocess_stage");
+      if (cfg.preprocess.workers > 1) {
+        std::vector<dcp::StageMetrics*> worker_metrics;
+        for (int w = 0; w < cfg.preprocess.workers; ++w) {
+          worker_metrics.push_back(metrics.make_stage(prefix + "pre#" + std::to_string(w), stage_labels("preprocess", {{"worker", std::to_string(w)}})));
+        }
+        c->preprocess_stage->set_pool_metrics(std::move(worker_metrics), metrics.make_stage(prefix + "pre:reorder", stage_labels("pre:reorder")));
+
+        // Reorder buffer occupancy vs window, drops are stragglers that arrived after a newer frame was released
+        const auto* rb = c->preprocess_stage->reorder_buffer();
+        qviews.push_back({
+          prefix + "reorder",
+          [rb]() { return rb->held(); },
+          [rb]() { return rb->window(); },
+          [rb]() { return rb->late_drops_total(); },
+          nullptr
+        });
+      }
+
+      std::vector<std::shared_ptr<dcp::BoundedQueue<dcp::RenderFrame>>> tracking_outs;
+      if (c->tracking_to_visualization_queue) tracking_outs.push_back(c->tracking_to_visualization_queue);
+      if (c->tracking_to_track_log_queue) tracking_outs.push_back(c->tracking_to_track_log_queue);
+      if (c->recording_queue && !record_annotated) tracking_outs.push_back(c->recording_queue);
+      if (c->tracking_to_loop_queue) tracking_outs.push_back(c->tracking_to_loop_queue);
+      if (c->tracking_to_shm_queue) tracking_outs.push_back(c->tracking_to_shm_queue);
+      if (c->tracking_to_stream_queue) tracking_outs.push_back(c->tracking_to_stream_queue);
+      c->tracking_stage = std::make_unique<dcp::TrackingStage>(tracking_metrics, cfg.tracking, c->preprocess_to_tracking_queue, c->detections_latest_store, std::move(tracking_outs), stage_prefix + "tracking_stage");
+
+      if (c->tracking_to_track_log_queue) {
+        const std::string path = multi ? StreamOutputPath(cfg.sinks.track_log.output_path, scfg.name) : cfg.sinks.track_log.output_path;
+        c->track_log_stage = std::make_unique<dcp::TrackLogStage>(metrics.make_stage(prefix + "track_log", stage_labels("track_log")), io_writer, path, dcp::MakeFileOptions(cfg.sinks.track_log.durability), c->tracking_to_track_log_queue, stage_prefix + "track_log_stage");
+      }
+      if (c->recording_queue) {
+        const std::string path = multi ? StreamOutputPath(rec.output_path, scfg.name) : rec.output_path;
+        c->recording_stage = std::make_unique<dcp::RecordingStage>(metrics.make_stage(prefix + "record", stage_labels("record")), rec, path, c->recording_queue, stage_prefix + "recording_stage");
+      }
+      if (c->tracking_to_loop_queue) {
+        const std::string dir = multi ? loop_cfg.directory + "/" + scfg.name : loop_cfg.directory;
+        c->loop_recorder_stage = std::make_unique<dcp::LoopRecorderStage>(metrics.make_stage(prefix + "loop_rec", stage_labels("loop_rec")), metrics.make_stage(prefix + "loop:event", stage_labels("loop:event")), loop_cfg, dir, io_writer, c->tracking_to_loop_queue, stage_prefix + "loop_recorder_stage");
+
+        // Pre-event ring: chunks held against the index size, bytes against ring_mb
+        const auto* ring = &c->loop_recorder_stage->ring();
+        qviews.push_back({
+          prefix + "loop ring",
+          [ring]() { return ring->size(); },
+          [ring]() { return ring->max_chunks(); },
+          [ring]() { return ring->oversize_total(); },
+          nullptr
+        });
+        mviews.push_back({prefix + "loop ring", [ring]() { return ring->bytes(); }, [ring]() { return ring->max_bytes(); }});
+      }
+      if (c->tracking_to_shm_queue) {
+        const std::string shm_name = multi ? shm_cfg.name + "_" + scfg.name : shm_cfg.name;
+        const std::size_t frame_capacity = shm_cfg.max_frame_mb > 0
+            ? static_cast<std::size_t>(shm_cfg.max_frame_mb) << 20
+            : static_cast<std::size_t>(scfg.camera.width) * static_cast<std::size_t>(scfg.camera.height) * 3;
+        c->shm_stage = std::make_unique<dcp::ShmPublisherStage>(metrics.make_stage(prefix + "shm", stage_labels("shm")), shm_cfg, shm_name, frame_capacity, c->tracking_to_shm_queue, stage_prefix + "shm_publisher_stage");
+        std::cout << "shm: publishing " << (multi ? scfg.name + " " : std::string()) << "to /dev/shm" << shm_name << ", "
+                  << c->shm_stage->writer().total_bytes() / (1024 * 1024) << " MB" << std::endl;
+      }
+      if (c->tracking_to_stream_queue) {
+        const std::string path = multi ? stream_cfg.socket_path + "_" + scfg.name : stream_cfg.socket_path;
+        c->track_stream_stage = std::make_unique<dcp::TrackStreamStage>(metrics.make_stage(prefix + "stream", stage_labels("stream")), metrics.make_stage(prefix + "stream:encode", stage_labels("stream:encode")), stream_cfg, path, c->tracking_to_stream_queue, stage_prefix + "track_stream_stage");
+        std::cout << "track stream: " << (multi ? scfg.name + " " : std::string()) << "listening on " << path << std::endl;
+
+        // Subscribers against max_subscribers, drops are messages a lagging subscriber lost before its resync
+        const auto* server = &c->track_stream_stage->server();
+        qviews.push_back({
+          prefix + "stream subs",
+          [server]() { return server->clients(); },
+          [server]() { return server->max_clients(); },
+          [server]() { return server->messages_dropped(); },
+          nullptr
+        });
+        const auto* stage = c->track_stream_stage.get();
+        rviews.push_back({prefix + "stream encoded", [stage]() { return stage->bytes_encoded(); }, "KB", 1024.0});
+        rviews.push_back({prefix + "stream sent", [server]() { return server->bytes_sent(); }, "KB", 1024.0});
+        rviews.push_back({prefix + "stream keyframes", [server]() { return server->keyframes_sent(); }, "msg"});
+      }
+
+      inference_streams.push_back({scfg.name, scfg.priority, scfg.min_fps, stream_inference_metrics, c->preprocessed_latest_store, c->detections_latest_store, c->inference_demand});
+      chains.push_back(std::move(c));
+    }
+
+    // Render stages last, the HUD reports on every queue and store of every stream
+    for (auto& c : chains) {
+      if (!ui) break;
+      const std::string stage_prefix = multi ? c->name + "/" : "";
+      c->render_stage = std::make_unique<dcp::RenderStage>(c->render_metrics, cfg.visualization, c->tracking_to_visualization_queue, c->display_store, dcp::HudSources{&metrics, qviews, mviews}, record_annotated ? c->recording_queue : nullptr, stage_prefix + "render_stage");
+    }
+
+    // Model in a worker process instead, its row: LAT = round trip minus the worker's own time (the IPC overhead)
+    std::unique_ptr<dcp::InferenceWorker> inference_worker;
+    if (cfg.inference.enabled && cfg.inference.worker.enabled) {
+      const auto& wcfg = cfg.inference.worker;
+      dcp::InferenceWorker::Options wopts;
+      wopts.executable = !wcfg.executable.empty()
+          ? wcfg.executable
+          : (std::filesystem::path(argv[0]).parent_path() / "inference_worker").string();
+      wopts.config_path = cfg_path;
+      wopts.shm_name = wcfg.shm_name;
+      wopts.max_batch = static_cast<std::size_t>(cfg.inference.max_batch);
+      wopts.frame_capacity = static_cast<std::size_t>(cfg.preprocess.resize_width) * static_cast<std::size_t>(cfg.preprocess.resize_height) * 3;
+      wopts.max_detections = static_cast<std::size_t>(wcfg.max_detections);
+      wopts.timeout_ms = wcfg.timeout_ms;
+      wopts.startup_timeout_ms = wcfg.startup_timeout_ms;
+      wopts.restart_backoff_ms = wcfg.restart_backoff_ms;
+      inference_worker = std::make_unique<dcp::InferenceWorker>(std::move(wopts), metrics.make_stage("inference:ipc"));
+      std::cout << "inference: worker process over " << wcfg.shm_name << ", " << inference_worker->shm_bytes() / 1024 << " KB" << std::endl;
+    }
+
+    // One shared inference scheduler (and model) for all streams
     auto* inference_metrics = metrics.make_stage("inference");
-    auto* tracking_metrics = metrics.make_stage("tracking");
-
-    // Create views into the queues (lambda)
-    std::vector<dcp::QueueView> qviews = {
-      {
-        "cam->pre",
-        [camera_to_preprocess_queue]() { return camera_to_preprocess_queue->size(); },
-        [camera_to_preprocess_queue]() { return camera_to_preprocess_queue->capacity(); },
-        [camera_to_preprocess_queue]() { return camera_to_preprocess_queue->drops_total(); }
-      },
-      {
-        "pre->trk",
-        [preprocess_to_tracking_queue]() { return preprocess_to_tracking_queue->size(); },
-        [preprocess_to_tracking_queue]() { return preprocess_to_tracking_queue->capacity(); },
-        [preprocess_to_tracking_queue]() { return preprocess_to_tracking_queue->drops_total(); }
-      },
-      {
-        "trk->vis",
-        [tracking_to_visualization_queue]() { return tracking_to_visualization_queue->size(); },
-        [tracking_to_visualization_queue]() { return tracking_to_visualization_queue->capacity(); },
-        [tracking_to_visualization_queue]() { return tracking_to_visualization_queue->drops_total(); }
-      },
-    };
+    dcp::InferenceStage inference_stage(inference_metrics, cfg.inference, std::move(inference_streams), std::move(inference_worker));
+
+    // Views go in the registry next to the stages, for the exporters
+    dcp::RegisterViews(metrics, qviews, mviews, rviews);
+
+    // Everything in the registry for a scraper, on its own low-priority thread. Bound before any stage starts, so a taken port fails cleanly
+    std::unique_ptr<dcp::MetricsHttpServer> http;
+    if (cfg.metrics.http.enabled) {
+      http = std::make_unique<dcp::MetricsHttpServer>(cfg.metrics.http, metrics);
+      std::cout << "metrics: http://127.0.0.1:" << http->port() << "/metrics" << std::endl;
+    }
+
+    // Per-stage pinning/policy, each thread applies it to itself on start and prints what took effect
+    for (auto& c : chains) {
+      c->camera_stage->set_thread_config(cfg.threads.camera);
+      c->preprocess_stage->set_thread_config(cfg.threads.preprocess);
+      c->tracking_stage->set_thread_config(cfg.threads.tracking);
+      if (c->render_stage) c->render_stage->set_thread_config(cfg.threads.render);
+      if (c->recording_stage) c->recording_stage->set_thread_config(cfg.threads.recording);
+      if (c->loop_recorder_stage) c->loop_recorder_stage->set_thread_config(cfg.threads.recording);
+    }
+    inference_stage.set_thread_config(cfg.threads.inference);
+
+    // In tasks mode the stages listed in executor.task_stages share one work-stealing pool, everything else keeps its thread
+    std::unique_ptr<dcp::TaskExecutor> executor;
+    if (cfg.executor.mode == "tasks") {
+      executor = std::make_unique<dcp::TaskExecutor>(static_cast<std::size_t>(cfg.executor.workers), "exec", cfg.threads.executor);
+      std::cout << "executor: " << executor->worker_count() << " task workers" << std::endl;
+    }
 
-    // Create stages and pass references of resources to appropriate stages
-    dcp::CameraStage camera_stage(camera_metrics, cfg.camera, camera_to_preprocess_queue);
-    dcp::PreprocessStage preprocess_stage(preprocess_metrics, cfg.preprocess, camera_to_preprocess_queue, preprocess_to_tracking_queue, preprocessed_latest_store);
-    dcp::InferenceStage inference_stage(inference_metrics, cfg.inference, preprocessed_latest_store, detections_latest_store);
-    dcp::TrackingStage tracking_stage(tracking_metrics, cfg.tracking, preprocess_to_tracking_queue, detections_latest_store, tracking_to_visualization_queue);
+    auto listed = [](const std::vector<std::string>& names, const std::string& kind) {
+      return std::find(names.begin(), names.end(), kind) != names.end();
+    };
+    auto start_stage = [&](dcp::Stage& stage, const std::string& kind) {
+      if (executor && listed(cfg.executor.task_stages, kind)) {
+        const auto prio = listed(cfg.executor.high_priority, kind) ? dcp::TaskPriority::High : dcp::TaskPriority::Normal;
+        stage.start(global_stop.token(), *executor, prio);
+      } else {
+        stage.start(global_stop.token());
+      }
+    };
 
     // Start each stage, consumers first. The stage will then handle its own looping/thread logic
-    tracking_stage.start(global_stop.token());
+    for (auto& c : chains) {
+      if (c->recording_stage) c->recording_stage->start(global_stop.token());
+      if (c->loop_recorder_stage) c->loop_recorder_stage->start(global_stop.token());
+      if (c->render_stage) start_stage(*c->render_stage, "render");
+      if (c->track_log_stage) start_stage(*c->track_log_stage, "track_log");
+      if (c->shm_stage) start_stage(*c->shm_stage, "shm");
+      if (c->track_stream_stage) start_stage(*c->track_stream_stage, "track_stream");
+    }
+    for (auto& c : chains) start_stage(*c->tracking_stage, "tracking");
     inference_stage.start(global_stop.token());
-    preprocess_stage.start(global_stop.token());
-    camera_stage.start(global_stop.token());
+    for (auto& c : chains) start_stage(*c->preprocess_stage, "preprocess");
+    for (auto& c : chains) c->camera_stage->start(global_stop.token());
 
     //UI (must be on main thread on MacOS)
-    dcp::HudOverlay hud;
-
-    cv::namedWindow(cfg.visualization.window_name, cv::WINDOW_AUTOSIZE);
-    dcp::RenderFrame latest;
-    bool have_latest = false;
+    if (ui) {
+      for (auto& c : chains) UiOpen(c->window_name);
+    }
 
     // Start the pipeline CLI dashboard by running it in a separate thread
     std::cout << std::endl;
     auto q_views_for_ansi = qviews; //create a copy
-    dcp::AnsiDashboard dash(metrics, std::move(q_views_for_ansi), g_sigint);
+    dcp::AnsiDashboard dash(metrics, std::move(q_views_for_ansi), mviews, rviews, g_sigint);
     std::thread dash_thread([&] { dash.run(global_stop.token()); });
+    std::thread http_thread;
+    if (http) http_thread = std::thread([&] { http->run(global_stop.token()); });
 
     // Run pipeline, exit on command or time limit
     while (!global_stop.stop_requested()) {
@@ -175,39 +501,57 @@ int main(int argc, char** argv) {
         break;
       }
 
-      int key = cv::waitKey(1);
+      if (g_event.exchange(false, std::memory_order_relaxed)) {
+        for (auto& c : chains) {
+          if (c->loop_recorder_stage) c->loop_recorder_stage->trigger();
+        }
+      }
+
+      // Headless, the main thread only watches for shutdown and triggers
+      if (!ui) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        continue;
+      }
+
+      int key = UiPollKey();
       if (key == 'q' || key == 27) {
         std::cout << "User exited. Shutting down pipeline..." << std::endl;
         global_stop.request_stop();
         break;
       }
 
-      // Run UI
-      dcp::RenderFrame rf;
-      if (tracking_to_visualization_queue->try_pop_for(rf, std::chrono::milliseconds(5))) {
-        if (!rf.frame.image.empty()) {
-          latest = std::move(rf);
-          have_latest = true;
-        }
-      }
+      // Show the newest composed frame per stream, UiPollKey() above paces the loop. Nothing is drawn here
+      for (auto& c : chains) {
+        if (!c->display_store->read_into(c->shown, c->shown_version)) continue;
 
-      if (have_latest) {
-        DrawTracks(latest.frame.image, latest.world);
-        hud.draw(latest.frame.image, metrics, qviews);
-        cv::imshow(cfg.visualization.window_name, latest.frame.image);
+        dcp::StageMetrics::Item item(c->display_metrics, c->shown.sequence_id);
+        item.set_capture_time(c->shown.capture_time);
+        UiShow(c->window_name, c->shown.image);
       }
     }
 
-    // Close UI window
-    cv::destroyWindow(cfg.visualization.window_name);
+    // Close UI windows
+    if (ui) {
+      for (auto& c : chains) UiClose(c->window_name);
+    }
 
     // Stop all stages, producers first
-    camera_stage.stop();
-    preprocess_stage.stop();
+    for (auto& c : chains) c->camera_stage->stop();
+    for (auto& c : chains) c->preprocess_stage->stop();
     inference_stage.stop();
-    tracking_stage.stop();
+    for (auto& c : chains) c->tracking_stage->stop();
+    for (auto& c : chains) {
+      if (c->render_stage) c->render_stage->stop();
+      if (c->track_log_stage) c->track_log_stage->stop();
+      if (c->shm_stage) c->shm_stage->stop();
+      if (c->track_stream_stage) c->track_stream_stage->stop();
+      if (c->recording_stage) c->recording_stage->stop();
+      if (c->loop_recorder_stage) c->loop_recorder_stage->stop();
+    }
+    if (executor) executor->stop();
 
     dash_thread.join();
+    if (http_thread.joinable()) http_thread.join();
 
   } catch (const std::exception& e) {
     std::cerr << e.what() << "\n";
@@ -215,4 +559,4 @@ int main(int argc, char** argv) {
   }
 
   return 0;
-}
\ No newline at end of file
+}
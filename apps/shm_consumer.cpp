@@ -0,0 +1,97 @@
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "infra/shm_channel.hpp"
+
+// shm_consumer.cpp is an example out-of-process consumer of sinks.shm, and a way to check the publisher is live
+// Walks every track record in order and reads the newest frame in place, once a second prints rates, the latency from
+// capture and how often it fell behind. Only links dcp_shm (libc), no OpenCV or config.
+//   shm_consumer [name] [seconds]     name defaults to /dcp, seconds to 0 = until Ctrl-C
+
+static std::atomic_bool g_stop{false};
+
+static void HandleSigint(int) {
+  g_stop.store(true);
+}
+
+int main(int argc, char** argv) {
+  const std::string name = (argc > 1) ? argv[1] : "/dcp";
+  const int seconds = (argc > 2) ? std::atoi(argv[2]) : 0;
+  std::signal(SIGINT, HandleSigint);
+
+  using Clock = std::chrono::steady_clock;
+  const auto deadline = Clock::now() + std::chrono::seconds(seconds);
+
+  std::unique_ptr<dcp::ShmReader> reader;
+  dcp::ShmWorldRecord rec{};
+  auto next_report = Clock::now() + std::chrono::seconds(1);
+  std::uint64_t records = 0, tracks = 0, frames = 0, torn = 0, last_frame_index = 0;
+  std::int64_t lag_ns_sum = 0;
+  double mean_pixel = 0.0;
+
+  while (!g_stop.load() && (seconds <= 0 || Clock::now() < deadline)) {
+    // (Re)attach: the publisher creates the object when the pipeline starts and replaces it on restart
+    if (!reader || !reader->writer_alive()) {
+      try {
+        auto fresh = std::make_unique<dcp::ShmReader>(name);
+        if (!reader || fresh->header().writer_pid != reader->header().writer_pid) {
+          std::cout << "attached to " << name << " (writer pid " << fresh->header().writer_pid << ", "
+                    << fresh->header().world_slots << " track slots, " << fresh->header().frame_slots << " frame slots)" << std::endl;
+          reader = std::move(fresh);
+        }
+      } catch (const std::runtime_error&) {
+        if (!reader) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(500));
+          continue;
+        }
+      }
+    }
+
+    // Every track record, in publication order
+    while (reader->next_world(rec) == dcp::ShmRead::Ok) {
+      ++records;
+      tracks += rec.track_count;
+      lag_ns_sum += dcp::ShmNowNs() - rec.capture_ns;
+    }
+
+    // Newest frame only, used in place. A frame the writer overwrote meanwhile is thrown away
+    dcp::ShmFrameView view;
+    if (reader->latest_frame(view) == dcp::ShmRead::Ok && view.info.index != last_frame_index) {
+      std::uint64_t sum = 0, n = 0;
+      for (std::uint64_t i = 0; i < view.info.bytes; i += 64, ++n) sum += view.pixels[i];
+      if (view.valid()) {
+        mean_pixel = n ? static_cast<double>(sum) / static_cast<double>(n) : 0.0;
+        last_frame_index = view.info.index;
+        ++frames;
+      } else {
+        ++torn;
+      }
+    }
+
+    const auto now = Clock::now();
+    if (now >= next_report) {
+      std::cout << std::fixed << std::setprecision(1)
+                << "tracks " << records << " rec/s (avg " << (records ? static_cast<double>(tracks) / static_cast<double>(records) : 0.0)
+                << " per frame, lag " << (records ? static_cast<double>(lag_ns_sum) / static_cast<double>(records) / 1e6 : 0.0) << " ms)"
+                << " | frames " << frames << "/s, mean pixel " << mean_pixel << ", " << torn << " lapped"
+                << " | overruns " << reader->world_overruns() << " rec " << reader->frame_overruns() << " frames"
+                << (reader->writer_alive() ? "" : " | writer idle") << std::endl;
+      records = tracks = frames = torn = 0;
+      lag_ns_sum = 0;
+      next_report = now + std::chrono::seconds(1);
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  }
+
+  return 0;
+}
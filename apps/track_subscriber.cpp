@@ -0,0 +1,147 @@
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "core/track_stream.hpp"
+
+// track_subscriber.cpp is an example subscriber of sinks.track_stream, and a way to see what the stream costs
+// Rebuilds the track set from the socket and once a second prints message and byte rates, keyframes, the latency
+// from capture and the tracks held. --slow-ms N sleeps N ms between reads, to watch the pipeline drop the backlog and
+// resync on a keyframe. Links dcp_track_stream (libc), no OpenCV or config.
+//   track_subscriber [socket] [seconds] [--slow-ms N]    socket defaults to /tmp/dcp_tracks, seconds to 0 = until Ctrl-C
+
+static std::atomic_bool g_stop{false};
+
+static void HandleSigint(int) {
+  g_stop.store(true);
+}
+
+static int Connect(const std::string& path) {
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) return -1;
+  std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+  const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) return -1;
+  if (::connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static std::int64_t NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int main(int argc, char** argv) {
+  std::string path = "/tmp/dcp_tracks";
+  int seconds = 0;
+  int slow_ms = 0;
+  int positional = 0;
+  for (int i = 1; i < argc; ++i) {
+    const std::string a = argv[i];
+    if (a == "--slow-ms" && i + 1 < argc) {
+      slow_ms = std::atoi(argv[++i]);
+    } else if (positional++ == 0) {
+      path = a;
+    } else {
+      seconds = std::atoi(argv[i]);
+    }
+  }
+  std::signal(SIGINT, HandleSigint);
+
+  using Clock = std::chrono::steady_clock;
+  const auto deadline = Clock::now() + std::chrono::seconds(seconds);
+
+  int fd = -1;
+  dcp::TrackStreamDecoder decoder;
+  std::vector<std::uint8_t> buf(1 << 16);
+  std::size_t have = 0;
+  auto next_report = Clock::now() + std::chrono::seconds(1);
+  std::uint64_t messages = 0, keyframes = 0, bytes = 0, unsynced = 0;
+  std::int64_t lag_ns_sum = 0;
+
+  while (!g_stop.load() && (seconds <= 0 || Clock::now() < deadline)) {
+    // (Re)connect: the socket exists while the pipeline runs
+    if (fd < 0) {
+      fd = Connect(path);
+      if (fd < 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        continue;
+      }
+      std::cout << "connected to " << path << std::endl;
+      decoder = dcp::TrackStreamDecoder();
+      have = 0;
+    }
+
+    pollfd pfd{fd, POLLIN, 0};
+    if (::poll(&pfd, 1, 100) > 0) {
+      const ssize_t n = ::recv(fd, buf.data() + have, buf.size() - have, 0);
+      if (n <= 0) {
+        std::cout << "disconnected" << std::endl;
+        ::close(fd);
+        fd = -1;
+        continue;
+      }
+      have += static_cast<std::size_t>(n);
+      bytes += static_cast<std::uint64_t>(n);
+
+      // Whole messages only, a partial one waits for the next read
+      std::size_t at = 0;
+      for (;;) {
+        const std::size_t size = dcp::TrackStreamDecoder::MessageSize(buf.data() + at, have - at);
+        if (size == 0 || have - at < size) break;
+        dcp::TrackStreamHeader h;
+        std::memcpy(&h, buf.data() + at, sizeof(h));
+        const dcp::TrackStreamApply r = decoder.apply(buf.data() + at, size);
+        if (r == dcp::TrackStreamApply::Malformed) {
+          std::cerr << "malformed message, reconnecting\n";
+          ::close(fd);
+          fd = -1;
+          break;
+        }
+        ++messages;
+        if (h.kind == static_cast<std::uint8_t>(dcp::TrackStreamKind::Keyframe)) ++keyframes;
+        if (r == dcp::TrackStreamApply::NeedKeyframe) ++unsynced;
+        lag_ns_sum += NowNs() - h.capture_ns;
+        at += size;
+      }
+      if (fd < 0) continue;
+      std::memmove(buf.data(), buf.data() + at, have - at);
+      have -= at;
+      if (have == buf.size()) buf.resize(buf.size() * 2);
+    }
+
+    const auto now = Clock::now();
+    if (now >= next_report) {
+      std::cout << std::fixed << std::setprecision(1)
+                << "msgs " << messages << "/s (" << keyframes << " keyframes, " << unsynced << " skipped until one)"
+                << " | " << static_cast<double>(bytes) / 1024.0 << " KB/s, "
+                << (messages ? static_cast<double>(bytes) / static_cast<double>(messages) : 0.0) << " B/msg"
+                << " | lag " << (messages ? static_cast<double>(lag_ns_sum) / static_cast<double>(messages) / 1e6 : 0.0) << " ms"
+                << " | frame " << decoder.frame_id() << ", " << decoder.tracks().size() << " tracks" << std::endl;
+      messages = keyframes = bytes = unsynced = 0;
+      lag_ns_sum = 0;
+      next_report = now + std::chrono::seconds(1);
+    }
+
+    if (slow_ms > 0) std::this_thread::sleep_for(std::chrono::milliseconds(slow_ms));
+  }
+
+  if (fd >= 0) ::close(fd);
+  return 0;
+}
@@ -0,0 +1,92 @@
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "core/config_loader.hpp"
+#include "core/preprocessed_frame.hpp"
+#include "core/yolo_dnn.hpp"
+
+// yolo_batch_bench.cpp measures YoloDnn CPU throughput per frame for batch size 1 vs infer_batch with larger B.
+// Uses the model from the given config and synthetic frames at the configured preprocess size.
+
+static std::vector<dcp::PreprocessedFrame> MakeFrames(int n, int w, int h) {
+  std::vector<dcp::PreprocessedFrame> frames;
+  frames.reserve(n);
+  for (int i = 0; i < n; ++i) {
+    dcp::PreprocessedFrame pf;
+    pf.source_frame_id = static_cast<std::uint64_t>(i);
+    pf.image = cv::Mat(h, w, CV_8UC3, cv::Scalar(40 + i % 100, 90, 160 - i % 100));
+    pf.info.roi = cv::Rect(0, 0, w, h);
+    pf.info.resize_width = w;
+    pf.info.resize_height = h;
+    frames.push_back(std::move(pf));
+  }
+  return frames;
+}
+
+int main(int argc, char** argv) {
+  const std::string cfg_path = (argc > 1) ? argv[1] : "configs/dev.yaml";
+  const int n_frames = (argc > 2) ? std::stoi(argv[2]) : 64;
+  if (n_frames <= 0) {
+    std::cerr << "frame count must be positive, got " << n_frames << "\n";
+    return 1;
+  }
+
+  try {
+    dcp::AppConfig cfg = dcp::LoadConfigFromYamlFile(cfg_path);
+
+    dcp::YoloDnn::Params p;
+    p.onnx_path = cfg.inference.model.path;
+    p.input_w = cfg.inference.model.input_width;
+    p.input_h = cfg.inference.model.input_height;
+    p.conf_thresh = cfg.inference.confidence_threshold;
+
+    dcp::YoloDnn yolo(std::move(p));
+    if (!yolo.is_loaded()) {
+      std::cerr << "model failed to load: " << cfg.inference.model.path << "\n";
+      return 1;
+    }
+
+    const auto frames = MakeFrames(n_frames, cfg.preprocess.resize_width, cfg.preprocess.resize_height);
+
+    // Warm up allocations and ORT's kernel selection
+    for (int i = 0; i < 3; ++i) yolo.infer(frames[i % frames.size()]);
+
+    std::cout << "model: " << cfg.inference.model.path << (yolo.supports_batch() ? " (dynamic batch)" : " (fixed batch)") << "\n";
+    std::cout << std::left << std::setw(8) << "BATCH" << std::setw(14) << "ms/frame" << std::setw(10) << "fps" << "SPEEDUP" << "\n";
+
+    double base_ms = 0.0;
+    for (int b : {1, 2, 4, 8}) {
+      const auto t0 = std::chrono::steady_clock::now();
+
+      if (b == 1) {
+        for (const auto& pf : frames) yolo.infer(pf);
+      } else {
+        std::vector<dcp::PreprocessedFrame> batch;
+        for (std::size_t i = 0; i < frames.size(); i += b) {
+          batch.assign(frames.begin() + i, frames.begin() + std::min(frames.size(), i + b));
+          yolo.infer_batch(batch);
+        }
+      }
+
+      const double total_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+      const double ms_per_frame = total_ms / static_cast<double>(frames.size());
+      if (b == 1) base_ms = ms_per_frame;
+
+      std::cout << std::left << std::setw(8) << b
+                << std::setw(14) << std::fixed << std::setprecision(2) << ms_per_frame
+                << std::setw(10) << std::fixed << std::setprecision(1) << (1000.0 / ms_per_frame)
+                << "x" << std::setprecision(2) << (base_ms / ms_per_frame) << "\n";
+    }
+
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << "\n";
+    return 1;
+  }
+
+  return 0;
+}
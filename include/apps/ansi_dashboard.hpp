@@ -17,12 +17,37 @@ struct QueueView {
   std::function<std::size_t()> size_fn;
   std::function<std::size_t()> cap_fn;
   std::function<std::uint64_t()> drops_fn;
+  std::function<std::uint64_t()> expired_fn;  // Optional, age-based drops (DropOlderThan)
 };
 
+// Bytes held by one queue or store, for the MEMORY panel
+struct MemoryView {
+  std::string name;
+  std::function<std::uint64_t()> bytes_fn;
+  std::function<std::uint64_t()> max_bytes_fn;  // Optional, 0 or unset = unbounded
+};
+
+// A monotonically increasing total shown as a per-second rate in the RATES panel, e.g. bytes a sink sent
+struct RateView {
+  std::string name;
+  std::function<std::uint64_t()> total_fn;
+  std::string unit;     // Of total_fn / scale, per second
+  double scale{1.0};
+};
+
+// Registers the views as callback series (dcp_queue_*, dcp_memory_*, dcp_counter_total) so exporters find them in the
+// registry next to the stages. Call once, before anything reads the registry on another thread
+void RegisterViews(Metrics& metrics,
+                   const std::vector<QueueView>& queues,
+                   const std::vector<MemoryView>& memory,
+                   const std::vector<RateView>& rates);
+
 class AnsiDashboard {
 public:
   AnsiDashboard(Metrics& metrics,
                 std::vector<QueueView> queues,
+                std::vector<MemoryView> memory,
+                std::vector<RateView> rates,
                 std::atomic_bool& sigint_flag);
 
   void run(const StopToken& stop);
@@ -30,11 +55,29 @@ public:
 private:
   Metrics& metrics_;
   std::vector<QueueView> queues_;
+  std::vector<MemoryView> memory_;
+  std::vector<RateView> rates_;
   std::atomic_bool& sigint_;
 
-  struct Prev { std::uint64_t count{0}; std::uint64_t work_ns{0}; };
+  struct Prev {
+    std::uint64_t count{0};
+    std::uint64_t work_ns{0};
+    std::uint64_t cpu_ns{0};
+    std::uint64_t preempt{0};
+    std::uint64_t skipped{0};
+    std::uint64_t wasted{0};
+    std::uint64_t allocs{0};
+    std::uint64_t alloc_count{0}; // count when allocs was sampled
+    std::vector<std::uint64_t> buckets; // latency histogram at the last refresh
+    PerfSample perf;                    // hardware counters at the last refresh
+    std::uint64_t perf_count{0};        // count when perf was sampled
+  };
   std::unordered_map<const StageMetrics*, Prev> prev_stage_;
   std::unordered_map<std::string, std::uint64_t> prev_qdrops_;
+  std::unordered_map<std::string, std::uint64_t> prev_qexpired_;
+  std::unordered_map<std::string, std::uint64_t> prev_rates_;
+  std::uint64_t prev_cpu_ns_{0};
+  std::vector<std::uint64_t> buckets_;  // Scratch, latency histogram deltas
 };
 
 } // namespace dcp
\ No newline at end of file
@@ -17,23 +17,36 @@ class HudOverlay {
 public:
   HudOverlay() = default;
 
-  void draw(cv::Mat& bgr,
-            const Metrics& metrics,
-            const std::vector<QueueView>& queues);
+  // Rebuild the stats panel if its refresh period passed (or it was never drawn). Returns true if the panel changed
+  bool refresh(const Metrics& metrics,
+               const std::vector<QueueView>& queues,
+               const std::vector<MemoryView>& memory,
+               int type);
+
+  const cv::Mat& panel() const { return panel_; }
+
+  // Where the panel goes on a frame of this size (bottom left), clipped to it. Empty if it doesn't fit
+  cv::Rect placement(cv::Size frame) const;
 
 private:
   std::chrono::steady_clock::time_point last_refresh_{};
   cv::Mat panel_;
 
-  struct Prev { std::uint64_t count{0}; std::uint64_t work_ns{0}; };
+  struct Prev { std::uint64_t count{0}; std::uint64_t work_ns{0}; std::uint64_t skipped{0}; std::uint64_t wasted{0}; };
 
   std::unordered_map<const StageMetrics*, Prev> prev_stage_;
   std::unordered_map<std::string, std::uint64_t> prev_qdrops_;
+  std::unordered_map<std::string, std::uint64_t> prev_qexpired_;
 
   std::uint64_t last_tick_ns_{0};
+  std::uint64_t prev_cpu_ns_{0};
+
+  // Text scratch reused every refresh
+  std::string text_;
+  std::string bar_;
 
   static double NsToMs(std::uint64_t ns);
-  static std::string Bar(std::size_t used, std::size_t cap, std::size_t width);
+  static void Bar(std::size_t used, std::size_t cap, std::size_t width, std::string& out);
 };
 
 } // namespace dcp
\ No newline at end of file
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "core/config.hpp"
+#include "infra/metrics.hpp"
+#include "infra/stop_token.hpp"
+
+/*
+  MetricsHttpServer serves every series in the Metrics registry in Prometheus text format (0.0.4) on
+  http://127.0.0.1:<port>/metrics, for a node exporter or a local scraper. Dashboard views show up once they are
+  registered with RegisterViews.
+
+  Minimal HTTP/1.1: one connection at a time, GET (or HEAD) /metrics, Connection: close. Bound to loopback only,
+  there is no authentication. run() serves on the calling thread at the configured nice, so scrapes only get CPU the
+  stages leave. Everything it reads is an atomic (series shards, queue and store counters), a scrape never takes a
+  stage or queue lock, only the registry's, which only registration contends for.
+
+  Counters are exported raw (items, seconds of work, drops) so rates come from the scraper, gauges are the EWMAs and
+  occupancies the dashboard shows, histograms have the usual cumulative _bucket/_sum/_count.
+*/
+
+namespace dcp {
+
+class MetricsHttpServer {
+public:
+  // Binds 127.0.0.1:cfg.port (0 = any free port). Throws std::runtime_error if it can't
+  MetricsHttpServer(const HttpMetricsConfig& cfg, const Metrics& metrics);
+  ~MetricsHttpServer();
+
+  MetricsHttpServer(const MetricsHttpServer&) = delete;
+  MetricsHttpServer& operator=(const MetricsHttpServer&) = delete;
+
+  // Serves until stop, checking it every 200 ms
+  void run(const StopToken& stop);
+
+  // The body of GET /metrics
+  const std::string& render();
+
+  int port() const { return port_; }
+  std::uint64_t scrapes() const { return scrapes_.load(std::memory_order_relaxed); }
+
+private:
+  void serve(int fd);
+
+  int nice_;
+  const Metrics& metrics_;
+
+  int listen_fd_{-1};
+  int port_{0};
+  std::uint64_t start_ns_;
+  std::string body_;                    // Reused between scrapes
+  std::string response_;
+  std::vector<std::uint64_t> buckets_;
+  std::uint64_t last_render_ns_{0};
+  std::atomic<std::uint64_t> scrapes_{0};
+};
+
+} // namespace dcp
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "core/config.hpp"
+#include "infra/stop_token.hpp"
+
+/*
+  Segmented replay is the offline batch mode for long recordings. A single cv::VideoCapture decodes serially, so
+  the file is split into K time segments and each segment is decoded, preprocessed and run through its own YoloDnn
+  on its own worker. Workers spill their rows to a part file, and the parts are concatenated in segment order at the
+  end, so the merged CSV is globally ordered by frame index without holding the whole run in memory.
+
+  Sequence IDs are absolute frame indices in the file and timestamps are media time, so the output is identical to a
+  single-worker run regardless of K.
+*/
+
+namespace dcp {
+
+struct ReplaySegment {
+  int index{0};
+  std::int64_t begin_frame{0}; // Inclusive
+  std::int64_t end_frame{0};   // Exclusive
+};
+
+struct SegmentedReplayStats {
+  std::uint64_t frames{0};
+  std::uint64_t detections{0};
+  double wall_seconds{0.0};
+  int workers{0};
+};
+
+// Split [0, total_frames) into at most k contiguous segments of near-equal length
+std::vector<ReplaySegment> PlanSegments(std::int64_t total_frames, int k);
+
+// Run camera.file_path through K parallel workers and write one merged detections CSV to offline.output_path.
+// Throws std::runtime_error if any segment can't be processed completely or stop is requested, nothing is written then
+SegmentedReplayStats RunSegmentedReplay(const AppConfig& cfg, const StopToken& stop);
+
+} // namespace dcp
@@ -1,12 +1,14 @@
 #pragma once
 #include <cstddef>
 #include <string>
+#include <vector>
 
 namespace dcp {
 
 enum class DropPolicy {
   DropOldest,
-  DropNewest
+  DropNewest,
+  DropOlderThan   // DropOldest when full, plus anything older than QueueConfig::max_age_ms is discarded
 };
 
 struct RoiConfig {
@@ -31,6 +33,8 @@ struct RoiConfig {
 struct QueueConfig {
   std::size_t capacity = 4;
   DropPolicy drop_policy = DropPolicy::DropOldest;
+  int max_age_ms = 0;     // drop_older_than only: max age since capture before an item is discarded
+  std::size_t max_mb = 0; // Byte bound alongside capacity, 0 = items only
 };
 
 struct CameraConfig {
@@ -45,12 +49,36 @@ struct CameraConfig {
 
   bool flip_vertical = false;
   bool flip_horizontal = false;
+
+  // Capture is split into grab() + retrieve(). When the downstream queue would reject the frame, skip the decode entirely
+  bool skip_retrieve_when_full = true;
+
+  // File sources only: number of frames a background thread may decode ahead of the paced camera loop (0 = decode inline)
+  int decode_ahead = 4;
+
+  // Frame buffers recycled once every consumer has let go (MatPool). Should cover the frames in flight across the
+  // queues and the display, past that frames are allocated as before. 0 = no pooling
+  int frame_pool = 16;
+};
+
+// One camera stream. Each stream gets its own camera/preprocess/tracking chain, inference is shared
+struct StreamConfig {
+  std::string name = "front";
+  int priority = 0;       // Higher wins when streams are equally stale
+  float min_fps = 0.f;    // Inference rate floor for this stream, 0 = best effort
+  CameraConfig camera{};  // Starts from the top-level camera section, stream keys override
 };
 
 struct PreprocessConfig {
   int resize_width = 640;
   int resize_height = 360;
   RoiConfig crop_roi{};
+
+  // Worker pool. With workers > 1, frames are processed in parallel and a reorder buffer restores sequence order
+  // before tracking. Frames held longer than the window/max wait are released anyway, stragglers are then dropped
+  int workers = 1;
+  int reorder_window = 8;
+  int reorder_max_wait_ms = 20;
 };
 
 struct LatestStoresConfig {
@@ -76,12 +104,28 @@ struct ModelConfig {
   int input_height = 360;
 };
 
+// Runs the model in a separate inference_worker process, see InferenceWorker. A crash or a hang there only makes
+// detections go stale while the worker restarts
+struct InferenceWorkerConfig {
+  bool enabled = false;
+  std::string executable = "";         // Empty = inference_worker next to live_pipeline
+  std::string shm_name = "/dcp_infer";
+  int max_detections = 256;            // Per frame
+  int timeout_ms = 1000;               // Unanswered request = hung worker, killed and restarted
+  int startup_timeout_ms = 30000;      // Model load
+  int restart_backoff_ms = 1000;       // Doubles up to 30 s while the worker keeps failing to start
+};
+
 struct InferenceConfig {
   bool enabled = true;
   std::string backend = "dummy"; // dummy | onnx | tensorrt (later)
   int target_fps = 10;
   float confidence_threshold = 0.5f;
+  int max_batch = 1;      // Max frames from different streams per ORT run (needs a dynamic batch model)
+  bool demand_driven = true;  // Preprocess only builds inference frames when inference asks for one
+  int demand_lead_ms = 40;    // Ask this long before the current run is expected to finish
   ModelConfig model{};
+  InferenceWorkerConfig worker{};
 };
 
 struct TrackingConfig {
@@ -93,8 +137,12 @@ struct TrackingConfig {
 
 struct RecordingConfig {
   bool enabled = false;
-  std::string output_path = "output/run.mp4";
+  std::string output_path = "output/run.mp4"; // Multiple streams write <stem>_<stream><ext>
   int fps = 30;
+  std::string source = "raw";  // raw = camera frames | annotated = what the display shows (falls back to raw when headless)
+  std::string codec = "mp4v";  // FourCC for cv::VideoWriter, must match what the container/backend supports
+  double scale = 1.0;          // (0, 1], downscale before encoding
+  QueueConfig queue{8, DropPolicy::DropOldest}; // Recorder's own queue, a slow encoder drops here instead of stalling
 };
 
 struct VisualizationConfig {
@@ -112,25 +160,172 @@ struct VisualizationConfig {
   RecordingConfig recording{};
 };
 
+// When a file sink's data is forced to storage, see AsyncWriter
+struct DurabilityConfig {
+  std::string fsync = "none"; // none = page cache, the kernel writes back | close = fsync before closing | periodic = also every sync_mb
+  int sync_mb = 8;            // periodic only
+};
+
+// Per-track CSV of everything tracking produced, one row per track per frame (one file per stream)
+struct TrackLogConfig {
+  bool enabled = false;
+  std::string output_path = "logs/tracks.csv"; // Multiple streams write <stem>_<stream><ext>
+  DurabilityConfig durability{};
+  QueueConfig queue{64, DropPolicy::DropOldest};
+};
+
+// Dashcam loop recording, see LoopRecorderStage. Frames are JPEG-encoded once and kept in a fixed-memory pre-event
+// ring, appended to rolling segment files under a disk quota, and saved as an event clip when something happens
+struct LoopRecorderConfig {
+  bool enabled = false;
+  std::string directory = "output/loop"; // Segments here, event clips in <directory>/events. Multiple streams use <directory>/<stream>
+  int segment_s = 60;                    // Loop segment length
+  int disk_quota_mb = 2048;              // Loop segments only, oldest deleted first. Event clips are never deleted
+  int pre_event_s = 10;                  // Kept in memory and saved ahead of an event
+  int post_event_s = 5;                  // Recorded after the last trigger
+  int max_event_s = 60;                  // A clip ends this long after its first trigger even if triggers keep coming
+  int ring_mb = 64;                      // Pre-event ring memory. Too small for pre_event_s just shortens the pre-event part
+  int max_fps = 60;                      // Highest frame rate expected, sizes the ring index
+  int jpeg_quality = 80;
+  double scale = 0.5;                    // (0, 1], downscale before encoding
+  float trigger_box_height = 0.5f;       // Close range: a matched track at least this fraction of frame height, 0 = off
+  float trigger_min_confidence = 0.5f;
+  DurabilityConfig segment_durability{};        // Loop segments are overwritten anyway, page cache is fine
+  DurabilityConfig event_durability{"close"};   // An event clip is fsynced before it gets its final name
+  QueueConfig queue{8, DropPolicy::DropOldest};
+};
+
+// Publishes tracks and frames to other processes through POSIX shared memory, see ShmPublisherStage and ShmReader.
+// The publisher never waits for readers, a reader that falls behind sees overruns
+struct ShmPublishConfig {
+  bool enabled = false;
+  std::string name = "/dcp";     // shm_open name, multiple streams use <name>_<stream>
+  int world_slots = 64;          // Track records kept, a reader may lag this many frames
+  int frame_slots = 4;           // Frames kept, a zero-copy view stays valid until frame_slots newer ones are published
+  bool publish_frames = true;    // false = tracks only
+  int max_frame_mb = 0;          // Size of each frame slot, 0 = from camera width * height * 3
+  QueueConfig queue{4, DropPolicy::DropOldest};
+};
+
+// Tracks only, delta-encoded, to local subscribers over a Unix domain socket (see core/track_stream.hpp)
+struct TrackStreamConfig {
+  bool enabled = false;
+  std::string socket_path = "/tmp/dcp_tracks";  // Multiple streams use <socket_path>_<stream>
+  int max_subscribers = 8;
+  int send_buffer_kb = 256;       // Per subscriber, one that falls this far behind loses its backlog and gets a keyframe
+  QueueConfig queue{8, DropPolicy::DropOldest};
+};
+
+// Where tracking results go besides the display. Each sink has its own queue off the tracking stage, so a slow sink
+// only ever drops its own items. With visualization disabled these are the only consumers
+struct SinksConfig {
+  TrackLogConfig track_log{};
+  LoopRecorderConfig loop_recorder{};
+  ShmPublishConfig shm{};
+  TrackStreamConfig track_stream{};
+};
+
+// The shared asynchronous writer every file sink goes through, see AsyncWriter. Sinks never wait on the disk: when
+// all buffers are in flight they drop what they would write and count it
+struct IoConfig {
+  std::string backend = "auto"; // auto = io_uring, threads if the kernel refuses it | io_uring | threads
+  int queue_depth = 64;         // io_uring entries, the most writes in flight at once
+  int buffer_kb = 256;          // Size of each write buffer, rounded up to 4 KB
+  int buffers = 64;             // Pool allocated (and registered with io_uring) once at startup
+  int max_in_flight_mb = 16;    // Submitted but not completed, past this sinks are refused too
+  int workers = 2;              // threads backend only
+  int max_files = 32;           // Files open at once across all sinks
+};
+
 struct CsvMetricsConfig {
   bool enabled = false;
   std::string output_path = "logs/metrics.csv";
 };
 
+// Prometheus text format on http://127.0.0.1:<port>/metrics. Loopback only, for a node exporter or local scraper
+struct HttpMetricsConfig {
+  bool enabled = false;
+  int port = 9464;
+  int nice = 19;                  // The serving thread's nice, scrapes only get CPU the stages don't want
+};
+
+// Per-frame stage timings in a memory-mapped ring file that survives a crash, see infra/flight_recorder.hpp
+struct FlightRecorderConfig {
+  bool enabled = false;
+  std::string path = "logs/flight.dcpf";  // The previous run's file is kept as <path>.prev
+  int records = 262144;                   // Ring size, rounded up to a power of two. 32 bytes each
+  int flush_interval_ms = 1000;           // msync period, bounds what a power cut loses. 0 = leave it to the kernel
+};
+
 struct MetricsConfig {
   bool enable_console_log = true;
   int log_interval_ms = 1000;
   CsvMetricsConfig record_csv{};
+  HttpMetricsConfig http{};
+  // Per-stage cycles, instructions, LLC and branch misses via perf_event_open. Shows "unavailable" where perf is restricted
+  bool perf_counters = false;
+  FlightRecorderConfig flight_recorder{};
+};
+
+struct OfflineConfig {
+  // Number of parallel segment workers, each with its own capture and detector (0 = one per hardware thread)
+  int workers = 0;
+  // Frames per ORT call in offline mode. Only takes effect if the model has a dynamic batch axis
+  int batch_size = 1;
+  std::string output_path = "logs/detections.csv";
+};
+
+// One CPU budget for every thread pool in the process: OpenCV's parallel_for, ONNX Runtime, and (via threads:) our stages
+struct CoreBudgetConfig {
+  int cores = 0;                    // CPUs the pipeline may use, 0 = all available to the process. Only used for the report/warnings
+  int opencv_threads = 1;           // cv::setNumThreads for resize/cvtColor/etc, 0 = OpenCV default (one per core)
+  int ort_intra_op_threads = 1;     // Threads per ORT run, including the calling (inference) thread
+  int ort_inter_op_threads = 1;     // > 1 switches ORT to parallel execution mode
+  bool ort_global_pool = true;      // One ORT pool shared by all sessions (multi-model, segmented replay) instead of one per session
+  std::vector<int> ort_cpus{};      // CPUs for the extra intra-op threads (the calling thread follows threads.inference), empty = unpinned
+};
+
+// Scheduling for one stage's thread(s). Applied by the thread itself when it starts, see ThreadRunner
+struct ThreadConfig {
+  std::vector<int> cpus{};        // CPU set to pin to, empty = no pinning
+  std::string policy = "other";   // other | fifo | rr. fifo/rr need CAP_SYS_NICE, otherwise falls back to nice
+  int priority = 0;               // Realtime priority 1..99, fifo/rr only
+  int nice = 0;                   // -20..19, negative needs CAP_SYS_NICE (falls back to 0)
+};
+
+struct ThreadsConfig {
+  ThreadConfig camera{};          // Also the file decode-ahead thread
+  ThreadConfig preprocess{};      // Also the preprocess pool workers
+  ThreadConfig inference{};
+  ThreadConfig tracking{};
+  ThreadConfig render{};          // Overlay compositing, off the UI thread
+  ThreadConfig recording{};       // Video encoders: recording and loop recorder
+  ThreadConfig io{};              // Asynchronous writer (io_uring service thread or the threads backend workers)
+  ThreadConfig executor{};        // Task executor workers (executor.mode: tasks)
+};
+
+struct ExecutorConfig {
+  std::string mode = "threads"; // threads = one thread per stage | tasks = stages listed below share a work-stealing pool
+  int workers = 0;              // Pool size in tasks mode, 0 = one per hardware thread
+  std::vector<std::string> task_stages{"preprocess", "tracking"}; // Stages moved onto the pool, the rest keep their thread
+  std::vector<std::string> high_priority{"tracking"};             // Stages served from the high priority lane
 };
 
 struct AppConfig {
   CameraConfig camera{};
+  std::vector<StreamConfig> streams{}; // Always >= 1 after loading, a single "front" stream if the YAML has none
   PreprocessConfig preprocess{};
   BufferingConfig buffering{};
   InferenceConfig inference{};
   TrackingConfig tracking{};
   VisualizationConfig visualization{};
+  SinksConfig sinks{};
+  IoConfig io{};
   MetricsConfig metrics{};
+  OfflineConfig offline{};
+  ExecutorConfig executor{};
+  ThreadsConfig threads{};
+  CoreBudgetConfig budget{};
 };
 
 }
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <string>
+
+#include "core/config.hpp"
+
+/*
+  CoreBudget sizes every thread pool in the process from one config (budget: + threads:), instead of OpenCV, ONNX Runtime
+  and our stages each assuming they own the machine.
+
+  ApplyCoreBudget() sets cv::setNumThreads and the process-wide ORT threading/global pool, then prints the effective
+  layout: who gets how many threads on which CPUs, the total against the budget, and warnings for oversubscription or
+  latency-critical stages (camera, tracking) sharing CPUs with ORT. Call it once at startup, before any stage or
+  ORT session is created.
+*/
+
+namespace dcp {
+
+enum class PipelineMode {
+  Live,
+  Offline,
+  Worker    // inference_worker process: only the inference thread and its ORT/OpenCV pools
+};
+
+struct CoreLayout {
+  int cores{0};            // Budget actually in effect (configured, capped by what the process may use)
+  int planned_threads{0};  // Busy threads the config asks for
+  bool oversubscribed{false};
+  std::string report;      // Multi-line, already printed by ApplyCoreBudget
+};
+
+// Cores the pipeline may use: budget.cores capped by the process affinity, or everything if budget.cores == 0
+int BudgetCores(const CoreBudgetConfig& budget);
+
+CoreLayout ApplyCoreBudget(const AppConfig& cfg, PipelineMode mode);
+
+} // namespace dcp
@@ -32,4 +32,6 @@ struct Detections {
   std::vector<Detection> items;
 };
 
+inline std::size_t ByteSize(const Detections& d) { return sizeof(Detections) + d.items.capacity() * sizeof(Detection); }
+
 } // namespace dcp
\ No newline at end of file
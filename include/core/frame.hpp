@@ -1,6 +1,7 @@
 #pragma once
 
 #include <chrono>
+#include <cstddef>
 #include <cstdint>
 
 #include <opencv2/core.hpp>
@@ -24,4 +25,13 @@ struct Frame {
   cv::Mat image;
 };
 
+// Age key for BoundedQueue's DropOlderThan policy
+inline TimePoint CaptureTime(const Frame& f) { return f.capture_time; }
+
+// Pixel bytes referenced by a Mat header (the ROI for views, not the parent buffer)
+inline std::size_t MatBytes(const cv::Mat& m) { return m.empty() ? 0 : m.total() * m.elemSize(); }
+
+// Size trait for queue/store byte accounting, see infra/byte_size.hpp
+inline std::size_t ByteSize(const Frame& f) { return sizeof(Frame) + MatBytes(f.image); }
+
 } // namespace dcp
\ No newline at end of file
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "core/detections.hpp"
+#include "core/preprocessed_frame.hpp"
+#include "infra/metrics.hpp"
+#include "infra/shm_infer_channel.hpp"
+
+/*
+  InferenceWorker runs the model in a separate process (apps/inference_worker) and talks to it over a
+  ShmInferClient, so a crash in ONNX Runtime or a model swap can't take the pipeline down.
+
+  The worker is started on the first poll() and restarted whenever it exits, fails to load its model or hangs past
+  timeout_ms on a request (it is then killed). Restarts back off, doubling up to 30 s while the worker keeps failing
+  before it gets ready. The worker reloads the YAML on every start, so a model swap is: edit inference.model, kill
+  the worker.
+
+  infer_batch_into() is one round trip: frames are copied into the request slots (rows packed), the worker reads them
+  in place and answers with fixed-layout detections. Returning false means no answer for this batch, and the caller
+  should keep what it had: tracking then runs on stale detections until the worker is back.
+
+  The ipc metrics row gets the round trip minus the worker's own time (LAT = IPC overhead: copy in, wake-ups and
+  reading the response); requests lost to a dying or hung worker count as wasted.
+
+  Not thread safe, the inference thread owns it.
+*/
+
+namespace dcp {
+
+class InferenceWorker {
+public:
+  struct Options {
+    std::string executable;           // The inference_worker binary
+    std::string config_path;          // YAML the worker loads its model and budget from
+    std::string shm_name = "/dcp_infer";
+    std::size_t max_batch = 1;
+    std::size_t frame_capacity = 0;   // Bytes of the largest preprocessed frame
+    std::size_t max_detections = 256; // Per frame, the rest are dropped (strongest are kept, NMS output is sorted)
+    int timeout_ms = 1000;            // A request not answered by then means the worker hung, it is killed
+    int startup_timeout_ms = 30000;   // Model load
+    int restart_backoff_ms = 1000;
+  };
+
+  // Creates the channel, the worker itself starts on the first poll(). Throws std::runtime_error if the channel
+  // can't be created
+  InferenceWorker(Options opts, StageMetrics* ipc_metrics = nullptr);
+  // Asks the worker to exit, kills it if it doesn't within a second
+  ~InferenceWorker();
+
+  InferenceWorker(const InferenceWorker&) = delete;
+  InferenceWorker& operator=(const InferenceWorker&) = delete;
+
+  // Starts, watches and restarts the worker. True when a worker is ready for requests
+  bool poll();
+
+  // Ready worker's model takes batches
+  bool supports_batch() const;
+
+  // One request/response. outs[i] belongs to frames[i], outs grows if needed. False = no answer, outs untouched
+  bool infer_batch_into(const std::vector<PreprocessedFrame>& frames, std::vector<Detections>& outs);
+
+  std::uint64_t restarts() const { return restarts_; }
+  std::size_t shm_bytes() const { return channel_.total_bytes(); }
+
+private:
+  enum class State {
+    Down,       // Waiting out the backoff
+    Starting,   // Spawned, loading the model
+    Ready
+  };
+
+  void spawn();
+  bool reap(const char* why);   // Collects an exited worker, true if it was gone
+  void kill_worker(const char* why);
+  void went_down(bool failed_start);
+
+  Options opts_;
+  StageMetrics* ipc_metrics_;
+  ShmInferClient channel_;
+
+  State state_{State::Down};
+  pid_t pid_{-1};
+  std::int64_t next_spawn_ns_{0};
+  std::int64_t started_ns_{0};
+  int backoff_ms_;
+  bool was_ready_{false};       // Some worker got ready before, later ones are restarts
+  std::uint64_t restarts_{0};
+};
+
+} // namespace dcp
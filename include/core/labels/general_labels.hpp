@@ -21,6 +21,14 @@ inline const std::vector<std::string>& GeneralLabels() {
   return labels;
 }
 
+// Reference into the label table, for per-frame drawing where a copy would allocate
+inline const std::string& GeneralClassLabel(int class_id) {
+  static const std::string unknown = "unknown";
+  const auto& labels = GeneralLabels();
+  if (class_id < 0 || class_id >= static_cast<int>(labels.size())) return unknown;
+  return labels[class_id];
+}
+
 inline std::string GeneralClassName(int class_id) {
   const auto& labels = GeneralLabels();
   if (class_id < 0 || class_id >= static_cast<int>(labels.size()))
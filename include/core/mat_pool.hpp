@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+/*
+  MatPool recycles image buffers so a warmed-up stage stops allocating one per frame.
+
+  Frames travel downstream by refcount, so a buffer can only be written again once every queue, store and display
+  that saw it has let go. The pool keeps one reference to each buffer it handed out, and acquire() picks one whose
+  refcount has dropped back to that single reference. Decoding or resizing into the returned Mat (same size/type)
+  then lands in the recycled buffer instead of a new one.
+
+  Not thread safe, each producing thread owns its pool. Once max_buffers are all in flight acquire() falls back to a
+  plain new Mat (counted in misses()), so an undersized pool costs allocations, never correctness.
+*/
+
+namespace dcp {
+
+class MatPool {
+public:
+  explicit MatPool(std::size_t max_buffers);
+
+  MatPool(const MatPool&) = delete;
+  MatPool& operator=(const MatPool&) = delete;
+
+  // A rows x cols buffer of this type that nobody else references. Empty Mat for an empty geometry
+  cv::Mat acquire(int rows, int cols, int type);
+
+  std::size_t size() const { return bufs_.size(); }
+  std::size_t max_buffers() const { return max_; }
+  std::uint64_t misses() const { return misses_; }
+
+private:
+  static bool Unshared(const cv::Mat& m);
+
+  const std::size_t max_;
+  std::vector<cv::Mat> bufs_;
+  std::uint64_t misses_{0};
+};
+
+} // namespace dcp
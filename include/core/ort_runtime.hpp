@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <onnxruntime/onnxruntime_cxx_api.h>
+
+/*
+  Process-wide ONNX Runtime setup. ORT wants one Env per process, and with a global thread pool every session
+  created from that Env shares the same intra/inter-op threads instead of each spinning up its own.
+
+  ConfigureOrtRuntime() must run before the first session is created (CoreBudget does it at startup). Later calls
+  are ignored with a warning, the Env and its pool can't be rebuilt under live sessions.
+*/
+
+namespace dcp {
+
+struct OrtThreading {
+  int intra_op_threads{1};
+  int inter_op_threads{1};
+  bool global_pool{false};
+  std::vector<int> intra_op_cpus{}; // CPUs for the extra intra-op threads, empty = unpinned
+};
+
+void ConfigureOrtRuntime(const OrtThreading& t);
+
+// Settings sessions should use. Defaults (one intra-op thread, per-session pool) if never configured
+OrtThreading OrtRuntimeThreading();
+
+// The shared Env, created on first use
+Ort::Env& SharedOrtEnv();
+
+// Apply the configured threading to a session's options
+void ApplyOrtSessionThreading(Ort::SessionOptions& opts);
+
+// ORT affinity string for the N-1 extra intra-op threads: ';' between threads, 1-based CPU ids
+std::string OrtAffinityString(int intra_op_threads, const std::vector<int>& cpus);
+
+} // namespace dcp
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+
+#include "core/config.hpp"
+#include "core/detections.hpp"
+#include "core/frame.hpp"
+#include "core/preprocessed_frame.hpp"
+#include "core/track.hpp"
+
+/*
+  Pure preprocessing helpers shared by PreprocessStage and the offline tools. Kept free of any threading so
+  the same code path produces the same PreprocessedFrame (and the same box mapping) live and offline.
+*/
+
+namespace dcp {
+
+// Compute the crop ROI for an image, clamped to the image. Returns the full image if ROI is disabled
+cv::Rect ComputeRoiRect(const cv::Mat& img, const RoiConfig& cfg);
+
+// Crop + resize a raw frame into what inference consumes. `buffer` is an optional output image (e.g. from a MatPool),
+// resized into in place when it already has the target size and type
+PreprocessedFrame BuildPreprocessedFrame(const Frame& f, const PreprocessConfig& cfg, cv::Mat buffer = cv::Mat());
+
+// Map a detection from preprocessed (cropped/resized) space back into raw frame pixels
+BBoxF MapDetToRaw(const Detection& d, const PreprocessInfo& pi);
+
+} // namespace dcp
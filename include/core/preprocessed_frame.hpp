@@ -30,4 +30,6 @@ struct PreprocessedFrame {
   PreprocessInfo info;  // Useful for mapping boxes back later since we are altering frames in this stage
 };
 
+inline std::size_t ByteSize(const PreprocessedFrame& pf) { return sizeof(PreprocessedFrame) + MatBytes(pf.image); }
+
 } // namespace dcp
\ No newline at end of file
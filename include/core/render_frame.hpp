@@ -10,4 +10,11 @@ struct RenderFrame {
   WorldState world;     // Tracks/state aligned to this frame
 };
 
+// Age key for BoundedQueue's DropOlderThan policy, ages from capture like the frame itself
+inline TimePoint CaptureTime(const RenderFrame& rf) { return rf.frame.capture_time; }
+
+inline std::size_t ByteSize(const RenderFrame& rf) {
+  return sizeof(RenderFrame) + MatBytes(rf.frame.image);
+}
+
 } // namespace dcp
\ No newline at end of file
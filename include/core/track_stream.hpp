@@ -0,0 +1,141 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "core/world_state.hpp"
+
+/*
+  Binary track stream: one message per frame, tracks only, for consumers that don't need pixels (fleet logger, HMI).
+
+  Message = TrackStreamHeader, then full_count TrackFullRecords, delta_count TrackDeltaRecords and removed_count
+  track ids (uint64). Everything is fixed layout, little-endian, 8-byte aligned; message_bytes in the header frames
+  the stream.
+
+  - Keyframe: every live track as a full record. Applies on its own
+  - Delta: applies on top of the state after base_frame_id. New tracks (and class changes or moves too big to encode)
+    are full records, changed tracks are 16-byte delta records (position/size in 1/16 px, confidence in 1/255),
+    tracks gone since the base are listed as removed, and a track that didn't change costs nothing
+
+  The encoder keeps the state the decoder will have rebuilt, not the exact tracks, and encodes each delta against it,
+  so quantization never accumulates: a decoded track is always within 1/32 px of the real one. A keyframe of a frame
+  carries the same state applying its delta would, so delta and keyframe subscribers continue identically.
+
+  Deltas only pay off because tracking keeps a track's id while it follows the same object. Delta records carry a
+  32-bit id, a track whose id doesn't fit is always sent as a full record.
+*/
+
+namespace dcp {
+
+inline constexpr std::uint32_t kTrackStreamMagic = 0x54504344;  // "DCPT"
+inline constexpr std::uint16_t kTrackStreamVersion = 1;
+inline constexpr float kTrackStreamPosStep = 1.0f / 16.0f;       // Pixels per delta unit
+
+enum class TrackStreamKind : std::uint8_t {
+  Keyframe = 1,
+  Delta = 2
+};
+
+struct TrackStreamHeader {
+  std::uint32_t magic;
+  std::uint16_t version;
+  std::uint8_t kind;              // TrackStreamKind
+  std::uint8_t reserved;
+  std::uint32_t message_bytes;    // Header included
+  std::uint16_t full_count;
+  std::uint16_t delta_count;
+  std::uint16_t removed_count;
+  std::uint16_t track_count;      // Live tracks once applied, a cheap consistency check
+  std::uint32_t reserved2;
+  std::uint64_t frame_id;
+  std::uint64_t base_frame_id;    // Delta only, the frame it applies to
+  std::int64_t capture_ns;        // CLOCK_MONOTONIC
+};
+static_assert(sizeof(TrackStreamHeader) == 48, "TrackStreamHeader layout changed, bump kTrackStreamVersion");
+
+enum TrackStreamFlags : std::uint8_t {
+  kTrackConfirmed = 1
+};
+
+struct TrackFullRecord {
+  std::uint64_t id;
+  float x, y, w, h;
+  float confidence;
+  std::int16_t class_id;
+  std::uint8_t missed_frames;     // Saturates at 255
+  std::uint8_t flags;             // TrackStreamFlags
+};
+static_assert(sizeof(TrackFullRecord) == 32, "TrackFullRecord layout changed, bump kTrackStreamVersion");
+
+struct TrackDeltaRecord {
+  std::uint32_t id;               // Tracks with larger ids go as full records
+  std::int16_t dx, dy, dw, dh;    // kTrackStreamPosStep units
+  std::uint8_t confidence;        // Absolute, 1/255
+  std::uint8_t missed_frames;
+  std::uint8_t flags;
+  std::uint8_t reserved;
+};
+static_assert(sizeof(TrackDeltaRecord) == 16, "TrackDeltaRecord layout changed, bump kTrackStreamVersion");
+
+class TrackStreamEncoder {
+public:
+  TrackStreamEncoder();
+
+  // Encodes ws as a delta against the previous call (everything is new on the first). Invalidates the previous
+  // messages. The returned bytes stay valid until the next encode()
+  const std::vector<std::uint8_t>& encode(const WorldState& ws, std::int64_t capture_ns);
+
+  // Keyframe of the frame last encoded, built on first use per frame
+  const std::vector<std::uint8_t>& keyframe();
+
+  std::uint64_t frame_id() const { return frame_id_; }
+
+private:
+  void write_header(std::vector<std::uint8_t>& out, TrackStreamKind kind, std::size_t fulls, std::size_t deltas,
+                    std::size_t removed, std::size_t tracks) const;
+
+  std::vector<TrackFullRecord> prev_;     // Decoder-side state after the previous frame
+  std::vector<TrackFullRecord> next_;
+  std::vector<TrackFullRecord> fulls_;
+  std::vector<TrackDeltaRecord> deltas_;
+  std::vector<std::uint64_t> removed_;
+  std::vector<std::uint8_t> seen_;        // Per prev_ entry, still tracked this frame
+  std::vector<std::uint8_t> delta_msg_;
+  std::vector<std::uint8_t> key_msg_;
+  bool key_valid_{false};
+
+  std::uint64_t frame_id_{0};
+  std::uint64_t base_frame_id_{0};
+  std::int64_t capture_ns_{0};
+  bool have_base_{false};
+};
+
+enum class TrackStreamApply {
+  Ok,
+  NeedKeyframe,   // A delta that doesn't follow the state we have (we missed messages or haven't synced yet)
+  Malformed
+};
+
+// Rebuilds the track set from messages, in arrival order
+class TrackStreamDecoder {
+public:
+  // Bytes of the message starting at data, 0 if fewer than a header's worth are available
+  static std::size_t MessageSize(const std::uint8_t* data, std::size_t n);
+
+  TrackStreamApply apply(const std::uint8_t* msg, std::size_t n);
+
+  bool synced() const { return synced_; }
+  std::uint64_t frame_id() const { return frame_id_; }
+  std::int64_t capture_ns() const { return capture_ns_; }
+  const std::vector<TrackFullRecord>& tracks() const { return tracks_; }
+
+private:
+  std::vector<TrackFullRecord> tracks_;
+  std::vector<TrackFullRecord> scratch_;
+  std::uint64_t frame_id_{0};
+  std::int64_t capture_ns_{0};
+  bool synced_{false};
+};
+
+} // namespace dcp
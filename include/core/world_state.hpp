@@ -1,22 +1,30 @@
 #pragma once
 
 #include <chrono>
+#include <cstddef>
 #include <cstdint>
-#include <vector>
 
 #include "core/track.hpp"
+#include "infra/fixed_vector.hpp"
 
 namespace dcp {
 
 using SteadyTP = std::chrono::steady_clock::time_point;
 
+// Tracks carried per frame. Inline storage, so a WorldState moves through queues without heap traffic. Detections
+// arrive sorted by score, so anything past the cap is the weakest
+inline constexpr std::size_t kMaxTracks = 128;
+
 struct WorldState {
   std::uint64_t frame_id{0};
   SteadyTP timestamp{};
-  std::vector<Track> tracks;
+  FixedVector<Track, kMaxTracks> tracks;
 
   std::uint64_t detections_source_frame_id{0};
   SteadyTP detections_inference_time{};
 };
 
+// Tracks are stored inline, sizeof covers them
+inline std::size_t ByteSize(const WorldState&) { return sizeof(WorldState); }
+
 } // namespace dcp
\ No newline at end of file
@@ -3,10 +3,13 @@
 #include <cstdint>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "core/detections.hpp"
 #include "core/preprocessed_frame.hpp"
 
+#include <opencv2/core.hpp>
+
 #include <onnxruntime/onnxruntime_cxx_api.h>
 
 namespace dcp {
@@ -25,13 +28,25 @@ public:
 
   bool is_loaded() const { return loaded_; }
 
+  // True if the model's input has a dynamic batch axis, so infer_batch runs a single [B,3,H,W] call
+  bool supports_batch() const { return batch_dynamic_; }
+
   Detections infer(const PreprocessedFrame& pf);
 
+  // Same as infer, but fills `out` in place so a caller that keeps it around reuses its item buffer
+  void infer_into(const PreprocessedFrame& pf, Detections& out);
+
+  // Offline/throughput path. Returns one Detections per input frame, in the same order
+  std::vector<Detections> infer_batch(const std::vector<PreprocessedFrame>& frames);
+
+  // In place variant, outs[i] belongs to frames[i]. outs grows to frames.size() if needed, never shrinks
+  void infer_batch_into(const std::vector<PreprocessedFrame>& frames, std::vector<Detections>& outs);
+
 private:
   Params p_;
   bool loaded_{false};
+  bool batch_dynamic_{false};
 
-  Ort::Env env_{ORT_LOGGING_LEVEL_WARNING, "dcp-yolo"};
   Ort::SessionOptions sess_opts_{};
   std::unique_ptr<Ort::Session> session_;
   Ort::AllocatorWithDefaultOptions allocator_;
@@ -39,6 +54,33 @@ private:
   std::string input_name_;
   std::string output_name_;
 
+  // Scratch reused by every run, so steady-state inference doesn't allocate on our side. The single-frame input and
+  // (for a fixed output shape) the output tensor are bound to ORT values once; ORT's own run-time allocations remain
+  Ort::MemoryInfo mem_info_{Ort::MemoryInfo::CreateCpu(OrtDeviceAllocator, OrtMemTypeCPU)};
+  Ort::RunOptions run_opts_{nullptr};
+  std::vector<float> input_buf_;
+  Ort::Value input_val_{nullptr};
+  std::vector<float> output_buf_;
+  std::vector<int64_t> output_shape_;
+  Ort::Value output_val_{nullptr};
+  std::vector<float> batch_buf_;
+
+  cv::Mat resized_;
+  cv::Mat rgb_;
+  cv::Mat f32_;
+
+  struct Cand {
+    BBox box;
+    int cls;
+    float score;
+  };
+  std::vector<Cand> cands_;
+  std::vector<Cand> kept_;
+
+  void bind_single_frame_tensors();
+  void fill_input(const PreprocessedFrame& pf, float* dst);
+  void decode(const float* data, int A, int B, const PreprocessedFrame& pf, Detections& out);
+
   static float IoU(const BBox& a, const BBox& b);
 };
 
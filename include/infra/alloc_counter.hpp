@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstdint>
+
+/*
+    Opt-in heap allocation counter, per thread.
+
+    alloc_counter.cpp (the dcp_alloc_counter library) replaces the global operator new/delete with thin malloc/free
+    wrappers that bump a thread-local counter. Stages sample it around each item and report the difference through
+    StageMetrics::on_allocs, so the dashboard can show allocations per frame and tests can assert that a warmed-up
+    pipeline allocates nothing.
+
+    dashcam_core links it with the DCP_COUNT_ALLOCS CMake option. Without the option it builds alloc_counter_off.cpp
+    instead: nothing is replaced and ThreadAllocations() always returns 0.
+*/
+
+namespace dcp {
+
+// True if this build counts allocations
+bool AllocCountingEnabled();
+
+// operator new calls made by the calling thread so far (any form: array, nothrow, aligned)
+std::uint64_t ThreadAllocations();
+
+} // namespace dcp
@@ -0,0 +1,252 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "core/config.hpp"
+#include "infra/metrics.hpp"
+#include "infra/stop_token.hpp"
+#include "infra/thread_runner.hpp"
+
+/*
+    AsyncWriter is the shared disk writer behind the file sinks, so no pipeline stage ever waits on write/fsync.
+
+    Producers take fixed-size, page-aligned buffers from one pool allocated up front, fill them and submit them against
+    an open file. Each submit is an append: its file offset is assigned at submit time, so writes can complete in any
+    order and a file still ends up exactly as appended. The buffer goes back to the pool when its write completes.
+
+    Backpressure never blocks: try_acquire() fails when the pool is empty or max_in_flight_bytes are already submitted
+    and not completed, and the producer drops what it wanted to write (and counts it).
+
+    Two backends do the writes:
+      - io_uring (Linux): one service thread owns the ring. The pool is registered with the kernel (WRITE_FIXED) when
+        the memlock limit allows it, requests that arrived while the previous batch was in flight go in one submission
+      - threads: a few workers doing pwrite/fdatasync/fsync, used when io_uring is unavailable (old kernel, seccomp)
+    "auto" tries io_uring and falls back to threads. A ring that breaks mid-run (io_uring_enter failing with anything
+    but EINTR/EAGAIN/EBUSY) fails the requests it holds and its thread carries on as a threads-backend worker.
+
+    Durability is per file: None leaves data to the page cache, OnClose fsyncs before the file is closed, Periodic
+    also fdatasyncs after every sync_bytes written. close() runs after all of the file's writes completed, optionally
+    renames the file (after the fsync, so a renamed file is complete) and then calls on_closed from the writer thread.
+
+    AsyncFile below is the producer side most sinks want: an append stream on one file that packs small writes into
+    the current buffer.
+*/
+
+namespace dcp {
+
+enum class Durability {
+  None,      // Page cache only, the kernel writes it back whenever
+  OnClose,   // fsync before close (and before the rename, if any)
+  Periodic   // fdatasync every FileOptions::sync_bytes, fsync on close
+};
+
+struct FileOptions {
+  Durability durability{Durability::None};
+  std::size_t sync_bytes{0};   // Periodic only
+};
+
+// A sink's durability setting from the config (validated there)
+inline FileOptions MakeFileOptions(const DurabilityConfig& cfg) {
+  FileOptions o;
+  if (cfg.fsync == "close") o.durability = Durability::OnClose;
+  if (cfg.fsync == "periodic") o.durability = Durability::Periodic;
+  o.sync_bytes = static_cast<std::size_t>(cfg.sync_mb) * 1024 * 1024;
+  return o;
+}
+
+class AsyncWriter {
+public:
+  struct Options {
+    std::string backend{"auto"};      // auto | io_uring | threads
+    std::size_t queue_depth{64};      // io_uring entries, also the most requests in flight on that backend
+    std::size_t buffer_size{256 * 1024};
+    std::size_t buffer_count{64};
+    std::size_t max_in_flight_bytes{16 * 1024 * 1024};
+    std::size_t workers{2};           // threads backend
+    std::size_t max_files{32};
+  };
+
+  struct Buffer {
+    std::uint8_t* data{nullptr};
+    std::size_t size{0};        // Bytes filled, what submit() writes
+    std::size_t capacity{0};
+    std::uint32_t index{0};     // Position in the pool, the registered buffer index
+  };
+
+  using File = int;             // -1 = invalid
+  using ClosedFn = std::function<void(bool ok)>;
+
+  // metrics gets one item per completed write (LAT = submit to completion). thread_cfg applies to the writer threads
+  explicit AsyncWriter(Options opts, StageMetrics* metrics = nullptr, ThreadConfig thread_cfg = {});
+  // Waits for everything submitted, closes what producers left open
+  ~AsyncWriter();
+
+  AsyncWriter(const AsyncWriter&) = delete;
+  AsyncWriter& operator=(const AsyncWriter&) = delete;
+
+  // Open (create, truncate) for writing. -1 if the file can't be opened or max_files are open
+  File open(const std::string& path, FileOptions opts = {});
+
+  // n empty buffers appended to out, or false (counted in rejected_total) with nothing taken. Never blocks
+  bool try_acquire(std::size_t n, std::vector<Buffer*>& out);
+  // Hand back a buffer that won't be submitted
+  void release(Buffer* buf);
+
+  // Append buf->size bytes to the file. The buffer belongs to the writer from here on
+  void submit(File f, Buffer* buf);
+
+  // Close once every submitted write completed: fsync per durability, rename to rename_to if not empty, then on_closed
+  void close(File f, std::string rename_to = {}, ClosedFn on_closed = {});
+
+  // Block until everything submitted so far (writes, syncs, closes) is done
+  void drain();
+
+  const char* backend() const { return uring_ && !uring_failed_.load(std::memory_order_relaxed) ? "io_uring" : "threads"; }
+  bool registered_buffers() const { return registered_; }
+  std::size_t buffer_size() const { return opts_.buffer_size; }
+  std::size_t buffer_count() const { return buffers_.size(); }
+  std::size_t max_in_flight_bytes() const { return opts_.max_in_flight_bytes; }
+
+  // Safe from any thread, for the dashboards
+  std::size_t buffers_in_use() const { return in_use_.load(std::memory_order_relaxed); }
+  std::size_t in_flight_bytes() const { return in_flight_bytes_.load(std::memory_order_relaxed); }
+  std::uint64_t rejected_total() const { return rejected_.load(std::memory_order_relaxed); }
+  std::uint64_t bytes_written_total() const { return written_.load(std::memory_order_relaxed); }
+  std::uint64_t syncs_total() const { return syncs_.load(std::memory_order_relaxed); }
+  std::uint64_t errors_total() const { return errors_.load(std::memory_order_relaxed); }
+
+private:
+  enum class OpKind { Write, Sync, Close };
+
+  struct Op {
+    OpKind kind{OpKind::Write};
+    File file{-1};
+    Buffer* buf{nullptr};
+    std::uint64_t offset{0};
+    std::size_t done{0};        // Bytes of buf already written (short writes continue from here)
+    std::uint64_t submit_ns{0};
+  };
+
+  struct FileState {
+    bool used{false};
+    int fd{-1};
+    std::string path;
+    std::string rename_to;
+    FileOptions opts{};
+    ClosedFn on_closed;
+    std::uint64_t offset{0};       // Next append offset
+    std::size_t pending{0};        // Writes and syncs queued or in flight
+    std::uint64_t unsynced{0};     // Bytes written since the last sync, Periodic only
+    bool sync_queued{false};
+    bool closing{false};
+    bool failed{false};
+  };
+
+  struct Uring;
+
+  // Request queue, a fixed ring: every write holds a buffer and a file has at most a sync and a close queued
+  void push_op_locked(const Op& op);
+  bool pop_op_locked(Op& out);
+
+  // Bookkeeping when an op finished, under mu_. May queue the file's sync/close
+  void complete_locked(const Op& op, bool ok, std::uint64_t now_ns);
+  void maybe_close_locked(File f);
+  void finish_close(File f, bool ok);
+
+  // Blocking execution of one op, threads backend (and the close step of both)
+  bool do_write(const Op& op);
+  bool do_sync(const Op& op);
+
+  void worker_loop(const StopToken& global, const std::atomic_bool& local);
+  void uring_loop(const StopToken& global, const std::atomic_bool& local);
+  bool init_uring();
+
+  Options opts_;
+  StageMetrics* metrics_;
+
+  std::uint8_t* arena_{nullptr};
+  std::vector<Buffer> buffers_;
+  std::vector<Buffer*> free_;
+  std::vector<FileState> files_;
+
+  std::vector<Op> ops_;
+  std::size_t ops_head_{0};
+  std::size_t ops_count_{0};
+  std::size_t active_{0};       // Ops popped and not completed yet
+
+  mutable std::mutex mu_;
+  std::condition_variable work_cv_;   // Workers / the ring thread: ops queued or stopping
+  std::condition_variable idle_cv_;   // drain(): nothing queued or active
+
+  std::unique_ptr<Uring> uring_;
+  bool registered_{false};
+  std::atomic_bool uring_failed_{false};   // The ring broke mid-run, its thread went on as a threads-backend worker
+
+  StopSource stop_;
+  bool stopping_{false};
+  std::vector<std::unique_ptr<ThreadRunner>> threads_;
+
+  std::atomic<std::size_t> in_use_{0};
+  std::atomic<std::size_t> in_flight_bytes_{0};
+  std::atomic<std::uint64_t> rejected_{0};
+  std::atomic<std::uint64_t> written_{0};
+  std::atomic<std::uint64_t> syncs_{0};
+  std::atomic<std::uint64_t> errors_{0};
+};
+
+// Writer settings from the io: section
+inline AsyncWriter::Options MakeWriterOptions(const IoConfig& cfg) {
+  AsyncWriter::Options o;
+  o.backend = cfg.backend;
+  o.queue_depth = static_cast<std::size_t>(cfg.queue_depth);
+  o.buffer_size = static_cast<std::size_t>(cfg.buffer_kb) * 1024;
+  o.buffer_count = static_cast<std::size_t>(cfg.buffers);
+  o.max_in_flight_bytes = static_cast<std::size_t>(cfg.max_in_flight_mb) * 1024 * 1024;
+  o.workers = static_cast<std::size_t>(cfg.workers);
+  o.max_files = static_cast<std::size_t>(cfg.max_files);
+  return o;
+}
+
+// Append stream on one AsyncWriter file, for a single producer thread. Small appends share a buffer, a buffer is
+// submitted when full or on flush()
+class AsyncFile {
+public:
+  AsyncFile() = default;
+  ~AsyncFile();
+
+  AsyncFile(const AsyncFile&) = delete;
+  AsyncFile& operator=(const AsyncFile&) = delete;
+
+  bool open(AsyncWriter* writer, const std::string& path, FileOptions opts = {});
+  bool is_open() const { return file_ >= 0; }
+
+  // All or nothing: false if the writer has no room for it right now (backpressure), nothing is written then
+  bool append(const void* data, std::size_t n);
+
+  // Submit the partly filled buffer
+  void flush();
+
+  // Flush and close, see AsyncWriter::close. No-op if not open
+  void close(std::string rename_to = {}, AsyncWriter::ClosedFn on_closed = {});
+
+  std::uint64_t bytes() const { return bytes_; }          // Appended since open
+  std::uint64_t rejected_bytes() const { return rejected_bytes_; }
+
+private:
+  AsyncWriter* writer_{nullptr};
+  AsyncWriter::File file_{-1};
+  AsyncWriter::Buffer* cur_{nullptr};
+  std::vector<AsyncWriter::Buffer*> spare_;
+  std::uint64_t bytes_{0};
+  std::uint64_t rejected_bytes_{0};
+};
+
+} // namespace dcp
@@ -1,67 +1,131 @@
 #pragma once
 
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <cstddef>
-#include <deque>
+#include <cstdint>
+#include <functional>
 #include <mutex>
 #include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 #include "core/config.hpp"
+#include "infra/byte_size.hpp"
 
 /*
     Implementation of bounded queue with capacity, drop policy, timed pop, non-blocking push, and statistics
+
+    DropOlderThan bounds the queue in time as well as in items: anything older than max_age (by its CaptureTime())
+    is discarded lazily, from the front on push and on pop, and counted in expired_total() rather than drops_total().
+    When full it behaves like DropOldest. Items without a CaptureTime() overload never expire.
+
+    Bytes held are tracked through ItemBytes() (infra/byte_size.hpp). With max_bytes > 0 the queue is also bounded in
+    bytes: a push that doesn't fit evicts from the front (DropOldest/DropOlderThan) or is rejected (DropNewest), and an
+    item bigger than max_bytes on its own is always rejected, without evicting anything. Both count as drops.
+
+    Storage is a ring of `capacity` slots allocated up front, so steady-state push/pop never touches the heap (a deque
+    allocates a block every few items once T is larger than a few hundred bytes). T must be default constructible;
+    freed slots are reset to T{} so they don't keep e.g. a frame buffer alive.
+
+    size(), bytes(), drops_total() and expired_total() are atomics written under the lock and read without it, so
+    monitoring (dashboard, /metrics) never contends with the stages pushing and popping.
 */
 
 namespace dcp {
 
+namespace detail {
+// True if CaptureTime(const T&) is found (by ADL, e.g. next to Frame/RenderFrame)
+template <typename T, typename = void>
+struct HasCaptureTime : std::false_type {};
+template <typename T>
+struct HasCaptureTime<T, std::void_t<decltype(CaptureTime(std::declval<const T&>()))>> : std::true_type {};
+} // namespace detail
+
 template <typename T>
 class BoundedQueue {
 public:
-  explicit BoundedQueue(std::size_t capacity, DropPolicy policy): capacity_(capacity), policy_(policy) {}
+  explicit BoundedQueue(std::size_t capacity, DropPolicy policy,
+                        std::chrono::milliseconds max_age = std::chrono::milliseconds(0), std::size_t max_bytes = 0)
+      : capacity_(capacity), policy_(policy), max_age_(max_age), max_bytes_(max_bytes), ring_(capacity) {}
 
   // No copy/move
   BoundedQueue(const BoundedQueue&) = delete;
   BoundedQueue& operator=(const BoundedQueue&) = delete;
 
-  bool try_push(T item) {
+  // discarded, if given, is set to how many items this push threw away: expired or evicted older items, plus the
+  // pushed item itself when rejected. Pops never count towards it, unlike the drops_total()/expired_total() deltas
+  bool try_push(T item, std::size_t* discarded = nullptr) {
+    const std::size_t item_bytes = ItemBytes(item);
     std::unique_lock<std::mutex> lock(mu_);
 
     ++pushes_;
 
-    if (capacity_ == 0) {
+    // Stale items free their slot first, so a fresh frame never evicts a fresher one
+    std::size_t n = evict_expired_locked();
+    auto reject = [&]() {
       ++drops_;
+      if (discarded) *discarded = n + 1;
       return false;
-    }
+    };
+
+    if (capacity_ == 0) return reject();
+    // Checked before anything is evicted for it, an item that can never fit must not cost queued ones
+    if (max_bytes_ > 0 && item_bytes > max_bytes_) return reject();
 
     // If past capacity
-    if (q_.size() >= capacity_) {
-      if (policy_ == DropPolicy::DropNewest) {
+    if (count_ >= capacity_) {
+      if (policy_ == DropPolicy::DropNewest) return reject();
+      // DropOldest/DropOlderThan: remove one oldest element, then accept new one
+      drop_front_locked();
+      ++drops_;
+      ++n;
+    }
+
+    // Byte bound, same policy as the item bound
+    if (max_bytes_ > 0) {
+      while (bytes_ + item_bytes > max_bytes_) {
+        if (policy_ == DropPolicy::DropNewest) return reject();
+        drop_front_locked();
         ++drops_;
-        return false;
+        ++n;
       }
-      // DropOldest: remove one oldest element, then accept new one
-      q_.pop_front();
-      ++drops_;
     }
 
-    q_.push_back(std::move(item));
+    bytes_ += item_bytes;
+    ring_[(head_ + count_) % capacity_] = std::move(item);
+    ++count_;
+    if (on_push_) on_push_();
     lock.unlock();
     cv_.notify_one();
+    if (discarded) *discarded = n;
     return true;
   }
 
-  bool try_pop(T& out) {
+  // Called after every accepted push, under the queue lock so it can be swapped out while producers run. Keep it cheap
+  // and never touch this queue from it. Used to wake task-mode consumers, see Stage
+  void set_on_push(std::function<void()> fn) {
     std::lock_guard<std::mutex> lock(mu_);
+    on_push_ = std::move(fn);
+  }
 
-    if (q_.empty()) return false;
-
-    out = std::move(q_.front());
+  bool try_pop(T& out) {
+    std::unique_lock<std::mutex> lock(mu_);
 
-    q_.pop_front();
+    const std::size_t expired = evict_expired_locked();
+    if (count_ == 0) {
+      lock.unlock();
+      if (expired > 0) space_cv_.notify_all();
+      return false;
+    }
 
+    pop_front_locked(out);
     ++pops_;
 
+    lock.unlock();
+    space_cv_.notify_one();
     return true;
   }
 
@@ -69,29 +133,72 @@ public:
   template <typename Rep, typename Period>
   bool try_pop_for(T& out, const std::chrono::duration<Rep, Period>& timeout) {
     std::unique_lock<std::mutex> lock(mu_);
-    if (!cv_.wait_for(lock, timeout, [&] { return !q_.empty(); })) return false;
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
 
-    out = std::move(q_.front());
-    q_.pop_front();
+    // Everything we find may have expired, keep waiting for a fresh item until the deadline
+    while (true) {
+      if (!cv_.wait_until(lock, deadline, [&] { return count_ > 0; })) return false;
+      if (evict_expired_locked() == 0 || count_ > 0) break;
+      space_cv_.notify_all();
+    }
+
+    pop_front_locked(out);
     ++pops_;
+    lock.unlock();
+    space_cv_.notify_one();
     return true;
   }
 
+  // Wait until there is at least one item, without taking it. For consumers that pop under their own lock (e.g. the
+  // preprocess pool), so they don't hold that lock while waiting. The item may be gone by the time they try_pop
+  template <typename Rep, typename Period>
+  bool wait_for_item(const std::chrono::duration<Rep, Period>& timeout) {
+    std::unique_lock<std::mutex> lock(mu_);
+    return cv_.wait_for(lock, timeout, [&] { return count_ > 0; });
+  }
+
+  // Wait until there is at least one free slot. Used by producers that must not drop (e.g. file decode-ahead)
+  template <typename Rep, typename Period>
+  bool wait_for_space(const std::chrono::duration<Rep, Period>& timeout) {
+    std::unique_lock<std::mutex> lock(mu_);
+    return space_cv_.wait_for(lock, timeout, [&] { return count_ < capacity_; });
+  }
+
   void clear() {
-    std::lock_guard<std::mutex> lock(mu_);
-    q_.clear();
+    std::unique_lock<std::mutex> lock(mu_);
+    while (count_ > 0) drop_front_locked();
+    bytes_ = 0;
+    lock.unlock();
+    space_cv_.notify_all();
   }
 
   // Getters
 
-  std::size_t size() const {
+  std::size_t size() const { return count_.load(std::memory_order_relaxed); }
+
+  std::size_t capacity() const { return capacity_; }
+
+  // Bytes currently held (ItemBytes of every item), and the byte bound (0 = none)
+  std::size_t bytes() const { return bytes_.load(std::memory_order_relaxed); }
+  std::size_t max_bytes() const { return max_bytes_; }
+
+  bool full() const {
     std::lock_guard<std::mutex> lock(mu_);
-    return q_.size();
+    return count_ >= capacity_;
   }
 
-  std::size_t capacity() const { return capacity_; }
+  // True if a push right now would be rejected, meaning the producer can skip building the item altogether.
+  // item_bytes is what the item is expected to weigh (ItemBytes, e.g. the previous one's), 0 checks the item bound only
+  bool would_drop_incoming(std::size_t item_bytes = 0) const {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (capacity_ == 0) return true;
+    if (max_bytes_ > 0 && item_bytes > max_bytes_) return true;
+    if (policy_ != DropPolicy::DropNewest) return false;
+    return count_ >= capacity_ || (max_bytes_ > 0 && bytes_ + item_bytes > max_bytes_);
+  }
 
   DropPolicy policy() const { return policy_; }
+  std::chrono::milliseconds max_age() const { return max_age_; }
 
   std::uint64_t pushes_total() const {
     std::lock_guard<std::mutex> lock(mu_);
@@ -103,22 +210,63 @@ public:
     return pops_;
   }
 
-  std::uint64_t drops_total() const {
-    std::lock_guard<std::mutex> lock(mu_);
-    return drops_;
-  }
+  std::uint64_t drops_total() const { return drops_.load(std::memory_order_relaxed); }
+
+  // Items discarded for being older than max_age (DropOlderThan), separate from capacity drops
+  std::uint64_t expired_total() const { return expired_.load(std::memory_order_relaxed); }
 
 private:
+  void drop_front_locked() {
+    bytes_ -= ItemBytes(ring_[head_]);
+    ring_[head_] = T{};
+    head_ = (head_ + 1) % capacity_;
+    --count_;
+  }
+
+  void pop_front_locked(T& out) {
+    bytes_ -= ItemBytes(ring_[head_]);
+    out = std::move(ring_[head_]);
+    ring_[head_] = T{};
+    head_ = (head_ + 1) % capacity_;
+    --count_;
+  }
+
+  // Drop expired items from the front. Returns how many were dropped
+  std::size_t evict_expired_locked() {
+    if constexpr (detail::HasCaptureTime<T>::value) {
+      if (policy_ != DropPolicy::DropOlderThan || max_age_.count() <= 0 || count_ == 0) return 0;
+
+      const auto cutoff = std::chrono::steady_clock::now() - max_age_;
+      std::size_t n = 0;
+      while (count_ > 0 && CaptureTime(ring_[head_]) < cutoff) {
+        drop_front_locked();
+        ++n;
+      }
+      expired_ += n;
+      return n;
+    } else {
+      return 0;
+    }
+  }
+
   const std::size_t capacity_;
   const DropPolicy policy_;
+  const std::chrono::milliseconds max_age_;
+  const std::size_t max_bytes_;
 
   mutable std::mutex mu_;
-  std::condition_variable cv_;
-  std::deque<T> q_;
+  std::condition_variable cv_;        // Signalled when an item is pushed
+  std::condition_variable space_cv_;  // Signalled when an item is popped
+  std::vector<T> ring_;               // capacity_ slots, items live in [head_, head_ + count_) modulo capacity_
+  std::size_t head_{0};
+  std::atomic<std::size_t> count_{0};
+  std::function<void()> on_push_;
+  std::atomic<std::size_t> bytes_{0};
 
   std::uint64_t pushes_{0};
   std::uint64_t pops_{0};
-  std::uint64_t drops_{0};
+  std::atomic<std::uint64_t> drops_{0};
+  std::atomic<std::uint64_t> expired_{0};
 };
 
 } // namespace dcp
\ No newline at end of file
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+/*
+    Byte accounting for queue/store items.
+
+    A type reports what it holds with a ByteSize(const T&) overload defined next to the type (found by ADL), e.g.
+    Frame counts its cv::Mat pixels. Anything without one counts as sizeof(T). Pixel buffers shared by refcount
+    between queues are counted in each, so totals are an upper bound.
+*/
+
+namespace dcp {
+
+namespace detail {
+template <typename T, typename = void>
+struct HasByteSize : std::false_type {};
+template <typename T>
+struct HasByteSize<T, std::void_t<decltype(ByteSize(std::declval<const T&>()))>> : std::true_type {};
+} // namespace detail
+
+template <typename T>
+std::size_t ItemBytes(const T& v) {
+  if constexpr (detail::HasByteSize<T>::value) {
+    return ByteSize(v);
+  } else {
+    (void)v;
+    return sizeof(T);
+  }
+}
+
+} // namespace dcp
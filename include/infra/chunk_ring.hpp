@@ -0,0 +1,88 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+    ChunkRing keeps the most recent variable-size chunks (e.g. compressed frames) in one fixed byte arena.
+
+    Memory is allocated once: max_bytes for the payloads and max_chunks index entries. Payloads are written back to
+    back and wrap to the start of the arena when the tail is too short for the next one (the tail gap is simply
+    skipped). A push evicts the oldest chunks it would overwrite, and the oldest ones past max_chunks. trim() evicts by
+    age, so the ring never holds more than the window a caller cares about.
+
+    Single writer. bytes()/size() are atomics so a dashboard thread can read occupancy, everything else belongs to the
+    writer thread.
+*/
+
+namespace dcp {
+
+class ChunkRing {
+public:
+  using TimePoint = std::chrono::steady_clock::time_point;
+
+  struct Chunk {
+    TimePoint time{};
+    std::uint64_t seq{0};
+    const std::uint8_t* data{nullptr};
+    std::size_t size{0};
+  };
+
+  ChunkRing(std::size_t max_bytes, std::size_t max_chunks);
+
+  ChunkRing(const ChunkRing&) = delete;
+  ChunkRing& operator=(const ChunkRing&) = delete;
+
+  // Copy a chunk in, evicting the oldest as needed. False (and counted) if it is larger than the whole arena
+  bool push(TimePoint time, std::uint64_t seq, const std::uint8_t* data, std::size_t size);
+
+  // Evict chunks older than cutoff
+  void trim(TimePoint cutoff);
+
+  void clear();
+
+  // Oldest first. Pointers are valid until the next push/trim/clear
+  template <typename F>
+  void for_each(F&& f) const {
+    for (std::size_t i = 0; i < count_; ++i) {
+      const Entry& e = entries_[(head_ + i) % entries_.size()];
+      f(Chunk{e.time, e.seq, arena_.data() + e.offset, e.size});
+    }
+  }
+
+  std::size_t bytes() const { return bytes_.load(std::memory_order_relaxed); }
+  std::size_t size() const { return size_.load(std::memory_order_relaxed); }
+  std::size_t max_bytes() const { return arena_.size(); }
+  std::size_t max_chunks() const { return entries_.size(); }
+  std::uint64_t oversize_total() const { return oversize_.load(std::memory_order_relaxed); }
+
+  // Span of time held, newest minus oldest chunk
+  std::chrono::nanoseconds span() const;
+
+private:
+  struct Entry {
+    TimePoint time{};
+    std::uint64_t seq{0};
+    std::size_t offset{0};
+    std::size_t size{0};
+  };
+
+  void pop_front();
+  void publish();
+
+  std::vector<std::uint8_t> arena_;
+  std::vector<Entry> entries_;
+  std::size_t head_{0};
+  std::size_t count_{0};
+  std::size_t write_pos_{0};
+  std::size_t used_{0};
+
+  std::atomic<std::size_t> bytes_{0};
+  std::atomic<std::size_t> size_{0};
+  std::atomic<std::uint64_t> oversize_{0};
+};
+
+} // namespace dcp
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+/*
+    DemandSignal is a one-slot "ready for next" ticket from a consumer to a producer.
+
+    LatestStore lets a fast producer overwrite items a slow consumer never sees. That bounds latency, but every
+    overwritten item was work for nothing. With a DemandSignal the consumer asks for exactly one item, optionally
+    not before a given time (so it can ask while still busy and have a fresh item ready the moment it is idle), and the
+    producer only builds an item when it can take a ticket.
+
+    Lock-free, one outstanding ticket at most. Requesting again before the producer took the ticket just moves the due time.
+*/
+
+namespace dcp {
+
+class DemandSignal {
+public:
+  // Start armed: a consumer that hasn't run yet is idle
+  DemandSignal() = default;
+
+  DemandSignal(const DemandSignal&) = delete;
+  DemandSignal& operator=(const DemandSignal&) = delete;
+
+  // Consumer side. Ask for one item, to be produced no earlier than not_before_ns (NowNs() clock, 0 = immediately)
+  void request(std::uint64_t not_before_ns = 0) {
+    not_before_ns_.store(not_before_ns, std::memory_order_relaxed);
+    armed_.store(true, std::memory_order_release);
+  }
+
+  // Producer side. Returns true and consumes the ticket if one is outstanding and due at now_ns
+  bool try_take(std::uint64_t now_ns) {
+    if (!armed_.load(std::memory_order_acquire)) return false;
+    if (now_ns < not_before_ns_.load(std::memory_order_relaxed)) return false;
+    bool expected = true;
+    return armed_.compare_exchange_strong(expected, false, std::memory_order_acq_rel);
+  }
+
+  bool armed() const { return armed_.load(std::memory_order_acquire); }
+
+private:
+  std::atomic_bool armed_{true};
+  std::atomic<std::uint64_t> not_before_ns_{0};
+};
+
+} // namespace dcp
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+/*
+    FixedVector is a vector with inline storage for at most N elements, so it never touches the heap.
+
+    Used for per-frame collections that are handed downstream by value (e.g. WorldState::tracks travelling through a
+    BoundedQueue). A std::vector there gives its buffer away on every move and the producer allocates a fresh one for
+    the next frame. push_back on a full FixedVector is refused and returns false.
+
+    Copies only copy the live elements, not all N slots.
+*/
+
+namespace dcp {
+
+template <typename T, std::size_t N>
+class FixedVector {
+public:
+  FixedVector() = default;
+
+  FixedVector(const FixedVector& other) : size_(other.size_) {
+    for (std::size_t i = 0; i < size_; ++i) items_[i] = other.items_[i];
+  }
+
+  FixedVector& operator=(const FixedVector& other) {
+    if (this == &other) return *this;
+    size_ = other.size_;
+    for (std::size_t i = 0; i < size_; ++i) items_[i] = other.items_[i];
+    return *this;
+  }
+
+  bool push_back(const T& v) {
+    if (size_ == N) return false;
+    items_[size_++] = v;
+    return true;
+  }
+
+  void clear() { size_ = 0; }
+
+  std::size_t size() const { return size_; }
+  static constexpr std::size_t capacity() { return N; }
+  bool empty() const { return size_ == 0; }
+  bool full() const { return size_ == N; }
+
+  T& operator[](std::size_t i) { return items_[i]; }
+  const T& operator[](std::size_t i) const { return items_[i]; }
+
+  T* begin() { return items_.data(); }
+  T* end() { return items_.data() + size_; }
+  const T* begin() const { return items_.data(); }
+  const T* end() const { return items_.data() + size_; }
+
+private:
+  std::array<T, N> items_{};
+  std::size_t size_{0};
+};
+
+} // namespace dcp
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+    Flight recorder: the last few minutes of per-frame stage timings, in a file that outlives the process.
+
+    One memory-mapped file (metrics.flight_recorder.path) holds a FlightHeader, the stage names, and a ring of
+    `records` fixed-size FlightRecords. Every stage appends one record per item it finishes (StageMetrics::on_frame):
+    camera sequence id, stage, start, duration and the depth of the stage's input queue. Appending is an atomic
+    increment of the write cursor and a few plain stores into the mapping, no syscalls and no locks, so it costs about
+    the same as a metrics counter. The file is a MAP_SHARED mapping of a real file, so once a store is done it is in
+    the page cache: a crash, abort or kill -9 keeps everything written so far. A background thread msyncs every
+    flush_interval_ms so a power cut loses at most that much. A hung pipeline can be decoded while it is still up.
+
+    Each record carries a stamp, its 1-based write index, written last. 0 means a writer was inside the record (or the
+    process died there) and the record is skipped, a stamp from an older lap means it was never rewritten.
+
+    On start an existing file is renamed to <path>.prev first, so restarting after a crash doesn't overwrite the very
+    run worth looking at. flight_decode turns a file into CSV or a Chrome trace (chrome://tracing, ui.perfetto.dev).
+
+    This header and its .cpp only need libc, like dcp_shm, so the decoder links the small dcp_flight library.
+*/
+
+namespace dcp {
+
+inline constexpr std::uint32_t kFlightMagic = 0x46504344;  // "DCPF"
+inline constexpr std::uint32_t kFlightVersion = 1;
+inline constexpr std::size_t kFlightMaxStages = 64;
+inline constexpr std::size_t kFlightStageNameLen = 32;
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "the flight recorder needs lock-free 64-bit atomics");
+
+// One item a stage finished. Fixed layout, 32 bytes. Fields are relaxed atomics only because writers a lap apart may
+// share a slot, the stores are plain movs
+struct FlightRecord {
+  std::atomic<std::uint64_t> stamp;        // Write index + 1, stored last. 0 = being written
+  std::atomic<std::uint64_t> sequence_id;  // Camera sequence id of the frame
+  std::atomic<std::int64_t> start_ns;      // CLOCK_MONOTONIC (steady_clock)
+  std::atomic<std::uint32_t> duration_ns;  // Saturates at ~4.29 s
+  std::atomic<std::uint16_t> stage;        // Index into FlightHeader::stage_names
+  std::atomic<std::uint16_t> queue_depth;  // Items waiting in the stage's input queue when it finished, saturates
+};
+static_assert(sizeof(FlightRecord) == 32, "FlightRecord layout changed, bump kFlightVersion");
+
+struct alignas(64) FlightHeader {
+  std::uint32_t magic;
+  std::uint32_t version;
+  std::uint32_t record_size;
+  std::int32_t writer_pid;
+  std::uint64_t capacity;             // Records in the ring, a power of two
+  std::uint64_t records_offset;       // From the start of the file
+  std::int64_t start_realtime_ns;     // Wall clock and CLOCK_MONOTONIC at the same instant, to date the records
+  std::int64_t start_monotonic_ns;
+
+  alignas(64) std::atomic<std::uint64_t> cursor;  // Records written so far
+  std::atomic<std::uint32_t> stage_count;
+  char stage_names[kFlightMaxStages][kFlightStageNameLen];
+};
+
+class FlightRecorder {
+public:
+  // Creates path (moving an existing file to <path>.prev) for at least `records` records, rounded up to a power of
+  // two, and starts the flush thread if flush_interval_ms > 0. Throws std::runtime_error on failure
+  FlightRecorder(std::string path, std::size_t records, int flush_interval_ms);
+  // Stops the flush thread, msyncs and unmaps. The file stays
+  ~FlightRecorder();
+
+  FlightRecorder(const FlightRecorder&) = delete;
+  FlightRecorder& operator=(const FlightRecorder&) = delete;
+
+  // Index for a stage name, the same name gets the same index. Thread-safe. Past kFlightMaxStages every new name
+  // shares the last index, named "other"
+  std::uint16_t add_stage(const std::string& name);
+
+  // Appends one record. Any thread, lock-free, no syscalls
+  void record(std::uint16_t stage, std::uint64_t sequence_id, std::int64_t start_ns, std::uint64_t duration_ns,
+              std::size_t queue_depth) {
+    const std::uint64_t i = hdr_->cursor.fetch_add(1, std::memory_order_relaxed);
+    FlightRecord& r = records_[i & mask_];
+    r.stamp.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    r.sequence_id.store(sequence_id, std::memory_order_relaxed);
+    r.start_ns.store(start_ns, std::memory_order_relaxed);
+    r.duration_ns.store(duration_ns > UINT32_MAX ? UINT32_MAX : static_cast<std::uint32_t>(duration_ns), std::memory_order_relaxed);
+    r.stage.store(stage, std::memory_order_relaxed);
+    r.queue_depth.store(queue_depth > UINT16_MAX ? UINT16_MAX : static_cast<std::uint16_t>(queue_depth), std::memory_order_relaxed);
+    r.stamp.store(i + 1, std::memory_order_release);
+  }
+
+  // msync the whole file, blocking. The flush thread calls this
+  void flush();
+
+  const std::string& path() const { return path_; }
+  std::size_t capacity() const { return static_cast<std::size_t>(hdr_->capacity); }
+  std::size_t total_bytes() const { return size_; }
+  std::uint64_t written() const { return hdr_->cursor.load(std::memory_order_relaxed); }
+
+private:
+  void flush_loop(int interval_ms);
+
+  std::string path_;
+  std::size_t size_{0};
+  std::uint8_t* base_{nullptr};
+  FlightHeader* hdr_{nullptr};
+  FlightRecord* records_{nullptr};
+  std::uint64_t mask_{0};
+
+  std::mutex stages_mu_;
+
+  std::mutex flush_mu_;
+  std::condition_variable flush_cv_;
+  bool stop_{false};
+  std::thread flusher_;
+};
+
+// A decoded file, records in write order
+struct FlightEvent {
+  std::uint64_t index;        // Write index, 0-based
+  std::uint64_t sequence_id;
+  std::int64_t start_ns;      // CLOCK_MONOTONIC of the run that wrote the file
+  std::int64_t end_ns;
+  std::uint16_t stage;
+  std::uint16_t queue_depth;
+};
+
+struct FlightDump {
+  std::int32_t writer_pid{0};
+  std::int64_t start_realtime_ns{0};
+  std::int64_t start_monotonic_ns{0};
+  std::uint64_t capacity{0};
+  std::uint64_t written{0};   // Records ever written, the ring keeps the last capacity of them
+  std::uint64_t torn{0};      // Records skipped because a writer was inside them
+  std::vector<std::string> stages;
+  std::vector<FlightEvent> events;
+};
+
+// Reads a flight recorder file, also one that is still being written. Throws std::runtime_error if it isn't one
+FlightDump ReadFlightFile(const std::string& path);
+
+// sequence_id,stage,start_ms,end_ms,duration_ms,queue_depth, times relative to the recorder's start
+void WriteFlightCsv(const FlightDump& dump, std::ostream& out);
+
+// Chrome trace event JSON, one complete event per record and one track per stage
+void WriteFlightTrace(const FlightDump& dump, std::ostream& out);
+
+} // namespace dcp
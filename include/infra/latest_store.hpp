@@ -1,10 +1,14 @@
 #pragma once
 
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
 #include <mutex>
 #include <optional>
 #include <utility>
 
+#include "infra/byte_size.hpp"
+
 /*
     LatestStore is my key to the two-stream pipeline design.
 
@@ -35,10 +39,39 @@ public:
   LatestStore& operator=(const LatestStore&) = delete;
 
   void write(T value) {
+    const std::size_t bytes = ItemBytes(value);
+    std::lock_guard<std::mutex> lock(mu_);
+    latest_ = std::move(value);
+    bytes_ = bytes;
+    has_value_ = true;
+    ++version_;
+  }
+
+  // Copy-assign into the stored value instead of replacing it, so its buffers (e.g. Detections::items) keep their
+  // capacity and a warmed-up writer doesn't allocate
+  void assign(const T& value) {
+    const std::size_t bytes = ItemBytes(value);
+    std::lock_guard<std::mutex> lock(mu_);
+    latest_ = value;
+    bytes_ = bytes;
+    has_value_ = true;
+    ++version_;
+  }
+
+  // write() only if key is above the key of the last write_if_newer (or nothing was written yet). Check and write are
+  // one step, so writers finishing out of order (e.g. the preprocess pool) never replace a newer value with an older
+  // one. Returns false if value was older and dropped
+  bool write_if_newer(T value, std::uint64_t key) {
+    const std::size_t bytes = ItemBytes(value);
     std::lock_guard<std::mutex> lock(mu_);
+    if (has_key_ && key <= key_) return false;
     latest_ = std::move(value);
+    bytes_ = bytes;
     has_value_ = true;
+    has_key_ = true;
+    key_ = key;
     ++version_;
+    return true;
   }
 
   std::optional<T> read_latest() const {
@@ -47,6 +80,24 @@ public:
     return latest_;
   }
 
+  // Read only if something newer than last_seen was written, and update last_seen to the version actually read.
+  // Avoids the version()/read_latest() race where a write lands in between and the same frame is consumed twice
+  std::optional<T> read_if_newer(std::uint64_t& last_seen) const {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (!has_value_ || version_ == last_seen) return std::nullopt;
+    last_seen = version_;
+    return latest_;
+  }
+
+  // read_if_newer into an existing object, reusing its buffers. Returns false (out untouched) if nothing newer
+  bool read_into(T& out, std::uint64_t& last_seen) const {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (!has_value_ || version_ == last_seen) return false;
+    last_seen = version_;
+    out = latest_;
+    return true;
+  }
+
   std::uint64_t version() const {
     std::lock_guard<std::mutex> lock(mu_);
     return version_;
@@ -57,11 +108,18 @@ public:
     return has_value_;
   }
 
+  // Bytes held by the stored value (ItemBytes), 0 before the first write
+  // Lock-free, for monitoring
+  std::size_t bytes() const { return bytes_.load(std::memory_order_relaxed); }
+
 private:
   mutable std::mutex mu_;
   T latest_{};
   bool has_value_{false};
   std::uint64_t version_{0};
+  bool has_key_{false};
+  std::uint64_t key_{0};  // Of the last write_if_newer
+  std::atomic<std::size_t> bytes_{0};
 };
 
 } // namespace dcp
\ No newline at end of file
@@ -1,17 +1,33 @@
 #pragma once
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
+#include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "infra/alloc_counter.hpp"
+#include "infra/flight_recorder.hpp"
+#include "infra/perf_counters.hpp"
+#include "infra/process_stats.hpp"
+
 /*
-  Metrics.hpp implements Metrics, an object owned by the pipeline that stores all stage metrics, and StageMetrics,
-  objects created for each stage to store general performance stats in. Also includes a helper function NowNs which
-  simplifies grabbing the current time in nanoseconds integer format.
+  Metrics.hpp implements Metrics, an object owned by the pipeline that is the registry of every metric series, and
+  StageMetrics, the bundle of series created for each stage to store general performance stats in. Also includes a
+  helper function NowNs which simplifies grabbing the current time in nanoseconds integer format.
+
+  A series is a typed metric (Counter, Gauge, Histogram) in a named family, told apart by labels such as stage, worker
+  or camera. Registering is thread-safe and idempotent: the same name and labels return the same series, so two workers
+  registering one counter share it. Writers never take a lock. Counters and histograms keep kMetricShards
+  cache-line-sized copies, each thread always adds to the same one and readers sum them, so threads sharing a series
+  (e.g. task workers running one stage) don't bounce a cache line. Readers (AnsiDashboard, HudOverlay, the HTTP
+  exporter) walk the registry under its lock, which only registration contends for.
 */
 
 namespace dcp {
@@ -25,43 +41,318 @@ inline std::uint64_t NowNs() {
           .count());
 }
 
-// StageMetrics is a class that contains general performance stats for a stage to log. These stats are used in visualization, e.g., the ANSI dashboard and HUD overlay.
-struct StageMetrics {
+using MetricLabels = std::vector<std::pair<std::string, std::string>>;
+
+enum class MetricType { Counter, Gauge, Histogram };
+
+inline constexpr std::size_t kMetricShards = 8;
+
+// Shard of the calling thread, handed out round-robin on its first write
+inline std::size_t MetricShardIndex() {
+  static std::atomic<std::size_t> next{0};
+  thread_local const std::size_t shard = next.fetch_add(1, std::memory_order_relaxed) % kMetricShards;
+  return shard;
+}
+
+// Monotonic total, e.g. items done or nanoseconds of work
+class Counter {
+public:
+  void add(std::uint64_t n = 1) { shards_[MetricShardIndex()].v.fetch_add(n, std::memory_order_relaxed); }
+
+  std::uint64_t value() const {
+    std::uint64_t sum = 0;
+    for (const auto& s : shards_) sum += s.v.load(std::memory_order_relaxed);
+    return sum;
+  }
+
+private:
+  struct alignas(64) Shard {
+    std::atomic<std::uint64_t> v{0};
+  };
+  Shard shards_[kMetricShards];
+};
+
+// Current value, last write wins, e.g. a moving average or an occupancy
+class Gauge {
+public:
+  void set(std::int64_t v) { v_.store(v, std::memory_order_relaxed); }
+  void add(std::int64_t d) { v_.fetch_add(d, std::memory_order_relaxed); }
+  std::int64_t value() const { return v_.load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<std::int64_t> v_{0};
+};
+
+// Counts of observations per bucket, bucket i holding values <= bounds[i] (and > bounds[i-1]), plus one past the last
+// bound. Keeps the observed sum too
+class Histogram {
+public:
+  explicit Histogram(std::vector<std::uint64_t> bounds);
+
+  void observe(std::uint64_t v) {
+    const std::size_t b = static_cast<std::size_t>(std::lower_bound(bounds_.begin(), bounds_.end(), v) - bounds_.begin());
+    Line* shard = lines_.get() + MetricShardIndex() * lines_per_shard_;
+    shard[b / 8].v[b % 8].fetch_add(1, std::memory_order_relaxed);
+    shard[sum_cell_ / 8].v[sum_cell_ % 8].fetch_add(v, std::memory_order_relaxed);
+  }
+
+  const std::vector<std::uint64_t>& bounds() const { return bounds_; }
+
+  // Per-bucket counts over all shards into counts (resized to bounds().size() + 1, not cumulative). Returns the sum
+  std::uint64_t read(std::vector<std::uint64_t>& counts) const;
+
+private:
+  struct alignas(64) Line {
+    std::atomic<std::uint64_t> v[8];
+  };
+  std::vector<std::uint64_t> bounds_;
+  std::size_t sum_cell_;          // Cell after the buckets
+  std::size_t lines_per_shard_;
+  std::unique_ptr<Line[]> lines_;
+};
+
+// 50 us to 2.5 s, for per-item latencies in ns
+const std::vector<std::uint64_t>& LatencyBucketsNs();
+
+// Quantile q (0..1) from per-bucket counts, interpolated inside the bucket like Prometheus' histogram_quantile. Values
+// past the last bound report the last bound. 0 if counts are all 0
+double HistogramQuantile(const std::vector<std::uint64_t>& bounds, const std::vector<std::uint64_t>& counts, double q);
+
+// One labelled series of a family, exactly one of the members below is set
+struct MetricSeries {
+  MetricLabels labels;
+  std::unique_ptr<Counter> counter;
+  std::unique_ptr<Gauge> gauge;
+  std::unique_ptr<Histogram> histogram;
+  std::function<std::uint64_t()> fn;  // Callback series, the value lives elsewhere (e.g. a queue's drop count)
+
+  // Counter, gauge or callback value, raw
+  double value() const;
+};
+
+struct MetricFamily {
   std::string name;
+  std::string help;
+  MetricType type;
+  double scale;  // Raw value * scale = exported unit, e.g. 1e-9 for series kept in ns and exported in seconds
+  std::vector<std::unique_ptr<MetricSeries>> series;
+};
+
+class Metrics;
+
+// StageMetrics is the bundle of series a stage logs general performance stats to, labelled stage=<name> unless given
+// labels. These stats are used in visualization, e.g., the ANSI dashboard and HUD overlay, and by the exporters
+struct StageMetrics {
+  StageMetrics(Metrics& registry, std::string n, MetricLabels l);
 
-  std::atomic<std::uint64_t> count{0};
-  std::atomic<std::uint64_t> avg_latency_ns{0};
+  std::string name;     // Row on the dashboard and HUD
+  MetricLabels labels;
+
+  Counter& count;
+  Counter& work_ns_total;
+  Histogram& latency_hist;  // Same item latencies, for percentiles
+  Gauge& avg_latency_ns;
+
+  // How old items are when this stage finishes them (capture to done), for stages that report it, e.g. display
+  Gauge& avg_age_ns;
+
+  // Work avoided on purpose (e.g. a grabbed frame that was never decoded because downstream had no room)
+  Counter& skipped;
+  // Work that was done but thrown away before anyone consumed it (e.g. a decoded frame evicted by DropOldest)
+  Counter& wasted;
+  // Heap allocations made while processing items (only counted in DCP_COUNT_ALLOCS builds, see infra/alloc_counter.hpp)
+  Counter& allocs;
+
+  // Thread CPU time and context switches while processing items (see ThreadUsageNow()). CPU well under work_ns_total
+  // means the stage waited (blocked or preempted) rather than computed
+  Counter& cpu_ns_total;
+  Counter& voluntary_switches;
+  Counter& involuntary_switches;
+
+  // Hardware counters while processing items, only registered when metrics.perf_counters is on (see
+  // infra/perf_counters.hpp), null otherwise
+  Counter* cycles{nullptr};
+  Counter* instructions{nullptr};
+  Counter* llc_misses{nullptr};
+  Counter* branch_misses{nullptr};
+
+  // Exported as dcp_stage_idle_seconds
   std::atomic<std::uint64_t> last_event_ns{0};
 
-  std::atomic<std::uint64_t> work_ns_total{0};
+  // Flight recorder this stage appends to (see infra/flight_recorder.hpp), null if none was attached to the registry
+  FlightRecorder* flight{nullptr};
+  std::uint16_t flight_stage{0};
 
-  explicit StageMetrics(std::string n) : name(std::move(n)) {
-    last_event_ns.store(NowNs(), std::memory_order_relaxed);
-  }
   void on_item(std::uint64_t latency_ns) {
-    count.fetch_add(1, std::memory_order_relaxed);
+    count.add();
+    latency_hist.observe(latency_ns);
 
-    auto prev = avg_latency_ns.load(std::memory_order_relaxed);
-    auto next = (prev == 0) ? latency_ns : (prev * 7 + latency_ns) / 8;
-    avg_latency_ns.store(next, std::memory_order_relaxed);
+    const auto prev = static_cast<std::uint64_t>(avg_latency_ns.value());
+    const auto next = (prev == 0) ? latency_ns : (prev * 7 + latency_ns) / 8;
+    avg_latency_ns.set(static_cast<std::int64_t>(next));
 
-    work_ns_total.fetch_add(latency_ns, std::memory_order_relaxed);
+    work_ns_total.add(latency_ns);
     last_event_ns.store(NowNs(), std::memory_order_relaxed);
   }
+
+  void on_age(std::uint64_t age_ns) {
+    const auto prev = static_cast<std::uint64_t>(avg_age_ns.value());
+    const auto next = (prev == 0) ? age_ns : (prev * 7 + age_ns) / 8;
+    avg_age_ns.set(static_cast<std::int64_t>(next));
+  }
+
+  void on_skip(std::uint64_t n = 1) { skipped.add(n); }
+  void on_wasted(std::uint64_t n = 1) { wasted.add(n); }
+  void on_allocs(std::uint64_t n) {
+    if (n > 0) allocs.add(n);
+  }
+  void on_usage(const ThreadUsage& d) {
+    cpu_ns_total.add(d.cpu_ns);
+    if (d.voluntary_switches > 0) voluntary_switches.add(d.voluntary_switches);
+    if (d.involuntary_switches > 0) involuntary_switches.add(d.involuntary_switches);
+  }
+  void on_perf(const PerfSample& d) {
+    if (!cycles || d.cycles == 0) return;
+    cycles->add(d.cycles);
+    instructions->add(d.instructions);
+    llc_misses->add(d.llc_misses);
+    branch_misses->add(d.branch_misses);
+  }
+  // One flight recorder record for the frame just finished, queue_depth = items still waiting in the stage's input (or
+  // whatever stands in for it, e.g. the queue the camera feeds)
+  void on_frame(std::uint64_t sequence_id, SteadyClock::time_point start, std::uint64_t work_ns, std::size_t queue_depth) {
+    if (!flight) return;
+    const auto start_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(start.time_since_epoch()).count();
+    flight->record(flight_stage, sequence_id, static_cast<std::int64_t>(start_ns), work_ns, queue_depth);
+  }
+
+  class Item;
 };
 
-// Metrics is a class that stores StageMetrics, allowing pipelines to own and control all metrics involved in it.
+// One item of a stage's work, as a scope. Construction takes the start time and the thread's allocation, usage and
+// perf counters, destruction (or finish()) reports their differences, the latency, the age if a capture time was set,
+// and the flight recorder record if a sequence id was given, with the depth of `queue` at that moment. A null stage
+// only times the item and reports nothing. Typical use, at the top of a stage's per-item function:
+//   StageMetrics::Item item(metrics_, f.sequence_id, in_.get());
+class StageMetrics::Item {
+public:
+  explicit Item(StageMetrics* m) : m_(m) { begin(); }
+  Item(StageMetrics* m, std::uint64_t sequence_id) : m_(m), seq_(sequence_id), has_seq_(true) { begin(); }
+  template <class Queue>
+  Item(StageMetrics* m, std::uint64_t sequence_id, const Queue* queue) : Item(m, sequence_id) {
+    queue_ = queue;
+    depth_ = [](const void* q) -> std::size_t { return static_cast<const Queue*>(q)->size(); };
+  }
+  ~Item() { finish(); }
+
+  Item(const Item&) = delete;
+  Item& operator=(const Item&) = delete;
+
+  void set_sequence_id(std::uint64_t sequence_id) {
+    seq_ = sequence_id;
+    has_seq_ = true;
+  }
+  void set_capture_time(SteadyClock::time_point t) {
+    capture_ = t;
+    has_capture_ = true;
+  }
+  // Also add the counters and latency to a second bundle (e.g. a pool worker's stage as a whole), no flight record
+  void also_report_to(StageMetrics* m) { also_ = m; }
+  // The item was abandoned, report nothing
+  void cancel() { done_ = true; }
+
+  SteadyClock::time_point start() const { return t0_; }
+
+  // Report now rather than at the end of the scope. Returns the work time, 0 if already reported or cancelled
+  std::uint64_t finish() {
+    if (done_) return 0;
+    done_ = true;
+    const auto t1 = SteadyClock::now();
+    const auto work_ns = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0_).count());
+    if (!m_) return work_ns;
+    const std::uint64_t allocs = ThreadAllocations() - allocs0_;
+    const PerfSample perf = ThreadPerfNow() - perf0_;
+    const ThreadUsage usage = ThreadUsageNow() - usage0_;
+    for (StageMetrics* m : {m_, also_}) {
+      if (!m) continue;
+      m->on_allocs(allocs);
+      m->on_perf(perf);
+      m->on_usage(usage);
+      if (has_capture_) m->on_age(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - capture_).count()));
+      m->on_item(work_ns);
+    }
+    if (has_seq_) m_->on_frame(seq_, t0_, work_ns, queue_ ? depth_(queue_) : 0);
+    return work_ns;
+  }
+
+private:
+  void begin() {
+    t0_ = SteadyClock::now();
+    if (!m_) return;
+    allocs0_ = ThreadAllocations();
+    usage0_ = ThreadUsageNow();
+    perf0_ = ThreadPerfNow();
+  }
+
+  StageMetrics* m_;
+  StageMetrics* also_{nullptr};
+  std::uint64_t seq_{0};
+  bool has_seq_{false};
+  const void* queue_{nullptr};
+  std::size_t (*depth_)(const void*){nullptr};
+  SteadyClock::time_point capture_{};
+  bool has_capture_{false};
+  bool done_{false};
+  SteadyClock::time_point t0_{};
+  std::uint64_t allocs0_{0};
+  ThreadUsage usage0_{};
+  PerfSample perf0_{};
+};
+
+// Metrics is the registry of all series, allowing pipelines to own and control all metrics involved in it.
 class Metrics {
 public:
-  StageMetrics* make_stage(std::string name) {
-    stages_.push_back(std::make_unique<StageMetrics>(std::move(name)));
-    return stages_.back().get();
+  Counter& counter(const std::string& name, const std::string& help, MetricLabels labels = {}, double scale = 1.0);
+  Gauge& gauge(const std::string& name, const std::string& help, MetricLabels labels = {}, double scale = 1.0);
+  // bounds only count for the family's first series, later ones share them
+  Histogram& histogram(const std::string& name, const std::string& help, MetricLabels labels,
+                       const std::vector<std::uint64_t>& bounds, double scale = 1.0);
+  // A counter or gauge whose value is read from fn at collection time. Registering the same series again replaces fn
+  void callback(MetricType type, const std::string& name, const std::string& help, MetricLabels labels,
+                std::function<std::uint64_t()> fn, double scale = 1.0);
+
+  // Registers the stage's series, labels default to {stage=name}. Thread-safe
+  StageMetrics* make_stage(std::string name, MetricLabels labels = {});
+
+  // Stages made after this append per-frame records to recorder, which must outlive the registry. Call before make_stage
+  void set_flight_recorder(FlightRecorder* recorder) { flight_ = recorder; }
+  FlightRecorder* flight_recorder() const { return flight_; }
+
+  std::size_t stage_count() const {
+    std::lock_guard<std::mutex> lk(mu_);
+    return stages_.size();
   }
 
-  const std::vector<std::unique_ptr<StageMetrics>>& stages() const { return stages_; }
+  // Visit stages in registration order / every family, under the registry lock. fn must not register
+  template <class Fn>
+  void for_each_stage(Fn&& fn) const {
+    std::lock_guard<std::mutex> lk(mu_);
+    for (const auto& s : stages_) fn(*s);
+  }
+  template <class Fn>
+  void for_each_family(Fn&& fn) const {
+    std::lock_guard<std::mutex> lk(mu_);
+    for (const auto& f : families_) fn(*f);
+  }
 
 private:
+  // Finds or adds the series, throws std::logic_error if name is already registered with another type
+  MetricSeries& series_locked(MetricType type, const std::string& name, const std::string& help, MetricLabels labels, double scale);
+
+  mutable std::mutex mu_;
+  std::vector<std::unique_ptr<MetricFamily>> families_;
   std::vector<std::unique_ptr<StageMetrics>> stages_;
+  FlightRecorder* flight_{nullptr};
 };
 
-} // namespace dcp
\ No newline at end of file
+} // namespace dcp
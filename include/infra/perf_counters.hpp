@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+/*
+    Opt-in hardware performance counters, per thread (metrics.perf_counters).
+
+    Once EnablePerfCounters(true) is called, the first ThreadPerfNow() on each thread opens a perf_event_open group on
+    that thread: cycles (leader), instructions, cache misses (the kernel's generic event, last-level misses on most
+    CPUs) and branch misses, user space only. Stages sample it around each item like ThreadAllocations() and report
+    the difference through StageMetrics::on_perf, so the dashboard can show IPC and misses per frame. A sample is one
+    read() of the group, about a microsecond.
+
+    Perf is often restricted (containers, seccomp, perf_event_paranoid >= 3, VMs without a PMU). Then the group fails
+    to open, every sample is 0 and PerfCountersStatus() says why. Nothing else changes. Events the CPU lacks read 0 on
+    their own. Samples hold raw counts plus the group's enabled/running times, the difference of two samples is what
+    gets scaled when the kernel multiplexed the group, by that interval's own enabled/running ratio.
+*/
+
+namespace dcp {
+
+struct PerfSample {
+  std::uint64_t cycles{0};
+  std::uint64_t instructions{0};
+  std::uint64_t llc_misses{0};
+  std::uint64_t branch_misses{0};
+  std::uint64_t time_enabled{0};  // ns the group was enabled (scheduled or not), 0 for counts that are already scaled
+  std::uint64_t time_running{0};  // ns of that it was actually on the PMU and counting
+};
+
+// Counts between two samples. Raw deltas first (never below 0), then scaled up if the group was only on the PMU for
+// part of the interval. Scaling each cumulative sample by its own ratio instead can make the later one the smaller
+inline PerfSample operator-(const PerfSample& a, const PerfSample& b) {
+  auto sub = [](std::uint64_t x, std::uint64_t y) -> std::uint64_t { return x > y ? x - y : 0; };
+  PerfSample d{sub(a.cycles, b.cycles),         sub(a.instructions, b.instructions),
+               sub(a.llc_misses, b.llc_misses), sub(a.branch_misses, b.branch_misses),
+               sub(a.time_enabled, b.time_enabled), sub(a.time_running, b.time_running)};
+  if (d.time_running > 0 && d.time_running < d.time_enabled) {
+    const double scale = static_cast<double>(d.time_enabled) / static_cast<double>(d.time_running);
+    for (std::uint64_t* v : {&d.cycles, &d.instructions, &d.llc_misses, &d.branch_misses}) {
+      *v = static_cast<std::uint64_t>(static_cast<double>(*v) * scale);
+    }
+  }
+  return d;
+}
+
+// Turns sampling on (or off) for every thread. Call before the stages start
+void EnablePerfCounters(bool on);
+bool PerfCountersEnabled();
+
+// True once some thread opened its counters
+bool PerfCountersAvailable();
+
+// "off", "on", "not opened yet" or "unavailable: <why>", for the dashboard
+std::string PerfCountersStatus();
+
+// Counters of the calling thread so far, opening them on the first call. All 0 if disabled or unavailable
+PerfSample ThreadPerfNow();
+
+} // namespace dcp
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+
+/*
+    Process-level resource numbers for the dashboards. Cheap enough to call every refresh.
+
+    ThreadUsageNow() is the per-thread counterpart, two syscalls (~0.5 us together) that stages sample around each item
+    like ThreadAllocations(), so the dashboard can tell a stage that burns CPU from one that is blocked or preempted.
+*/
+
+namespace dcp {
+
+// Resident set size of this process in bytes, 0 if the platform doesn't tell us
+std::uint64_t ProcessRssBytes();
+
+// User + system CPU time of all threads of this process so far, in ns. 0 if the platform doesn't tell us
+std::uint64_t ProcessCpuNs();
+
+// CPU time and context switches of the calling thread so far. Fields the platform doesn't give stay 0
+struct ThreadUsage {
+  std::uint64_t cpu_ns{0};                // CLOCK_THREAD_CPUTIME_ID
+  std::uint64_t voluntary_switches{0};    // Gave up the CPU: blocked on a lock, I/O, a sleep
+  std::uint64_t involuntary_switches{0};  // Preempted: the scheduler took the CPU away
+};
+
+ThreadUsage ThreadUsageNow();
+
+inline ThreadUsage operator-(const ThreadUsage& a, const ThreadUsage& b) {
+  return {a.cpu_ns - b.cpu_ns, a.voluntary_switches - b.voluntary_switches, a.involuntary_switches - b.involuntary_switches};
+}
+
+} // namespace dcp
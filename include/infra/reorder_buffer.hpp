@@ -0,0 +1,159 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <utility>
+
+/*
+    ReorderBuffer puts items finished by several workers back into sequence order.
+
+    Workers call begin(seq) when they take an item (under the same lock they popped it with, so the in-flight set is exact)
+    and complete(seq, item, emit) when done. An item is released, in order, as soon as no smaller sequence number is
+    still in flight. Sequence gaps caused by upstream drops therefore never stall the buffer, only slow workers do.
+
+    Bounded:
+        - at most `window` finished items are held. Past that the smallest one is released even if an older item is still in flight
+        - an item never waits longer than `max_wait`
+    A straggler that finishes after a newer item was released is late and gets dropped (counted in late_drops).
+
+    emit(T&&, wait_ns) is called with the internal lock held so releases stay ordered. Keep it cheap (e.g. a try_push).
+*/
+
+namespace dcp {
+
+template <typename T>
+class ReorderBuffer {
+public:
+  ReorderBuffer(std::size_t window, std::chrono::nanoseconds max_wait)
+      : window_(window == 0 ? 1 : window), max_wait_ns_(static_cast<std::uint64_t>(max_wait.count())) {}
+
+  ReorderBuffer(const ReorderBuffer&) = delete;
+  ReorderBuffer& operator=(const ReorderBuffer&) = delete;
+
+  // A worker took seq and is processing it
+  void begin(std::uint64_t seq) {
+    std::lock_guard<std::mutex> lock(mu_);
+    in_flight_.insert(seq);
+  }
+
+  // The worker produced nothing for seq (e.g. empty frame), stop waiting for it
+  template <typename Emit>
+  void abandon(std::uint64_t seq, std::uint64_t now_ns, Emit&& emit) {
+    std::lock_guard<std::mutex> lock(mu_);
+    erase_in_flight(seq);
+    release_locked(now_ns, emit);
+  }
+
+  // The worker finished seq. Returns false if it arrived too late and was dropped
+  template <typename Emit>
+  bool complete(std::uint64_t seq, T item, std::uint64_t now_ns, Emit&& emit) {
+    std::lock_guard<std::mutex> lock(mu_);
+    erase_in_flight(seq);
+
+    if (has_released_ && seq <= last_released_) {
+      ++late_drops_;
+      release_locked(now_ns, emit);
+      return false;
+    }
+
+    held_.emplace(seq, Held{std::move(item), now_ns});
+    held_count_.store(held_.size(), std::memory_order_relaxed);
+    release_locked(now_ns, emit);
+    return true;
+  }
+
+  // Release anything whose max_wait expired. Call periodically when no completions arrive
+  template <typename Emit>
+  void drain(std::uint64_t now_ns, Emit&& emit) {
+    std::lock_guard<std::mutex> lock(mu_);
+    release_locked(now_ns, emit);
+  }
+
+  // Getters
+
+  // held() and late_drops_total() are lock-free, for monitoring
+  std::size_t held() const { return held_count_.load(std::memory_order_relaxed); }
+
+  std::size_t window() const { return window_; }
+
+  std::uint64_t released_total() const {
+    std::lock_guard<std::mutex> lock(mu_);
+    return released_;
+  }
+
+  // Items released while an older item was still in flight (window full or max_wait hit)
+  std::uint64_t forced_total() const {
+    std::lock_guard<std::mutex> lock(mu_);
+    return forced_;
+  }
+
+  std::uint64_t late_drops_total() const { return late_drops_.load(std::memory_order_relaxed); }
+
+private:
+  struct Held {
+    T item;
+    std::uint64_t done_ns;
+  };
+
+  // Callers sample their clock before taking the lock, so now_ns can trail a done_ns stored by another thread
+  static std::uint64_t Elapsed(std::uint64_t now_ns, std::uint64_t then_ns) {
+    return now_ns > then_ns ? now_ns - then_ns : 0;
+  }
+
+  void erase_in_flight(std::uint64_t seq) {
+    auto it = in_flight_.find(seq);
+    if (it != in_flight_.end()) in_flight_.erase(it);
+  }
+
+  template <typename Emit>
+  void release_locked(std::uint64_t now_ns, Emit& emit) {
+    while (!held_.empty()) {
+      auto it = held_.begin();
+      const std::uint64_t seq = it->first;
+
+      // Only in-flight items that can still be released count. Anything at or below last_released_ will arrive late anyway
+      auto oldest = has_released_ ? in_flight_.upper_bound(last_released_) : in_flight_.begin();
+      const bool blocked = oldest != in_flight_.end() && *oldest < seq;
+      bool forced = false;
+      if (blocked) {
+        const bool over_window = held_.size() > window_;
+        const bool expired = Elapsed(now_ns, it->second.done_ns) >= max_wait_ns_;
+        if (!over_window && !expired) return;
+        forced = true;
+      }
+
+      const std::uint64_t wait_ns = Elapsed(now_ns, it->second.done_ns);
+      T item = std::move(it->second.item);
+      held_.erase(it);
+      held_count_.store(held_.size(), std::memory_order_relaxed);
+
+      last_released_ = seq;
+      has_released_ = true;
+      ++released_;
+      if (forced) ++forced_;
+
+      emit(std::move(item), wait_ns);
+    }
+  }
+
+  const std::size_t window_;
+  const std::uint64_t max_wait_ns_;
+
+  mutable std::mutex mu_;
+  std::multiset<std::uint64_t> in_flight_;
+  std::map<std::uint64_t, Held> held_;
+
+  std::uint64_t last_released_{0};
+  bool has_released_{false};
+
+  std::uint64_t released_{0};
+  std::uint64_t forced_{0};
+  std::atomic<std::uint64_t> late_drops_{0};
+  std::atomic<std::size_t> held_count_{0};   // held_.size()
+};
+
+} // namespace dcp
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+    Shared-memory publication of frames and tracks to other processes on the same box.
+
+    One POSIX shared-memory object per stream (shm_open name, e.g. "/dcp") holds:
+      - ShmHeader: layout, publish counters and a heartbeat
+      - a world ring: the last world_slots ShmWorldRecords (tracks of one frame each)
+      - a frame ring: the last frame_slots frames, ShmFrameInfo followed by the pixels
+
+    Every slot has a seqlock header. The writer makes the sequence odd, writes the slot, stores the publication index
+    and makes it even again. It never waits for anyone. Readers map the object read-only, so they can't disturb the
+    writer or each other, and check the sequence before and after reading: a change means the writer lapped them
+    while they were reading, and the read is thrown away. Publication indices are 1-based and increase by one per
+    publish, so a reader walking the ring in order sees exactly how many records it missed (overruns).
+
+    Frame pixels are read in place: ShmReader hands out a ShmFrameView pointing into the mapping, and valid() says
+    whether the slot is still the one the view was taken on. Work on the pixels first, then check valid() before
+    trusting the result.
+
+    This header and its .cpp only need libc, so out-of-process consumers link the small dcp_shm library without
+    OpenCV. ShmWriter is used by ShmPublisherStage.
+*/
+
+namespace dcp {
+
+inline constexpr std::uint32_t kShmMagic = 0x53504344;  // "DCPS"
+inline constexpr std::uint32_t kShmVersion = 1;
+inline constexpr std::size_t kShmMaxTracks = 128;
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "shared-memory seqlocks need lock-free 64-bit atomics");
+
+// Fixed layout, the same in every process that maps the object
+struct ShmTrack {
+  std::uint64_t id;
+  float x, y, w, h;         // Pixels in the published frame
+  float confidence;
+  std::int32_t class_id;
+  std::int32_t missed_frames;
+  std::int32_t age_frames;
+  std::uint32_t confirmed;
+  std::uint32_t reserved;
+};
+static_assert(sizeof(ShmTrack) == 48, "ShmTrack layout changed, bump kShmVersion");
+
+struct ShmWorldRecord {
+  std::uint64_t index;        // Publication number, 1-based
+  std::uint64_t frame_id;     // Tracking's frame id
+  std::uint64_t sequence_id;  // Camera sequence id, matches ShmFrameInfo::sequence_id
+  std::int64_t capture_ns;    // CLOCK_MONOTONIC (steady_clock), comparable across processes
+  std::uint32_t track_count;
+  std::uint32_t reserved;
+  ShmTrack tracks[kShmMaxTracks];
+};
+
+struct ShmFrameInfo {
+  std::uint64_t index;        // Publication number, 1-based
+  std::uint64_t sequence_id;
+  std::int64_t capture_ns;
+  std::int32_t width;
+  std::int32_t height;
+  std::int32_t type;          // OpenCV type, e.g. 16 = CV_8UC3 (BGR)
+  std::int32_t stride;        // Bytes per row
+  std::uint64_t bytes;        // stride * height
+};
+
+struct alignas(64) ShmSlotHeader {
+  std::atomic<std::uint64_t> seq;     // Odd while the writer is in the slot
+  std::atomic<std::uint64_t> index;   // Publication held, 0 = never written
+};
+
+struct alignas(64) ShmHeader {
+  std::uint32_t magic;
+  std::uint32_t version;
+  std::int32_t writer_pid;
+  std::uint32_t world_slots;
+  std::uint32_t frame_slots;
+  std::uint32_t reserved;
+  std::uint64_t world_offset;     // From the start of the mapping
+  std::uint64_t world_stride;
+  std::uint64_t frame_offset;
+  std::uint64_t frame_stride;
+  std::uint64_t frame_capacity;   // Largest frame a slot holds, bytes
+  std::uint64_t total_bytes;
+
+  std::atomic<std::uint64_t> world_published;   // Index of the newest world record
+  std::atomic<std::uint64_t> frame_published;
+  std::atomic<std::int64_t> heartbeat_ns;       // Last publish, CLOCK_MONOTONIC
+  std::atomic<std::uint32_t> ready;             // Set last, once the layout above is valid
+};
+
+// Bytes of a slot's pixels, from the start of the slot
+inline constexpr std::size_t kShmFramePixelsOffset = 4096;
+
+class ShmWriter {
+public:
+  // Creates (replacing any stale object of that name) and maps it. Throws std::runtime_error on failure
+  ShmWriter(std::string name, std::size_t world_slots, std::size_t frame_slots, std::size_t frame_capacity);
+  // Unlinks the name. Readers that still have it mapped keep their mapping
+  ~ShmWriter();
+
+  ShmWriter(const ShmWriter&) = delete;
+  ShmWriter& operator=(const ShmWriter&) = delete;
+
+  // Publish tracks. rec.index is filled in
+  void publish_world(ShmWorldRecord& rec);
+
+  // Frame in two steps so the caller writes the pixels straight into the slot: begin_frame() returns the slot's
+  // pixel memory (frame_capacity bytes), commit_frame() publishes it
+  std::uint8_t* begin_frame();
+  void commit_frame(ShmFrameInfo info);
+
+  const std::string& name() const { return name_; }
+  std::size_t frame_capacity() const { return static_cast<std::size_t>(hdr_->frame_capacity); }
+  std::size_t total_bytes() const { return size_; }
+
+private:
+  ShmSlotHeader* world_slot(std::uint64_t index) const;
+  ShmSlotHeader* frame_slot(std::uint64_t index) const;
+
+  std::string name_;
+  std::uint8_t* base_{nullptr};
+  std::size_t size_{0};
+  ShmHeader* hdr_{nullptr};
+  ShmSlotHeader* open_frame_{nullptr};   // Between begin_frame and commit_frame
+  std::uint64_t open_index_{0};
+  std::uint64_t open_seq_{0};
+};
+
+// Zero-copy view of one published frame, valid until the writer laps the ring
+struct ShmFrameView {
+  ShmFrameInfo info{};
+  const std::uint8_t* pixels{nullptr};
+
+  // Still the frame the view was taken on. Check after using the pixels
+  bool valid() const;
+
+  // Set by ShmReader
+  const ShmSlotHeader* slot_{nullptr};
+  std::uint64_t seq_{0};
+};
+
+enum class ShmRead {
+  Ok,
+  Empty,    // Nothing new published
+  Retry     // The writer was in the slot, try again
+};
+
+class ShmReader {
+public:
+  // Maps an existing object read-only. Throws std::runtime_error if it doesn't exist or isn't ours
+  explicit ShmReader(const std::string& name);
+  ~ShmReader();
+
+  ShmReader(const ShmReader&) = delete;
+  ShmReader& operator=(const ShmReader&) = delete;
+
+  // Next world record in publication order, starting at the newest one when the reader opens. Records the writer
+  // overwrote before we got to them are skipped and counted in world_overruns()
+  ShmRead next_world(ShmWorldRecord& out);
+  // Newest world record only
+  ShmRead latest_world(ShmWorldRecord& out);
+
+  // Same for frames, as zero-copy views
+  ShmRead next_frame(ShmFrameView& out);
+  ShmRead latest_frame(ShmFrameView& out);
+
+  std::uint64_t world_overruns() const { return world_overruns_; }
+  std::uint64_t frame_overruns() const { return frame_overruns_; }
+
+  // Something was published within max_age_ns (the publisher runs and the pipeline is moving)
+  bool writer_alive(std::int64_t max_age_ns = 2'000'000'000) const;
+
+  const ShmHeader& header() const { return *hdr_; }
+
+private:
+  ShmRead read_world(std::uint64_t index, ShmWorldRecord& out) const;
+  ShmRead read_frame(std::uint64_t index, ShmFrameView& out) const;
+
+  std::uint8_t* base_{nullptr};
+  std::size_t size_{0};
+  const ShmHeader* hdr_{nullptr};
+
+  std::uint64_t next_world_{0};   // 0 = start at the newest
+  std::uint64_t next_frame_{0};
+  std::uint64_t world_overruns_{0};
+  std::uint64_t frame_overruns_{0};
+};
+
+// CLOCK_MONOTONIC in ns, the clock capture_ns and heartbeat_ns use
+std::int64_t ShmNowNs();
+
+} // namespace dcp
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "infra/shm_infer_limits.hpp"
+
+/*
+    Request/response channel between the pipeline and an out-of-process inference worker, over POSIX shared memory.
+
+    The pipeline (ShmInferClient) creates the object and the worker (ShmInferServer) maps it. One request is in flight
+    at a time, which is all inference does anyway:
+      - the client writes up to max_batch frames (fixed-layout ShmInferFrame + pixels in place) and bumps request_seq
+      - the worker reads the pixels where they are, runs the model, writes fixed-layout ShmDetections and sets
+        response_seq to the request it answered
+    Both sequence words double as futex words on Linux, so neither side spins or polls while waiting. Elsewhere the
+    waits fall back to short sleeps.
+
+    Nothing is serialized: frames and detections are plain structs at fixed offsets, and the worker wraps the pixels
+    without copying them. The client side is the only copy, from the preprocessed frame into the request slot.
+
+    A worker that dies or hangs mid-request never corrupts anything the client reads: the client only looks at a
+    response whose sequence matches its request, and reset_worker() abandons the outstanding one before a new worker
+    is started. A new worker ignores whatever request was pending when it attached.
+*/
+
+namespace dcp {
+
+inline constexpr std::uint32_t kShmInferMagic = 0x49504344;  // "DCPI"
+inline constexpr std::uint32_t kShmInferVersion = 1;
+
+struct ShmInferFrame {
+  std::uint64_t source_frame_id;
+  std::int64_t capture_ns;      // CLOCK_MONOTONIC
+  std::int32_t width;
+  std::int32_t height;
+  std::int32_t type;            // OpenCV type of the preprocessed image
+  std::int32_t stride;          // Bytes per row, rows are packed
+  std::uint64_t bytes;
+  std::int32_t roi_applied;     // PreprocessInfo, so the worker maps boxes back like in-process inference does
+  std::int32_t roi_x, roi_y, roi_w, roi_h;
+  std::int32_t resize_width;
+  std::int32_t resize_height;
+  std::int32_t reserved;
+};
+
+struct ShmDetection {
+  float x, y, w, h;
+  std::int32_t class_id;
+  float confidence;
+};
+static_assert(sizeof(ShmDetection) == 24, "ShmDetection layout changed, bump kShmInferVersion");
+
+struct ShmInferResult {
+  std::uint64_t source_frame_id;
+  std::uint32_t detection_count;
+  std::uint32_t truncated;      // Detections past max_detections that were dropped
+};
+
+enum class ShmWorkerState : std::uint32_t {
+  Starting = 0,   // No worker yet, or loading the model
+  Ready = 1,
+  Failed = 2      // Model failed to load, the worker exits
+};
+
+struct alignas(64) ShmInferHeader {
+  std::uint32_t magic;
+  std::uint32_t version;
+  std::uint32_t max_batch;
+  std::uint32_t max_detections;   // Per frame
+  std::uint64_t frame_capacity;   // Bytes per request frame
+  std::uint64_t pixels_offset;    // From the start of the mapping, max_batch * frame_capacity
+  std::uint64_t detections_offset;
+  std::uint64_t total_bytes;
+
+  // Request, written by the client while nothing is outstanding
+  std::uint32_t request_count;
+  std::uint32_t reserved;
+  ShmInferFrame frames[kShmInferMaxBatch];
+
+  // Response, written by the worker while it handles the request
+  std::uint32_t response_count;
+  std::int32_t status;            // 0 = ok, otherwise the run failed and the results are empty
+  std::int64_t run_ns;            // Worker time spent on the request, the rest of the round trip is IPC
+  ShmInferResult results[kShmInferMaxBatch];
+
+  alignas(64) std::atomic<std::uint32_t> request_seq;    // Futex word the worker waits on
+  alignas(64) std::atomic<std::uint32_t> response_seq;   // Futex word the client waits on
+  alignas(64) std::atomic<std::uint32_t> worker_state;   // ShmWorkerState
+  std::atomic<std::int32_t> worker_pid;
+  std::atomic<std::uint32_t> batch_dynamic;              // The worker's model takes batches
+  std::atomic<std::uint32_t> shutdown;                   // Client asks the worker to exit
+  std::atomic<std::int64_t> heartbeat_ns;                // Worker, at least every wait timeout
+  std::atomic<std::uint32_t> ready;                      // Set last by the client, once the layout is valid
+};
+
+// Pipeline side. Creates the object (replacing a stale one), throws std::runtime_error on failure
+class ShmInferClient {
+public:
+  ShmInferClient(std::string name, std::size_t max_batch, std::size_t frame_capacity, std::size_t max_detections);
+  ~ShmInferClient();
+
+  ShmInferClient(const ShmInferClient&) = delete;
+  ShmInferClient& operator=(const ShmInferClient&) = delete;
+
+  // Request slot i: fill the pixels (frame_capacity bytes) and the frame record, then submit
+  std::uint8_t* pixels(std::size_t i);
+  ShmInferFrame& frame(std::size_t i);
+  // Hands count frames to the worker, returns the request's sequence
+  std::uint32_t submit(std::size_t count);
+
+  // Waits up to timeout_ns for the response to seq. False on timeout, the request stays outstanding
+  bool wait_response(std::uint32_t seq, std::int64_t timeout_ns) const;
+
+  // Valid after wait_response() returned true, until the next submit
+  std::int32_t status() const { return hdr_->status; }
+  std::int64_t run_ns() const { return hdr_->run_ns; }
+  std::size_t response_count() const { return hdr_->response_count; }
+  const ShmInferResult& result(std::size_t i) const { return hdr_->results[i]; }
+  const ShmDetection* detections(std::size_t i) const;
+
+  // Before starting a (new) worker: forget the outstanding request and the old worker's state. Only call once the
+  // old worker process is gone
+  void reset_worker();
+  void request_shutdown();
+
+  ShmWorkerState worker_state() const { return static_cast<ShmWorkerState>(hdr_->worker_state.load(std::memory_order_acquire)); }
+  bool batch_dynamic() const { return hdr_->batch_dynamic.load(std::memory_order_acquire) != 0; }
+
+  const std::string& name() const { return name_; }
+  std::size_t max_batch() const { return hdr_->max_batch; }
+  std::size_t frame_capacity() const { return static_cast<std::size_t>(hdr_->frame_capacity); }
+  std::size_t max_detections() const { return hdr_->max_detections; }
+  std::size_t total_bytes() const { return size_; }
+
+private:
+  std::string name_;
+  std::uint8_t* base_{nullptr};
+  std::size_t size_{0};
+  ShmInferHeader* hdr_{nullptr};
+};
+
+// Worker side. Maps an existing object, throws std::runtime_error if it doesn't exist or isn't ours
+class ShmInferServer {
+public:
+  explicit ShmInferServer(const std::string& name);
+  ~ShmInferServer();
+
+  ShmInferServer(const ShmInferServer&) = delete;
+  ShmInferServer& operator=(const ShmInferServer&) = delete;
+
+  void set_ready(bool batch_dynamic);
+  void set_failed();
+
+  // Waits up to timeout_ns for a request this worker hasn't answered. False on timeout or shutdown
+  bool wait_request(std::int64_t timeout_ns);
+  bool shutdown_requested() const { return hdr_->shutdown.load(std::memory_order_acquire) != 0; }
+
+  std::size_t request_count() const { return hdr_->request_count; }
+  const ShmInferFrame& frame(std::size_t i) const { return hdr_->frames[i]; }
+  const std::uint8_t* pixels(std::size_t i) const;
+
+  ShmInferResult& result(std::size_t i) { return hdr_->results[i]; }
+  ShmDetection* detections(std::size_t i);
+  std::size_t max_detections() const { return hdr_->max_detections; }
+
+  // Publishes the response to the request wait_request() returned
+  void complete(std::size_t count, std::int32_t status, std::int64_t run_ns);
+
+private:
+  std::uint8_t* base_{nullptr};
+  std::size_t size_{0};
+  ShmInferHeader* hdr_{nullptr};
+  std::uint32_t pending_{0};   // Sequence of the request being handled
+  std::uint32_t handled_{0};
+};
+
+} // namespace dcp
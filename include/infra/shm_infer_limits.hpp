@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstddef>
+
+// Fixed sizes of the shared-memory inference channel (infra/shm_infer_channel.hpp), on their own so config
+// validation can check against them without pulling in the channel
+
+namespace dcp {
+
+inline constexpr std::size_t kShmInferMaxBatch = 8;  // Frames per request, the slot arrays are sized for this
+
+} // namespace dcp
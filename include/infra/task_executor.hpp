@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "infra/stop_token.hpp"
+#include "infra/thread_runner.hpp"
+
+/*
+    TaskExecutor is a fixed-size work-stealing pool, the alternative to one ThreadRunner per stage.
+
+    Each worker owns a deque per priority lane. Tasks submitted from a worker go to that worker's own deque,
+    tasks submitted from outside are spread round-robin. A worker serves lanes in priority order: its own High lane,
+    then High work stolen from other workers, then its own Normal lane, then stolen Normal work. Idle workers sleep
+    until something is submitted.
+
+    Stages run on it through Stage::start(StopToken, TaskExecutor&, TaskPriority), see stage.hpp.
+*/
+
+namespace dcp {
+
+enum class TaskPriority {
+  High = 0,   // Latency critical (tracking, display)
+  Normal = 1
+};
+
+class TaskExecutor {
+public:
+  using Task = std::function<void()>;
+
+  // workers == 0 means one per hardware thread. thread_cfg applies to every worker
+  explicit TaskExecutor(std::size_t workers, std::string name = "exec", ThreadConfig thread_cfg = {});
+  ~TaskExecutor();
+
+  TaskExecutor(const TaskExecutor&) = delete;
+  TaskExecutor& operator=(const TaskExecutor&) = delete;
+
+  void submit(TaskPriority prio, Task task);
+
+  // Stop accepting work, let workers finish their current task and join them. Queued tasks are discarded
+  void stop();
+
+  std::size_t worker_count() const { return workers_.size(); }
+  bool stopped() const { return stop_.stop_requested(); }
+
+  std::uint64_t executed_total() const { return executed_.load(std::memory_order_relaxed); }
+  std::uint64_t stolen_total() const { return stolen_.load(std::memory_order_relaxed); }
+  std::size_t pending() const { return pending_.load(std::memory_order_relaxed); }
+
+private:
+  static constexpr std::size_t kLanes = 2;
+
+  struct Worker {
+    std::mutex mu;
+    std::deque<Task> lanes[kLanes];
+    std::unique_ptr<ThreadRunner> runner;
+  };
+
+  bool pop_local(std::size_t self, std::size_t lane, Task& out);
+  bool steal(std::size_t self, std::size_t lane, Task& out);
+  bool next_task(std::size_t self, Task& out);
+  void worker_loop(std::size_t self, const StopToken& global, const std::atomic_bool& local);
+
+  std::string name_;
+  std::vector<std::unique_ptr<Worker>> workers_;
+  StopSource stop_;
+
+  std::atomic<std::size_t> next_worker_{0};
+  std::atomic<std::size_t> pending_{0};
+  std::atomic<std::uint64_t> executed_{0};
+  std::atomic<std::uint64_t> stolen_{0};
+
+  std::mutex sleep_mu_;
+  std::condition_variable sleep_cv_;
+};
+
+} // namespace dcp
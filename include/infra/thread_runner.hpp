@@ -1,10 +1,13 @@
 #pragma once
 #include <atomic>
 #include <functional>
+#include <mutex>
 #include <string>
 #include <thread>
 
+#include "core/config.hpp"
 #include "infra/stop_token.hpp"
+#include "infra/thread_tuning.hpp"
 
 /*
     ThreadRunner is a simple utility for basic thread usage. It owns one worker thread
@@ -12,6 +15,8 @@
         - Consistent start/stop behavior
         - A local_stop flag for stopping the singular worker thread
         - Read-only access to a global_stop flag for stopping on entire system shutdowns
+        - Thread naming, CPU pinning and scheduling policy from a ThreadConfig, applied by the new thread before fn runs.
+          What actually took effect is kept in report(), and printed once when the config asked for anything
 
 */
 
@@ -33,10 +38,17 @@ public:
 
   ~ThreadRunner();
 
+  // Scheduling for the thread. Call before start()
+  void set_thread_config(ThreadConfig cfg) { thread_cfg_ = std::move(cfg); }
+  const ThreadConfig& thread_config() const { return thread_cfg_; }
+
   // Start the thread
   // Pass in StopToken to check for when to stop thread, and fn to do the actual work 
   void start(StopToken global_stop, Fn fn);
 
+  // Settings in effect on the thread. Empty name until the thread has applied them
+  ThreadReport report() const;
+
   // Request this specific thread to stop. Does NOT affect other threads
   void request_stop();
   // Returns true if either global or local stop flags are true
@@ -52,7 +64,11 @@ private:
   std::thread thread_;                    // The thread itself
   std::atomic_bool local_stop_{false};    // Flag that stops this thread only
   StopToken global_stop_{};               // Class that is used to check on StopSource's global_stop flag. Causes all threads to stop
-  std::string name_{"thread"};            // Thread name, used for simple debugging/profiling
+  std::string name_{"thread"};            // Thread name, set on the OS thread too so top/perf show it
+  ThreadConfig thread_cfg_{};             // Pinning/policy applied when the thread starts
+
+  mutable std::mutex report_mu_;
+  ThreadReport report_{};
 };
 
 } // namespace dcp
\ No newline at end of file
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "core/config.hpp"
+
+/*
+    Per-thread naming, CPU pinning and scheduling policy.
+
+    ApplyThreadConfig() is called by a thread on itself (ThreadRunner does it first thing in the new thread). Each
+    setting is applied, then read back from the kernel, so the report shows what we actually got, not what we asked for.
+    Nothing here is fatal. If a CPU doesn't exist it is dropped from the set, and if SCHED_FIFO/RR or a negative nice
+    is denied (no CAP_SYS_NICE) we fall back to SCHED_OTHER / nice 0 and say so in the report's notes.
+
+    Linux only for pinning/policy/nice. Elsewhere only the name is set and the rest is reported as unsupported.
+*/
+
+namespace dcp {
+
+struct ThreadReport {
+  std::string name;
+  long tid{0};
+  std::vector<int> cpus{};      // Effective affinity, empty = unknown
+  std::string policy{"other"};  // Effective policy
+  int priority{0};              // Effective realtime priority
+  int nice{0};                  // Effective nice
+  std::string notes{};          // Fallbacks and failures, empty when everything applied as configured
+};
+
+// Apply name + cfg to the calling thread and return what is now in effect
+ThreadReport ApplyThreadConfig(const std::string& name, const ThreadConfig& cfg);
+
+// True if cfg asks for pinning, a policy or a nice value, i.e. ApplyThreadConfig does more than name the thread
+bool ThreadConfigRequested(const ThreadConfig& cfg);
+
+// One line, e.g. "camera_stage tid=4121 cpus=0 policy=fifo:50 nice=0"
+std::string FormatThreadReport(const ThreadReport& r);
+
+// "0-3,6" style list, "any" when empty
+std::string FormatCpuList(const std::vector<int>& cpus);
+
+// Number of CPUs this process may run on (respects cgroup/taskset limits on Linux)
+int AvailableCpuCount();
+
+} // namespace dcp
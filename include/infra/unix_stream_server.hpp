@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+/*
+  UnixStreamServer fans a message stream out to local subscribers over a SOCK_STREAM Unix domain socket.
+
+  Everything is non-blocking and runs on the caller's thread: poll() accepts new subscribers and flushes what is
+  buffered, publish() queues one message for every subscriber and flushes. Each subscriber has its own send buffer
+  capped at buffer_bytes, so a slow or stalled one never holds up the publisher or the others.
+
+  The stream is made of deltas with a keyframe on demand. A subscriber whose buffer can't take the next delta loses
+  its backlog (every whole message not started yet; a message half sent is finished so framing stays intact) and is
+  resynced with a keyframe, as is every new subscriber. The keyframe callback is only called when some subscriber
+  needs one. Subscribers never see a gap between a delta and the state it applies to.
+
+  Counters are atomics for the dashboard thread; everything else belongs to the publishing thread. Libc only.
+*/
+
+namespace dcp {
+
+class UnixStreamServer {
+public:
+  struct Options {
+    std::string path;                   // Socket file, a stale one is replaced
+    std::size_t max_clients = 8;        // Connections past this are closed right away
+    std::size_t buffer_bytes = 256 * 1024;
+  };
+
+  using KeyframeFn = std::function<const std::vector<std::uint8_t>&()>;
+
+  // Binds and listens. Throws std::runtime_error if the socket can't be set up
+  explicit UnixStreamServer(Options opts);
+  // Disconnects everyone and removes the socket file
+  ~UnixStreamServer();
+
+  UnixStreamServer(const UnixStreamServer&) = delete;
+  UnixStreamServer& operator=(const UnixStreamServer&) = delete;
+
+  void poll();
+  void publish(const std::vector<std::uint8_t>& delta, const KeyframeFn& keyframe);
+
+  const std::string& path() const { return opts_.path; }
+  std::size_t max_clients() const { return opts_.max_clients; }
+  std::size_t clients() const { return client_count_.load(std::memory_order_relaxed); }
+  std::uint64_t bytes_sent() const { return bytes_sent_.load(std::memory_order_relaxed); }
+  std::uint64_t messages_dropped() const { return dropped_.load(std::memory_order_relaxed); }
+  std::uint64_t keyframes_sent() const { return keyframes_.load(std::memory_order_relaxed); }
+
+private:
+  struct Client {
+    int fd{-1};
+    std::vector<std::uint8_t> buf;      // Reserved to buffer_bytes once, [head, size) is unsent
+    std::size_t head{0};
+    std::vector<std::size_t> ends;      // End offset of each message in buf, [first_end, size) not fully sent
+    std::size_t first_end{0};
+    bool need_keyframe{true};
+  };
+
+  void accept_new();
+  bool append(Client& c, const std::vector<std::uint8_t>& msg);
+  void drop_backlog(Client& c);
+  bool flush(Client& c);                // False once the subscriber is gone
+  void close_client(Client& c);
+
+  Options opts_;
+  int listen_fd_{-1};
+  std::vector<Client> clients_;
+
+  std::atomic<std::size_t> client_count_{0};
+  std::atomic<std::uint64_t> bytes_sent_{0};
+  std::atomic<std::uint64_t> dropped_{0};
+  std::atomic<std::uint64_t> keyframes_{0};
+};
+
+} // namespace dcp
@@ -2,6 +2,7 @@
 
 #include <cstdint>
 #include <memory>
+#include <string>
 
 #include "core/config.hpp"
 #include "infra/metrics.hpp"
@@ -13,7 +14,7 @@ namespace dcp {
 
 class CameraStage final : public Stage {
 public:
-  CameraStage(StageMetrics* metrics, CameraConfig cfg, std::shared_ptr<BoundedQueue<Frame>> out);
+  CameraStage(StageMetrics* metrics, CameraConfig cfg, std::shared_ptr<BoundedQueue<Frame>> out, std::string name = "camera_stage");
 
 protected:
   void run(const StopToken& global_stop,
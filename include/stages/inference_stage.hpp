@@ -2,20 +2,55 @@
 
 #include <cstdint>
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "core/config.hpp"
 #include "infra/metrics.hpp"
 #include "core/preprocessed_frame.hpp"
 #include "core/detections.hpp"
+#include "infra/demand_signal.hpp"
 #include "infra/latest_store.hpp"
 #include "stages/stage.hpp"
 
+#include "core/inference_worker.hpp"
 #include "core/yolo_dnn.hpp"
 
+/*
+  InferenceStage is the shared inference scheduler. It owns the single YoloDnn and serves every camera stream,
+  each of which hands it a preprocessed LatestStore and gets detections back through its own detections LatestStore.
+
+  Scheduling: among streams with a frame not yet inferred, streams that are below their min_fps go first (most
+  overdue first, i.e. the most 1/min_fps periods since their last run), then the stalest stream wins, with staleness
+  scaled by (1 + priority). With inference.max_batch > 1 and a dynamic batch model, the top streams are batched into
+  one ORT run.
+
+  Worker: given an InferenceWorker (inference.worker.enabled), the model runs in a separate process instead of an
+  in-process YoloDnn. Scheduling is unchanged. While the worker is down or restarting no frames are taken, the
+  detections stores keep their last result and tracking runs on those.
+
+  Demand: when inference.demand_driven is on, every run start asks each stream's preprocess stage for one fresh frame,
+  due demand_lead_ms before the run is expected to finish, so preprocessing only runs for frames we will consume.
+*/
+
 namespace dcp {
 
+struct InferenceStream {
+  std::string name;
+  int priority{0};
+  float min_fps{0.f};
+  StageMetrics* metrics{nullptr};  // Per-stream rate/staleness, may be null
+  std::shared_ptr<LatestStore<PreprocessedFrame>> preprocessed_latest_store;
+  std::shared_ptr<LatestStore<Detections>> detections_latest_store;
+  std::shared_ptr<DemandSignal> demand;  // Ticket to the stream's preprocess stage, may be null
+};
+
 class InferenceStage final : public Stage {
 public:
+  // With a worker, no model is loaded in this process
+  InferenceStage(StageMetrics* metrics, InferenceConfig cfg, std::vector<InferenceStream> streams, std::unique_ptr<InferenceWorker> worker = nullptr);
+
+  // Single stream convenience, same wiring as before streams existed
   InferenceStage(StageMetrics* metrics, InferenceConfig cfg, std::shared_ptr<LatestStore<PreprocessedFrame>> preprocessed_latest_store, std::shared_ptr<LatestStore<Detections>> detections_latest_store);
 
 protected:
@@ -25,9 +60,9 @@ protected:
 private:
   StageMetrics* metrics_;
   InferenceConfig cfg_;
-  std::shared_ptr<LatestStore<PreprocessedFrame>> preprocessed_latest_store_;
-  std::shared_ptr<LatestStore<Detections>> detections_latest_store_;
+  std::vector<InferenceStream> streams_;
   std::unique_ptr<YoloDnn> yolo_;
+  std::unique_ptr<InferenceWorker> worker_;
 };
 
-} // namespace dcp
\ No newline at end of file
+} // namespace dcp
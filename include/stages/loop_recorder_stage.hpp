@@ -0,0 +1,113 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "core/config.hpp"
+#include "core/render_frame.hpp"
+#include "infra/async_writer.hpp"
+#include "infra/bounded_queue.hpp"
+#include "infra/chunk_ring.hpp"
+#include "infra/metrics.hpp"
+#include "stages/stage.hpp"
+
+/*
+  LoopRecorderStage is the dashcam loop recorder.
+
+  Every frame is JPEG-encoded once, on this stage's thread, then:
+    - pushed into a fixed-memory ChunkRing holding the last pre_event_s seconds
+    - appended to the current loop segment, <dir>/loop_<time>_<seq>.mjpeg, rotated every segment_s. The oldest
+      segments are deleted to stay under disk_quota_mb (existing ones in <dir> count too)
+  When an event fires (a close-range track in the frame's WorldState, or trigger() from another thread) the ring is
+  written to <dir>/events/event_<time>_<seq>.mjpeg.part, followed by every frame until post_event_s after the last
+  trigger. The file is then closed with event_durability (fsync by default) and renamed to .mjpeg, so an event clip
+  either exists complete or not at all. Event clips don't count against the quota and are never deleted here.
+
+  All writes go through the shared AsyncWriter. The event file trails the ring by sequence id: each frame copies
+  whatever the writer has room for, so the pre-event burst spreads over the next frames instead of stalling one.
+  A segment write the writer refuses loses that frame from the segment (counted as wasted).
+
+  Files are concatenated JPEGs (raw MJPEG, e.g. `ffplay -f mjpeg file.mjpeg`), so saving an event never re-encodes.
+  Fed by its own queue off tracking, a slow disk drops frames there and never stalls perception.
+*/
+
+namespace dcp {
+
+class LoopRecorderStage final : public Stage {
+public:
+  // flush_metrics gets one item per saved event: LAT = trigger until the pre-event ring is handed to the writer,
+  // AGE = trigger to durable file
+  LoopRecorderStage(StageMetrics* metrics, StageMetrics* flush_metrics, LoopRecorderConfig cfg, std::string directory, std::shared_ptr<AsyncWriter> writer, std::shared_ptr<BoundedQueue<RenderFrame>> in, std::string name = "loop_recorder_stage");
+  ~LoopRecorderStage() override;
+
+  // Fire an event on the next frame. Thread safe
+  void trigger() { external_trigger_.store(true, std::memory_order_relaxed); }
+
+  // Occupancy for the dashboards, bytes()/size() are safe from other threads
+  const ChunkRing& ring() const { return ring_; }
+  std::uint64_t events_total() const { return events_.load(std::memory_order_relaxed); }
+
+protected:
+  void run(const StopToken& global_stop,
+           const std::atomic_bool& local_stop) override;
+
+private:
+  using TimePoint = std::chrono::steady_clock::time_point;
+
+  void process(const RenderFrame& rf);
+  bool close_range(const RenderFrame& rf) const;
+
+  void open_segment(TimePoint t, std::uint64_t seq);
+  void close_segment();
+  void enforce_quota();
+
+  void begin_event(TimePoint t, std::uint64_t seq, const char* reason);
+  // Copy ring chunks the event file doesn't have yet, as far as the writer takes them. True once caught up
+  bool pump_event();
+  void end_event();
+
+  StageMetrics* metrics_;
+  StageMetrics* flush_metrics_;
+  LoopRecorderConfig cfg_;
+  std::string dir_;
+  std::string events_dir_;
+  std::shared_ptr<AsyncWriter> writer_;
+  std::shared_ptr<BoundedQueue<RenderFrame>> in_;
+
+  ChunkRing ring_;
+
+  // Encode scratch, reused
+  std::vector<std::uint8_t> jpeg_;
+  std::vector<int> jpeg_params_;
+  cv::Mat scaled_;
+
+  // Loop segments, oldest first, with their sizes for the quota
+  AsyncFile segment_;
+  TimePoint segment_start_{};
+  std::string segment_path_;
+  std::deque<std::pair<std::string, std::uint64_t>> segments_;
+  std::uint64_t segments_bytes_{0};
+
+  // Open event, if any
+  AsyncFile event_;
+  std::string event_path_;       // Final name, the file is written as <name>.part until complete
+  TimePoint event_trigger_{};    // steady time of the first trigger, for LAT/AGE
+  TimePoint event_start_{};      // Capture time it was triggered at
+  TimePoint event_until_{};      // Capture time the post-event window ends
+  std::uint64_t event_next_seq_{0};  // First ring chunk not in the event file yet
+  bool event_caught_up_{false};
+  std::size_t event_frames_{0};
+  bool was_close_{false};        // Close-range triggers fire on the first close frame, not every one
+
+  std::atomic_bool external_trigger_{false};
+  std::atomic<std::uint64_t> events_{0};
+};
+
+} // namespace dcp
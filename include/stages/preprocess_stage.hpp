@@ -1,32 +1,73 @@
 #pragma once
 
 #include <cstdint>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
 #include "core/config.hpp"
 #include "infra/metrics.hpp"
 #include "core/frame.hpp"
+#include "core/mat_pool.hpp"
 #include "core/preprocessed_frame.hpp"
 #include "infra/bounded_queue.hpp"
+#include "infra/demand_signal.hpp"
 #include "infra/latest_store.hpp"
+#include "infra/reorder_buffer.hpp"
 #include "stages/stage.hpp"
 
 namespace dcp {
 
 class PreprocessStage final : public Stage {
 public:
-  PreprocessStage(StageMetrics* metrics, PreprocessConfig cfg, std::shared_ptr<BoundedQueue<Frame>> in, std::shared_ptr<BoundedQueue<Frame>> out, std::shared_ptr<LatestStore<PreprocessedFrame>> preprocessed_latest_store);
+  PreprocessStage(StageMetrics* metrics, PreprocessConfig cfg, std::shared_ptr<BoundedQueue<Frame>> in, std::shared_ptr<BoundedQueue<Frame>> out, std::shared_ptr<LatestStore<PreprocessedFrame>> preprocessed_latest_store, std::shared_ptr<DemandSignal> inference_demand = nullptr, std::string name = "preprocess_stage");
+
+  // Optional metrics for the worker pool (preprocess.workers > 1). Call before start()
+  // worker_metrics[i] tracks worker i's busy time, reorder_metrics tracks reorder wait (LAT) and late drops (WASTE)
+  void set_pool_metrics(std::vector<StageMetrics*> worker_metrics, StageMetrics* reorder_metrics);
+
+  // Null unless preprocess.workers > 1
+  const ReorderBuffer<Frame>* reorder_buffer() const { return reorder_.get(); }
 
 protected:
   void run(const StopToken& global_stop,
            const std::atomic_bool& local_stop) override;
 
+  bool supports_tasks() const override;
+  void bind_wake(std::function<void()> wake) override;
+  bool step() override;
+
 private:
+  // Single worker path shared by run() and step(): fast path push, then the demand gated slow path
+  void process(Frame& f);
+
+  // Pooled mode: N workers pull from in_, a ReorderBuffer restores sequence order before out_
+  void run_pool(const StopToken& global_stop, const std::atomic_bool& local_stop);
+  void pool_worker(std::size_t index, const StopToken& global_stop, const std::atomic_bool& local_stop);
+
   StageMetrics* metrics_;
   PreprocessConfig cfg_;
   std::shared_ptr<BoundedQueue<Frame>> in_;
   std::shared_ptr<BoundedQueue<Frame>> out_;
   std::shared_ptr<LatestStore<PreprocessedFrame>> preprocessed_latest_store_;
+  std::shared_ptr<DemandSignal> inference_demand_; // Null = build a PreprocessedFrame for every frame
+
+  std::vector<StageMetrics*> worker_metrics_;
+  StageMetrics* reorder_metrics_{nullptr};
+  std::unique_ptr<ReorderBuffer<Frame>> reorder_;
+  std::mutex pop_mu_;                                 // Pop + ReorderBuffer::begin must be atomic across workers
+
+  // Resize outputs per worker (MatPool is single threaded). Each buffer is held by the LatestStore and at most one
+  // inference run, so a handful covers it
+  static constexpr std::size_t kResizePoolSize = 4;
+  std::vector<std::unique_ptr<MatPool>> resize_pools_;
 };
 
+// Pool workers finish out of order. Writes pf unless the store already holds a newer frame (checked and written in one
+// step). A dropped frame hands its demand ticket back, so the consumer still gets the frame it asked for. Returns
+// false if pf was dropped
+bool PublishIfNewer(LatestStore<PreprocessedFrame>& store, DemandSignal* demand, PreprocessedFrame pf, std::uint64_t seq);
+
 } // namespace dcp
\ No newline at end of file
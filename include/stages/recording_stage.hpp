@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+
+#include "core/config.hpp"
+#include "core/render_frame.hpp"
+#include "infra/bounded_queue.hpp"
+#include "infra/metrics.hpp"
+#include "stages/stage.hpp"
+
+/*
+  RecordingStage encodes frames to a video file through cv::VideoWriter, on its own thread.
+
+  It is fed by its own bounded queue (visualization.recording.queue), so a slow encoder or disk drops frames there
+  instead of stalling tracking or the display. Frames dropped on the way in are reported as wasted on the stage row,
+  frames written as its FPS, encode time as its latency.
+
+  The writer is opened on the first frame, once the size is known. Thread mode only, an encode can block for a while.
+*/
+
+namespace dcp {
+
+class RecordingStage final : public Stage {
+public:
+  RecordingStage(StageMetrics* metrics, RecordingConfig cfg, std::string output_path, std::shared_ptr<BoundedQueue<RenderFrame>> in, std::string name = "recording_stage");
+
+protected:
+  void run(const StopToken& global_stop,
+           const std::atomic_bool& local_stop) override;
+
+private:
+  void process(const RenderFrame& rf);
+  bool open_writer(cv::Size size);
+  void report_drops();
+
+  StageMetrics* metrics_;
+  RecordingConfig cfg_;
+  std::string output_path_;
+  std::shared_ptr<BoundedQueue<RenderFrame>> in_;
+
+  cv::VideoWriter writer_;
+  cv::Size frame_size_{};      // Size the writer was opened with (after scaling)
+  bool open_failed_{false};    // Don't retry every frame
+  cv::Mat scaled_;             // Downscale target, reused
+  std::uint64_t drops_seen_{0};
+};
+
+} // namespace dcp
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "apps/ansi_dashboard.hpp"
+#include "apps/hud_overlay.hpp"
+#include "core/config.hpp"
+#include "core/frame.hpp"
+#include "core/mat_pool.hpp"
+#include "core/render_frame.hpp"
+#include "infra/bounded_queue.hpp"
+#include "infra/fixed_vector.hpp"
+#include "infra/latest_store.hpp"
+#include "infra/metrics.hpp"
+#include "stages/stage.hpp"
+
+/*
+  RenderStage turns tracking output into display frames, off the UI thread.
+
+  Input frames are never written to, their pixels are shared by refcount with the rest of the pipeline. Boxes, labels
+  and the HUD panel are rasterized into a cached overlay layer (plus a mask of what it covers), and only redrawn when
+  the tracks or the HUD panel actually change. Every frame is then composited into a pooled output buffer: a copy of
+  the input, with the overlay copied over it inside the rects the last raster touched.
+
+  The newest composed frame goes into a LatestStore, the UI thread only shows it. An optional tap queue gets every
+  composed frame as well (annotated recording), the output pool is sized so frames held there don't cost allocations.
+*/
+
+namespace dcp {
+
+// What the HUD panel reports on, shared with the dashboards
+struct HudSources {
+  const Metrics* metrics{nullptr};
+  std::vector<QueueView> queues;
+  std::vector<MemoryView> memory;
+};
+
+class RenderStage final : public Stage {
+public:
+  RenderStage(StageMetrics* metrics, VisualizationConfig cfg, std::shared_ptr<BoundedQueue<RenderFrame>> in, std::shared_ptr<LatestStore<Frame>> out, HudSources hud_sources, std::shared_ptr<BoundedQueue<RenderFrame>> tap = nullptr, std::string name = "render_stage");
+
+protected:
+  void run(const StopToken& global_stop,
+           const std::atomic_bool& local_stop) override;
+
+  bool supports_tasks() const override;
+  void bind_wake(std::function<void()> wake) override;
+  bool step() override;
+
+private:
+  // One frame, shared by run() and step()
+  void process(RenderFrame& rf);
+
+  // True if ws would rasterize exactly like the tracks currently in the overlay
+  bool same_as_drawn(const WorldState& ws) const;
+  void rasterize(const WorldState& ws, cv::Size size);
+
+  StageMetrics* metrics_;
+  VisualizationConfig cfg_;
+  std::shared_ptr<BoundedQueue<RenderFrame>> in_;
+  std::shared_ptr<LatestStore<Frame>> out_;
+  HudSources hud_sources_;
+  std::shared_ptr<BoundedQueue<RenderFrame>> tap_;
+
+  // Only touched by whichever thread runs the stage
+  HudOverlay hud_;
+  cv::Mat overlay_;                                     // Same size/type as the frames, black where nothing is drawn
+  cv::Mat mask_;                                        // CV_8UC1, non-zero where overlay_ has content
+  FixedVector<cv::Rect, kMaxTracks + 1> dirty_;         // Regions the last raster drew into (tracks + HUD panel)
+  FixedVector<Track, kMaxTracks> drawn_;                // Tracks currently in the overlay
+  bool have_raster_{false};
+  std::string label_;                                   // Label scratch, reused
+  MatPool out_pool_;                                    // Composed frames: built, stored, shown, plus whatever the tap holds
+};
+
+} // namespace dcp
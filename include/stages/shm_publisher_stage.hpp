@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "core/config.hpp"
+#include "core/render_frame.hpp"
+#include "infra/bounded_queue.hpp"
+#include "infra/metrics.hpp"
+#include "infra/shm_channel.hpp"
+#include "stages/stage.hpp"
+
+/*
+  ShmPublisherStage publishes tracking results to other processes through a ShmWriter (see infra/shm_channel.hpp).
+
+  It has its own queue off the tracking stage like the other sinks. Each frame becomes one world record (the tracks)
+  and, with publish_frames, one frame slot: the pixels are copied once, straight from the frame into shared memory,
+  and readers use them in place from there. The writer never waits for readers, so a stalled consumer can't hold up
+  the pipeline; it sees overruns instead. A frame too big for a slot is skipped (counted as wasted), its tracks are
+  still published.
+*/
+
+namespace dcp {
+
+class ShmPublisherStage final : public Stage {
+public:
+  // Creates the shared-memory object shm_name, replacing a stale one. frame_capacity is the size of one frame slot.
+  // Throws if the object can't be created
+  ShmPublisherStage(StageMetrics* metrics, const ShmPublishConfig& cfg, std::string shm_name, std::size_t frame_capacity, std::shared_ptr<BoundedQueue<RenderFrame>> in, std::string name = "shm_publisher_stage");
+
+  const ShmWriter& writer() const { return writer_; }
+
+protected:
+  void run(const StopToken& global_stop,
+           const std::atomic_bool& local_stop) override;
+
+  bool supports_tasks() const override;
+  void bind_wake(std::function<void()> wake) override;
+  bool step() override;
+
+private:
+  void process(const RenderFrame& rf);
+  bool publish_frame(const Frame& frame, std::int64_t capture_ns);
+
+  StageMetrics* metrics_;
+  bool publish_frames_;
+  std::shared_ptr<BoundedQueue<RenderFrame>> in_;
+  ShmWriter writer_;
+  ShmWorldRecord record_{};   // Staging for the world record, too big for the stack of a task worker
+};
+
+} // namespace dcp
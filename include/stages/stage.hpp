@@ -1,11 +1,23 @@
 #pragma once
 
 #include <atomic>
+#include <functional>
 #include <string>
 
 #include "infra/stop_token.hpp"
+#include "infra/task_executor.hpp"
 #include "infra/thread_runner.hpp"
 
+/*
+    A Stage runs in one of two modes:
+        - thread mode, start(stop): run() loops on the stage's own ThreadRunner. Every stage supports this
+        - task mode, start(stop, executor, prio): the stage has no thread. Its inputs call wake() when data arrives,
+          which schedules a task on the shared TaskExecutor that calls step() until the input is drained
+
+    A stage opts into task mode by overriding supports_tasks(), bind_wake() and step(). Stages that don't (or can't,
+    e.g. a blocking capture) fall back to thread mode, so stages can move over one at a time.
+*/
+
 namespace dcp {
 
 class Stage {
@@ -16,18 +28,47 @@ public:
   Stage(const Stage&) = delete;
   Stage& operator=(const Stage&) = delete;
 
+  // Pinning/policy for the stage's thread and any helper threads it starts. Call before start(), ignored in task mode
+  void set_thread_config(ThreadConfig cfg) { runner_.set_thread_config(std::move(cfg)); }
+
   void start(StopToken global_stop);
+  void start(StopToken global_stop, TaskExecutor& executor, TaskPriority prio);
   void stop();
 
   const std::string& name() const { return name_; }
+  bool task_mode() const { return executor_ != nullptr; }
 
 protected:
   virtual void run(const StopToken& global_stop,
                    const std::atomic_bool& local_stop) = 0;
 
+  // Helper threads (decode-ahead, pool workers) use the same settings as the stage thread
+  const ThreadConfig& thread_config() const { return runner_.thread_config(); }
+
+  // Task mode hooks
+  virtual bool supports_tasks() const { return false; }
+  // Make the stage's inputs call wake when data arrives. Called with an empty function on stop to unhook them
+  virtual void bind_wake(std::function<void()> wake) { (void)wake; }
+  // Do at most one item of work without blocking. Return false if there was no input
+  virtual bool step() { return false; }
+
 private:
+  // Steps per task before yielding the worker back to the executor
+  static constexpr int kStepBudget = 8;
+
+  void wake();
+  void run_task();
+
   std::string name_;
   ThreadRunner runner_;
+
+  TaskExecutor* executor_{nullptr};
+  TaskPriority prio_{TaskPriority::Normal};
+  StopToken global_stop_{};
+  std::atomic_bool stopping_{false};
+  std::atomic_bool scheduled_{false};  // A task for this stage is queued or running
+  std::atomic_bool rewake_{false};     // wake() arrived while scheduled, look again before going idle
+  std::atomic<int> running_{0};        // run_task() bodies in progress, stop() waits for 0
 };
 
-} // namespace dcp
\ No newline at end of file
+} // namespace dcp
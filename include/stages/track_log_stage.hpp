@@ -0,0 +1,52 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "core/config.hpp"
+#include "core/render_frame.hpp"
+#include "infra/async_writer.hpp"
+#include "infra/bounded_queue.hpp"
+#include "infra/metrics.hpp"
+#include "stages/stage.hpp"
+
+/*
+  TrackLogStage is a headless sink for tracking results: one CSV row per track per frame.
+
+  It has its own queue off the tracking stage, and rows go to disk through the shared AsyncWriter, so a slow disk never
+  stalls tracking: rows the writer has no room for are dropped (counted as wasted). Buffered rows are handed to the
+  writer at least once a second. Pixels are not touched, the frame only provides the capture time.
+*/
+
+namespace dcp {
+
+class TrackLogStage final : public Stage {
+public:
+  // Opens (truncates) output_path and writes the header, throws if it can't be opened
+  TrackLogStage(StageMetrics* metrics, std::shared_ptr<AsyncWriter> writer, std::string output_path, FileOptions file_opts, std::shared_ptr<BoundedQueue<RenderFrame>> in, std::string name = "track_log_stage");
+
+protected:
+  void run(const StopToken& global_stop,
+           const std::atomic_bool& local_stop) override;
+
+  bool supports_tasks() const override;
+  void bind_wake(std::function<void()> wake) override;
+  bool step() override;
+
+private:
+  void process(const RenderFrame& rf);
+
+  StageMetrics* metrics_;
+  std::shared_ptr<AsyncWriter> writer_;
+  std::shared_ptr<BoundedQueue<RenderFrame>> in_;
+  AsyncFile out_;                     // Declared after writer_, closes first
+  std::chrono::steady_clock::time_point last_flush_{};
+
+  TimePoint first_capture_{};
+  bool have_first_{false};
+};
+
+} // namespace dcp
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "core/config.hpp"
+#include "core/render_frame.hpp"
+#include "core/track_stream.hpp"
+#include "infra/bounded_queue.hpp"
+#include "infra/metrics.hpp"
+#include "infra/unix_stream_server.hpp"
+#include "stages/stage.hpp"
+
+/*
+  TrackStreamStage streams tracking results to local subscribers (fleet logger, HMI) over a Unix domain socket:
+  one TrackStreamEncoder message per frame, fanned out by a UnixStreamServer (see core/track_stream.hpp and
+  infra/unix_stream_server.hpp for the format and the resync rules).
+
+  It has its own queue off the tracking stage like the other sinks. Frames dropped by that queue are invisible to
+  subscribers, the next delta is against the last frame encoded. Subscribers are accepted and flushed on every frame
+  and, on a thread, while idle too; as a task only on frames.
+
+  Metrics: the stage row covers encode and send, the encode row (optional) only the serialization, one item per
+  frame. Bytes sent, drops and keyframes are counters on server().
+*/
+
+namespace dcp {
+
+class TrackStreamStage final : public Stage {
+public:
+  // Listens on socket_path. Throws std::runtime_error if it can't
+  TrackStreamStage(StageMetrics* metrics, StageMetrics* encode_metrics, const TrackStreamConfig& cfg, std::string socket_path, std::shared_ptr<BoundedQueue<RenderFrame>> in, std::string name = "track_stream_stage");
+
+  const UnixStreamServer& server() const { return server_; }
+  // Encoded bytes before fan-out, the stream's own rate whatever the number of subscribers
+  std::uint64_t bytes_encoded() const { return bytes_encoded_.load(std::memory_order_relaxed); }
+
+protected:
+  void run(const StopToken& global_stop,
+           const std::atomic_bool& local_stop) override;
+
+  bool supports_tasks() const override;
+  void bind_wake(std::function<void()> wake) override;
+  bool step() override;
+
+private:
+  void process(const RenderFrame& rf);
+
+  StageMetrics* metrics_;
+  StageMetrics* encode_metrics_;
+  std::shared_ptr<BoundedQueue<RenderFrame>> in_;
+  UnixStreamServer server_;
+  TrackStreamEncoder encoder_;
+  UnixStreamServer::KeyframeFn keyframe_;
+  std::atomic<std::uint64_t> bytes_encoded_{0};
+};
+
+} // namespace dcp
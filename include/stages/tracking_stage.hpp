@@ -1,33 +1,60 @@
 #pragma once
 
 #include <cstdint>
+#include <functional>
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "core/config.hpp"
 #include "infra/metrics.hpp"
 #include "core/frame.hpp"
 #include "core/detections.hpp"
 #include "core/render_frame.hpp"
+#include "core/world_state.hpp"
+#include "infra/fixed_vector.hpp"
 #include "infra/bounded_queue.hpp"
 #include "infra/latest_store.hpp"
 #include "stages/stage.hpp"
 
 namespace dcp {
 
+// IoU tracker. Each new inference result is matched against the live tracks, so an object keeps its track id while
+// it stays in view. Between results every frame carries the same tracks. age_frames and missed_frames count inference
+// results, which is when tracks are observed
+// Every result goes to each output queue (display, sinks). Copies share the frame's pixels, an empty list is fine
 class TrackingStage final : public Stage {
 public:
-  TrackingStage(StageMetrics* metrics, TrackingConfig cfg, std::shared_ptr<BoundedQueue<Frame>> in, std::shared_ptr<LatestStore<Detections>> detections_latest_store, std::shared_ptr<BoundedQueue<RenderFrame>> out);
+  TrackingStage(StageMetrics* metrics, TrackingConfig cfg, std::shared_ptr<BoundedQueue<Frame>> in, std::shared_ptr<LatestStore<Detections>> detections_latest_store, std::vector<std::shared_ptr<BoundedQueue<RenderFrame>>> outs, std::string name = "tracking_stage");
 
 protected:
   void run(const StopToken& global_stop,
            const std::atomic_bool& local_stop) override;
 
+  bool supports_tasks() const override;
+  void bind_wake(std::function<void()> wake) override;
+  bool step() override;
+
 private:
+  // One frame, shared by run() and step()
+  void process(Frame& f);
+
+  // Updates tracks_ from cached_dets_ (a new inference result)
+  void associate(std::uint64_t frame_id);
+
   StageMetrics* metrics_;
   TrackingConfig cfg_;
   std::shared_ptr<BoundedQueue<Frame>> in_;
   std::shared_ptr<LatestStore<Detections>> detections_latest_store_;
-  std::shared_ptr<BoundedQueue<RenderFrame>> out_;
+  std::vector<std::shared_ptr<BoundedQueue<RenderFrame>>> outs_;
+
+  // Only touched by whichever thread runs the stage. In task mode scheduling keeps that to one at a time
+  // cached_dets_ is refreshed in place (LatestStore::read_into) so its item buffer is reused across inference results
+  Detections cached_dets_;
+  bool have_dets_{false};
+  std::uint64_t dets_version_{0};
+  FixedVector<Track, kMaxTracks> tracks_;
+  std::uint64_t next_track_id_{1};
 };
 
 } // namespace dcp
\ No newline at end of file
@@ -5,6 +5,10 @@
 #include <iostream>
 #include <thread>
 
+#include "infra/alloc_counter.hpp"
+#include "infra/perf_counters.hpp"
+#include "infra/process_stats.hpp"
+
 namespace dcp {
 
 static constexpr const char* kReset = "\033[0m";
@@ -13,6 +17,7 @@ static constexpr const char* kGreen = "\033[32m";
 static constexpr const char* kYellow= "\033[33m";
 
 static double NsToMs(std::uint64_t ns) { return static_cast<double>(ns) / 1e6; }
+static double BytesToMb(std::uint64_t b) { return static_cast<double>(b) / (1024.0 * 1024.0); }
 
 // Fill a simple bar based on ratio of used/cap
 static std::string Bar(std::size_t used, std::size_t cap, std::size_t width) {
@@ -26,10 +31,30 @@ static std::string Bar(std::size_t used, std::size_t cap, std::size_t width) {
   return s;
 }
 
-AnsiDashboard::AnsiDashboard(Metrics& metrics, std::vector<QueueView> queues, std::atomic_bool& sigint_flag): metrics_(metrics), queues_(std::move(queues)), sigint_(sigint_flag) {}
+void RegisterViews(Metrics& metrics, const std::vector<QueueView>& queues, const std::vector<MemoryView>& memory, const std::vector<RateView>& rates) {
+  for (const auto& q : queues) {
+    const MetricLabels l{{"queue", q.name}};
+    if (q.size_fn) metrics.callback(MetricType::Gauge, "dcp_queue_items", "Items held.", l, [f = q.size_fn]() { return static_cast<std::uint64_t>(f()); });
+    if (q.cap_fn) metrics.callback(MetricType::Gauge, "dcp_queue_capacity", "Items the queue holds at most.", l, [f = q.cap_fn]() { return static_cast<std::uint64_t>(f()); });
+    if (q.drops_fn) metrics.callback(MetricType::Counter, "dcp_queue_drops_total", "Items dropped by the queue's policy.", l, q.drops_fn);
+    if (q.expired_fn) metrics.callback(MetricType::Counter, "dcp_queue_expired_total", "Items dropped for being older than the queue's max age.", l, q.expired_fn);
+  }
+  for (const auto& m : memory) {
+    const MetricLabels l{{"name", m.name}};
+    if (m.bytes_fn) metrics.callback(MetricType::Gauge, "dcp_memory_bytes", "Bytes held by a queue or store.", l, m.bytes_fn);
+    if (m.max_bytes_fn && m.max_bytes_fn() > 0) {
+      metrics.callback(MetricType::Gauge, "dcp_memory_limit_bytes", "Byte bound of a queue or store, bounded ones only.", l, m.max_bytes_fn);
+    }
+  }
+  for (const auto& r : rates) {
+    if (r.total_fn) metrics.callback(MetricType::Counter, "dcp_counter_total", "Running totals shown as rates on the dashboard, in their raw unit.", {{"name", r.name}}, r.total_fn);
+  }
+}
+
+AnsiDashboard::AnsiDashboard(Metrics& metrics, std::vector<QueueView> queues, std::vector<MemoryView> memory, std::vector<RateView> rates, std::atomic_bool& sigint_flag): metrics_(metrics), queues_(std::move(queues)), memory_(std::move(memory)), rates_(std::move(rates)), sigint_(sigint_flag) {}
 
 // Main draw function. Update every kHudPeriod ms, go through each metric stage and display calculates.
-// Currently displays FPS, Busy % (thread utilization %), Latency in ms, and Last in ms (last time since stage processed an item, aka staleness)
+// Currently displays FPS, Busy % (thread utilization %) and CPU % (of it, actually on a CPU), preemptions/s, Latency and p99 in ms, and Last in ms (last time since stage processed an item, aka staleness)
 void AnsiDashboard::run(const StopToken& stop) {
   using namespace std::chrono;
   using namespace std::chrono_literals;
@@ -51,48 +76,144 @@ void AnsiDashboard::run(const StopToken& stop) {
     // Print dashboard title
     std::cout << "\033[H";
     std::cout << "PERCEPTION PIPELINE\n";
-    std::cout << "SIGINT: " << (sigint_.load(std::memory_order_relaxed) ? "pending" : "ok") << "\n\n";
+    std::cout << "SIGINT: " << (sigint_.load(std::memory_order_relaxed) ? "pending" : "ok") << "\n";
+
+    // Whole-process CPU, in cores. Where headless mode or a cached overlay shows up as CPU saved
+    const auto cpu_ns = ProcessCpuNs();
+    const double cpu_cores = (dt > 0 && prev_cpu_ns_ != 0) ? static_cast<double>(cpu_ns - prev_cpu_ns_) / (dt * 1e9) : 0.0;
+    prev_cpu_ns_ = cpu_ns;
+    std::cout << "CPU: " << std::fixed << std::setprecision(2) << cpu_cores << " cores (" << std::setprecision(0)
+              << (cpu_cores * 100.0) << "%)      \n\n";
 
     // Print column names at specific positions
     std::cout << std::left
-              << std::setw(14) << "STAGE"
+              << std::setw(20) << "STAGE"
               << std::setw(10) << "FPS"
               << std::setw(10) << "BUSY%"
+              << std::setw(8) << "CPU%"
+              << std::setw(11) << "PREEMPT/s"
               << std::setw(12) << "LAT(ms)"
+              << std::setw(10) << "P99(ms)"
               << std::setw(14) << "LAST(ms)"
+              << std::setw(10) << "SKIP/s"
+              << std::setw(10) << "WASTE/s"
+              << std::setw(10) << "AGE(ms)"
+              << std::setw(10) << "ALLOC/f"
               << "\n";
-    std::cout << std::string(14 + 10 + 10 + 12 + 14, '-') << "\n";
+    std::cout << std::string(20 + 10 + 10 + 8 + 11 + 12 + 10 + 14 + 10 + 10 + 10 + 10, '-') << "\n";
 
     // For each stage
-    for (const auto& up : metrics_.stages()) {
-      const StageMetrics& m = *up;
-      auto& p = prev_stage_[up.get()];
+    metrics_.for_each_stage([&](const StageMetrics& m) {
+      auto& p = prev_stage_[&m];
 
       // Compute FPS
-      const auto c = m.count.load(std::memory_order_relaxed);
+      const auto c = m.count.value();
       const double fps = (dt > 0) ? (static_cast<double>(c - p.count) / dt) : 0.0;
       p.count = c;
 
       // Compute Work
-      const auto work = m.work_ns_total.load(std::memory_order_relaxed);
+      const auto work = m.work_ns_total.value();
       double busy = (dt > 0) ? static_cast<double>(work - p.work_ns) / (dt * 1e9) : 0.0;
       busy = std::max(0.0, std::min(1.0, busy));
       auto busy_color = (busy > 0.85) ? kRed : (busy > 0.60) ? kYellow : kGreen;
       p.work_ns = work;
 
+      // Thread CPU over the same window, and preemptions. BUSY% well above CPU% = the stage waits inside its items
+      // (blocked or preempted), close = it really computes that long. Stages that don't sample it show "-"
+      const auto cpu = m.cpu_ns_total.value();
+      const double cpu_frac = (dt > 0) ? std::max(0.0, std::min(1.0, static_cast<double>(cpu - p.cpu_ns) / (dt * 1e9))) : 0.0;
+      p.cpu_ns = cpu;
+      const auto preempt = m.involuntary_switches.value();
+      const double preempt_ps = (dt > 0) ? static_cast<double>(preempt - p.preempt) / dt : 0.0;
+      p.preempt = preempt;
+
       // Compute Latency and Staleness
-      const double lat_ms = NsToMs(m.avg_latency_ns.load(std::memory_order_relaxed));
+      const double lat_ms = NsToMs(static_cast<std::uint64_t>(m.avg_latency_ns.value()));
       const auto le = m.last_event_ns.load(std::memory_order_relaxed);
       const double last_ms = (le == 0) ? 0.0 : NsToMs(now_ns - le);
 
+      // p99 of the items finished over this refresh, from the latency histogram's bucket deltas
+      m.latency_hist.read(buckets_);
+      p.buckets.resize(buckets_.size(), 0);
+      for (std::size_t b = 0; b < buckets_.size(); ++b) {
+        const std::uint64_t total = buckets_[b];
+        buckets_[b] = total - p.buckets[b];
+        p.buckets[b] = total;
+      }
+      const double p99_ms = HistogramQuantile(m.latency_hist.bounds(), buckets_, 0.99) / 1e6;
+
+      // Compute skipped/wasted work rates
+      const auto sk = m.skipped.value();
+      const auto wa = m.wasted.value();
+      const double skip_ps = (dt > 0) ? (static_cast<double>(sk - p.skipped) / dt) : 0.0;
+      const double waste_ps = (dt > 0) ? (static_cast<double>(wa - p.wasted) / dt) : 0.0;
+      p.skipped = sk;
+      p.wasted = wa;
+
+      // Heap allocations per item over this refresh, only known in DCP_COUNT_ALLOCS builds. Steady state should be 0
+      const auto al = m.allocs.value();
+      const double allocs_per_item = (c > p.alloc_count) ? static_cast<double>(al - p.allocs) / static_cast<double>(c - p.alloc_count) : 0.0;
+      p.allocs = al;
+      p.alloc_count = c;
+
       // Print entire row of stats for this stage
       std::cout << std::left
-                << std::setw(14) << m.name
+                << std::setw(20) << m.name
                 << std::setw(10)  << std::fixed << std::setprecision(1) << fps
-                << busy_color << std::setw(10)  << std::fixed << std::setprecision(1) << (busy * 100.0) << kReset
+                << busy_color << std::setw(10)  << std::fixed << std::setprecision(1) << (busy * 100.0) << kReset;
+      if (cpu > 0) {
+        std::cout << ((cpu_frac > 0.85) ? kRed : (cpu_frac > 0.60) ? kYellow : kGreen) << std::setw(8) << std::fixed
+                  << std::setprecision(1) << (cpu_frac * 100.0) << kReset;
+      } else {
+        std::cout << std::setw(8) << "-";
+      }
+      std::cout << (preempt_ps > 0.0 ? kYellow : "") << std::setw(11) << std::fixed << std::setprecision(1) << preempt_ps
+                << (preempt_ps > 0.0 ? kReset : "")
                 << std::setw(12) << std::fixed << std::setprecision(1) << lat_ms
-                << std::setw(20) << std::fixed << std::setprecision(1) << last_ms
-                << "\n";
+                << std::setw(10) << std::fixed << std::setprecision(1) << p99_ms
+                << std::setw(14) << std::fixed << std::setprecision(1) << last_ms
+                << std::setw(10) << std::fixed << std::setprecision(1) << skip_ps
+                << std::setw(10) << std::fixed << std::setprecision(1) << waste_ps;
+      const auto age = static_cast<std::uint64_t>(m.avg_age_ns.value());
+      if (age > 0) std::cout << std::setw(10) << std::fixed << std::setprecision(1) << NsToMs(age);
+      else std::cout << std::setw(10) << "-";
+      if (AllocCountingEnabled()) {
+        std::cout << (allocs_per_item > 0.0 ? kYellow : kGreen) << std::setw(10) << std::fixed << std::setprecision(1)
+                  << allocs_per_item << kReset;
+      } else {
+        std::cout << std::setw(10) << "-";
+      }
+      std::cout << "\n";
+    });
+
+    // Hardware counters per item over this refresh, only with metrics.perf_counters. Low IPC with many LLC misses per
+    // frame = the stage waits on memory, not on arithmetic
+    if (PerfCountersEnabled()) {
+      std::cout << "\nPERF  " << PerfCountersStatus() << "\n";
+      if (PerfCountersAvailable()) {
+        std::cout << std::left << std::setw(20) << "  STAGE" << std::setw(8) << "IPC" << std::setw(14) << "CYCLES/f"
+                  << std::setw(14) << "INSTR/f" << std::setw(12) << "LLC-MISS/f" << std::setw(12) << "BR-MISS/f" << "\n";
+      }
+      metrics_.for_each_stage([&](const StageMetrics& m) {
+        if (!m.cycles) return;
+        auto& p = prev_stage_[&m];
+        const PerfSample now{m.cycles->value(), m.instructions->value(), m.llc_misses->value(), m.branch_misses->value()};
+        const PerfSample d = now - p.perf;
+        const auto c = m.count.value();
+        const std::uint64_t items = c - p.perf_count;
+        p.perf = now;
+        p.perf_count = c;
+        if (!PerfCountersAvailable() || d.cycles == 0 || items == 0) return;
+
+        const double n = static_cast<double>(items);
+        const double ipc = static_cast<double>(d.instructions) / static_cast<double>(d.cycles);
+        std::cout << "  " << std::setw(18) << m.name << (ipc < 1.0 ? kYellow : kGreen) << std::setw(8) << std::fixed
+                  << std::setprecision(2) << ipc << kReset << std::setprecision(0)
+                  << std::setw(14) << static_cast<double>(d.cycles) / n
+                  << std::setw(14) << static_cast<double>(d.instructions) / n
+                  << std::setw(12) << static_cast<double>(d.llc_misses) / n
+                  << std::setw(12) << static_cast<double>(d.branch_misses) / n << "\n";
+      });
     }
 
     // Queues sections, for each queue provided in pipeline, iterate and display its stats
@@ -110,14 +231,53 @@ void AnsiDashboard::run(const StopToken& stop) {
       const double drop_ps = dt > 0 ? (static_cast<double>(total_drops - prev_total) / dt) : 0.0;
       prev_total = total_drops;
 
+      std::uint64_t total_expired = q.expired_fn ? q.expired_fn() : 0;
+      std::uint64_t& prev_expired = prev_qexpired_[q.name];
+      const double expired_ps = dt > 0 ? (static_cast<double>(total_expired - prev_expired) / dt) : 0.0;
+      prev_expired = total_expired;
+
       // Print bar visual, using the Bar helper function to fill easily
-      std::cout << "  " << std::setw(11) << std::left << q.name
+      std::cout << "  " << std::setw(17) << std::left << q.name
                 << " " << color << used << "/" << cap
                 << " [" << Bar(used, cap, 24) << "]" << kReset
                 << "  drop/s=" << std::fixed << std::setprecision(1) << drop_ps
+                << "  expired/s=" << std::fixed << std::setprecision(1) << expired_ps
                 << "\n";
     }
 
+    // Memory section, bytes held per queue/store against its byte bound, plus what the OS says we use
+    std::uint64_t held = 0;
+    for (const auto& m : memory_) held += m.bytes_fn ? m.bytes_fn() : 0;
+
+    std::cout << "\nMEMORY  rss=" << std::fixed << std::setprecision(1) << BytesToMb(ProcessRssBytes()) << " MB"
+              << "  held=" << BytesToMb(held) << " MB\n";
+    for (const auto& m : memory_) {
+      const std::uint64_t bytes = m.bytes_fn ? m.bytes_fn() : 0;
+      const std::uint64_t max = m.max_bytes_fn ? m.max_bytes_fn() : 0;
+
+      std::cout << "  " << std::setw(17) << std::left << m.name << " " << std::right << std::setw(8)
+                << std::fixed << std::setprecision(1) << BytesToMb(bytes) << " MB";
+      if (max > 0) {
+        const double frac = static_cast<double>(bytes) / static_cast<double>(max);
+        const char* color = (frac > 0.85) ? kRed : (frac > 0.60) ? kYellow : kGreen;
+        std::cout << " / " << std::setw(6) << BytesToMb(max) << " MB " << color << "[" << Bar(bytes, max, 16) << "]" << kReset;
+      }
+      std::cout << std::left << "\n";
+    }
+
+    // Rates section, only when something registered one
+    if (!rates_.empty()) std::cout << "\nRATES\n";
+    for (const auto& r : rates_) {
+      const std::uint64_t total = r.total_fn ? r.total_fn() : 0;
+      std::uint64_t& prev = prev_rates_[r.name];
+      const double per_s = dt > 0 ? static_cast<double>(total - prev) / dt / r.scale : 0.0;
+      prev = total;
+
+      std::cout << "  " << std::setw(17) << std::left << r.name << " " << std::right << std::setw(10) << std::fixed
+                << std::setprecision(1) << per_s << " " << r.unit << "/s  total=" << std::setprecision(1)
+                << static_cast<double>(total) / r.scale << " " << r.unit << std::left << "\n";
+    }
+
     std::cout << "\n" << std::flush;
   }
 }
@@ -5,8 +5,9 @@
 
 #include <algorithm>
 #include <chrono>
-#include <iomanip>
-#include <sstream>
+#include <cstdio>
+
+#include "infra/process_stats.hpp"
 
 namespace dcp {
 
@@ -23,25 +24,28 @@ double HudOverlay::NsToMs(std::uint64_t ns) {
   return static_cast<double>(ns) / 1e6;
 }
 
-// Fill a simple bar based on ratio of used/cap
-std::string HudOverlay::Bar(std::size_t used, std::size_t cap, std::size_t width) {
-  if (cap == 0) return std::string(width, '.');
-  const double frac = static_cast<double>(used) / static_cast<double>(cap);
+static double BytesToMb(std::uint64_t b) {
+  return static_cast<double>(b) / (1024.0 * 1024.0);
+}
+
+// Fill a simple bracketed bar based on ratio of used/cap, into out (reused, so no allocation once it has grown)
+void HudOverlay::Bar(std::size_t used, std::size_t cap, std::size_t width, std::string& out) {
+  const double frac = (cap == 0) ? 0.0 : static_cast<double>(used) / static_cast<double>(cap);
   const std::size_t filled = static_cast<std::size_t>(frac * width);
-  std::string s;
-  s.reserve(width);
-  for (std::size_t i = 0; i < width; ++i) s.push_back(i < filled ? 'I' : '.');
-  return s;
+  out.assign(1, '[');
+  for (std::size_t i = 0; i < width; ++i) out.push_back(i < filled ? 'I' : '.');
+  out.push_back(']');
 }
 
-// Main draw function. Update every kHudPeriod ms, go through each metric stage and display calculates.
-// Currently displays FPS, Busy % (thread utilization %), Latency in ms, and Last in ms (last time since stage processed an item, aka staleness)
-void HudOverlay::draw(cv::Mat& bgr, const Metrics& metrics, const std::vector<QueueView>& queues) {
+// Main refresh function. Rebuild the panel every kHudPeriod ms, go through each metric stage and display calculates.
+// Currently displays FPS, Busy % (thread utilization %), Latency in ms, Last in ms (last time since stage processed an item,
+// aka staleness) and Age in ms (capture to done, for stages that report it)
+bool HudOverlay::refresh(const Metrics& metrics, const std::vector<QueueView>& queues, const std::vector<MemoryView>& memory, int type) {
   using clock = std::chrono::steady_clock;
   const auto now = clock::now();
 
   const bool needs_refresh =
-      (last_refresh_.time_since_epoch().count() == 0) || (now - last_refresh_ >= kHudPeriod);
+      (last_refresh_.time_since_epoch().count() == 0) || (now - last_refresh_ >= kHudPeriod) || panel_.type() != type;
 
   if (needs_refresh) {
     const auto now_ns = dcp::NowNs();
@@ -53,11 +57,12 @@ void HudOverlay::draw(cv::Mat& bgr, const Metrics& metrics, const std::vector<Qu
 
     // Display simple black box, where stats will be arranged and displayed
     const int line = 15;
-    const int panel_w = 350;
-    const int panel_h = 22 + line * (static_cast<int>(metrics.stages().size()) +
-                                     static_cast<int>(queues.size()) + 3);
+    const int panel_w = 540;
+    const int panel_h = 22 + line * (static_cast<int>(metrics.stage_count()) +
+                                     static_cast<int>(queues.size()) +
+                                     static_cast<int>(memory.size()) + 4) + 12;
 
-    panel_.create(panel_h, panel_w, bgr.type());
+    panel_.create(panel_h, panel_w, type);
     panel_.setTo(cv::Scalar(0, 0, 0));
     cv::rectangle(panel_, cv::Rect(0, 0, panel_w, panel_h), cv::Scalar(80, 80, 80), 1);
 
@@ -65,26 +70,42 @@ void HudOverlay::draw(cv::Mat& bgr, const Metrics& metrics, const std::vector<Qu
     const double scale = 0.4;
     const int thickness = 1;
 
-    auto put_at = [&](int x, int y, const std::string& s, const cv::Scalar& color = cv::Scalar(255, 255, 255)) {
-      cv::putText(panel_, s, cv::Point(x, y), font, scale, color, thickness, cv::LINE_AA);
+    // Text goes through text_ (reused), so short-lived labels never allocate a std::string each refresh
+    auto put_at = [&](int x, int y, const char* s, const cv::Scalar& color = cv::Scalar(255, 255, 255)) {
+      text_.assign(s);
+      cv::putText(panel_, text_, cv::Point(x, y), font, scale, color, thickness, cv::LINE_AA);
+    };
+
+    char buf[96];
+    auto put_fmt = [&](int x, int y, const cv::Scalar& color, const char* fmt, auto... args) {
+      std::snprintf(buf, sizeof(buf), fmt, args...);
+      put_at(x, y, buf, color);
     };
+    const cv::Scalar white(255, 255, 255);
 
     // Specific x positions of columns, I tinkered around with them and found a clean and consistent layout
     const int x_name = 6;
-    const int x_fps  = 100;
-    const int x_busy = 160;
-    const int x_lat  = 220;
-    const int x_last = 280;
+    const int x_fps  = 120;
+    const int x_busy = 180;
+    const int x_lat  = 240;
+    const int x_last = 300;
+    const int x_skip = 365;
+    const int x_waste = 420;
+    const int x_age = 480;
 
     const int x_qname   = 6;
-    const int x_usedcap = 100;
-    const int x_bar     = 160;
-    const int x_qdrop   = 280;
+    const int x_usedcap = 120;
+    const int x_bar     = 180;
+    const int x_qdrop   = 320;
+    const int x_qexp    = 380;
 
     int y = 18;
 
-    // Print HUD title
-    put_at(x_name, y, "PIPELINE STATS");
+    // Print HUD title, with whole-process CPU in cores
+    const auto cpu_ns = ProcessCpuNs();
+    const double cpu_cores = (dt > 0.0 && prev_cpu_ns_ != 0) ? static_cast<double>(cpu_ns - prev_cpu_ns_) / (dt * 1e9) : 0.0;
+    prev_cpu_ns_ = cpu_ns;
+    put_fmt(x_name, y, white, "PIPELINE STATS   cpu %.2f cores", cpu_cores);
     y += line;
 
     // Print column names
@@ -93,6 +114,9 @@ void HudOverlay::draw(cv::Mat& bgr, const Metrics& metrics, const std::vector<Qu
     put_at(x_busy, y, "BUSY%");
     put_at(x_lat,  y, "LAT(ms)");
     put_at(x_last, y, "LAST(ms)");
+    put_at(x_skip, y, "SKIP/s");
+    put_at(x_waste, y, "WASTE/s");
+    put_at(x_age, y, "AGE(ms)");
     y += line;
 
     cv::line(panel_, cv::Point(6, y - line + 4),
@@ -100,42 +124,47 @@ void HudOverlay::draw(cv::Mat& bgr, const Metrics& metrics, const std::vector<Qu
              cv::Scalar(180, 180, 180), 1);
 
     // For each stage, get its metrics, perform basic calculations and print
-    for (const auto& up : metrics.stages()) {
-      const StageMetrics* mptr = up.get();
-      const StageMetrics& m = *mptr;
-      auto& p = prev_stage_[mptr];
+    metrics.for_each_stage([&](const StageMetrics& m) {
+      auto& p = prev_stage_[&m];
 
       // Compute FPS
-      const auto c = m.count.load(std::memory_order_relaxed);
+      const auto c = m.count.value();
       const double fps = (dt > 0.0) ? (static_cast<double>(c - p.count) / dt) : 0.0;
       p.count = c;
 
       // Compute work to find Busy%
-      const auto work = m.work_ns_total.load(std::memory_order_relaxed);
+      const auto work = m.work_ns_total.value();
       double busy = (dt > 0.0) ? (static_cast<double>(work - p.work_ns) / (dt * 1e9)) : 0.0;
       busy = std::max(0.0, std::min(1.0, busy));
       auto busy_color = ColorByFrac(busy);
       p.work_ns = work;
 
       // Compute latency and staleness in ms
-      const double lat_ms = NsToMs(m.avg_latency_ns.load(std::memory_order_relaxed));
+      const double lat_ms = NsToMs(static_cast<std::uint64_t>(m.avg_latency_ns.value()));
       const auto le = m.last_event_ns.load(std::memory_order_relaxed);
       const double last_ms = (le == 0) ? 0.0 : NsToMs(now_ns - le);
 
-      std::ostringstream s_fps, s_busy, s_lat, s_last;
-      s_fps  << std::fixed << std::setprecision(1) << fps;
-      s_busy << std::fixed << std::setprecision(1) << (busy * 100.0);
-      s_lat  << std::fixed << std::setprecision(1) << lat_ms;
-      s_last << std::fixed << std::setprecision(1) << last_ms;
+      // Compute skipped/wasted work rates
+      const auto sk = m.skipped.value();
+      const auto wa = m.wasted.value();
+      const double skip_ps = (dt > 0.0) ? (static_cast<double>(sk - p.skipped) / dt) : 0.0;
+      const double waste_ps = (dt > 0.0) ? (static_cast<double>(wa - p.wasted) / dt) : 0.0;
+      p.skipped = sk;
+      p.wasted = wa;
 
       // Print entire stats row for stage
-      put_at(x_name, y, m.name);
-      put_at(x_fps,  y, s_fps.str());
-      put_at(x_busy, y, s_busy.str(), busy_color);
-      put_at(x_lat,  y, s_lat.str());
-      put_at(x_last, y, s_last.str());
+      put_at(x_name, y, m.name.c_str());
+      put_fmt(x_fps,  y, white, "%.1f", fps);
+      put_fmt(x_busy, y, busy_color, "%.1f", busy * 100.0);
+      put_fmt(x_lat,  y, white, "%.1f", lat_ms);
+      put_fmt(x_last, y, white, "%.1f", last_ms);
+      put_fmt(x_skip, y, white, "%.1f", skip_ps);
+      put_fmt(x_waste, y, white, "%.1f", waste_ps);
+      const auto age = static_cast<std::uint64_t>(m.avg_age_ns.value());
+      if (age > 0) put_fmt(x_age, y, white, "%.1f", NsToMs(age));
+      else put_at(x_age, y, "-");
       y += line;
-    }
+    });
 
     y += 12;
 
@@ -144,6 +173,7 @@ void HudOverlay::draw(cv::Mat& bgr, const Metrics& metrics, const std::vector<Qu
     put_at(x_usedcap, y, "CAP");
     put_at(x_bar,     y, "DEPTH");
     put_at(x_qdrop,   y, "DROP/s");
+    put_at(x_qexp,    y, "EXP/s");
     y += line;
 
     cv::line(panel_, cv::Point(6, y - line + 4),
@@ -165,36 +195,62 @@ void HudOverlay::draw(cv::Mat& bgr, const Metrics& metrics, const std::vector<Qu
       const double drop_ps = (dt > 0.0) ? (static_cast<double>(total_drops - prev_total) / dt) : 0.0;
       prev_total = total_drops;
 
-      std::ostringstream s_usedcap, s_drop;
-      s_usedcap << used << "/" << cap;
-      s_drop << std::fixed << std::setprecision(1) << drop_ps;
+      // Compute age-based expiries per second
+      const std::uint64_t total_expired = q.expired_fn ? q.expired_fn() : 0;
+      std::uint64_t& prev_expired = prev_qexpired_[q.name];
+      const double expired_ps = (dt > 0.0) ? (static_cast<double>(total_expired - prev_expired) / dt) : 0.0;
+      prev_expired = total_expired;
 
-      const std::string bar = "[" + Bar(used, cap, 20) + "]";
+      Bar(used, cap, 20, bar_);
 
       // Print stats for queue
-      put_at(x_qname, y, q.name);
-      put_at(x_usedcap, y, s_usedcap.str(), qcolor);
-      put_at(x_bar, y, bar, qcolor);
-      put_at(x_qdrop, y, s_drop.str());
+      put_at(x_qname, y, q.name.c_str());
+      put_fmt(x_usedcap, y, qcolor, "%zu/%zu", used, cap);
+      put_at(x_bar, y, bar_.c_str(), qcolor);
+      put_fmt(x_qdrop, y, white, "%.1f", drop_ps);
+      put_fmt(x_qexp, y, white, "%.1f", expired_ps);
       y += line;
     }
-  }
 
-  // At the end, position box in the bottom left of the frame
-  if (!panel_.empty()) {
-    const int margin = 6;
+    y += 12;
 
-    const int w = std::min(panel_.cols, bgr.cols - 2 * margin);
-    const int h = std::min(panel_.rows, bgr.rows - 2 * margin);
+    // Memory section, bytes held per queue/store (and its byte bound), process RSS in the header
+    std::uint64_t held = 0;
+    for (const auto& m : memory) held += m.bytes_fn ? m.bytes_fn() : 0;
 
-    const int x = margin;
-    const int y = bgr.rows - h - margin;
+    put_fmt(x_qname, y, white, "MEMORY  rss %.1f MB  held %.1f MB", BytesToMb(ProcessRssBytes()), BytesToMb(held));
+    y += line;
 
-    if (w > 0 && h > 0) {
-      panel_(cv::Rect(0, 0, w, h))
-          .copyTo(bgr(cv::Rect(x, y, w, h)));
+    for (const auto& m : memory) {
+      const std::uint64_t bytes = m.bytes_fn ? m.bytes_fn() : 0;
+      const std::uint64_t max = m.max_bytes_fn ? m.max_bytes_fn() : 0;
+
+      put_at(x_qname, y, m.name.c_str());
+      if (max > 0) {
+        const double frac = static_cast<double>(bytes) / static_cast<double>(max);
+        put_fmt(x_usedcap, y, ColorByFrac(frac), "%.1f MB / %.1f", BytesToMb(bytes), BytesToMb(max));
+        Bar(bytes, max, 12, bar_);
+        put_at(x_qdrop, y, bar_.c_str(), ColorByFrac(frac));
+      } else {
+        put_fmt(x_usedcap, y, white, "%.1f MB", BytesToMb(bytes));
+      }
+      y += line;
     }
   }
+
+  return needs_refresh;
+}
+
+// Bottom left of the frame, clipped to it
+cv::Rect HudOverlay::placement(cv::Size frame) const {
+  if (panel_.empty()) return cv::Rect();
+  const int margin = 6;
+
+  const int w = std::min(panel_.cols, frame.width - 2 * margin);
+  const int h = std::min(panel_.rows, frame.height - 2 * margin);
+  if (w <= 0 || h <= 0) return cv::Rect();
+
+  return cv::Rect(margin, frame.height - h - margin, w, h);
 }
 
-} // namespace dcp
\ No newline at end of file
+} // namespace dcp
@@ -0,0 +1,242 @@
+#include "apps/metrics_http_server.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "infra/process_stats.hpp"
+#include "infra/thread_tuning.hpp"
+
+namespace dcp {
+
+static constexpr std::size_t kMaxRequestBytes = 4096;
+
+// Label values are quoted, backslash, quote and newline escaped
+static void AppendLabelValue(std::string& out, const std::string& value) {
+  out += '"';
+  for (const char c : value) {
+    if (c == '\\' || c == '"') {
+      out += '\\';
+      out += c;
+    } else if (c == '\n') {
+      out += "\\n";
+    } else {
+      out += c;
+    }
+  }
+  out += '"';
+}
+
+// {k="v",...} plus le="<bound>" for histogram buckets, nothing if there are no labels
+static void AppendLabels(std::string& out, const MetricLabels& labels, const char* le = nullptr) {
+  if (labels.empty() && !le) return;
+  out += '{';
+  bool first = true;
+  for (const auto& kv : labels) {
+    if (!first) out += ',';
+    first = false;
+    out += kv.first;
+    out += '=';
+    AppendLabelValue(out, kv.second);
+  }
+  if (le) {
+    if (!first) out += ',';
+    out += "le=\"";
+    out += le;
+    out += '"';
+  }
+  out += '}';
+}
+
+// Whole numbers (counts, bytes) print exactly, the rest (seconds) to 9 digits
+static void AppendNumber(std::string& out, double v) {
+  char num[32];
+  if (v < 9.007199254740992e15 && v > -9.007199254740992e15 && v == static_cast<double>(static_cast<std::int64_t>(v))) {
+    std::snprintf(num, sizeof(num), "%lld", static_cast<long long>(v));
+  } else {
+    std::snprintf(num, sizeof(num), "%.9g", v);
+  }
+  out += num;
+}
+
+static void Family(std::string& out, const std::string& name, const char* type, const std::string& help) {
+  out += "# HELP ";
+  out += name;
+  out += ' ';
+  out += help;
+  out += "\n# TYPE ";
+  out += name;
+  out += ' ';
+  out += type;
+  out += '\n';
+}
+
+static void Sample(std::string& out, const std::string& name, const char* suffix, const MetricLabels& labels, double v, const char* le = nullptr) {
+  out += name;
+  out += suffix;
+  AppendLabels(out, labels, le);
+  out += ' ';
+  AppendNumber(out, v);
+  out += '\n';
+}
+
+static const char* TypeName(MetricType type) {
+  switch (type) {
+    case MetricType::Counter: return "counter";
+    case MetricType::Gauge: return "gauge";
+    case MetricType::Histogram: return "histogram";
+  }
+  return "untyped";
+}
+
+MetricsHttpServer::MetricsHttpServer(const HttpMetricsConfig& cfg, const Metrics& metrics)
+    : nice_(cfg.nice), metrics_(metrics), start_ns_(NowNs()) {
+  listen_fd_ = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (listen_fd_ < 0) throw std::runtime_error(std::string("metrics http: socket failed: ") + std::strerror(errno));
+  const int one = 1;
+  ::setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(static_cast<std::uint16_t>(cfg.port));
+  socklen_t len = sizeof(addr);
+  if (::bind(listen_fd_, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(listen_fd_, 8) != 0 ||
+      ::getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&addr), &len) != 0) {
+    const int err = errno;
+    ::close(listen_fd_);
+    throw std::runtime_error("metrics http: can't listen on 127.0.0.1:" + std::to_string(cfg.port) + ": " + std::strerror(err));
+  }
+  port_ = ntohs(addr.sin_port);
+  body_.reserve(64 * 1024);
+  response_.reserve(64 * 1024);
+}
+
+MetricsHttpServer::~MetricsHttpServer() {
+  ::close(listen_fd_);
+}
+
+void MetricsHttpServer::run(const StopToken& stop) {
+  ThreadConfig tc;
+  tc.nice = nice_;
+  const ThreadReport r = ApplyThreadConfig("metrics_http", tc);
+  if (ThreadConfigRequested(tc) || !r.notes.empty()) std::cout << "[thread] " << FormatThreadReport(r) << std::endl;
+
+  while (!stop.stop_requested()) {
+    pollfd p{listen_fd_, POLLIN, 0};
+    if (::poll(&p, 1, 200) <= 0) continue;
+    const int fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd < 0) continue;
+    serve(fd);
+    ::close(fd);
+  }
+}
+
+void MetricsHttpServer::serve(int fd) {
+  // A scraper that stalls mid-request or mid-response is cut off rather than holding the next one up
+  timeval tv{1, 0};
+  ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+  char req[kMaxRequestBytes];
+  std::size_t have = 0;
+  while (have < sizeof(req)) {
+    const ssize_t n = ::recv(fd, req + have, sizeof(req) - have, 0);
+    if (n <= 0) return;
+    have += static_cast<std::size_t>(n);
+    if (std::string_view(req, have).find("\r\n\r\n") != std::string_view::npos) break;
+  }
+
+  const std::string_view request(req, have);
+  const std::string_view line = request.substr(0, request.find("\r\n"));
+  const bool get = line.substr(0, 4) == "GET ";
+  const bool head = line.substr(0, 5) == "HEAD ";
+  const std::string_view target = line.substr(get ? 4 : head ? 5 : 0);
+  const bool metrics_path = target.substr(0, 9) == "/metrics " || target.substr(0, 9) == "/metrics?";
+
+  const char* status = "200 OK";
+  const std::string* body = nullptr;
+  static const std::string not_found = "Not found, try /metrics\n";
+  static const std::string not_allowed = "Only GET /metrics\n";
+  if (!get && !head) {
+    status = "405 Method Not Allowed";
+    body = &not_allowed;
+  } else if (!metrics_path) {
+    status = "404 Not Found";
+    body = &not_found;
+  } else {
+    body = &render();
+    scrapes_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  response_.clear();
+  response_ += "HTTP/1.1 ";
+  response_ += status;
+  response_ += "\r\nContent-Type: ";
+  response_ += body == &body_ ? "text/plain; version=0.0.4; charset=utf-8" : "text/plain; charset=utf-8";
+  response_ += "\r\nContent-Length: ";
+  response_ += std::to_string(body->size());
+  response_ += "\r\nConnection: close\r\n\r\n";
+  if (!head) response_ += *body;
+
+  std::size_t sent = 0;
+  while (sent < response_.size()) {
+    const ssize_t n = ::send(fd, response_.data() + sent, response_.size() - sent, MSG_NOSIGNAL);
+    if (n <= 0) return;
+    sent += static_cast<std::size_t>(n);
+  }
+}
+
+const std::string& MetricsHttpServer::render() {
+  const std::uint64_t t0 = NowNs();
+  std::string& out = body_;
+  out.clear();
+
+  metrics_.for_each_family([&](const MetricFamily& f) {
+    if (f.series.empty()) return;
+    Family(out, f.name, TypeName(f.type), f.help);
+    for (const auto& s : f.series) {
+      if (!s->histogram) {
+        Sample(out, f.name, "", s->labels, s->value() * f.scale);
+        continue;
+      }
+      // Buckets are cumulative in the exposition format
+      const std::uint64_t sum = s->histogram->read(buckets_);
+      const auto& bounds = s->histogram->bounds();
+      std::uint64_t cumulative = 0;
+      char le[32];
+      for (std::size_t b = 0; b < buckets_.size(); ++b) {
+        cumulative += buckets_[b];
+        if (b < bounds.size()) std::snprintf(le, sizeof(le), "%.9g", static_cast<double>(bounds[b]) * f.scale);
+        Sample(out, f.name, "_bucket", s->labels, static_cast<double>(cumulative), b < bounds.size() ? le : "+Inf");
+      }
+      Sample(out, f.name, "_sum", s->labels, static_cast<double>(sum) * f.scale);
+      Sample(out, f.name, "_count", s->labels, static_cast<double>(cumulative));
+    }
+  });
+
+  const MetricLabels none;
+  Family(out, "process_resident_memory_bytes", "gauge", "Resident memory size in bytes.");
+  Sample(out, "process_resident_memory_bytes", "", none, static_cast<double>(ProcessRssBytes()));
+  Family(out, "process_cpu_seconds_total", "counter", "Total user and system CPU time spent in seconds.");
+  Sample(out, "process_cpu_seconds_total", "", none, static_cast<double>(ProcessCpuNs()) / 1e9);
+  Family(out, "dcp_uptime_seconds", "gauge", "Time since the exporter started.");
+  Sample(out, "dcp_uptime_seconds", "", none, static_cast<double>(NowNs() - start_ns_) / 1e9);
+  Family(out, "dcp_scrape_render_seconds", "gauge", "Time the previous scrape took to render.");
+  Sample(out, "dcp_scrape_render_seconds", "", none, static_cast<double>(last_render_ns_) / 1e9);
+
+  last_render_ns_ = NowNs() - t0;
+  return out;
+}
+
+} // namespace dcp
@@ -0,0 +1,226 @@
+#include "apps/segmented_replay.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+#include <opencv2/videoio.hpp>
+
+#include "core/core_budget.hpp"
+#include "core/frame.hpp"
+#include "core/labels/general_labels.hpp"
+#include "core/preprocess_ops.hpp"
+#include "core/yolo_dnn.hpp"
+
+namespace dcp {
+
+static constexpr const char* kCsvHeader = "frame_id,media_ms,class_id,class_name,confidence,x,y,w,h";
+
+static std::string PartPath(const std::string& out_path, int index) {
+  return out_path + ".part" + std::to_string(index);
+}
+
+std::vector<ReplaySegment> PlanSegments(std::int64_t total_frames, int k) {
+  std::vector<ReplaySegment> segs;
+  if (total_frames <= 0 || k <= 0) return segs;
+
+  const std::int64_t n = std::min<std::int64_t>(k, total_frames);
+  segs.reserve(static_cast<std::size_t>(n));
+
+  for (std::int64_t i = 0; i < n; ++i) {
+    ReplaySegment s;
+    s.index = static_cast<int>(i);
+    s.begin_frame = total_frames * i / n;
+    s.end_frame = total_frames * (i + 1) / n;
+    segs.push_back(s);
+  }
+  return segs;
+}
+
+// Worker body: one capture, one detector, one part file per segment. Throws std::runtime_error if the segment can't
+// be processed completely (including when stopped), the caller then fails the whole run
+static std::uint64_t RunSegment(const AppConfig& cfg, const ReplaySegment& seg, const StopToken& stop,
+                                std::uint64_t& frames_out) {
+  const std::string where = "segment " + std::to_string(seg.index) + ": ";
+  cv::VideoCapture cap(cfg.camera.file_path);
+  if (!cap.isOpened()) throw std::runtime_error(where + "failed to open '" + cfg.camera.file_path + "'");
+
+  // FFmpeg backends seek to the keyframe before begin_frame and decode forward, so the first frame we read is
+  // begin_frame itself. Some backends land early instead, in which case we decode and discard up to begin_frame.
+  // Landing late would lose the frames in between
+  cap.set(cv::CAP_PROP_POS_FRAMES, static_cast<double>(seg.begin_frame));
+  std::int64_t idx = static_cast<std::int64_t>(cap.get(cv::CAP_PROP_POS_FRAMES));
+  if (idx > seg.begin_frame) {
+    throw std::runtime_error(where + "seek to frame " + std::to_string(seg.begin_frame) + " landed on " +
+                             std::to_string(idx) + ", try offline.workers: 1");
+  }
+
+  std::unique_ptr<YoloDnn> yolo;
+  if (cfg.inference.enabled) {
+    YoloDnn::Params p;
+    p.onnx_path = cfg.inference.model.path;
+    p.input_w = cfg.inference.model.input_width;
+    p.input_h = cfg.inference.model.input_height;
+    p.conf_thresh = cfg.inference.confidence_threshold;
+    p.nms_thresh = 0.45f;
+
+    yolo = std::make_unique<YoloDnn>(std::move(p));
+    if (!yolo->is_loaded()) throw std::runtime_error(where + "failed to load model '" + cfg.inference.model.path + "'");
+
+    if (yolo && seg.index == 0 && cfg.offline.batch_size > 1 && !yolo->supports_batch()) {
+      std::cerr << "model has a fixed batch axis, offline.batch_size=" << cfg.offline.batch_size
+                << " falls back to one frame per run\n";
+    }
+  }
+
+  const std::string part_path = PartPath(cfg.offline.output_path, seg.index);
+  std::ofstream part(part_path, std::ios::trunc);
+  if (!part) throw std::runtime_error(where + "failed to open '" + part_path + "'");
+  part << std::fixed;
+
+  double fps = cap.get(cv::CAP_PROP_FPS);
+  if (fps <= 1.0 || fps > 240.0) fps = 30.0;
+
+  std::uint64_t dets_written = 0;
+
+  // Frames are accumulated into batches of offline.batch_size and run through one ORT call each. Latency does not
+  // matter here, throughput does. Each PreprocessedFrame carries its own source_frame_id/PreprocessInfo, so results
+  // map back to the right frame regardless of batch size
+  const std::size_t batch_size = static_cast<std::size_t>(std::max(1, cfg.offline.batch_size));
+  std::vector<PreprocessedFrame> batch;
+  batch.reserve(batch_size);
+
+  auto flush = [&] {
+    if (batch.empty()) return;
+    const std::vector<Detections> results = yolo->infer_batch(batch);
+
+    for (const Detections& dets : results) {
+      const double media_ms = static_cast<double>(dets.source_frame_id) * 1000.0 / fps;
+      for (const auto& d : dets.items) {
+        const BBoxF raw = MapDetToRaw(d, dets.preprocess_info);
+        part << dets.source_frame_id << ',' << std::setprecision(1) << media_ms << ',' << d.class_id << ','
+             << GeneralClassName(d.class_id) << ',' << std::setprecision(3) << d.confidence << ','
+             << std::setprecision(1) << raw.x << ',' << raw.y << ',' << raw.w << ',' << raw.h << '\n';
+        ++dets_written;
+      }
+    }
+    batch.clear();
+  };
+
+  while (idx < seg.end_frame && !stop.stop_requested()) {
+    Frame f;
+    if (!cap.read(f.image)) {
+      throw std::runtime_error(where + "video ended at frame " + std::to_string(idx) + ", before the segment's end at " +
+                               std::to_string(seg.end_frame));
+    }
+
+    if (idx < seg.begin_frame) {
+      ++idx;
+      continue;
+    }
+
+    if (cfg.camera.flip_vertical) cv::flip(f.image, f.image, 0);
+    if (cfg.camera.flip_horizontal) cv::flip(f.image, f.image, 1);
+
+    // Global sequence ID is the absolute frame index, media time is derived from it so every worker agrees
+    f.sequence_id = static_cast<std::uint64_t>(idx);
+    f.capture_time = std::chrono::steady_clock::now();
+
+    if (yolo) {
+      batch.push_back(BuildPreprocessedFrame(f, cfg.preprocess));
+      if (batch.size() >= batch_size) flush();
+    }
+
+    ++frames_out;
+    ++idx;
+  }
+  if (stop.stop_requested()) throw std::runtime_error(where + "stopped at frame " + std::to_string(idx));
+  if (yolo) flush();
+
+  part.flush();
+  if (!part) throw std::runtime_error(where + "failed writing '" + part_path + "'");
+  return dets_written;
+}
+
+SegmentedReplayStats RunSegmentedReplay(const AppConfig& cfg, const StopToken& stop) {
+  SegmentedReplayStats stats;
+
+  std::int64_t total_frames = 0;
+  {
+    cv::VideoCapture probe(cfg.camera.file_path);
+    if (!probe.isOpened()) throw std::runtime_error("offline replay: failed to open '" + cfg.camera.file_path + "'");
+    total_frames = static_cast<std::int64_t>(probe.get(cv::CAP_PROP_FRAME_COUNT));
+  }
+  if (total_frames <= 0) {
+    throw std::runtime_error("offline replay: '" + cfg.camera.file_path + "' does not report a frame count");
+  }
+
+  int k = cfg.offline.workers;
+  if (k == 0) k = BudgetCores(cfg.budget);
+
+  const auto segs = PlanSegments(total_frames, k);
+  stats.workers = static_cast<int>(segs.size());
+
+  std::cout << "Offline replay: " << total_frames << " frames, " << segs.size() << " segments\n";
+
+  const auto t0 = std::chrono::steady_clock::now();
+
+  std::vector<std::uint64_t> frames(segs.size(), 0);
+  std::vector<std::uint64_t> dets(segs.size(), 0);
+  std::vector<std::string> errors(segs.size());
+  std::vector<std::thread> workers;
+  workers.reserve(segs.size());
+
+  for (std::size_t i = 0; i < segs.size(); ++i) {
+    workers.emplace_back([&, i] {
+      try {
+        dets[i] = RunSegment(cfg, segs[i], stop, frames[i]);
+      } catch (const std::exception& e) {
+        errors[i] = e.what();
+      }
+    });
+  }
+  for (auto& w : workers) w.join();
+
+  // A missing segment would leave a silent hole in the CSV, so any failure or a stop fails the run and nothing is
+  // merged
+  std::string failed;
+  for (const auto& e : errors) {
+    if (!e.empty()) failed += (failed.empty() ? "" : "; ") + e;
+  }
+  if (stop.stop_requested()) failed = "interrupted";
+  if (!failed.empty()) {
+    for (const auto& s : segs) std::remove(PartPath(cfg.offline.output_path, s.index).c_str());
+    throw std::runtime_error("offline replay: " + failed + ", nothing written");
+  }
+
+  // Merge part files in segment order. Segments are contiguous and each part is already in frame order,
+  // so concatenation gives a globally ordered log
+  std::ofstream out(cfg.offline.output_path, std::ios::trunc);
+  if (!out) throw std::runtime_error("offline replay: failed to open '" + cfg.offline.output_path + "'");
+  out << kCsvHeader << "\n";
+
+  for (const auto& s : segs) {
+    const std::string part_path = PartPath(cfg.offline.output_path, s.index);
+    {
+      std::ifstream part(part_path);
+      if (part && part.peek() != std::ifstream::traits_type::eof()) out << part.rdbuf();
+    }
+    std::remove(part_path.c_str());
+  }
+
+  for (std::size_t i = 0; i < segs.size(); ++i) {
+    stats.frames += frames[i];
+    stats.detections += dets[i];
+  }
+  stats.wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  return stats;
+}
+
+} // namespace dcp
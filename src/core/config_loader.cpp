@@ -1,4 +1,5 @@
 #include "core/config_loader.hpp"
+#include "infra/shm_infer_limits.hpp"
 
 #include <yaml-cpp/yaml.h>
 
@@ -52,19 +53,20 @@ static DropPolicy ParseDropPolicyKey(const YAML::Node& parent, const char* key,
   const std::string s = GetOrKey<std::string>(parent, key, key_path, "");
   if (s == "drop_oldest") return DropPolicy::DropOldest;
   if (s == "drop_newest") return DropPolicy::DropNewest;
-  throw ConfigError(key_path, "unknown drop_policy '" + s + "'. Use: drop_oldest | drop_newest");
+  if (s == "drop_older_than") return DropPolicy::DropOlderThan;
+  throw ConfigError(key_path, "unknown drop_policy '" + s + "'. Use: drop_oldest | drop_newest | drop_older_than");
 }
 
 static void LoadQueueConfig(const YAML::Node& qnode, const std::string& key_path, QueueConfig& out) {
   if (!qnode) return;
   out.capacity = GetOrKey<std::size_t>(qnode, "capacity", PathJoin(key_path, "capacity"), out.capacity);
   out.drop_policy = ParseDropPolicyKey(qnode, "drop_policy", PathJoin(key_path, "drop_policy"), out.drop_policy);
+  out.max_age_ms = GetOrKey<int>(qnode, "max_age_ms", PathJoin(key_path, "max_age_ms"), out.max_age_ms);
+  out.max_mb = GetOrKey<std::size_t>(qnode, "max_mb", PathJoin(key_path, "max_mb"), out.max_mb);
 }
 
-static void LoadCamera(const YAML::Node& root, CameraConfig& cfg) {
-  const YAML::Node cam = root["camera"];
+static void LoadCameraNode(const YAML::Node& cam, const std::string& p, CameraConfig& cfg) {
   if (!cam) return;
-  const std::string p = "camera";
 
   cfg.backend = GetOrKey<std::string>(cam, "backend", PathJoin(p, "backend"), cfg.backend);
   cfg.source = GetOrKey<std::string>(cam, "source", PathJoin(p, "source"), cfg.source);
@@ -75,6 +77,41 @@ static void LoadCamera(const YAML::Node& root, CameraConfig& cfg) {
   cfg.fps = GetOrKey<int>(cam, "fps", PathJoin(p, "fps"), cfg.fps);
   cfg.flip_vertical = GetOrKey<bool>(cam, "flip_vertical", PathJoin(p, "flip_vertical"), cfg.flip_vertical);
   cfg.flip_horizontal = GetOrKey<bool>(cam, "flip_horizontal", PathJoin(p, "flip_horizontal"), cfg.flip_horizontal);
+  cfg.skip_retrieve_when_full =
+      GetOrKey<bool>(cam, "skip_retrieve_when_full", PathJoin(p, "skip_retrieve_when_full"), cfg.skip_retrieve_when_full);
+  cfg.decode_ahead = GetOrKey<int>(cam, "decode_ahead", PathJoin(p, "decode_ahead"), cfg.decode_ahead);
+  cfg.frame_pool = GetOrKey<int>(cam, "frame_pool", PathJoin(p, "frame_pool"), cfg.frame_pool);
+}
+
+static void LoadCamera(const YAML::Node& root, CameraConfig& cfg) {
+  LoadCameraNode(root["camera"], "camera", cfg);
+}
+
+// Streams inherit the top-level camera section, so it must be loaded first
+static void LoadStreams(const YAML::Node& root, const CameraConfig& base, std::vector<StreamConfig>& out) {
+  out.clear();
+
+  const YAML::Node streams = root["streams"];
+  if (!streams) {
+    StreamConfig s;
+    s.camera = base;
+    out.push_back(std::move(s));
+    return;
+  }
+  if (!streams.IsSequence()) throw ConfigError("streams", "must be a list");
+
+  for (std::size_t i = 0; i < streams.size(); ++i) {
+    const YAML::Node sn = streams[i];
+    const std::string p = "streams[" + std::to_string(i) + "]";
+
+    StreamConfig s;
+    s.camera = base;
+    s.name = GetOrKey<std::string>(sn, "name", PathJoin(p, "name"), "stream" + std::to_string(i));
+    s.priority = GetOrKey<int>(sn, "priority", PathJoin(p, "priority"), s.priority);
+    s.min_fps = GetOrKey<float>(sn, "min_fps", PathJoin(p, "min_fps"), s.min_fps);
+    LoadCameraNode(Child(sn, "camera"), PathJoin(p, "camera"), s.camera);
+    out.push_back(std::move(s));
+  }
 }
 
 static void LoadPreprocess(const YAML::Node& root, PreprocessConfig& cfg) {
@@ -84,6 +121,10 @@ static void LoadPreprocess(const YAML::Node& root, PreprocessConfig& cfg) {
 
   cfg.resize_width = GetOrKey<int>(pre, "resize_width", PathJoin(p, "resize_width"), cfg.resize_width);
   cfg.resize_height = GetOrKey<int>(pre, "resize_height", PathJoin(p, "resize_height"), cfg.resize_height);
+  cfg.workers = GetOrKey<int>(pre, "workers", PathJoin(p, "workers"), cfg.workers);
+  cfg.reorder_window = GetOrKey<int>(pre, "reorder_window", PathJoin(p, "reorder_window"), cfg.reorder_window);
+  cfg.reorder_max_wait_ms =
+      GetOrKey<int>(pre, "reorder_max_wait_ms", PathJoin(p, "reorder_max_wait_ms"), cfg.reorder_max_wait_ms);
 
   const YAML::Node roi = pre["crop_roi"];
   if (!roi) return;
@@ -164,6 +205,9 @@ static void LoadInference(const YAML::Node& root, InferenceConfig& cfg) {
   cfg.target_fps = GetOrKey<int>(inf, "target_fps", PathJoin(p, "target_fps"), cfg.target_fps);
   cfg.confidence_threshold =
       GetOrKey<float>(inf, "confidence_threshold", PathJoin(p, "confidence_threshold"), cfg.confidence_threshold);
+  cfg.max_batch = GetOrKey<int>(inf, "max_batch", PathJoin(p, "max_batch"), cfg.max_batch);
+  cfg.demand_driven = GetOrKey<bool>(inf, "demand_driven", PathJoin(p, "demand_driven"), cfg.demand_driven);
+  cfg.demand_lead_ms = GetOrKey<int>(inf, "demand_lead_ms", PathJoin(p, "demand_lead_ms"), cfg.demand_lead_ms);
 
   const YAML::Node model = inf["model"];
   const std::string mp = PathJoin(p, "model");
@@ -172,6 +216,19 @@ static void LoadInference(const YAML::Node& root, InferenceConfig& cfg) {
     cfg.model.input_width = GetOrKey<int>(model, "input_width", PathJoin(mp, "input_width"), cfg.model.input_width);
     cfg.model.input_height = GetOrKey<int>(model, "input_height", PathJoin(mp, "input_height"), cfg.model.input_height);
   }
+
+  const YAML::Node worker = inf["worker"];
+  const std::string wp = PathJoin(p, "worker");
+  if (worker) {
+    auto& w = cfg.worker;
+    w.enabled = GetOrKey<bool>(worker, "enabled", PathJoin(wp, "enabled"), w.enabled);
+    w.executable = GetOrKey<std::string>(worker, "executable", PathJoin(wp, "executable"), w.executable);
+    w.shm_name = GetOrKey<std::string>(worker, "shm_name", PathJoin(wp, "shm_name"), w.shm_name);
+    w.max_detections = GetOrKey<int>(worker, "max_detections", PathJoin(wp, "max_detections"), w.max_detections);
+    w.timeout_ms = GetOrKey<int>(worker, "timeout_ms", PathJoin(wp, "timeout_ms"), w.timeout_ms);
+    w.startup_timeout_ms = GetOrKey<int>(worker, "startup_timeout_ms", PathJoin(wp, "startup_timeout_ms"), w.startup_timeout_ms);
+    w.restart_backoff_ms = GetOrKey<int>(worker, "restart_backoff_ms", PathJoin(wp, "restart_backoff_ms"), w.restart_backoff_ms);
+  }
 }
 
 static void LoadTracking(const YAML::Node& root, TrackingConfig& cfg) {
@@ -209,9 +266,96 @@ static void LoadVisualization(const YAML::Node& root, VisualizationConfig& cfg)
     cfg.recording.output_path = GetOrKey<std::string>(rec, "output_path", PathJoin(rp, "output_path"),
                                                       cfg.recording.output_path);
     cfg.recording.fps = GetOrKey<int>(rec, "fps", PathJoin(rp, "fps"), cfg.recording.fps);
+    cfg.recording.source = GetOrKey<std::string>(rec, "source", PathJoin(rp, "source"), cfg.recording.source);
+    cfg.recording.codec = GetOrKey<std::string>(rec, "codec", PathJoin(rp, "codec"), cfg.recording.codec);
+    cfg.recording.scale = GetOrKey<double>(rec, "scale", PathJoin(rp, "scale"), cfg.recording.scale);
+    LoadQueueConfig(rec["queue"], PathJoin(rp, "queue"), cfg.recording.queue);
   }
 }
 
+static void LoadDurability(const YAML::Node& node, const std::string& key_path, DurabilityConfig& out) {
+  if (!node) return;
+  out.fsync = GetOrKey<std::string>(node, "fsync", PathJoin(key_path, "fsync"), out.fsync);
+  out.sync_mb = GetOrKey<int>(node, "sync_mb", PathJoin(key_path, "sync_mb"), out.sync_mb);
+}
+
+static void LoadSinks(const YAML::Node& root, SinksConfig& cfg) {
+  const YAML::Node s = root["sinks"];
+  if (!s) return;
+  const std::string p = "sinks";
+
+  const YAML::Node tl = s["track_log"];
+  const std::string tp = PathJoin(p, "track_log");
+  if (tl) {
+    cfg.track_log.enabled = GetOrKey<bool>(tl, "enabled", PathJoin(tp, "enabled"), cfg.track_log.enabled);
+    cfg.track_log.output_path =
+        GetOrKey<std::string>(tl, "output_path", PathJoin(tp, "output_path"), cfg.track_log.output_path);
+    LoadDurability(tl["durability"], PathJoin(tp, "durability"), cfg.track_log.durability);
+    LoadQueueConfig(tl["queue"], PathJoin(tp, "queue"), cfg.track_log.queue);
+  }
+
+  const YAML::Node lr = s["loop_recorder"];
+  const std::string lp = PathJoin(p, "loop_recorder");
+  if (lr) {
+    auto& l = cfg.loop_recorder;
+    l.enabled = GetOrKey<bool>(lr, "enabled", PathJoin(lp, "enabled"), l.enabled);
+    l.directory = GetOrKey<std::string>(lr, "directory", PathJoin(lp, "directory"), l.directory);
+    l.segment_s = GetOrKey<int>(lr, "segment_s", PathJoin(lp, "segment_s"), l.segment_s);
+    l.disk_quota_mb = GetOrKey<int>(lr, "disk_quota_mb", PathJoin(lp, "disk_quota_mb"), l.disk_quota_mb);
+    l.pre_event_s = GetOrKey<int>(lr, "pre_event_s", PathJoin(lp, "pre_event_s"), l.pre_event_s);
+    l.post_event_s = GetOrKey<int>(lr, "post_event_s", PathJoin(lp, "post_event_s"), l.post_event_s);
+    l.max_event_s = GetOrKey<int>(lr, "max_event_s", PathJoin(lp, "max_event_s"), l.max_event_s);
+    l.ring_mb = GetOrKey<int>(lr, "ring_mb", PathJoin(lp, "ring_mb"), l.ring_mb);
+    l.max_fps = GetOrKey<int>(lr, "max_fps", PathJoin(lp, "max_fps"), l.max_fps);
+    l.jpeg_quality = GetOrKey<int>(lr, "jpeg_quality", PathJoin(lp, "jpeg_quality"), l.jpeg_quality);
+    l.scale = GetOrKey<double>(lr, "scale", PathJoin(lp, "scale"), l.scale);
+    l.trigger_box_height = GetOrKey<float>(lr, "trigger_box_height", PathJoin(lp, "trigger_box_height"), l.trigger_box_height);
+    l.trigger_min_confidence =
+        GetOrKey<float>(lr, "trigger_min_confidence", PathJoin(lp, "trigger_min_confidence"), l.trigger_min_confidence);
+    LoadDurability(lr["segment_durability"], PathJoin(lp, "segment_durability"), l.segment_durability);
+    LoadDurability(lr["event_durability"], PathJoin(lp, "event_durability"), l.event_durability);
+    LoadQueueConfig(lr["queue"], PathJoin(lp, "queue"), l.queue);
+  }
+
+  const YAML::Node sh = s["shm"];
+  const std::string sp = PathJoin(p, "shm");
+  if (sh) {
+    auto& m = cfg.shm;
+    m.enabled = GetOrKey<bool>(sh, "enabled", PathJoin(sp, "enabled"), m.enabled);
+    m.name = GetOrKey<std::string>(sh, "name", PathJoin(sp, "name"), m.name);
+    m.world_slots = GetOrKey<int>(sh, "world_slots", PathJoin(sp, "world_slots"), m.world_slots);
+    m.frame_slots = GetOrKey<int>(sh, "frame_slots", PathJoin(sp, "frame_slots"), m.frame_slots);
+    m.publish_frames = GetOrKey<bool>(sh, "publish_frames", PathJoin(sp, "publish_frames"), m.publish_frames);
+    m.max_frame_mb = GetOrKey<int>(sh, "max_frame_mb", PathJoin(sp, "max_frame_mb"), m.max_frame_mb);
+    LoadQueueConfig(sh["queue"], PathJoin(sp, "queue"), m.queue);
+  }
+
+  const YAML::Node ts = s["track_stream"];
+  const std::string xp = PathJoin(p, "track_stream");
+  if (ts) {
+    auto& t = cfg.track_stream;
+    t.enabled = GetOrKey<bool>(ts, "enabled", PathJoin(xp, "enabled"), t.enabled);
+    t.socket_path = GetOrKey<std::string>(ts, "socket_path", PathJoin(xp, "socket_path"), t.socket_path);
+    t.max_subscribers = GetOrKey<int>(ts, "max_subscribers", PathJoin(xp, "max_subscribers"), t.max_subscribers);
+    t.send_buffer_kb = GetOrKey<int>(ts, "send_buffer_kb", PathJoin(xp, "send_buffer_kb"), t.send_buffer_kb);
+    LoadQueueConfig(ts["queue"], PathJoin(xp, "queue"), t.queue);
+  }
+}
+
+static void LoadIo(const YAML::Node& root, IoConfig& cfg) {
+  const YAML::Node io = root["io"];
+  if (!io) return;
+  const std::string p = "io";
+
+  cfg.backend = GetOrKey<std::string>(io, "backend", PathJoin(p, "backend"), cfg.backend);
+  cfg.queue_depth = GetOrKey<int>(io, "queue_depth", PathJoin(p, "queue_depth"), cfg.queue_depth);
+  cfg.buffer_kb = GetOrKey<int>(io, "buffer_kb", PathJoin(p, "buffer_kb"), cfg.buffer_kb);
+  cfg.buffers = GetOrKey<int>(io, "buffers", PathJoin(p, "buffers"), cfg.buffers);
+  cfg.max_in_flight_mb = GetOrKey<int>(io, "max_in_flight_mb", PathJoin(p, "max_in_flight_mb"), cfg.max_in_flight_mb);
+  cfg.workers = GetOrKey<int>(io, "workers", PathJoin(p, "workers"), cfg.workers);
+  cfg.max_files = GetOrKey<int>(io, "max_files", PathJoin(p, "max_files"), cfg.max_files);
+}
+
 static void LoadMetrics(const YAML::Node& root, MetricsConfig& cfg) {
   const YAML::Node m = root["metrics"];
   if (!m) return;
@@ -220,6 +364,7 @@ static void LoadMetrics(const YAML::Node& root, MetricsConfig& cfg) {
   cfg.enable_console_log =
       GetOrKey<bool>(m, "enable_console_log", PathJoin(p, "enable_console_log"), cfg.enable_console_log);
   cfg.log_interval_ms = GetOrKey<int>(m, "log_interval_ms", PathJoin(p, "log_interval_ms"), cfg.log_interval_ms);
+  cfg.perf_counters = GetOrKey<bool>(m, "perf_counters", PathJoin(p, "perf_counters"), cfg.perf_counters);
 
   const YAML::Node csv = m["record_csv"];
   const std::string cp = PathJoin(p, "record_csv");
@@ -228,14 +373,134 @@ static void LoadMetrics(const YAML::Node& root, MetricsConfig& cfg) {
     cfg.record_csv.output_path =
         GetOrKey<std::string>(csv, "output_path", PathJoin(cp, "output_path"), cfg.record_csv.output_path);
   }
+
+  const YAML::Node http = m["http"];
+  const std::string hp = PathJoin(p, "http");
+  if (http) {
+    cfg.http.enabled = GetOrKey<bool>(http, "enabled", PathJoin(hp, "enabled"), cfg.http.enabled);
+    cfg.http.port = GetOrKey<int>(http, "port", PathJoin(hp, "port"), cfg.http.port);
+    cfg.http.nice = GetOrKey<int>(http, "nice", PathJoin(hp, "nice"), cfg.http.nice);
+  }
+
+  const YAML::Node fr = m["flight_recorder"];
+  const std::string fp = PathJoin(p, "flight_recorder");
+  if (fr) {
+    auto& f = cfg.flight_recorder;
+    f.enabled = GetOrKey<bool>(fr, "enabled", PathJoin(fp, "enabled"), f.enabled);
+    f.path = GetOrKey<std::string>(fr, "path", PathJoin(fp, "path"), f.path);
+    f.records = GetOrKey<int>(fr, "records", PathJoin(fp, "records"), f.records);
+    f.flush_interval_ms = GetOrKey<int>(fr, "flush_interval_ms", PathJoin(fp, "flush_interval_ms"), f.flush_interval_ms);
+  }
+}
+
+static void LoadOffline(const YAML::Node& root, OfflineConfig& cfg) {
+  const YAML::Node off = root["offline"];
+  if (!off) return;
+  const std::string p = "offline";
+
+  cfg.workers = GetOrKey<int>(off, "workers", PathJoin(p, "workers"), cfg.workers);
+  cfg.batch_size = GetOrKey<int>(off, "batch_size", PathJoin(p, "batch_size"), cfg.batch_size);
+  cfg.output_path = GetOrKey<std::string>(off, "output_path", PathJoin(p, "output_path"), cfg.output_path);
+}
+
+static void LoadExecutor(const YAML::Node& root, ExecutorConfig& cfg) {
+  const YAML::Node ex = root["executor"];
+  if (!ex) return;
+  const std::string p = "executor";
+
+  cfg.mode = GetOrKey<std::string>(ex, "mode", PathJoin(p, "mode"), cfg.mode);
+  cfg.workers = GetOrKey<int>(ex, "workers", PathJoin(p, "workers"), cfg.workers);
+  cfg.task_stages = GetOrKey<std::vector<std::string>>(ex, "task_stages", PathJoin(p, "task_stages"), cfg.task_stages);
+  cfg.high_priority = GetOrKey<std::vector<std::string>>(ex, "high_priority", PathJoin(p, "high_priority"), cfg.high_priority);
+}
+
+static void LoadThreadConfig(const YAML::Node& tnode, const std::string& p, ThreadConfig& out) {
+  if (!tnode) return;
+  out.cpus = GetOrKey<std::vector<int>>(tnode, "cpus", PathJoin(p, "cpus"), out.cpus);
+  out.policy = GetOrKey<std::string>(tnode, "policy", PathJoin(p, "policy"), out.policy);
+  out.priority = GetOrKey<int>(tnode, "priority", PathJoin(p, "priority"), out.priority);
+  out.nice = GetOrKey<int>(tnode, "nice", PathJoin(p, "nice"), out.nice);
+}
+
+static void LoadThreads(const YAML::Node& root, ThreadsConfig& cfg) {
+  const YAML::Node th = root["threads"];
+  if (!th) return;
+  const std::string p = "threads";
+
+  LoadThreadConfig(th["camera"], PathJoin(p, "camera"), cfg.camera);
+  LoadThreadConfig(th["preprocess"], PathJoin(p, "preprocess"), cfg.preprocess);
+  LoadThreadConfig(th["inference"], PathJoin(p, "inference"), cfg.inference);
+  LoadThreadConfig(th["tracking"], PathJoin(p, "tracking"), cfg.tracking);
+  LoadThreadConfig(th["render"], PathJoin(p, "render"), cfg.render);
+  LoadThreadConfig(th["recording"], PathJoin(p, "recording"), cfg.recording);
+  LoadThreadConfig(th["io"], PathJoin(p, "io"), cfg.io);
+  LoadThreadConfig(th["executor"], PathJoin(p, "executor"), cfg.executor);
+}
+
+static void LoadBudget(const YAML::Node& root, CoreBudgetConfig& cfg) {
+  const YAML::Node b = root["budget"];
+  if (!b) return;
+  const std::string p = "budget";
+
+  cfg.cores = GetOrKey<int>(b, "cores", PathJoin(p, "cores"), cfg.cores);
+  cfg.opencv_threads = GetOrKey<int>(b, "opencv_threads", PathJoin(p, "opencv_threads"), cfg.opencv_threads);
+  cfg.ort_intra_op_threads = GetOrKey<int>(b, "ort_intra_op_threads", PathJoin(p, "ort_intra_op_threads"), cfg.ort_intra_op_threads);
+  cfg.ort_inter_op_threads = GetOrKey<int>(b, "ort_inter_op_threads", PathJoin(p, "ort_inter_op_threads"), cfg.ort_inter_op_threads);
+  cfg.ort_global_pool = GetOrKey<bool>(b, "ort_global_pool", PathJoin(p, "ort_global_pool"), cfg.ort_global_pool);
+  cfg.ort_cpus = GetOrKey<std::vector<int>>(b, "ort_cpus", PathJoin(p, "ort_cpus"), cfg.ort_cpus);
+}
+
+static void ValidateQueueConfig(const QueueConfig& q, const std::string& p) {
+  if (q.max_age_ms < 0) throw ConfigError(PathJoin(p, "max_age_ms"), "must be >= 0");
+  if (q.drop_policy == DropPolicy::DropOlderThan && q.max_age_ms == 0)
+    throw ConfigError(PathJoin(p, "max_age_ms"), "must be > 0 with drop_policy drop_older_than");
+  if (q.drop_policy != DropPolicy::DropOlderThan && q.max_age_ms != 0)
+    throw ConfigError(PathJoin(p, "max_age_ms"), "only used with drop_policy drop_older_than");
+}
+
+static void ValidateThreadConfig(const ThreadConfig& t, const std::string& p) {
+  for (int cpu : t.cpus) {
+    if (cpu < 0) throw ConfigError(PathJoin(p, "cpus"), "cpu ids must be >= 0");
+  }
+  if (t.policy != "other" && t.policy != "fifo" && t.policy != "rr")
+    throw ConfigError(PathJoin(p, "policy"), "unknown policy '" + t.policy + "'. Use: other | fifo | rr");
+  if (t.policy != "other" && (t.priority < 1 || t.priority > 99))
+    throw ConfigError(PathJoin(p, "priority"), "must be in [1, 99] for fifo/rr");
+  if (t.nice < -20 || t.nice > 19) throw ConfigError(PathJoin(p, "nice"), "must be in [-20, 19]");
+}
+
+static void ValidateDurability(const DurabilityConfig& d, const std::string& p) {
+  if (d.fsync != "none" && d.fsync != "close" && d.fsync != "periodic")
+    throw ConfigError(PathJoin(p, "fsync"), "unknown mode '" + d.fsync + "'. Use: none | close | periodic");
+  if (d.fsync == "periodic" && d.sync_mb < 1) throw ConfigError(PathJoin(p, "sync_mb"), "must be >= 1 with fsync periodic");
 }
 
 void ValidateOrThrow(const AppConfig& cfg) {
   if (cfg.camera.width <= 0 || cfg.camera.height <= 0) throw ConfigError("camera", "width/height must be > 0");
   if (cfg.camera.fps <= 0) throw ConfigError("camera.fps", "must be > 0");
+  if (cfg.camera.decode_ahead < 0) throw ConfigError("camera.decode_ahead", "must be >= 0");
+  if (cfg.camera.frame_pool < 0) throw ConfigError("camera.frame_pool", "must be >= 0");
+
+  if (cfg.streams.empty()) throw ConfigError("streams", "at least one stream is required");
+  for (std::size_t i = 0; i < cfg.streams.size(); ++i) {
+    const auto& s = cfg.streams[i];
+    const std::string p = "streams[" + std::to_string(i) + "]";
+    if (s.name.empty()) throw ConfigError(PathJoin(p, "name"), "must not be empty");
+    for (std::size_t j = 0; j < i; ++j) {
+      if (cfg.streams[j].name == s.name) throw ConfigError(PathJoin(p, "name"), "duplicate stream name '" + s.name + "'");
+    }
+    if (s.min_fps < 0.f) throw ConfigError(PathJoin(p, "min_fps"), "must be >= 0");
+    if (s.camera.width <= 0 || s.camera.height <= 0) throw ConfigError(PathJoin(p, "camera"), "width/height must be > 0");
+    if (s.camera.fps <= 0) throw ConfigError(PathJoin(p, "camera.fps"), "must be > 0");
+    if (s.camera.decode_ahead < 0) throw ConfigError(PathJoin(p, "camera.decode_ahead"), "must be >= 0");
+    if (s.camera.frame_pool < 0) throw ConfigError(PathJoin(p, "camera.frame_pool"), "must be >= 0");
+  }
 
   if (cfg.preprocess.resize_width <= 0 || cfg.preprocess.resize_height <= 0)
     throw ConfigError("preprocess", "resize_width/resize_height must be > 0");
+  if (cfg.preprocess.workers < 1) throw ConfigError("preprocess.workers", "must be >= 1");
+  if (cfg.preprocess.reorder_window < 1) throw ConfigError("preprocess.reorder_window", "must be >= 1");
+  if (cfg.preprocess.reorder_max_wait_ms < 0) throw ConfigError("preprocess.reorder_max_wait_ms", "must be >= 0");
 
   if (cfg.preprocess.crop_roi.enabled) {
     const auto& r = cfg.preprocess.crop_roi;
@@ -252,6 +517,10 @@ void ValidateOrThrow(const AppConfig& cfg) {
     }
   }
 
+  ValidateQueueConfig(cfg.buffering.queues.camera_to_preprocess, "buffering.queues.camera_to_preprocess");
+  ValidateQueueConfig(cfg.buffering.queues.preprocess_to_tracking, "buffering.queues.preprocess_to_tracking");
+  ValidateQueueConfig(cfg.buffering.queues.tracking_to_visualization, "buffering.queues.tracking_to_visualization");
+
   if (cfg.buffering.queues.camera_to_preprocess.capacity < 1)
     throw ConfigError("buffering.queues.camera_to_preprocess.capacity", "must be >= 1");
   if (cfg.buffering.queues.preprocess_to_tracking.capacity < 1)
@@ -264,8 +533,24 @@ void ValidateOrThrow(const AppConfig& cfg) {
       throw ConfigError("inference.target_fps", "must be > 0 when inference.enabled=true");
     if (cfg.inference.confidence_threshold < 0.f || cfg.inference.confidence_threshold > 1.f)
       throw ConfigError("inference.confidence_threshold", "must be in [0, 1]");
+    if (cfg.inference.max_batch < 1)
+      throw ConfigError("inference.max_batch", "must be >= 1");
+    if (cfg.inference.demand_lead_ms < 0)
+      throw ConfigError("inference.demand_lead_ms", "must be >= 0");
     if (cfg.inference.backend != "dummy" && cfg.inference.model.path.empty())
       throw ConfigError("inference.model.path", "required when inference.backend != 'dummy'");
+
+    const auto& w = cfg.inference.worker;
+    if (w.enabled) {
+      if (cfg.inference.max_batch > static_cast<int>(kShmInferMaxBatch))
+        throw ConfigError("inference.max_batch", "must be <= " + std::to_string(kShmInferMaxBatch) + " with inference.worker.enabled");
+      if (w.shm_name.size() < 2 || w.shm_name[0] != '/' || w.shm_name.find('/', 1) != std::string::npos)
+        throw ConfigError("inference.worker.shm_name", "must be '/' followed by a name without further slashes, e.g. /dcp_infer");
+      if (w.max_detections < 1) throw ConfigError("inference.worker.max_detections", "must be >= 1");
+      if (w.timeout_ms < 1) throw ConfigError("inference.worker.timeout_ms", "must be >= 1");
+      if (w.startup_timeout_ms < 1) throw ConfigError("inference.worker.startup_timeout_ms", "must be >= 1");
+      if (w.restart_backoff_ms < 1) throw ConfigError("inference.worker.restart_backoff_ms", "must be >= 1");
+    }
   }
 
   if (cfg.tracking.iou_threshold < 0.f || cfg.tracking.iou_threshold > 1.f)
@@ -277,6 +562,108 @@ void ValidateOrThrow(const AppConfig& cfg) {
     throw ConfigError("visualization.recording.fps", "must be > 0 when recording enabled");
 
   if (cfg.metrics.log_interval_ms <= 0) throw ConfigError("metrics.log_interval_ms", "must be > 0");
+  if (cfg.metrics.http.port < 0 || cfg.metrics.http.port > 65535)
+    throw ConfigError("metrics.http.port", "must be in [0, 65535] (0 = any free port)");
+  if (cfg.metrics.http.nice < 0 || cfg.metrics.http.nice > 19) throw ConfigError("metrics.http.nice", "must be in [0, 19]");
+  if (cfg.metrics.flight_recorder.enabled) {
+    const auto& f = cfg.metrics.flight_recorder;
+    if (f.path.empty()) throw ConfigError("metrics.flight_recorder.path", "must not be empty when enabled");
+    if (f.records < 1 || f.records > (1 << 26)) throw ConfigError("metrics.flight_recorder.records", "must be in [1, 67108864]");
+    if (f.flush_interval_ms < 0) throw ConfigError("metrics.flight_recorder.flush_interval_ms", "must be >= 0");
+  }
+
+  const auto& rec = cfg.visualization.recording;
+  ValidateQueueConfig(rec.queue, "visualization.recording.queue");
+  if (rec.queue.capacity < 1) throw ConfigError("visualization.recording.queue.capacity", "must be >= 1");
+  if (rec.fps < 1) throw ConfigError("visualization.recording.fps", "must be >= 1");
+  if (rec.source != "raw" && rec.source != "annotated")
+    throw ConfigError("visualization.recording.source", "unknown source '" + rec.source + "'. Use: raw | annotated");
+  if (rec.codec.size() != 4) throw ConfigError("visualization.recording.codec", "must be a 4 character FourCC, e.g. mp4v");
+  if (rec.scale <= 0.0 || rec.scale > 1.0) throw ConfigError("visualization.recording.scale", "must be in (0, 1]");
+  if (rec.enabled && rec.output_path.empty()) throw ConfigError("visualization.recording.output_path", "must not be empty");
+
+  ValidateQueueConfig(cfg.sinks.track_log.queue, "sinks.track_log.queue");
+  if (cfg.sinks.track_log.queue.capacity < 1) throw ConfigError("sinks.track_log.queue.capacity", "must be >= 1");
+  if (cfg.sinks.track_log.enabled && cfg.sinks.track_log.output_path.empty())
+    throw ConfigError("sinks.track_log.output_path", "must not be empty");
+  ValidateDurability(cfg.sinks.track_log.durability, "sinks.track_log.durability");
+
+  const auto& lr = cfg.sinks.loop_recorder;
+  ValidateQueueConfig(lr.queue, "sinks.loop_recorder.queue");
+  if (lr.queue.capacity < 1) throw ConfigError("sinks.loop_recorder.queue.capacity", "must be >= 1");
+  if (lr.enabled && lr.directory.empty()) throw ConfigError("sinks.loop_recorder.directory", "must not be empty");
+  if (lr.segment_s < 1) throw ConfigError("sinks.loop_recorder.segment_s", "must be >= 1");
+  if (lr.disk_quota_mb < 1) throw ConfigError("sinks.loop_recorder.disk_quota_mb", "must be >= 1");
+  if (lr.pre_event_s < 0) throw ConfigError("sinks.loop_recorder.pre_event_s", "must be >= 0");
+  if (lr.post_event_s < 0) throw ConfigError("sinks.loop_recorder.post_event_s", "must be >= 0");
+  if (lr.max_event_s < lr.post_event_s) throw ConfigError("sinks.loop_recorder.max_event_s", "must be >= post_event_s");
+  if (lr.ring_mb < 1) throw ConfigError("sinks.loop_recorder.ring_mb", "must be >= 1");
+  if (lr.max_fps < 1) throw ConfigError("sinks.loop_recorder.max_fps", "must be >= 1");
+  if (lr.jpeg_quality < 1 || lr.jpeg_quality > 100) throw ConfigError("sinks.loop_recorder.jpeg_quality", "must be in [1, 100]");
+  if (lr.scale <= 0.0 || lr.scale > 1.0) throw ConfigError("sinks.loop_recorder.scale", "must be in (0, 1]");
+  if (lr.trigger_box_height < 0.f || lr.trigger_box_height > 1.f)
+    throw ConfigError("sinks.loop_recorder.trigger_box_height", "must be in [0, 1]");
+  ValidateDurability(lr.segment_durability, "sinks.loop_recorder.segment_durability");
+  ValidateDurability(lr.event_durability, "sinks.loop_recorder.event_durability");
+
+  const auto& sh = cfg.sinks.shm;
+  ValidateQueueConfig(sh.queue, "sinks.shm.queue");
+  if (sh.queue.capacity < 1) throw ConfigError("sinks.shm.queue.capacity", "must be >= 1");
+  if (sh.name.size() < 2 || sh.name[0] != '/' || sh.name.find('/', 1) != std::string::npos)
+    throw ConfigError("sinks.shm.name", "must be '/' followed by a name without further slashes, e.g. /dcp");
+  if (sh.world_slots < 2) throw ConfigError("sinks.shm.world_slots", "must be >= 2");
+  if (sh.frame_slots < 2) throw ConfigError("sinks.shm.frame_slots", "must be >= 2");
+  if (sh.max_frame_mb < 0) throw ConfigError("sinks.shm.max_frame_mb", "must be >= 0 (0 = from the camera size)");
+
+  const auto& ts = cfg.sinks.track_stream;
+  ValidateQueueConfig(ts.queue, "sinks.track_stream.queue");
+  if (ts.queue.capacity < 1) throw ConfigError("sinks.track_stream.queue.capacity", "must be >= 1");
+  // sun_path is 108 bytes, leave room for a _<stream> suffix
+  if (ts.socket_path.empty() || ts.socket_path.size() > 80)
+    throw ConfigError("sinks.track_stream.socket_path", "must be a path of at most 80 characters");
+  if (ts.max_subscribers < 1) throw ConfigError("sinks.track_stream.max_subscribers", "must be >= 1");
+  // A keyframe of kMaxTracks tracks is about 4 KB and has to fit
+  if (ts.send_buffer_kb < 8) throw ConfigError("sinks.track_stream.send_buffer_kb", "must be >= 8");
+
+  if (cfg.io.backend != "auto" && cfg.io.backend != "io_uring" && cfg.io.backend != "threads")
+    throw ConfigError("io.backend", "unknown backend '" + cfg.io.backend + "'. Use: auto | io_uring | threads");
+  if (cfg.io.queue_depth < 1 || cfg.io.queue_depth > 4096) throw ConfigError("io.queue_depth", "must be in [1, 4096]");
+  if (cfg.io.buffer_kb < 4) throw ConfigError("io.buffer_kb", "must be >= 4");
+  if (cfg.io.buffers < 2) throw ConfigError("io.buffers", "must be >= 2");
+  if (cfg.io.max_in_flight_mb < 1) throw ConfigError("io.max_in_flight_mb", "must be >= 1");
+  if (cfg.io.workers < 1) throw ConfigError("io.workers", "must be >= 1");
+  if (cfg.io.max_files < 1) throw ConfigError("io.max_files", "must be >= 1");
+
+  if (cfg.offline.workers < 0) throw ConfigError("offline.workers", "must be >= 0");
+  if (cfg.offline.batch_size < 1) throw ConfigError("offline.batch_size", "must be >= 1");
+  if (cfg.offline.output_path.empty()) throw ConfigError("offline.output_path", "must not be empty");
+
+  if (cfg.executor.mode != "threads" && cfg.executor.mode != "tasks")
+    throw ConfigError("executor.mode", "unknown mode '" + cfg.executor.mode + "'. Use: threads | tasks");
+  if (cfg.executor.workers < 0) throw ConfigError("executor.workers", "must be >= 0");
+  for (const auto& name : cfg.executor.task_stages) {
+    if (name != "preprocess" && name != "tracking" && name != "render" && name != "track_log" && name != "shm" &&
+        name != "track_stream")
+      throw ConfigError("executor.task_stages",
+                        "stage '" + name + "' can't run as a task. Supported: preprocess | tracking | render | track_log | shm | track_stream");
+  }
+
+  ValidateThreadConfig(cfg.threads.camera, "threads.camera");
+  ValidateThreadConfig(cfg.threads.preprocess, "threads.preprocess");
+  ValidateThreadConfig(cfg.threads.inference, "threads.inference");
+  ValidateThreadConfig(cfg.threads.tracking, "threads.tracking");
+  ValidateThreadConfig(cfg.threads.render, "threads.render");
+  ValidateThreadConfig(cfg.threads.recording, "threads.recording");
+  ValidateThreadConfig(cfg.threads.io, "threads.io");
+  ValidateThreadConfig(cfg.threads.executor, "threads.executor");
+
+  if (cfg.budget.cores < 0) throw ConfigError("budget.cores", "must be >= 0");
+  if (cfg.budget.opencv_threads < 0) throw ConfigError("budget.opencv_threads", "must be >= 0");
+  if (cfg.budget.ort_intra_op_threads < 1) throw ConfigError("budget.ort_intra_op_threads", "must be >= 1");
+  if (cfg.budget.ort_inter_op_threads < 1) throw ConfigError("budget.ort_inter_op_threads", "must be >= 1");
+  for (int cpu : cfg.budget.ort_cpus) {
+    if (cpu < 0) throw ConfigError("budget.ort_cpus", "cpu ids must be >= 0");
+  }
 }
 
 AppConfig LoadConfigFromYamlFile(const std::string& path) {
@@ -290,12 +677,19 @@ AppConfig LoadConfigFromYamlFile(const std::string& path) {
   }
 
   LoadCamera(root, cfg.camera);
+  LoadStreams(root, cfg.camera, cfg.streams);
   LoadPreprocess(root, cfg.preprocess);
   LoadBuffering(root, cfg.buffering);
   LoadInference(root, cfg.inference);
   LoadTracking(root, cfg.tracking);
   LoadVisualization(root, cfg.visualization);
+  LoadSinks(root, cfg.sinks);
+  LoadIo(root, cfg.io);
   LoadMetrics(root, cfg.metrics);
+  LoadOffline(root, cfg.offline);
+  LoadExecutor(root, cfg.executor);
+  LoadThreads(root, cfg.threads);
+  LoadBudget(root, cfg.budget);
 
   ValidateOrThrow(cfg);
   return cfg;
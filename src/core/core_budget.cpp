@@ -0,0 +1,139 @@
+#include "core/core_budget.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "core/ort_runtime.hpp"
+#include "infra/thread_tuning.hpp"
+
+namespace dcp {
+
+int BudgetCores(const CoreBudgetConfig& budget) {
+  const int available = AvailableCpuCount();
+  return budget.cores > 0 ? std::min(budget.cores, available) : available;
+}
+
+static bool Overlaps(const std::vector<int>& a, const std::vector<int>& b) {
+  for (int x : a) {
+    if (std::find(b.begin(), b.end(), x) != b.end()) return true;
+  }
+  return false;
+}
+
+static std::string Policy(const ThreadConfig& t) {
+  std::string s = t.policy;
+  if (t.policy != "other") s += ":" + std::to_string(t.priority);
+  if (t.nice != 0) s += " nice=" + std::to_string(t.nice);
+  return s;
+}
+
+CoreLayout ApplyCoreBudget(const AppConfig& cfg, PipelineMode mode) {
+  const CoreBudgetConfig& b = cfg.budget;
+  CoreLayout layout;
+  layout.cores = BudgetCores(b);
+
+  // OpenCV's parallel_for pool (resize, cvtColor, ...). 0 keeps OpenCV's own default
+  if (b.opencv_threads > 0) cv::setNumThreads(b.opencv_threads);
+  const int cv_threads = std::max(1, cv::getNumThreads());
+
+  OrtThreading ort;
+  ort.intra_op_threads = b.ort_intra_op_threads;
+  ort.inter_op_threads = b.ort_inter_op_threads;
+  ort.global_pool = b.ort_global_pool;
+  ort.intra_op_cpus = b.ort_cpus;
+  ConfigureOrtRuntime(ort);
+
+  std::ostringstream os;
+  std::ostringstream warn;
+  auto row = [&os](const std::string& who, int threads, const std::string& cpus, const std::string& extra) {
+    os << "[budget] " << std::left << std::setw(12) << who << " x" << std::setw(3) << threads << " cpus="
+       << std::setw(8) << cpus << extra << "\n";
+  };
+
+  os << "[budget] cores=" << layout.cores << " (configured " << (b.cores > 0 ? std::to_string(b.cores) : "all")
+     << ", " << AvailableCpuCount() << " available to the process)\n";
+
+  int planned = 0;
+  const int ort_extra = (b.ort_intra_op_threads - 1) + (b.ort_inter_op_threads - 1);
+  const std::string ort_pool = b.ort_global_pool ? "global pool" : "per-session pool";
+
+  if (mode == PipelineMode::Live) {
+    const int streams = static_cast<int>(cfg.streams.size());
+    const bool tasks = cfg.executor.mode == "tasks";
+    auto as_task = [&](const std::string& kind) {
+      return tasks && std::find(cfg.executor.task_stages.begin(), cfg.executor.task_stages.end(), kind) != cfg.executor.task_stages.end();
+    };
+
+    int decode_threads = 0;
+    for (const auto& s : cfg.streams) {
+      if (s.camera.source == "file" && s.camera.decode_ahead > 0) ++decode_threads;
+    }
+    const int camera_threads = streams + decode_threads;
+    const int preprocess_threads = (as_task("preprocess") && cfg.preprocess.workers <= 1) ? 0 : streams * cfg.preprocess.workers;
+    const int tracking_threads = as_task("tracking") ? 0 : streams;
+    const int render_threads = (!cfg.visualization.enabled || as_task("render")) ? 0 : streams; // None when headless
+    const int recording_threads = ((cfg.visualization.recording.enabled ? 1 : 0) + (cfg.sinks.loop_recorder.enabled ? 1 : 0)) * streams;
+    const int track_log_threads = (!cfg.sinks.track_log.enabled || as_task("track_log")) ? 0 : streams;
+    const int shm_threads = (!cfg.sinks.shm.enabled || as_task("shm")) ? 0 : streams;
+    const int stream_threads = (!cfg.sinks.track_stream.enabled || as_task("track_stream")) ? 0 : streams;
+    // One io_uring service thread, or the threads backend workers ("auto" planned as io_uring)
+    const bool file_sinks = cfg.sinks.track_log.enabled || cfg.sinks.loop_recorder.enabled;
+    const int io_threads = !file_sinks ? 0 : (cfg.io.backend == "threads" ? cfg.io.workers : 1);
+    const int executor_threads = tasks ? (cfg.executor.workers > 0 ? cfg.executor.workers : AvailableCpuCount()) : 0;
+
+    row("camera", camera_threads, FormatCpuList(cfg.threads.camera.cpus), Policy(cfg.threads.camera));
+    if (preprocess_threads > 0) row("preprocess", preprocess_threads, FormatCpuList(cfg.threads.preprocess.cpus), Policy(cfg.threads.preprocess));
+    if (tracking_threads > 0) row("tracking", tracking_threads, FormatCpuList(cfg.threads.tracking.cpus), Policy(cfg.threads.tracking));
+    if (render_threads > 0) row("render", render_threads, FormatCpuList(cfg.threads.render.cpus), Policy(cfg.threads.render));
+    if (recording_threads > 0) row("recording", recording_threads, FormatCpuList(cfg.threads.recording.cpus), Policy(cfg.threads.recording));
+    if (track_log_threads > 0) row("track_log", track_log_threads, "any", "");
+    if (shm_threads > 0) row("shm", shm_threads, "any", "");
+    if (stream_threads > 0) row("track_stream", stream_threads, "any", "");
+    if (io_threads > 0) row("io", io_threads, FormatCpuList(cfg.threads.io.cpus), Policy(cfg.threads.io));
+    if (executor_threads > 0) row("executor", executor_threads, FormatCpuList(cfg.threads.executor.cpus), Policy(cfg.threads.executor));
+    row("inference", 1, FormatCpuList(cfg.threads.inference.cpus), Policy(cfg.threads.inference) + (cfg.inference.worker.enabled ? ", worker process" : ""));
+    planned += camera_threads + preprocess_threads + tracking_threads + render_threads + recording_threads + track_log_threads + shm_threads + stream_threads + io_threads + executor_threads + 1;
+
+    // Camera and tracking are what jitter when ORT lands on their cores
+    std::vector<int> ort_cpus = b.ort_cpus;
+    ort_cpus.insert(ort_cpus.end(), cfg.threads.inference.cpus.begin(), cfg.threads.inference.cpus.end());
+    if (Overlaps(cfg.threads.camera.cpus, ort_cpus)) warn << "[budget] warning: camera shares CPUs with inference/ORT\n";
+    if (Overlaps(cfg.threads.tracking.cpus, ort_cpus)) warn << "[budget] warning: tracking shares CPUs with inference/ORT\n";
+    if (cfg.threads.camera.cpus.empty() && cfg.inference.enabled) warn << "[budget] note: camera is unpinned, ORT threads may preempt it\n";
+  } else if (mode == PipelineMode::Worker) {
+    row("inference", 1, FormatCpuList(cfg.threads.inference.cpus), Policy(cfg.threads.inference));
+    planned += 1;
+  } else {
+    const int workers = cfg.offline.workers > 0 ? cfg.offline.workers : layout.cores;
+    row("segments", workers, "any", "");
+    planned += workers;
+  }
+
+  // Per-session pools multiply by session count. Live has one session, offline one per segment worker
+  const int sessions = (mode == PipelineMode::Offline && !b.ort_global_pool)
+      ? (cfg.offline.workers > 0 ? cfg.offline.workers : layout.cores) : 1;
+  row("ort", ort_extra * sessions, FormatCpuList(b.ort_cpus),
+      "intra=" + std::to_string(b.ort_intra_op_threads) + " inter=" + std::to_string(b.ort_inter_op_threads) + ", " + ort_pool);
+  planned += ort_extra * sessions;
+
+  // OpenCV's pool threads only run inside a parallel_for called from a stage thread, count the extras
+  row("opencv", cv_threads, "any", b.opencv_threads > 0 ? "" : "opencv default");
+  planned += cv_threads - 1;
+
+  layout.planned_threads = planned;
+  layout.oversubscribed = planned > layout.cores;
+  os << "[budget] planned busy threads: " << planned << " / " << layout.cores << " cores"
+     << (layout.oversubscribed ? "  OVERSUBSCRIBED, expect p99 latency spikes" : "") << "\n";
+  os << warn.str();
+
+  layout.report = os.str();
+  std::cout << layout.report << std::flush;
+  return layout;
+}
+
+} // namespace dcp
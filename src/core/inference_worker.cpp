@@ -0,0 +1,223 @@
+#include "core/inference_worker.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <utility>
+
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+
+#include "infra/shm_channel.hpp"
+
+extern char** environ;
+
+namespace dcp {
+
+static constexpr int kMaxBackoffMs = 30000;
+static constexpr std::int64_t kWaitSliceNs = 20'000'000;   // Check the worker is still alive this often while waiting
+
+static std::int64_t MsToNs(int ms) {
+  return static_cast<std::int64_t>(ms) * 1'000'000;
+}
+
+InferenceWorker::InferenceWorker(Options opts, StageMetrics* ipc_metrics)
+    : opts_(std::move(opts)),
+      ipc_metrics_(ipc_metrics),
+      channel_(opts_.shm_name, opts_.max_batch, opts_.frame_capacity, opts_.max_detections),
+      backoff_ms_(opts_.restart_backoff_ms) {}
+
+InferenceWorker::~InferenceWorker() {
+  if (pid_ <= 0) return;
+  channel_.request_shutdown();
+  for (int i = 0; i < 100; ++i) {
+    if (::waitpid(pid_, nullptr, WNOHANG) == pid_) return;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ::kill(pid_, SIGKILL);
+  ::waitpid(pid_, nullptr, 0);
+}
+
+void InferenceWorker::spawn() {
+  // Only once the previous worker is gone, so nothing else writes the response area
+  channel_.reset_worker();
+
+  std::string exe = opts_.executable;
+  std::string cfg = opts_.config_path;
+  std::string shm = opts_.shm_name;
+  char* argv[] = {exe.data(), cfg.data(), shm.data(), nullptr};
+  pid_t pid = -1;
+  const int err = ::posix_spawn(&pid, exe.c_str(), nullptr, nullptr, argv, environ);
+  if (err != 0) {
+    std::cerr << "inference: can't start worker '" << exe << "': " << std::strerror(err) << "\n";
+    went_down(true);
+    return;
+  }
+  pid_ = pid;
+  state_ = State::Starting;
+  started_ns_ = ShmNowNs();
+}
+
+bool InferenceWorker::reap(const char* why) {
+  if (pid_ <= 0) return true;
+  int status = 0;
+  if (::waitpid(pid_, &status, WNOHANG) != pid_) return false;
+
+  std::cerr << "inference: worker pid " << pid_ << " " << why;
+  if (WIFEXITED(status)) std::cerr << " (exit " << WEXITSTATUS(status) << ")";
+  if (WIFSIGNALED(status)) std::cerr << " (signal " << WTERMSIG(status) << ")";
+  std::cerr << ", detections go stale until it is back\n";
+  pid_ = -1;
+  return true;
+}
+
+void InferenceWorker::kill_worker(const char* why) {
+  if (pid_ <= 0) return;
+  std::cerr << "inference: worker pid " << pid_ << " " << why << ", killing it\n";
+  ::kill(pid_, SIGKILL);
+  ::waitpid(pid_, nullptr, 0);
+  pid_ = -1;
+}
+
+void InferenceWorker::went_down(bool failed_start) {
+  state_ = State::Down;
+  next_spawn_ns_ = ShmNowNs() + MsToNs(backoff_ms_);
+  // A worker that can't get ready (bad model path, missing binary) is retried less and less often
+  if (failed_start) backoff_ms_ = std::min(kMaxBackoffMs, backoff_ms_ * 2);
+}
+
+bool InferenceWorker::poll() {
+  switch (state_) {
+    case State::Down:
+      if (ShmNowNs() >= next_spawn_ns_) spawn();
+      break;
+
+    case State::Starting:
+      if (reap("exited during startup")) {
+        went_down(true);
+      } else if (channel_.worker_state() == ShmWorkerState::Ready) {
+        state_ = State::Ready;
+        backoff_ms_ = opts_.restart_backoff_ms;
+        if (was_ready_) ++restarts_;
+        std::cout << "inference: worker pid " << pid_ << " ready" << (was_ready_ ? " (restart #" + std::to_string(restarts_) + ")" : "")
+                  << (channel_.batch_dynamic() ? ", batched" : "") << std::endl;
+        was_ready_ = true;
+      } else if (ShmNowNs() - started_ns_ > MsToNs(opts_.startup_timeout_ms)) {
+        kill_worker("did not load its model in time");
+        went_down(true);
+      }
+      break;
+
+    case State::Ready:
+      if (reap("exited")) went_down(false);
+      break;
+  }
+  return state_ == State::Ready;
+}
+
+bool InferenceWorker::supports_batch() const {
+  return state_ == State::Ready && channel_.batch_dynamic();
+}
+
+bool InferenceWorker::infer_batch_into(const std::vector<PreprocessedFrame>& frames, std::vector<Detections>& outs) {
+  if (state_ != State::Ready || frames.empty()) return false;
+  const std::size_t n = std::min(frames.size(), channel_.max_batch());
+  const auto t0 = std::chrono::steady_clock::now();
+
+  // The one copy: each preprocessed image goes into its request slot, rows packed
+  for (std::size_t k = 0; k < n; ++k) {
+    const PreprocessedFrame& pf = frames[k];
+    const cv::Mat& img = pf.image;
+    const std::size_t row_bytes = img.cols * img.elemSize();
+    const std::size_t bytes = row_bytes * static_cast<std::size_t>(img.rows);
+    if (bytes > channel_.frame_capacity()) {
+      std::cerr << "inference: frame " << img.cols << "x" << img.rows << " doesn't fit a worker slot\n";
+      if (ipc_metrics_) ipc_metrics_->on_wasted();
+      return false;
+    }
+
+    std::uint8_t* dst = channel_.pixels(k);
+    if (img.isContinuous()) {
+      std::memcpy(dst, img.data, bytes);
+    } else {
+      for (int r = 0; r < img.rows; ++r) std::memcpy(dst + static_cast<std::size_t>(r) * row_bytes, img.ptr(r), row_bytes);
+    }
+
+    ShmInferFrame& f = channel_.frame(k);
+    f.source_frame_id = pf.source_frame_id;
+    f.capture_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(pf.capture_time.time_since_epoch()).count();
+    f.width = img.cols;
+    f.height = img.rows;
+    f.type = img.type();
+    f.stride = static_cast<std::int32_t>(row_bytes);
+    f.bytes = bytes;
+    f.roi_applied = pf.info.roi_applied ? 1 : 0;
+    f.roi_x = pf.info.roi.x;
+    f.roi_y = pf.info.roi.y;
+    f.roi_w = pf.info.roi.width;
+    f.roi_h = pf.info.roi.height;
+    f.resize_width = pf.info.resize_width;
+    f.resize_height = pf.info.resize_height;
+    f.reserved = 0;
+  }
+
+  // Wait in slices, a worker that died mid-request is noticed right away rather than at the timeout
+  const std::uint32_t seq = channel_.submit(n);
+  const std::int64_t deadline = ShmNowNs() + MsToNs(opts_.timeout_ms);
+  bool answered = false;
+  while (!answered) {
+    const std::int64_t left = deadline - ShmNowNs();
+    if (left <= 0) {
+      kill_worker("did not answer within inference.worker.timeout_ms");
+      went_down(false);
+      break;
+    }
+    answered = channel_.wait_response(seq, std::min(left, kWaitSliceNs));
+    if (!answered && reap("died during a request")) {
+      went_down(false);
+      break;
+    }
+  }
+  if (!answered || channel_.status() != 0) {
+    if (ipc_metrics_) ipc_metrics_->on_wasted();
+    return false;
+  }
+
+  const auto done = std::chrono::steady_clock::now();
+  if (outs.size() < n) outs.resize(n);
+  bool out_of_range = false;
+  for (std::size_t k = 0; k < n; ++k) {
+    const ShmInferResult& r = channel_.result(k);
+    const ShmDetection* dets = channel_.detections(k);
+    Detections& out = outs[k];
+    out.inference_time = done;
+    out.source_frame_id = r.source_frame_id;
+    out.preprocess_info = frames[k].info;
+    out.items.clear();
+    // The count comes from the other process, never read past this frame's detection slots
+    std::uint32_t count = r.detection_count;
+    if (count > channel_.max_detections()) {
+      count = static_cast<std::uint32_t>(channel_.max_detections());
+      out_of_range = true;
+    }
+    for (std::uint32_t i = 0; i < count; ++i) {
+      Detection d;
+      d.bbox = BBox{dets[i].x, dets[i].y, dets[i].w, dets[i].h};
+      d.class_id = dets[i].class_id;
+      d.confidence = dets[i].confidence;
+      out.items.push_back(d);
+    }
+  }
+
+  if (out_of_range && ipc_metrics_) ipc_metrics_->on_wasted();
+  if (ipc_metrics_) {
+    const auto round_trip = std::chrono::duration_cast<std::chrono::nanoseconds>(done - t0).count();
+    ipc_metrics_->on_item(static_cast<std::uint64_t>(std::max<std::int64_t>(0, round_trip - channel_.run_ns())));
+  }
+  return true;
+}
+
+} // namespace dcp
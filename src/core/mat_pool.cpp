@@ -0,0 +1,38 @@
+#include "core/mat_pool.hpp"
+
+namespace dcp {
+
+MatPool::MatPool(std::size_t max_buffers) : max_(max_buffers) {
+  bufs_.reserve(max_);
+}
+
+// Only the pool's own header left. Atomic read, the last consumer may be releasing on another thread right now
+bool MatPool::Unshared(const cv::Mat& m) {
+  return m.u != nullptr && CV_XADD(&m.u->refcount, 0) == 1;
+}
+
+cv::Mat MatPool::acquire(int rows, int cols, int type) {
+  if (rows <= 0 || cols <= 0) return cv::Mat();
+
+  for (auto& b : bufs_) {
+    if (b.rows == rows && b.cols == cols && b.type() == type && Unshared(b)) return b;
+  }
+
+  // Geometry changed (e.g. a camera switched mode), reallocate a free slot rather than growing the pool
+  for (auto& b : bufs_) {
+    if (Unshared(b)) {
+      b.create(rows, cols, type);
+      return b;
+    }
+  }
+
+  if (bufs_.size() < max_) {
+    bufs_.emplace_back(rows, cols, type);
+    return bufs_.back();
+  }
+
+  ++misses_;
+  return cv::Mat(rows, cols, type);
+}
+
+} // namespace dcp
@@ -0,0 +1,84 @@
+#include "core/ort_runtime.hpp"
+
+#include <iostream>
+#include <memory>
+#include <mutex>
+
+namespace dcp {
+
+static std::mutex g_ort_mu;
+static OrtThreading g_ort_threading;
+static std::unique_ptr<Ort::Env> g_ort_env;
+
+void ConfigureOrtRuntime(const OrtThreading& t) {
+  std::lock_guard<std::mutex> lock(g_ort_mu);
+  if (g_ort_env) {
+    std::cerr << "ConfigureOrtRuntime ignored, ORT Env already created\n";
+    return;
+  }
+  g_ort_threading = t;
+}
+
+OrtThreading OrtRuntimeThreading() {
+  std::lock_guard<std::mutex> lock(g_ort_mu);
+  return g_ort_threading;
+}
+
+Ort::Env& SharedOrtEnv() {
+  std::lock_guard<std::mutex> lock(g_ort_mu);
+  if (g_ort_env) return *g_ort_env;
+
+  if (!g_ort_threading.global_pool) {
+    g_ort_env = std::make_unique<Ort::Env>(ORT_LOGGING_LEVEL_WARNING, "dcp");
+    return *g_ort_env;
+  }
+
+  Ort::ThreadingOptions tp;
+  tp.SetGlobalIntraOpNumThreads(g_ort_threading.intra_op_threads);
+  tp.SetGlobalInterOpNumThreads(g_ort_threading.inter_op_threads);
+  tp.SetGlobalSpinControl(0); // Pool threads sleep between runs instead of spinning on cores our stages need
+
+  const std::string affinity = OrtAffinityString(g_ort_threading.intra_op_threads, g_ort_threading.intra_op_cpus);
+  if (!affinity.empty()) {
+    try {
+      Ort::ThrowOnError(Ort::GetApi().SetGlobalIntraOpThreadAffinity(tp, affinity.c_str()));
+    } catch (const Ort::Exception& e) {
+      std::cerr << "ORT intra-op affinity '" << affinity << "' rejected: " << e.what() << "\n";
+    }
+  }
+
+  g_ort_env = std::make_unique<Ort::Env>(tp, ORT_LOGGING_LEVEL_WARNING, "dcp");
+  return *g_ort_env;
+}
+
+void ApplyOrtSessionThreading(Ort::SessionOptions& opts) {
+  const OrtThreading t = OrtRuntimeThreading();
+
+  if (t.inter_op_threads > 1) opts.SetExecutionMode(ExecutionMode::ORT_PARALLEL);
+
+  if (t.global_pool) {
+    opts.DisablePerSessionThreads();
+    return;
+  }
+
+  opts.SetIntraOpNumThreads(t.intra_op_threads);
+  opts.SetInterOpNumThreads(t.inter_op_threads);
+  opts.AddConfigEntry("session.intra_op.allow_spinning", "0");
+
+  const std::string affinity = OrtAffinityString(t.intra_op_threads, t.intra_op_cpus);
+  if (!affinity.empty()) opts.AddConfigEntry("session.intra_op_thread_affinities", affinity.c_str());
+}
+
+std::string OrtAffinityString(int intra_op_threads, const std::vector<int>& cpus) {
+  if (cpus.empty() || intra_op_threads <= 1) return {};
+
+  // The calling thread is intra-op thread 0 and keeps its own pinning, ORT only takes the other N-1
+  std::string s;
+  for (int i = 0; i < intra_op_threads - 1; ++i) {
+    if (i > 0) s += ";";
+    s += std::to_string(cpus[static_cast<std::size_t>(i) % cpus.size()] + 1);
+  }
+  return s;
+}
+
+} // namespace dcp
@@ -0,0 +1,97 @@
+#include "core/preprocess_ops.hpp"
+
+#include <chrono>
+
+#include <opencv2/imgproc.hpp>
+
+namespace dcp {
+
+// Simple helper function to encapsulate ROI clamping
+static cv::Rect ClampRect(const cv::Rect& r, int w, int h) {
+  cv::Rect bounds(0, 0, w, h);
+  cv::Rect out = r & bounds;
+  return out;
+}
+
+cv::Rect ComputeRoiRect(const cv::Mat& img, const RoiConfig& cfg) {
+  if (!cfg.enabled) return cv::Rect(0, 0, img.cols, img.rows);
+
+  cv::Rect roi;
+
+  if (cfg.use_normalized) {
+    auto clamp01 = [](float v) {
+      if (v < 0.f) return 0.f;
+      if (v > 1.f) return 1.f;
+      return v;
+    };
+
+    const float x0 = clamp01(cfg.x_norm);
+    const float y0 = clamp01(cfg.y_norm);
+    const float w0 = clamp01(cfg.w_norm);
+    const float h0 = clamp01(cfg.h_norm);
+
+    const int x = static_cast<int>(x0 * img.cols);
+    const int y = static_cast<int>(y0 * img.rows);
+    const int w = static_cast<int>(w0 * img.cols);
+    const int h = static_cast<int>(h0 * img.rows);
+
+    roi = cv::Rect(x, y, w, h);
+  } else {
+    roi = cv::Rect(cfg.x, cfg.y, cfg.width, cfg.height);
+  }
+
+  roi = ClampRect(roi, img.cols, img.rows);
+
+  if (roi.width <= 0 || roi.height <= 0) {
+    // Fallback values for invalid configurations, bottomg half of the frame
+    roi = cv::Rect(0, img.rows / 2, img.cols, img.rows - (img.rows / 2));
+    roi = ClampRect(roi, img.cols, img.rows);
+  }
+
+  return roi;
+}
+
+PreprocessedFrame BuildPreprocessedFrame(const Frame& f, const PreprocessConfig& cfg, cv::Mat buffer) {
+  const cv::Mat& src = f.image;
+
+  // Perform ROI crop, nothing changes if disabled
+  const cv::Rect roi = ComputeRoiRect(src, cfg.crop_roi);
+  const cv::Mat roi_view = src(roi);
+
+  // Resize to configured size
+  cv::resize(roi_view, buffer, cv::Size(cfg.resize_width, cfg.resize_height), 0, 0, cv::INTER_LINEAR);
+
+  PreprocessedFrame pf;
+  pf.source_frame_id = f.sequence_id;
+  pf.capture_time = f.capture_time;
+  pf.image = std::move(buffer);
+  pf.info.roi_applied = cfg.crop_roi.enabled;
+  pf.info.roi = roi;
+  pf.info.resize_width = cfg.resize_width;
+  pf.info.resize_height = cfg.resize_height;
+
+  pf.preprocess_time = std::chrono::steady_clock::now();
+  return pf;
+}
+
+BBoxF MapDetToRaw(const Detection& d, const PreprocessInfo& pi) {
+  const auto& roi = pi.roi;
+
+  const float rw = roi.width  > 0 ? static_cast<float>(roi.width)  : 1.f;
+  const float rh = roi.height > 0 ? static_cast<float>(roi.height) : 1.f;
+
+  const float sw = pi.resize_width  > 0 ? static_cast<float>(pi.resize_width)  : rw;
+  const float sh = pi.resize_height > 0 ? static_cast<float>(pi.resize_height) : rh;
+
+  const float sx = rw / sw;
+  const float sy = rh / sh;
+
+  BBoxF out;
+  out.x = static_cast<float>(roi.x) + d.bbox.x * sx;
+  out.y = static_cast<float>(roi.y) + d.bbox.y * sy;
+  out.w = d.bbox.w * sx;
+  out.h = d.bbox.h * sy;
+  return out;
+}
+
+} // namespace dcp
@@ -0,0 +1,252 @@
+#include "core/track_stream.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace dcp {
+
+static TrackFullRecord ToRecord(const Track& tr) {
+  TrackFullRecord r{};
+  r.id = tr.id;
+  r.x = tr.bbox.x;
+  r.y = tr.bbox.y;
+  r.w = tr.bbox.w;
+  r.h = tr.bbox.h;
+  r.confidence = tr.confidence;
+  r.class_id = static_cast<std::int16_t>(tr.class_id);
+  r.missed_frames = static_cast<std::uint8_t>(std::clamp(tr.missed_frames, 0, 255));
+  r.flags = tr.confirmed ? kTrackConfirmed : 0;
+  return r;
+}
+
+static std::uint8_t QuantizeConfidence(float c) {
+  return static_cast<std::uint8_t>(std::lround(std::clamp(c, 0.f, 1.f) * 255.f));
+}
+
+// Delta of one coordinate in kTrackStreamPosStep units, false if it doesn't fit an int16. Ties round to even, so a
+// track sitting exactly half a step off what the decoder has stays put instead of flipping by a step every frame
+static bool QuantizeDelta(float to, float from, std::int16_t& out) {
+  const float q = std::nearbyint((to - from) / kTrackStreamPosStep);
+  if (!(std::fabs(q) <= static_cast<float>(std::numeric_limits<std::int16_t>::max()))) return false;  // NaN too
+  out = static_cast<std::int16_t>(q);
+  return true;
+}
+
+// Encoder and decoder both go through this, so they rebuild bit-identical tracks
+static void ApplyDelta(TrackFullRecord& r, const TrackDeltaRecord& d) {
+  r.x += static_cast<float>(d.dx) * kTrackStreamPosStep;
+  r.y += static_cast<float>(d.dy) * kTrackStreamPosStep;
+  r.w += static_cast<float>(d.dw) * kTrackStreamPosStep;
+  r.h += static_cast<float>(d.dh) * kTrackStreamPosStep;
+  r.confidence = static_cast<float>(d.confidence) / 255.f;
+  r.missed_frames = d.missed_frames;
+  r.flags = d.flags;
+}
+
+template <typename T>
+static void AppendRecords(std::vector<std::uint8_t>& out, const std::vector<T>& records) {
+  if (records.empty()) return;
+  const std::size_t at = out.size();
+  out.resize(at + records.size() * sizeof(T));
+  std::memcpy(out.data() + at, records.data(), records.size() * sizeof(T));
+}
+
+TrackStreamEncoder::TrackStreamEncoder() {
+  prev_.reserve(kMaxTracks);
+  next_.reserve(kMaxTracks);
+  fulls_.reserve(kMaxTracks);
+  deltas_.reserve(kMaxTracks);
+  removed_.reserve(kMaxTracks);
+  seen_.reserve(kMaxTracks);
+  delta_msg_.reserve(sizeof(TrackStreamHeader) + kMaxTracks * (sizeof(TrackFullRecord) + sizeof(std::uint64_t)));
+  key_msg_.reserve(sizeof(TrackStreamHeader) + kMaxTracks * sizeof(TrackFullRecord));
+}
+
+void TrackStreamEncoder::write_header(std::vector<std::uint8_t>& out, TrackStreamKind kind, std::size_t fulls, std::size_t deltas,
+                                      std::size_t removed, std::size_t tracks) const {
+  TrackStreamHeader h{};
+  h.magic = kTrackStreamMagic;
+  h.version = kTrackStreamVersion;
+  h.kind = static_cast<std::uint8_t>(kind);
+  h.message_bytes = static_cast<std::uint32_t>(out.size());
+  h.full_count = static_cast<std::uint16_t>(fulls);
+  h.delta_count = static_cast<std::uint16_t>(deltas);
+  h.removed_count = static_cast<std::uint16_t>(removed);
+  h.track_count = static_cast<std::uint16_t>(tracks);
+  h.frame_id = frame_id_;
+  h.base_frame_id = kind == TrackStreamKind::Delta ? base_frame_id_ : 0;
+  h.capture_ns = capture_ns_;
+  std::memcpy(out.data(), &h, sizeof(h));
+}
+
+const std::vector<std::uint8_t>& TrackStreamEncoder::encode(const WorldState& ws, std::int64_t capture_ns) {
+  base_frame_id_ = frame_id_;
+  frame_id_ = ws.frame_id;
+  capture_ns_ = capture_ns;
+  key_valid_ = false;
+
+  next_.clear();
+  fulls_.clear();
+  deltas_.clear();
+  removed_.clear();
+
+  // Tracking lists the tracks it matched in detection score order, then the ones it missed, so a track is often but
+  // not always right after the previous match. Scanning on from there is at worst kMaxTracks^2 id compares, a few
+  // microseconds, and needs no map, which would allocate
+  seen_.assign(prev_.size(), 0);
+  std::size_t hint = 0;
+  auto find_prev = [this, &hint](std::uint64_t id) -> const TrackFullRecord* {
+    for (std::size_t n = 0; n < prev_.size(); ++n) {
+      const std::size_t i = (hint + n) % prev_.size();
+      if (prev_[i].id == id) {
+        seen_[i] = 1;
+        hint = i + 1;
+        return &prev_[i];
+      }
+    }
+    return nullptr;
+  };
+
+  for (const Track& tr : ws.tracks) {
+    const TrackFullRecord exact = ToRecord(tr);
+    const TrackFullRecord* old = have_base_ ? find_prev(exact.id) : nullptr;
+
+    TrackDeltaRecord d{};
+    const bool encodable = old && old->class_id == exact.class_id &&
+                           QuantizeDelta(exact.x, old->x, d.dx) && QuantizeDelta(exact.y, old->y, d.dy) &&
+                           QuantizeDelta(exact.w, old->w, d.dw) && QuantizeDelta(exact.h, old->h, d.dh);
+    if (!encodable) {
+      fulls_.push_back(exact);
+      next_.push_back(exact);
+      continue;
+    }
+
+    d.id = static_cast<std::uint32_t>(exact.id);
+    d.confidence = QuantizeConfidence(exact.confidence);
+    d.missed_frames = exact.missed_frames;
+    d.flags = exact.flags;
+    const bool unchanged = d.dx == 0 && d.dy == 0 && d.dw == 0 && d.dh == 0 &&
+                           d.confidence == QuantizeConfidence(old->confidence) &&
+                           d.missed_frames == old->missed_frames && d.flags == old->flags;
+    if (unchanged) {
+      next_.push_back(*old);
+      continue;
+    }
+
+    if (exact.id > std::numeric_limits<std::uint32_t>::max()) {
+      fulls_.push_back(exact);
+      next_.push_back(exact);
+      continue;
+    }
+
+    TrackFullRecord rebuilt = *old;
+    ApplyDelta(rebuilt, d);
+    deltas_.push_back(d);
+    next_.push_back(rebuilt);
+  }
+
+  for (std::size_t i = 0; have_base_ && i < prev_.size(); ++i) {
+    if (!seen_[i]) removed_.push_back(prev_[i].id);
+  }
+
+  delta_msg_.resize(sizeof(TrackStreamHeader));
+  AppendRecords(delta_msg_, fulls_);
+  AppendRecords(delta_msg_, deltas_);
+  AppendRecords(delta_msg_, removed_);
+  write_header(delta_msg_, TrackStreamKind::Delta, fulls_.size(), deltas_.size(), removed_.size(), next_.size());
+
+  prev_.swap(next_);
+  have_base_ = true;
+  return delta_msg_;
+}
+
+const std::vector<std::uint8_t>& TrackStreamEncoder::keyframe() {
+  if (key_valid_) return key_msg_;
+  key_msg_.resize(sizeof(TrackStreamHeader));
+  AppendRecords(key_msg_, prev_);
+  write_header(key_msg_, TrackStreamKind::Keyframe, prev_.size(), 0, 0, prev_.size());
+  key_valid_ = true;
+  return key_msg_;
+}
+
+std::size_t TrackStreamDecoder::MessageSize(const std::uint8_t* data, std::size_t n) {
+  if (n < sizeof(TrackStreamHeader)) return 0;
+  TrackStreamHeader h;
+  std::memcpy(&h, data, sizeof(h));
+  return h.message_bytes;
+}
+
+TrackStreamApply TrackStreamDecoder::apply(const std::uint8_t* msg, std::size_t n) {
+  if (n < sizeof(TrackStreamHeader)) return TrackStreamApply::Malformed;
+  TrackStreamHeader h;
+  std::memcpy(&h, msg, sizeof(h));
+  const std::size_t expected = sizeof(h) + h.full_count * sizeof(TrackFullRecord) + h.delta_count * sizeof(TrackDeltaRecord) +
+                               h.removed_count * sizeof(std::uint64_t);
+  if (h.magic != kTrackStreamMagic || h.version != kTrackStreamVersion || h.message_bytes != n || expected != n) {
+    return TrackStreamApply::Malformed;
+  }
+
+  const std::uint8_t* p = msg + sizeof(h);
+  const auto kind = static_cast<TrackStreamKind>(h.kind);
+  if (kind == TrackStreamKind::Keyframe) {
+    tracks_.resize(h.full_count);
+    std::memcpy(tracks_.data(), p, h.full_count * sizeof(TrackFullRecord));
+  } else if (kind == TrackStreamKind::Delta) {
+    if (!synced_ || h.base_frame_id != frame_id_) {
+      synced_ = false;
+      return TrackStreamApply::NeedKeyframe;
+    }
+
+    const std::uint8_t* fulls = p;
+    const std::uint8_t* deltas = fulls + h.full_count * sizeof(TrackFullRecord);
+    const std::uint8_t* removed = deltas + h.delta_count * sizeof(TrackDeltaRecord);
+
+    // Track order carries no meaning, survivors keep theirs and new tracks go last
+    scratch_.clear();
+    for (const TrackFullRecord& r : tracks_) {
+      bool gone = false;
+      for (std::size_t i = 0; i < h.removed_count && !gone; ++i) {
+        std::uint64_t id;
+        std::memcpy(&id, removed + i * sizeof(id), sizeof(id));
+        gone = id == r.id;
+      }
+      if (!gone) scratch_.push_back(r);
+    }
+    for (std::size_t i = 0; i < h.delta_count; ++i) {
+      TrackDeltaRecord d;
+      std::memcpy(&d, deltas + i * sizeof(d), sizeof(d));
+      auto it = std::find_if(scratch_.begin(), scratch_.end(), [&](const TrackFullRecord& r) { return r.id == d.id; });
+      if (it == scratch_.end()) {
+        synced_ = false;
+        return TrackStreamApply::NeedKeyframe;
+      }
+      ApplyDelta(*it, d);
+    }
+    for (std::size_t i = 0; i < h.full_count; ++i) {
+      TrackFullRecord r;
+      std::memcpy(&r, fulls + i * sizeof(r), sizeof(r));
+      auto it = std::find_if(scratch_.begin(), scratch_.end(), [&](const TrackFullRecord& s) { return s.id == r.id; });
+      if (it != scratch_.end()) {
+        *it = r;
+      } else {
+        scratch_.push_back(r);
+      }
+    }
+    if (scratch_.size() != h.track_count) {
+      synced_ = false;
+      return TrackStreamApply::NeedKeyframe;
+    }
+    tracks_.swap(scratch_);
+  } else {
+    return TrackStreamApply::Malformed;
+  }
+
+  frame_id_ = h.frame_id;
+  capture_ns_ = h.capture_ns;
+  synced_ = true;
+  return TrackStreamApply::Ok;
+}
+
+} // namespace dcp
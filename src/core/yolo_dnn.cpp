@@ -1,8 +1,9 @@
 #include "core/yolo_dnn.hpp"
+#include "core/ort_runtime.hpp"
 
 #include <algorithm>
+#include <array>
 #include <cmath>
-#include <cstring>
 #include <iostream>
 #include <vector>
 
@@ -35,10 +36,11 @@ static inline float IoUBox(const BBox& a, const BBox& b) {
 
 YoloDnn::YoloDnn(Params p) : p_(std::move(p)) {
   try {
-    sess_opts_.SetIntraOpNumThreads(1);
+    // Thread counts/pool come from the core budget (ConfigureOrtRuntime), shared by every session in the process
+    ApplyOrtSessionThreading(sess_opts_);
     sess_opts_.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_ALL);
 
-    session_ = std::make_unique<Ort::Session>(env_, p_.onnx_path.c_str(), sess_opts_);
+    session_ = std::make_unique<Ort::Session>(SharedOrtEnv(), p_.onnx_path.c_str(), sess_opts_);
 
     {
       auto in = session_->GetInputNameAllocated(0, allocator_);
@@ -49,71 +51,177 @@ YoloDnn::YoloDnn(Params p) : p_(std::move(p)) {
       output_name_ = out ? std::string(out.get()) : std::string{};
     }
 
+    // A symbolic/negative leading dimension means the model accepts any batch size
+    {
+      const auto in_shape = session_->GetInputTypeInfo(0).GetTensorTypeAndShapeInfo().GetShape();
+      batch_dynamic_ = !in_shape.empty() && in_shape[0] < 0;
+    }
+
     loaded_ = !input_name_.empty() && !output_name_.empty();
+    if (loaded_) bind_single_frame_tensors();
   } catch (const Ort::Exception& e) {
     std::cerr << "ONNX Runtime init failed: " << e.what() << "\n";
     loaded_ = false;
   }
 }
 
+// Single-frame tensors live as long as the session. The output is only pre-bound when the model declares a fixed
+// [1,A,B] shape, otherwise ORT allocates it per run as before
+void YoloDnn::bind_single_frame_tensors() {
+  input_buf_.assign(static_cast<std::size_t>(3) * p_.input_h * p_.input_w, 0.f);
+  const std::array<int64_t, 4> in_shape{1, 3, p_.input_h, p_.input_w};
+  input_val_ = Ort::Value::CreateTensor<float>(mem_info_, input_buf_.data(), input_buf_.size(), in_shape.data(), in_shape.size());
+
+  auto out_shape = session_->GetOutputTypeInfo(0).GetTensorTypeAndShapeInfo().GetShape();
+  if (out_shape.size() != 3) return;
+  if (out_shape[0] < 0) out_shape[0] = 1;
+  if (out_shape[0] != 1 || out_shape[1] <= 0 || out_shape[2] <= 0) return;
+
+  output_shape_ = out_shape;
+  output_buf_.assign(static_cast<std::size_t>(out_shape[1]) * static_cast<std::size_t>(out_shape[2]), 0.f);
+  output_val_ = Ort::Value::CreateTensor<float>(mem_info_, output_buf_.data(), output_buf_.size(), output_shape_.data(), output_shape_.size());
+}
+
+// Resize/convert one preprocessed frame into a planar RGB float tensor at dst (3 * input_h * input_w floats).
+// Intermediates are members, and the final split writes straight into dst through plane headers
+void YoloDnn::fill_input(const PreprocessedFrame& pf, float* dst) {
+  cv::resize(pf.image, resized_, cv::Size(p_.input_w, p_.input_h), 0, 0, cv::INTER_LINEAR);
+  cv::cvtColor(resized_, rgb_, cv::COLOR_BGR2RGB);
+  rgb_.convertTo(f32_, CV_32F, 1.0 / 255.0);
+
+  const int hw = p_.input_h * p_.input_w;
+  cv::Mat planes[3] = {
+    cv::Mat(p_.input_h, p_.input_w, CV_32F, dst + 0 * hw),
+    cv::Mat(p_.input_h, p_.input_w, CV_32F, dst + 1 * hw),
+    cv::Mat(p_.input_h, p_.input_w, CV_32F, dst + 2 * hw),
+  };
+  cv::split(f32_, planes);
+}
+
 Detections YoloDnn::infer(const PreprocessedFrame& pf) {
   Detections out;
+  infer_into(pf, out);
+  return out;
+}
+
+void YoloDnn::infer_into(const PreprocessedFrame& pf, Detections& out) {
   out.inference_time = std::chrono::steady_clock::now();
   out.source_frame_id = pf.source_frame_id;
   out.preprocess_info = pf.info;
+  out.items.clear();
+
+  if (!loaded_ || !session_ || pf.image.empty()) return;
+
+  fill_input(pf, input_buf_.data());
+
+  const char* in_names[] = {input_name_.c_str()};
+  const char* out_names[] = {output_name_.c_str()};
+
+  // Pre-bound output, ORT writes into output_buf_
+  if (output_val_) {
+    try {
+      session_->Run(run_opts_, in_names, &input_val_, 1, out_names, &output_val_, 1);
+    } catch (const Ort::Exception& e) {
+      std::cerr << "ORT Run failed: " << e.what() << "\n";
+      return;
+    }
+    decode(output_buf_.data(), static_cast<int>(output_shape_[1]), static_cast<int>(output_shape_[2]), pf, out);
+    return;
+  }
+
+  std::vector<Ort::Value> ort_out;
+  try {
+    ort_out = session_->Run(run_opts_, in_names, &input_val_, 1, out_names, 1);
+  } catch (const Ort::Exception& e) {
+    std::cerr << "ORT Run failed: " << e.what() << "\n";
+    return;
+  }
 
-  if (!loaded_ || !session_ || pf.image.empty()) return out;
+  if (ort_out.empty() || !ort_out[0].IsTensor()) return;
 
-  cv::Mat resized;
-  cv::resize(pf.image, resized, cv::Size(p_.input_w, p_.input_h), 0, 0, cv::INTER_LINEAR);
+  auto& t = ort_out[0];
+  auto shape = t.GetTensorTypeAndShapeInfo().GetShape();
+  if (shape.size() != 3 || shape[0] != 1) return;
 
-  cv::Mat rgb;
-  cv::cvtColor(resized, rgb, cv::COLOR_BGR2RGB);
+  decode(t.GetTensorData<float>(), static_cast<int>(shape[1]), static_cast<int>(shape[2]), pf, out);
+}
+
+std::vector<Detections> YoloDnn::infer_batch(const std::vector<PreprocessedFrame>& frames) {
+  std::vector<Detections> outs(frames.size());
+  infer_batch_into(frames, outs);
+  return outs;
+}
 
-  cv::Mat f32;
-  rgb.convertTo(f32, CV_32F, 1.0 / 255.0);
+// Batched path for offline use. One ORT run over [B,3,H,W] when the model has a dynamic batch axis,
+// otherwise falls back to B single-frame runs. Output i always belongs to frames[i]
+void YoloDnn::infer_batch_into(const std::vector<PreprocessedFrame>& frames, std::vector<Detections>& outs) {
+  if (outs.size() < frames.size()) outs.resize(frames.size());
+  if (frames.empty()) return;
 
-  std::vector<float> input_tensor(1 * 3 * p_.input_h * p_.input_w);
-  {
-    std::vector<cv::Mat> ch(3);
-    cv::split(f32, ch);
-    const int hw = p_.input_h * p_.input_w;
-    std::memcpy(input_tensor.data() + 0 * hw, ch[0].data, hw * sizeof(float));
-    std::memcpy(input_tensor.data() + 1 * hw, ch[1].data, hw * sizeof(float));
-    std::memcpy(input_tensor.data() + 2 * hw, ch[2].data, hw * sizeof(float));
+  if (!batch_dynamic_ || frames.size() == 1) {
+    for (std::size_t i = 0; i < frames.size(); ++i) infer_into(frames[i], outs[i]);
+    return;
   }
 
-  std::array<int64_t, 4> in_shape{1, 3, p_.input_h, p_.input_w};
-  auto mem_info = Ort::MemoryInfo::CreateCpu(OrtDeviceAllocator, OrtMemTypeCPU);
+  const auto now = std::chrono::steady_clock::now();
+  for (std::size_t i = 0; i < frames.size(); ++i) {
+    outs[i].inference_time = now;
+    outs[i].source_frame_id = frames[i].source_frame_id;
+    outs[i].preprocess_info = frames[i].info;
+    outs[i].items.clear();
+  }
 
-  Ort::Value in = Ort::Value::CreateTensor<float>(
-      mem_info, input_tensor.data(), input_tensor.size(), in_shape.data(), in_shape.size());
+  if (!loaded_ || !session_) return;
+
+  // Empty images still occupy a slot so indices line up, they are zero-filled and their results discarded
+  const std::size_t per_frame = static_cast<std::size_t>(3) * p_.input_h * p_.input_w;
+  const std::size_t total = frames.size() * per_frame;
+  if (batch_buf_.size() < total) batch_buf_.resize(total);
+  for (std::size_t i = 0; i < frames.size(); ++i) {
+    float* dst = batch_buf_.data() + i * per_frame;
+    if (frames[i].image.empty()) {
+      std::fill(dst, dst + per_frame, 0.f);
+    } else {
+      fill_input(frames[i], dst);
+    }
+  }
+
+  std::array<int64_t, 4> in_shape{static_cast<int64_t>(frames.size()), 3, p_.input_h, p_.input_w};
+  Ort::Value in = Ort::Value::CreateTensor<float>(mem_info_, batch_buf_.data(), total, in_shape.data(), in_shape.size());
 
   const char* in_names[] = {input_name_.c_str()};
   const char* out_names[] = {output_name_.c_str()};
 
   std::vector<Ort::Value> ort_out;
   try {
-    ort_out = session_->Run(Ort::RunOptions{nullptr}, in_names, &in, 1, out_names, 1);
+    ort_out = session_->Run(run_opts_, in_names, &in, 1, out_names, 1);
   } catch (const Ort::Exception& e) {
-    std::cerr << "ORT Run failed: " << e.what() << "\n";
-    return out;
+    std::cerr << "ORT batched Run failed: " << e.what() << "\n";
+    return;
   }
 
-  if (ort_out.empty() || !ort_out[0].IsTensor()) return out;
+  if (ort_out.empty() || !ort_out[0].IsTensor()) return;
 
   auto& t = ort_out[0];
   auto shape = t.GetTensorTypeAndShapeInfo().GetShape();
-  if (shape.size() != 3 || shape[0] != 1) return out;
+  if (shape.size() != 3 || shape[0] != static_cast<int64_t>(frames.size())) return;
 
-  const float* data = t.GetTensorData<float>();
   const int A = static_cast<int>(shape[1]);
   const int B = static_cast<int>(shape[2]);
+  const float* data = t.GetTensorData<float>();
 
+  for (std::size_t i = 0; i < frames.size(); ++i) {
+    if (frames[i].image.empty()) continue;
+    decode(data + i * static_cast<std::size_t>(A) * B, A, B, frames[i], outs[i]);
+  }
+}
+
+// Decode one [A,B] output slice (either CxN or NxC layout) into detections in pf.image coordinates, with NMS
+void YoloDnn::decode(const float* data, int A, int B, const PreprocessedFrame& pf, Detections& out) {
   const bool layout_CxN = (A < B);
   const int C = layout_CxN ? A : B;
   const int N = layout_CxN ? B : A;
-  if (C < 6) return out;
+  if (C < 6) return;
 
   const int num_classes = C - 4;
 
@@ -125,9 +233,7 @@ Detections YoloDnn::infer(const PreprocessedFrame& pf) {
   const float sx = static_cast<float>(pf.image.cols) / static_cast<float>(p_.input_w);
   const float sy = static_cast<float>(pf.image.rows) / static_cast<float>(p_.input_h);
 
-  struct Cand { BBox box; int cls; float score; };
-  std::vector<Cand> cands;
-  cands.reserve(256);
+  cands_.clear();
 
   for (int i = 0; i < N; ++i) {
     const float cx = at(0, i);
@@ -156,33 +262,29 @@ Detections YoloDnn::infer(const PreprocessedFrame& pf) {
     bb.h = Clamp(hh, 0.f, (float)pf.image.rows - bb.y);
     if (bb.w <= 1.f || bb.h <= 1.f) continue;
 
-    cands.push_back({bb, best_cls, best});
+    cands_.push_back({bb, best_cls, best});
   }
 
-  std::sort(cands.begin(), cands.end(),
+  std::sort(cands_.begin(), cands_.end(),
             [](const Cand& a, const Cand& b) { return a.score > b.score; });
 
-  std::vector<Cand> kept;
-  kept.reserve(cands.size());
+  kept_.clear();
 
-  for (const auto& c : cands) {
+  for (const auto& c : cands_) {
     bool ok = true;
-    for (const auto& k : kept) {
+    for (const auto& k : kept_) {
       if (IoUBox(c.box, k.box) > p_.nms_thresh) { ok = false; break; }
     }
-    if (ok) kept.push_back(c);
+    if (ok) kept_.push_back(c);
   }
 
-  out.items.reserve(kept.size());
-  for (const auto& k : kept) {
+  for (const auto& k : kept_) {
     Detection d;
     d.class_id = k.cls;
     d.confidence = k.score;
     d.bbox = k.box;
     out.items.push_back(d);
   }
-
-  return out;
 }
 
 } // namespace dcp
\ No newline at end of file
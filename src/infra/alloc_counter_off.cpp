@@ -0,0 +1,10 @@
+#include "infra/alloc_counter.hpp"
+
+// Builds without DCP_COUNT_ALLOCS: operator new is left alone and nothing is counted
+
+namespace dcp {
+
+bool AllocCountingEnabled() { return false; }
+std::uint64_t ThreadAllocations() { return 0; }
+
+} // namespace dcp
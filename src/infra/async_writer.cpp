@@ -0,0 +1,664 @@
+#include "infra/async_writer.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define DCP_HAVE_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+namespace dcp {
+
+static constexpr std::size_t kAlign = 4096;
+
+#ifdef DCP_HAVE_IO_URING
+
+// No liburing dependency: the three syscalls and the mmap'd rings are all it takes for plain writes and fsyncs
+static int UringSetup(unsigned entries, io_uring_params* p) {
+  return static_cast<int>(::syscall(__NR_io_uring_setup, entries, p));
+}
+
+static int UringEnter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+  return static_cast<int>(::syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+static int UringRegister(int fd, unsigned opcode, const void* arg, unsigned nr_args) {
+  return static_cast<int>(::syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+struct AsyncWriter::Uring {
+  int fd{-1};
+  unsigned entries{0};
+
+  void* sq_ring{nullptr};
+  std::size_t sq_ring_size{0};
+  void* cq_ring{nullptr};
+  std::size_t cq_ring_size{0};
+  io_uring_sqe* sqes{nullptr};
+  std::size_t sqes_size{0};
+
+  unsigned* sq_head{nullptr};
+  unsigned* sq_tail{nullptr};
+  unsigned* sq_mask{nullptr};
+  unsigned* sq_array{nullptr};
+  unsigned* cq_head{nullptr};
+  unsigned* cq_tail{nullptr};
+  unsigned* cq_mask{nullptr};
+  io_uring_cqe* cqes{nullptr};
+
+  // One slot per request in flight, user_data is the slot index
+  std::vector<Op> slots;
+  std::vector<std::uint32_t> free_slots;
+
+  ~Uring() {
+    if (sqes) ::munmap(sqes, sqes_size);
+    if (cq_ring && cq_ring != sq_ring) ::munmap(cq_ring, cq_ring_size);
+    if (sq_ring) ::munmap(sq_ring, sq_ring_size);
+    if (fd >= 0) ::close(fd);
+  }
+
+  // Next free SQE, owned by the ring thread. Callers never have more than `entries` requests in flight
+  io_uring_sqe* next_sqe() {
+    const unsigned tail = *sq_tail;
+    const unsigned idx = tail & *sq_mask;
+    io_uring_sqe* sqe = &sqes[idx];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sq_array[idx] = idx;
+    __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+    return sqe;
+  }
+
+  // Queued in the SQ, not yet consumed by the kernel
+  unsigned unsubmitted() const {
+    return *sq_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+  }
+};
+
+#else
+
+struct AsyncWriter::Uring {};
+
+#endif
+
+AsyncWriter::AsyncWriter(Options opts, StageMetrics* metrics, ThreadConfig thread_cfg)
+    : opts_(std::move(opts)), metrics_(metrics) {
+  if (opts_.buffer_count == 0 || opts_.buffer_size == 0 || opts_.max_files == 0 || opts_.queue_depth == 0) {
+    throw std::invalid_argument("AsyncWriter: buffer_count, buffer_size, max_files and queue_depth must be > 0");
+  }
+  if (opts_.backend != "auto" && opts_.backend != "io_uring" && opts_.backend != "threads") {
+    throw std::invalid_argument("AsyncWriter: unknown backend '" + opts_.backend + "'");
+  }
+
+  // Page-aligned, page-sized buffers: what O_DIRECT and registered buffers want, and no buffer straddles a page
+  opts_.buffer_size = (opts_.buffer_size + kAlign - 1) / kAlign * kAlign;
+  void* mem = nullptr;
+  if (::posix_memalign(&mem, kAlign, opts_.buffer_size * opts_.buffer_count) != 0) throw std::bad_alloc();
+  arena_ = static_cast<std::uint8_t*>(mem);
+
+  buffers_.resize(opts_.buffer_count);
+  free_.reserve(opts_.buffer_count);
+  for (std::size_t i = opts_.buffer_count; i-- > 0;) {
+    buffers_[i] = Buffer{arena_ + i * opts_.buffer_size, 0, opts_.buffer_size, static_cast<std::uint32_t>(i)};
+    free_.push_back(&buffers_[i]);
+  }
+  files_.resize(opts_.max_files);
+  ops_.resize(opts_.buffer_count + 2 * opts_.max_files);
+
+  if (opts_.backend != "threads" && !init_uring()) {
+    if (opts_.backend == "io_uring") std::cerr << "io: io_uring unavailable, using the threads backend\n";
+  }
+
+  if (uring_) {
+    threads_.push_back(std::make_unique<ThreadRunner>("io_uring"));
+  } else {
+    const std::size_t n = std::max<std::size_t>(1, opts_.workers);
+    for (std::size_t i = 0; i < n; ++i) threads_.push_back(std::make_unique<ThreadRunner>("io#" + std::to_string(i)));
+  }
+  for (auto& t : threads_) {
+    t->set_thread_config(thread_cfg);
+    t->start(stop_.token(), [this](const StopToken& g, const std::atomic_bool& l) {
+      if (uring_) uring_loop(g, l);
+      else worker_loop(g, l);
+    });
+  }
+}
+
+AsyncWriter::~AsyncWriter() {
+  // Files producers never closed still get their durability, then nothing is left in flight
+  drain();
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    for (std::size_t f = 0; f < files_.size(); ++f) {
+      if (files_[f].used && !files_[f].closing) {
+        files_[f].closing = true;
+        maybe_close_locked(static_cast<File>(f));
+      }
+    }
+    work_cv_.notify_all();
+  }
+  drain();
+
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    stopping_ = true;
+  }
+  work_cv_.notify_all();
+  stop_.request_stop();
+  for (auto& t : threads_) t->join();
+  threads_.clear();
+
+  uring_.reset();
+  std::free(arena_);
+}
+
+bool AsyncWriter::init_uring() {
+#ifdef DCP_HAVE_IO_URING
+  auto u = std::make_unique<Uring>();
+
+  io_uring_params p{};
+  u->fd = UringSetup(static_cast<unsigned>(opts_.queue_depth), &p);
+  if (u->fd < 0) return false;   // ENOSYS (old kernel), EPERM (seccomp, io_uring_disabled)
+
+  // IORING_OP_WRITE and the current-position feature arrived together (5.6), older rings can't do what we need
+  if (!(p.features & IORING_FEAT_RW_CUR_POS)) return false;
+
+  u->entries = p.sq_entries;
+  u->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  u->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+  const bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+  if (single) u->sq_ring_size = u->cq_ring_size = std::max(u->sq_ring_size, u->cq_ring_size);
+
+  void* sq = ::mmap(nullptr, u->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+  if (sq == MAP_FAILED) return false;
+  u->sq_ring = sq;
+  if (single) {
+    u->cq_ring = sq;
+  } else {
+    void* cq = ::mmap(nullptr, u->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+    if (cq == MAP_FAILED) return false;
+    u->cq_ring = cq;
+  }
+  u->sqes_size = p.sq_entries * sizeof(io_uring_sqe);
+  void* sqes = ::mmap(nullptr, u->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+  if (sqes == MAP_FAILED) return false;
+  u->sqes = static_cast<io_uring_sqe*>(sqes);
+
+  auto* sqb = static_cast<std::uint8_t*>(u->sq_ring);
+  auto* cqb = static_cast<std::uint8_t*>(u->cq_ring);
+  u->sq_head = reinterpret_cast<unsigned*>(sqb + p.sq_off.head);
+  u->sq_tail = reinterpret_cast<unsigned*>(sqb + p.sq_off.tail);
+  u->sq_mask = reinterpret_cast<unsigned*>(sqb + p.sq_off.ring_mask);
+  u->sq_array = reinterpret_cast<unsigned*>(sqb + p.sq_off.array);
+  u->cq_head = reinterpret_cast<unsigned*>(cqb + p.cq_off.head);
+  u->cq_tail = reinterpret_cast<unsigned*>(cqb + p.cq_off.tail);
+  u->cq_mask = reinterpret_cast<unsigned*>(cqb + p.cq_off.ring_mask);
+  u->cqes = reinterpret_cast<io_uring_cqe*>(cqb + p.cq_off.cqes);
+
+  u->slots.resize(u->entries);
+  u->free_slots.reserve(u->entries);
+  for (unsigned i = u->entries; i-- > 0;) u->free_slots.push_back(i);
+
+  // Registered buffers skip the per-write page pinning. Needs RLIMIT_MEMLOCK room, plain writes otherwise
+  std::vector<iovec> iov(buffers_.size());
+  for (std::size_t i = 0; i < buffers_.size(); ++i) iov[i] = iovec{buffers_[i].data, buffers_[i].capacity};
+  registered_ = UringRegister(u->fd, IORING_REGISTER_BUFFERS, iov.data(), static_cast<unsigned>(iov.size())) == 0;
+
+  uring_ = std::move(u);
+  return true;
+#else
+  return false;
+#endif
+}
+
+AsyncWriter::File AsyncWriter::open(const std::string& path, FileOptions opts) {
+  // Reserve a slot, then open without mu_: O_CREAT|O_TRUNC can block on the filesystem (truncating a big file, a slow
+  // card) and every submit and completion takes mu_. Nobody else touches the slot until we return its index
+  std::size_t slot = 0;
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    auto it = std::find_if(files_.begin(), files_.end(), [](const FileState& s) { return !s.used; });
+    if (it == files_.end()) return -1;
+    *it = FileState{};
+    it->used = true;
+    slot = static_cast<std::size_t>(it - files_.begin());
+  }
+
+  const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+  std::lock_guard<std::mutex> lock(mu_);
+  FileState& fs = files_[slot];
+  if (fd < 0) {
+    fs.used = false;
+    return -1;
+  }
+  fs.fd = fd;
+  fs.path = path;
+  fs.opts = opts;
+  return static_cast<File>(slot);
+}
+
+bool AsyncWriter::try_acquire(std::size_t n, std::vector<Buffer*>& out) {
+  std::lock_guard<std::mutex> lock(mu_);
+  if (free_.size() < n || in_flight_bytes_.load(std::memory_order_relaxed) >= opts_.max_in_flight_bytes) {
+    rejected_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  for (std::size_t i = 0; i < n; ++i) {
+    out.push_back(free_.back());
+    free_.pop_back();
+  }
+  in_use_.fetch_add(n, std::memory_order_relaxed);
+  return true;
+}
+
+void AsyncWriter::release(Buffer* buf) {
+  if (!buf) return;
+  std::lock_guard<std::mutex> lock(mu_);
+  buf->size = 0;
+  free_.push_back(buf);
+  in_use_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void AsyncWriter::submit(File f, Buffer* buf) {
+  if (!buf) return;
+  if (buf->size == 0 || f < 0 || static_cast<std::size_t>(f) >= files_.size()) {
+    release(buf);
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    FileState& fs = files_[static_cast<std::size_t>(f)];
+    if (!fs.used || fs.closing) {
+      buf->size = 0;
+      free_.push_back(buf);
+      in_use_.fetch_sub(1, std::memory_order_relaxed);
+      errors_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    Op op;
+    op.kind = OpKind::Write;
+    op.file = f;
+    op.buf = buf;
+    op.offset = fs.offset;
+    op.submit_ns = NowNs();
+    fs.offset += buf->size;
+    ++fs.pending;
+    in_flight_bytes_.fetch_add(buf->size, std::memory_order_relaxed);
+    push_op_locked(op);
+  }
+  work_cv_.notify_one();
+}
+
+void AsyncWriter::close(File f, std::string rename_to, ClosedFn on_closed) {
+  if (f < 0 || static_cast<std::size_t>(f) >= files_.size()) return;
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    FileState& fs = files_[static_cast<std::size_t>(f)];
+    if (!fs.used || fs.closing) return;
+    fs.closing = true;
+    fs.rename_to = std::move(rename_to);
+    fs.on_closed = std::move(on_closed);
+    maybe_close_locked(f);
+  }
+  work_cv_.notify_one();
+}
+
+void AsyncWriter::drain() {
+  std::unique_lock<std::mutex> lock(mu_);
+  idle_cv_.wait(lock, [&] { return ops_count_ == 0 && active_ == 0; });
+}
+
+void AsyncWriter::push_op_locked(const Op& op) {
+  // Can't overflow: writes are bounded by the buffers, syncs and closes by one each per file
+  ops_[(ops_head_ + ops_count_) % ops_.size()] = op;
+  ++ops_count_;
+}
+
+bool AsyncWriter::pop_op_locked(Op& out) {
+  if (ops_count_ == 0) return false;
+  out = ops_[ops_head_];
+  ops_head_ = (ops_head_ + 1) % ops_.size();
+  --ops_count_;
+  ++active_;
+  return true;
+}
+
+void AsyncWriter::maybe_close_locked(File f) {
+  FileState& fs = files_[static_cast<std::size_t>(f)];
+  if (!fs.closing || fs.pending > 0) return;
+  Op op;
+  op.kind = OpKind::Close;
+  op.file = f;
+  op.submit_ns = NowNs();
+  ++fs.pending; // The close itself, so it's queued once
+  push_op_locked(op);
+}
+
+void AsyncWriter::complete_locked(const Op& op, bool ok, std::uint64_t now_ns) {
+  FileState& fs = files_[static_cast<std::size_t>(op.file)];
+  if (!ok) {
+    fs.failed = true;
+    errors_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  if (op.kind == OpKind::Write) {
+    const std::size_t n = op.buf->size;
+    if (ok) written_.fetch_add(n, std::memory_order_relaxed);
+    in_flight_bytes_.fetch_sub(n, std::memory_order_relaxed);
+    op.buf->size = 0;
+    free_.push_back(op.buf);
+    in_use_.fetch_sub(1, std::memory_order_relaxed);
+    if (metrics_) metrics_->on_item(now_ns - op.submit_ns);
+
+    if (ok && fs.opts.durability == Durability::Periodic && fs.opts.sync_bytes > 0) {
+      fs.unsynced += n;
+      if (fs.unsynced >= fs.opts.sync_bytes && !fs.sync_queued && !fs.closing) {
+        fs.unsynced = 0;
+        fs.sync_queued = true;
+        Op sync;
+        sync.kind = OpKind::Sync;
+        sync.file = op.file;
+        sync.submit_ns = now_ns;
+        ++fs.pending;
+        push_op_locked(sync);
+        work_cv_.notify_one();
+      }
+    }
+  } else if (op.kind == OpKind::Sync) {
+    fs.sync_queued = false;
+    if (ok) syncs_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  --fs.pending;
+  --active_;
+  maybe_close_locked(op.file);
+  if (ops_count_ > 0) work_cv_.notify_one();
+  if (ops_count_ == 0 && active_ == 0) idle_cv_.notify_all();
+}
+
+// Last step of a file, after its writes and (for a durable file) the fsync completed. Runs on a writer thread
+void AsyncWriter::finish_close(File f, bool ok) {
+  FileState& fs = files_[static_cast<std::size_t>(f)];
+  bool good = ok && !fs.failed;
+  if (::close(fs.fd) != 0) good = false;
+
+  // An incomplete file keeps its temporary name
+  if (good && !fs.rename_to.empty() && std::rename(fs.path.c_str(), fs.rename_to.c_str()) != 0) good = false;
+
+  ClosedFn cb;
+  {
+    std::lock_guard<std::mutex> lock(mu_);
+    if (!good) errors_.fetch_add(1, std::memory_order_relaxed);
+    cb = std::move(fs.on_closed);
+    fs = FileState{};
+    --active_;
+    if (ops_count_ == 0 && active_ == 0) idle_cv_.notify_all();
+  }
+  if (cb) cb(good);
+}
+
+bool AsyncWriter::do_write(const Op& op) {
+  const int fd = files_[static_cast<std::size_t>(op.file)].fd;
+  std::size_t done = 0;
+  while (done < op.buf->size) {
+    const ssize_t n = ::pwrite(fd, op.buf->data + done, op.buf->size - done, static_cast<off_t>(op.offset + done));
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    done += static_cast<std::size_t>(n);
+  }
+  return true;
+}
+
+bool AsyncWriter::do_sync(const Op& op) {
+  const int fd = files_[static_cast<std::size_t>(op.file)].fd;
+  return (op.kind == OpKind::Sync ? ::fdatasync(fd) : ::fsync(fd)) == 0;
+}
+
+void AsyncWriter::worker_loop(const StopToken&, const std::atomic_bool&) {
+  // Stop flags are not checked: whatever was submitted gets written, the destructor drains before stopping us
+  std::unique_lock<std::mutex> lock(mu_);
+  while (true) {
+    work_cv_.wait(lock, [&] { return stopping_ || ops_count_ > 0; });
+    Op op;
+    if (!pop_op_locked(op)) {
+      if (stopping_) return;
+      continue;
+    }
+    lock.unlock();
+
+    if (op.kind == OpKind::Close) {
+      const bool durable = files_[static_cast<std::size_t>(op.file)].opts.durability != Durability::None;
+      bool ok = true;
+      if (durable) {
+        ok = do_sync(op);
+        if (ok) syncs_.fetch_add(1, std::memory_order_relaxed);
+      }
+      finish_close(op.file, ok);
+      lock.lock();
+      continue;
+    }
+
+    const bool ok = op.kind == OpKind::Write ? do_write(op) : do_sync(op);
+    const std::uint64_t now = NowNs();
+    lock.lock();
+    complete_locked(op, ok, now);
+  }
+}
+
+void AsyncWriter::uring_loop(const StopToken& global, const std::atomic_bool& local) {
+#ifdef DCP_HAVE_IO_URING
+  Uring& u = *uring_;
+  unsigned in_flight = 0;
+
+  auto prep = [&](std::uint32_t slot) {
+    const Op& op = u.slots[slot];
+    const FileState& fs = files_[static_cast<std::size_t>(op.file)];
+    io_uring_sqe* sqe = u.next_sqe();
+    sqe->fd = fs.fd;
+    sqe->user_data = slot;
+    if (op.kind == OpKind::Write) {
+      sqe->opcode = registered_ ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+      sqe->addr = reinterpret_cast<std::uint64_t>(op.buf->data + op.done);
+      sqe->len = static_cast<std::uint32_t>(op.buf->size - op.done);
+      sqe->off = op.offset + op.done;
+      if (registered_) sqe->buf_index = static_cast<std::uint16_t>(op.buf->index);
+    } else {
+      sqe->opcode = IORING_OP_FSYNC;
+      if (op.kind == OpKind::Sync) sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+    }
+  };
+
+  // Completions of one reap, handled under the lock in one go
+  struct Done {
+    std::uint32_t slot;
+    int res;
+  };
+  std::vector<Done> done;
+  done.reserve(u.entries * 2);
+
+  std::unique_lock<std::mutex> lock(mu_);
+  while (true) {
+    // Everything queued since the last round goes into this submission, as far as the ring has room
+    while (in_flight < u.entries && ops_count_ > 0) {
+      Op op;
+      pop_op_locked(op);
+      if (op.kind == OpKind::Close && files_[static_cast<std::size_t>(op.file)].opts.durability == Durability::None) {
+        // Nothing to wait for, close right here
+        lock.unlock();
+        finish_close(op.file, true);
+        lock.lock();
+        continue;
+      }
+      const std::uint32_t slot = u.free_slots.back();
+      u.free_slots.pop_back();
+      u.slots[slot] = op;
+      prep(slot);
+      ++in_flight;
+    }
+
+    if (in_flight == 0) {
+      if (stopping_ && ops_count_ == 0) return;
+      work_cv_.wait(lock, [&] { return stopping_ || ops_count_ > 0; });
+      continue;
+    }
+    lock.unlock();
+
+    // Submit and wait for at least one completion. Requests arriving meanwhile batch up for the next round
+    const int r = UringEnter(u.fd, u.unsubmitted(), 1, IORING_ENTER_GETEVENTS);
+    const int enter_errno = r < 0 ? errno : 0;
+    const bool broken = r < 0 && enter_errno != EINTR && enter_errno != EAGAIN && enter_errno != EBUSY;
+
+    done.clear();
+    unsigned head = *u.cq_head;
+    const unsigned tail = __atomic_load_n(u.cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+      const io_uring_cqe& cqe = u.cqes[head & *u.cq_mask];
+      done.push_back(Done{static_cast<std::uint32_t>(cqe.user_data), cqe.res});
+    }
+    __atomic_store_n(u.cq_head, head, __ATOMIC_RELEASE);
+
+    const std::uint64_t now = NowNs();
+    lock.lock();
+    for (const Done& d : done) {
+      Op& op = u.slots[d.slot];
+
+      if (op.kind == OpKind::Write && (d.res == -EINTR || d.res == -EAGAIN ||
+                                       (d.res > 0 && op.done + static_cast<std::size_t>(d.res) < op.buf->size))) {
+        // Short or interrupted write, the rest goes out from the same slot
+        if (d.res > 0) op.done += static_cast<std::size_t>(d.res);
+        prep(d.slot);
+        continue;
+      }
+
+      // A write that made no progress with bytes left fails, like n == 0 in the threads backend. Counting it as done
+      // would silently truncate the file
+      const bool ok = d.res >= 0 && (op.kind != OpKind::Write ||
+                                     op.done + static_cast<std::size_t>(d.res) >= op.buf->size);
+      const Op finished = op;
+      u.free_slots.push_back(d.slot);
+      --in_flight;
+
+      if (finished.kind == OpKind::Close) {
+        if (ok) syncs_.fetch_add(1, std::memory_order_relaxed);
+        lock.unlock();
+        finish_close(finished.file, ok);
+        lock.lock();
+      } else {
+        complete_locked(finished, ok, now);
+      }
+    }
+
+    if (broken) {
+      // The ring itself is unusable (EBADF, EFAULT, ...), retrying would only spin. Fail whatever it still holds and
+      // serve the rest of the run as a threads-backend worker
+      std::cerr << "io: io_uring_enter failed: " << std::strerror(enter_errno) << ", failing " << in_flight
+                << " requests in flight and switching to the threads backend\n";
+      std::vector<char> busy(u.entries, 1);
+      for (const std::uint32_t s : u.free_slots) busy[s] = 0;
+      for (std::uint32_t s = 0; s < u.entries; ++s) {
+        if (!busy[s]) continue;
+        const Op failed = u.slots[s];
+        u.free_slots.push_back(s);
+        if (failed.kind == OpKind::Close) {
+          lock.unlock();
+          finish_close(failed.file, false);
+          lock.lock();
+        } else {
+          complete_locked(failed, false, now);
+        }
+      }
+      in_flight = 0;
+      uring_failed_.store(true, std::memory_order_relaxed);
+      lock.unlock();
+      worker_loop(global, local);
+      return;
+    }
+  }
+#else
+  (void)global;
+  (void)local;
+#endif
+}
+
+AsyncFile::~AsyncFile() {
+  close();
+}
+
+bool AsyncFile::open(AsyncWriter* writer, const std::string& path, FileOptions opts) {
+  close();
+  if (!writer) return false;
+  writer_ = writer;
+  file_ = writer_->open(path, opts);
+  bytes_ = 0;
+  rejected_bytes_ = 0;
+  spare_.reserve(writer_->buffer_count());
+  return file_ >= 0;
+}
+
+bool AsyncFile::append(const void* data, std::size_t n) {
+  if (file_ < 0) return false;
+  if (n == 0) return true;
+
+  const std::size_t room = cur_ ? cur_->capacity - cur_->size : 0;
+  if (n > room) {
+    const std::size_t bs = writer_->buffer_size();
+    if (!writer_->try_acquire((n - room + bs - 1) / bs, spare_)) {
+      rejected_bytes_ += n;
+      return false;
+    }
+  }
+
+  const auto* p = static_cast<const std::uint8_t*>(data);
+  std::size_t left = n;
+  while (left > 0) {
+    if (!cur_ || cur_->size == cur_->capacity) {
+      if (cur_) writer_->submit(file_, cur_);
+      cur_ = spare_.back();
+      spare_.pop_back();
+    }
+    const std::size_t take = std::min(left, cur_->capacity - cur_->size);
+    std::memcpy(cur_->data + cur_->size, p, take);
+    cur_->size += take;
+    p += take;
+    left -= take;
+  }
+  bytes_ += n;
+
+  // A full buffer goes out right away
+  if (cur_->size == cur_->capacity) {
+    writer_->submit(file_, cur_);
+    cur_ = nullptr;
+  }
+  return true;
+}
+
+void AsyncFile::flush() {
+  if (!cur_) return;
+  writer_->submit(file_, cur_);   // An empty one just goes back to the pool
+  cur_ = nullptr;
+}
+
+void AsyncFile::close(std::string rename_to, AsyncWriter::ClosedFn on_closed) {
+  if (file_ < 0) return;
+  flush();
+  for (auto* b : spare_) writer_->release(b);
+  spare_.clear();
+  writer_->close(file_, std::move(rename_to), std::move(on_closed));
+  file_ = -1;
+}
+
+} // namespace dcp
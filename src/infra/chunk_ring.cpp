@@ -0,0 +1,73 @@
+#include "infra/chunk_ring.hpp"
+
+#include <cstring>
+
+namespace dcp {
+
+ChunkRing::ChunkRing(std::size_t max_bytes, std::size_t max_chunks)
+    : arena_(max_bytes == 0 ? 1 : max_bytes), entries_(max_chunks == 0 ? 1 : max_chunks) {}
+
+void ChunkRing::pop_front() {
+  used_ -= entries_[head_].size;
+  head_ = (head_ + 1) % entries_.size();
+  --count_;
+  if (count_ == 0) {
+    head_ = 0;
+    write_pos_ = 0;
+  }
+}
+
+void ChunkRing::publish() {
+  bytes_.store(used_, std::memory_order_relaxed);
+  size_.store(count_, std::memory_order_relaxed);
+}
+
+bool ChunkRing::push(TimePoint time, std::uint64_t seq, const std::uint8_t* data, std::size_t size) {
+  if (size > arena_.size()) {
+    oversize_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  if (count_ == entries_.size()) pop_front();
+
+  // Tail too short, wrap. Everything still stored past write_pos_ is from the previous lap, so the oldest
+  if (write_pos_ + size > arena_.size()) {
+    while (count_ > 0 && entries_[head_].offset >= write_pos_) pop_front();
+    write_pos_ = 0;
+  }
+
+  // Evict the chunks this write lands on. Chunks ahead of write_pos_ are the oldest ones, in order
+  while (count_ > 0 && entries_[head_].offset >= write_pos_ && entries_[head_].offset < write_pos_ + size) pop_front();
+
+  std::memcpy(arena_.data() + write_pos_, data, size);
+  const std::size_t tail = (head_ + count_) % entries_.size();
+  entries_[tail] = Entry{time, seq, write_pos_, size};
+  ++count_;
+  write_pos_ += size;
+  used_ += size;
+
+  publish();
+  return true;
+}
+
+void ChunkRing::trim(TimePoint cutoff) {
+  while (count_ > 0 && entries_[head_].time < cutoff) pop_front();
+  publish();
+}
+
+void ChunkRing::clear() {
+  head_ = 0;
+  count_ = 0;
+  write_pos_ = 0;
+  used_ = 0;
+  publish();
+}
+
+std::chrono::nanoseconds ChunkRing::span() const {
+  if (count_ < 2) return std::chrono::nanoseconds(0);
+  const Entry& oldest = entries_[head_];
+  const Entry& newest = entries_[(head_ + count_ - 1) % entries_.size()];
+  return newest.time - oldest.time;
+}
+
+} // namespace dcp
@@ -0,0 +1,244 @@
+#include "infra/flight_recorder.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <ostream>
+#include <stdexcept>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace dcp {
+
+static constexpr std::size_t kPage = 4096;
+
+static std::size_t RoundUp(std::size_t n, std::size_t to) {
+  return (n + to - 1) / to * to;
+}
+
+static std::int64_t ClockNs(clockid_t clock) {
+  timespec ts{};
+  ::clock_gettime(clock, &ts);
+  return static_cast<std::int64_t>(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+}
+
+FlightRecorder::FlightRecorder(std::string path, std::size_t records, int flush_interval_ms) : path_(std::move(path)) {
+  if (records == 0) throw std::runtime_error("flight recorder: records must be > 0");
+  std::uint64_t capacity = 1;
+  while (capacity < records) capacity <<= 1;
+  mask_ = capacity - 1;
+
+  const std::size_t records_offset = RoundUp(sizeof(FlightHeader), kPage);
+  size_ = records_offset + static_cast<std::size_t>(capacity) * sizeof(FlightRecord);
+
+  // Keep the previous run, it is the one to look at after a crash or reboot
+  if (::access(path_.c_str(), F_OK) == 0) ::rename(path_.c_str(), (path_ + ".prev").c_str());
+
+  const int fd = ::open(path_.c_str(), O_CREAT | O_TRUNC | O_RDWR | O_CLOEXEC, 0644);
+  if (fd < 0) throw std::runtime_error("flight recorder: open '" + path_ + "' failed: " + std::strerror(errno));
+  // Allocate the blocks now, a store into a sparse mapping on a full disk would be SIGBUS in a stage
+  int err = ::posix_fallocate(fd, 0, static_cast<off_t>(size_));
+  if (err == EOPNOTSUPP || err == EINVAL) err = ::ftruncate(fd, static_cast<off_t>(size_)) == 0 ? 0 : errno;
+  if (err != 0) {
+    ::close(fd);
+    throw std::runtime_error("flight recorder: sizing '" + path_ + "' failed: " + std::strerror(err));
+  }
+  void* mem = ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (mem == MAP_FAILED) throw std::runtime_error("flight recorder: mmap '" + path_ + "' failed: " + std::strerror(errno));
+  base_ = static_cast<std::uint8_t*>(mem);
+
+  // Touch every page up front so stages never take a first-write fault on the ring
+  std::memset(base_, 0, size_);
+
+  hdr_ = new (base_) FlightHeader{};
+  hdr_->magic = kFlightMagic;
+  hdr_->version = kFlightVersion;
+  hdr_->record_size = sizeof(FlightRecord);
+  hdr_->writer_pid = static_cast<std::int32_t>(::getpid());
+  hdr_->capacity = capacity;
+  hdr_->records_offset = records_offset;
+  hdr_->start_realtime_ns = ClockNs(CLOCK_REALTIME);
+  hdr_->start_monotonic_ns = ClockNs(CLOCK_MONOTONIC);
+
+  records_ = reinterpret_cast<FlightRecord*>(base_ + records_offset);
+  for (std::uint64_t i = 0; i < capacity; ++i) new (&records_[i]) FlightRecord{};
+
+  if (flush_interval_ms > 0) flusher_ = std::thread([this, flush_interval_ms]() { flush_loop(flush_interval_ms); });
+}
+
+FlightRecorder::~FlightRecorder() {
+  if (flusher_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lk(flush_mu_);
+      stop_ = true;
+    }
+    flush_cv_.notify_all();
+    flusher_.join();
+  }
+  if (base_) {
+    flush();
+    ::munmap(base_, size_);
+  }
+}
+
+std::uint16_t FlightRecorder::add_stage(const std::string& name) {
+  std::lock_guard<std::mutex> lk(stages_mu_);
+  const std::uint32_t n = hdr_->stage_count.load(std::memory_order_relaxed);
+  for (std::uint32_t i = 0; i < n; ++i) {
+    if (std::strncmp(hdr_->stage_names[i], name.c_str(), kFlightStageNameLen - 1) == 0) return static_cast<std::uint16_t>(i);
+  }
+  if (n == kFlightMaxStages) return static_cast<std::uint16_t>(kFlightMaxStages - 1);
+
+  // The last slot is the overflow bucket once it is taken
+  const std::string stored = (n == kFlightMaxStages - 1) ? std::string("other") : name;
+  std::strncpy(hdr_->stage_names[n], stored.c_str(), kFlightStageNameLen - 1);
+  hdr_->stage_count.store(n + 1, std::memory_order_release);
+  return static_cast<std::uint16_t>(n);
+}
+
+void FlightRecorder::flush() {
+  ::msync(base_, size_, MS_SYNC);
+}
+
+void FlightRecorder::flush_loop(int interval_ms) {
+  std::unique_lock<std::mutex> lk(flush_mu_);
+  while (!flush_cv_.wait_for(lk, std::chrono::milliseconds(interval_ms), [this]() { return stop_; })) {
+    lk.unlock();
+    flush();
+    lk.lock();
+  }
+}
+
+FlightDump ReadFlightFile(const std::string& path) {
+  const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) throw std::runtime_error("flight: open '" + path + "' failed: " + std::strerror(errno));
+  struct stat st {};
+  if (::fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(FlightHeader)) {
+    ::close(fd);
+    throw std::runtime_error("flight: '" + path + "' is too small to be a flight recorder file");
+  }
+  const std::size_t size = static_cast<std::size_t>(st.st_size);
+  void* mem = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (mem == MAP_FAILED) throw std::runtime_error("flight: mmap '" + path + "' failed: " + std::strerror(errno));
+  const auto* base = static_cast<const std::uint8_t*>(mem);
+  const auto* hdr = reinterpret_cast<const FlightHeader*>(base);
+
+  auto fail = [&](const std::string& why) {
+    ::munmap(mem, size);
+    return std::runtime_error("flight: '" + path + "' " + why);
+  };
+  if (hdr->magic != kFlightMagic) throw fail("is not a flight recorder file");
+  if (hdr->version != kFlightVersion || hdr->record_size != sizeof(FlightRecord)) {
+    throw fail("has version " + std::to_string(hdr->version) + ", this decoder reads " + std::to_string(kFlightVersion));
+  }
+  const std::uint64_t capacity = hdr->capacity;
+  if (capacity == 0 || (capacity & (capacity - 1)) != 0 || hdr->records_offset < sizeof(FlightHeader) ||
+      hdr->records_offset + capacity * sizeof(FlightRecord) > size) {
+    throw fail("has a damaged header");
+  }
+
+  FlightDump d;
+  d.writer_pid = hdr->writer_pid;
+  d.start_realtime_ns = hdr->start_realtime_ns;
+  d.start_monotonic_ns = hdr->start_monotonic_ns;
+  d.capacity = capacity;
+  d.written = hdr->cursor.load(std::memory_order_acquire);
+
+  const std::uint32_t stages = std::min<std::uint32_t>(hdr->stage_count.load(std::memory_order_acquire), kFlightMaxStages);
+  for (std::uint32_t i = 0; i < stages; ++i) {
+    d.stages.emplace_back(hdr->stage_names[i], strnlen(hdr->stage_names[i], kFlightStageNameLen));
+  }
+
+  // Every slot holds the newest record written to it, if its stamp says the write finished
+  const auto* records = reinterpret_cast<const FlightRecord*>(base + hdr->records_offset);
+  d.events.reserve(static_cast<std::size_t>(std::min(capacity, d.written)));
+  for (std::uint64_t slot = 0; slot < capacity; ++slot) {
+    const FlightRecord& r = records[slot];
+    const std::uint64_t stamp = r.stamp.load(std::memory_order_acquire);
+    if (stamp == 0) {
+      if (slot < d.written) ++d.torn;
+      continue;
+    }
+    if (((stamp - 1) & (capacity - 1)) != slot) {
+      ++d.torn;
+      continue;
+    }
+    FlightEvent e;
+    e.index = stamp - 1;
+    e.sequence_id = r.sequence_id.load(std::memory_order_relaxed);
+    e.start_ns = r.start_ns.load(std::memory_order_relaxed);
+    e.end_ns = e.start_ns + static_cast<std::int64_t>(r.duration_ns.load(std::memory_order_relaxed));
+    e.stage = r.stage.load(std::memory_order_relaxed);
+    e.queue_depth = r.queue_depth.load(std::memory_order_relaxed);
+    // A live writer may have lapped us while we copied
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (r.stamp.load(std::memory_order_relaxed) != stamp) {
+      ++d.torn;
+      continue;
+    }
+    d.events.push_back(e);
+  }
+  ::munmap(mem, size);
+
+  std::sort(d.events.begin(), d.events.end(), [](const FlightEvent& a, const FlightEvent& b) { return a.index < b.index; });
+  return d;
+}
+
+static const std::string& StageName(const FlightDump& d, std::uint16_t stage) {
+  static const std::string unknown = "?";
+  return stage < d.stages.size() ? d.stages[stage] : unknown;
+}
+
+void WriteFlightCsv(const FlightDump& d, std::ostream& out) {
+  out << "sequence_id,stage,start_ms,end_ms,duration_ms,queue_depth\n";
+  char row[160];
+  for (const auto& e : d.events) {
+    const double start_ms = static_cast<double>(e.start_ns - d.start_monotonic_ns) / 1e6;
+    const double end_ms = static_cast<double>(e.end_ns - d.start_monotonic_ns) / 1e6;
+    const int n = std::snprintf(row, sizeof(row), "%llu,%s,%.3f,%.3f,%.3f,%u\n", static_cast<unsigned long long>(e.sequence_id),
+                                StageName(d, e.stage).c_str(), start_ms, end_ms, end_ms - start_ms, e.queue_depth);
+    if (n > 0) out.write(row, std::min<std::streamsize>(n, static_cast<std::streamsize>(sizeof(row) - 1)));
+  }
+}
+
+void WriteFlightTrace(const FlightDump& d, std::ostream& out) {
+  // Microseconds from the recorder's start, pid = the writer, one tid (track) per stage
+  out << "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"start_realtime_ns\":" << d.start_realtime_ns
+      << ",\"records_written\":" << d.written << ",\"torn\":" << d.torn << "},\"traceEvents\":[\n";
+  bool first = true;
+  auto sep = [&]() {
+    if (!first) out << ",\n";
+    first = false;
+  };
+  for (std::size_t i = 0; i < d.stages.size(); ++i) {
+    sep();
+    out << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":" << d.writer_pid << ",\"tid\":" << i
+        << ",\"args\":{\"name\":\"" << d.stages[i] << "\"}}";
+  }
+  char ev[256];
+  for (const auto& e : d.events) {
+    const double ts_us = static_cast<double>(e.start_ns - d.start_monotonic_ns) / 1e3;
+    const double dur_us = static_cast<double>(e.end_ns - e.start_ns) / 1e3;
+    const int n = std::snprintf(ev, sizeof(ev),
+                                "{\"ph\":\"X\",\"name\":\"%s\",\"pid\":%d,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,"
+                                "\"args\":{\"seq\":%llu,\"queue_depth\":%u}}",
+                                StageName(d, e.stage).c_str(), d.writer_pid, e.stage, ts_us, dur_us,
+                                static_cast<unsigned long long>(e.sequence_id), e.queue_depth);
+    if (n <= 0) continue;
+    sep();
+    out.write(ev, std::min<std::streamsize>(n, static_cast<std::streamsize>(sizeof(ev) - 1)));
+  }
+  out << "\n]}\n";
+}
+
+} // namespace dcp
@@ -0,0 +1,164 @@
+#include "infra/metrics.hpp"
+
+#include <stdexcept>
+
+namespace dcp {
+
+Histogram::Histogram(std::vector<std::uint64_t> bounds) : bounds_(std::move(bounds)) {
+  std::sort(bounds_.begin(), bounds_.end());
+  bounds_.erase(std::unique(bounds_.begin(), bounds_.end()), bounds_.end());
+  sum_cell_ = bounds_.size() + 1;
+  lines_per_shard_ = (sum_cell_ + 1 + 7) / 8;
+  lines_.reset(new Line[kMetricShards * lines_per_shard_]());
+}
+
+std::uint64_t Histogram::read(std::vector<std::uint64_t>& counts) const {
+  counts.assign(bounds_.size() + 1, 0);
+  std::uint64_t sum = 0;
+  for (std::size_t s = 0; s < kMetricShards; ++s) {
+    const Line* shard = lines_.get() + s * lines_per_shard_;
+    for (std::size_t b = 0; b < counts.size(); ++b) counts[b] += shard[b / 8].v[b % 8].load(std::memory_order_relaxed);
+    sum += shard[sum_cell_ / 8].v[sum_cell_ % 8].load(std::memory_order_relaxed);
+  }
+  return sum;
+}
+
+const std::vector<std::uint64_t>& LatencyBucketsNs() {
+  static const std::vector<std::uint64_t> bounds{
+      50'000,      100'000,     250'000,     500'000,                                  // us
+      1'000'000,   2'500'000,   5'000'000,   10'000'000,  25'000'000,  50'000'000,    // ms
+      100'000'000, 250'000'000, 500'000'000, 1'000'000'000, 2'500'000'000};
+  return bounds;
+}
+
+double HistogramQuantile(const std::vector<std::uint64_t>& bounds, const std::vector<std::uint64_t>& counts, double q) {
+  std::uint64_t total = 0;
+  for (const auto c : counts) total += c;
+  if (total == 0 || bounds.empty()) return 0.0;
+
+  const double rank = std::max(0.0, std::min(1.0, q)) * static_cast<double>(total);
+  std::uint64_t below = 0;
+  for (std::size_t b = 0; b < bounds.size(); ++b) {
+    if (static_cast<double>(below + counts[b]) >= rank && counts[b] > 0) {
+      const double lo = b == 0 ? 0.0 : static_cast<double>(bounds[b - 1]);
+      const double hi = static_cast<double>(bounds[b]);
+      return lo + (hi - lo) * (rank - static_cast<double>(below)) / static_cast<double>(counts[b]);
+    }
+    below += counts[b];
+  }
+  return static_cast<double>(bounds.back());
+}
+
+double MetricSeries::value() const {
+  if (counter) return static_cast<double>(counter->value());
+  if (gauge) return static_cast<double>(gauge->value());
+  if (fn) return static_cast<double>(fn());
+  return 0.0;
+}
+
+static MetricLabels WithLabel(MetricLabels labels, const char* key, const char* value) {
+  labels.emplace_back(key, value);
+  return labels;
+}
+
+StageMetrics::StageMetrics(Metrics& registry, std::string n, MetricLabels l)
+    : name(std::move(n)),
+      labels(l.empty() ? MetricLabels{{"stage", name}} : std::move(l)),
+      count(registry.counter("dcp_stage_items_total", "Items the stage finished.", labels)),
+      work_ns_total(registry.counter("dcp_stage_work_seconds_total", "Wall time spent on items, rate() of it is the stage's busy fraction.", labels, 1e-9)),
+      latency_hist(registry.histogram("dcp_stage_latency_seconds", "Per-item latency.", labels, LatencyBucketsNs(), 1e-9)),
+      avg_latency_ns(registry.gauge("dcp_stage_latency_avg_seconds", "Per-item latency, moving average.", labels, 1e-9)),
+      avg_age_ns(registry.gauge("dcp_stage_age_avg_seconds", "Capture to done for the items the stage finishes, moving average. 0 = not reported.", labels, 1e-9)),
+      skipped(registry.counter("dcp_stage_skipped_total", "Work avoided on purpose.", labels)),
+      wasted(registry.counter("dcp_stage_wasted_total", "Work done and thrown away before anyone used it.", labels)),
+      allocs(registry.counter("dcp_stage_allocs_total", "Heap allocations while processing items, DCP_COUNT_ALLOCS builds only.", labels)),
+      cpu_ns_total(registry.counter("dcp_stage_cpu_seconds_total", "Thread CPU time spent on items, well under work seconds means waiting rather than computing.", labels, 1e-9)),
+      voluntary_switches(registry.counter("dcp_stage_context_switches_total", "Context switches while processing items, voluntary = blocked, involuntary = preempted.", WithLabel(labels, "kind", "voluntary"))),
+      involuntary_switches(registry.counter("dcp_stage_context_switches_total", "Context switches while processing items, voluntary = blocked, involuntary = preempted.", WithLabel(labels, "kind", "involuntary"))) {
+  last_event_ns.store(NowNs(), std::memory_order_relaxed);
+  if (FlightRecorder* recorder = registry.flight_recorder()) {
+    flight = recorder;
+    flight_stage = recorder->add_stage(name);
+  }
+  if (PerfCountersEnabled()) {
+    cycles = &registry.counter("dcp_stage_cycles_total", "CPU cycles in user space while processing items.", labels);
+    instructions = &registry.counter("dcp_stage_instructions_total", "Instructions retired in user space while processing items.", labels);
+    llc_misses = &registry.counter("dcp_stage_llc_misses_total", "Cache misses (the kernel's generic event, last level on most CPUs) while processing items.", labels);
+    branch_misses = &registry.counter("dcp_stage_branch_misses_total", "Mispredicted branches while processing items.", labels);
+    registry.callback(MetricType::Gauge, "dcp_perf_counters_available", "1 if hardware counters opened, 0 if perf is restricted here.", {},
+                      []() -> std::uint64_t { return PerfCountersAvailable() ? 1 : 0; });
+  }
+  registry.callback(MetricType::Gauge, "dcp_stage_idle_seconds", "Time since the stage last finished an item.", labels, [this]() {
+    const std::uint64_t now = NowNs();
+    const std::uint64_t last = last_event_ns.load(std::memory_order_relaxed);
+    return now > last ? now - last : 0;
+  }, 1e-9);
+}
+
+MetricSeries& Metrics::series_locked(MetricType type, const std::string& name, const std::string& help, MetricLabels labels, double scale) {
+  MetricFamily* family = nullptr;
+  for (const auto& f : families_) {
+    if (f->name == name) family = f.get();
+  }
+  if (!family) {
+    families_.push_back(std::make_unique<MetricFamily>(MetricFamily{name, help, type, scale, {}}));
+    family = families_.back().get();
+  } else if (family->type != type) {
+    throw std::logic_error("Metrics: '" + name + "' is already registered with another type");
+  }
+
+  for (const auto& s : family->series) {
+    if (s->labels == labels) return *s;
+  }
+  family->series.push_back(std::make_unique<MetricSeries>());
+  family->series.back()->labels = std::move(labels);
+  return *family->series.back();
+}
+
+Counter& Metrics::counter(const std::string& name, const std::string& help, MetricLabels labels, double scale) {
+  std::lock_guard<std::mutex> lk(mu_);
+  MetricSeries& s = series_locked(MetricType::Counter, name, help, std::move(labels), scale);
+  if (s.fn) throw std::logic_error("Metrics: '" + name + "' is already registered as a callback");
+  if (!s.counter) s.counter = std::make_unique<Counter>();
+  return *s.counter;
+}
+
+Gauge& Metrics::gauge(const std::string& name, const std::string& help, MetricLabels labels, double scale) {
+  std::lock_guard<std::mutex> lk(mu_);
+  MetricSeries& s = series_locked(MetricType::Gauge, name, help, std::move(labels), scale);
+  if (s.fn) throw std::logic_error("Metrics: '" + name + "' is already registered as a callback");
+  if (!s.gauge) s.gauge = std::make_unique<Gauge>();
+  return *s.gauge;
+}
+
+Histogram& Metrics::histogram(const std::string& name, const std::string& help, MetricLabels labels,
+                              const std::vector<std::uint64_t>& bounds, double scale) {
+  std::lock_guard<std::mutex> lk(mu_);
+  MetricSeries& s = series_locked(MetricType::Histogram, name, help, std::move(labels), scale);
+  if (!s.histogram) {
+    // Every series of a family shares the first one's buckets, so they aggregate
+    const MetricFamily& family = **std::find_if(families_.begin(), families_.end(), [&](const auto& f) { return f->name == name; });
+    const Histogram* first = family.series.front()->histogram.get();
+    s.histogram = std::make_unique<Histogram>(first ? first->bounds() : bounds);
+  }
+  return *s.histogram;
+}
+
+void Metrics::callback(MetricType type, const std::string& name, const std::string& help, MetricLabels labels,
+                       std::function<std::uint64_t()> fn, double scale) {
+  if (type == MetricType::Histogram) throw std::logic_error("Metrics: '" + name + "' callback series must be a counter or gauge");
+  std::lock_guard<std::mutex> lk(mu_);
+  MetricSeries& s = series_locked(type, name, help, std::move(labels), scale);
+  if (s.counter || s.gauge) throw std::logic_error("Metrics: '" + name + "' is already registered as a stored series");
+  s.fn = std::move(fn);
+}
+
+StageMetrics* Metrics::make_stage(std::string name, MetricLabels labels) {
+  // Series register themselves (each under the lock), the stage list is only locked to append
+  auto stage = std::make_unique<StageMetrics>(*this, std::move(name), std::move(labels));
+  std::lock_guard<std::mutex> lk(mu_);
+  stages_.push_back(std::move(stage));
+  return stages_.back().get();
+}
+
+} // namespace dcp
@@ -0,0 +1,163 @@
+#include "infra/perf_counters.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace dcp {
+
+static std::atomic_bool g_enabled{false};
+static std::atomic_bool g_available{false};
+static std::mutex g_reason_mu;
+static std::string g_reason;  // First failure, empty while none
+
+static void SetUnavailable(const std::string& why) {
+  std::lock_guard<std::mutex> lk(g_reason_mu);
+  if (g_reason.empty()) g_reason = why;
+}
+
+void EnablePerfCounters(bool on) {
+  g_enabled.store(on, std::memory_order_relaxed);
+}
+
+bool PerfCountersEnabled() {
+  return g_enabled.load(std::memory_order_relaxed);
+}
+
+bool PerfCountersAvailable() {
+  return g_available.load(std::memory_order_relaxed);
+}
+
+std::string PerfCountersStatus() {
+  if (!PerfCountersEnabled()) return "off";
+  if (PerfCountersAvailable()) return "on";
+  std::lock_guard<std::mutex> lk(g_reason_mu);
+  return g_reason.empty() ? "not opened yet" : "unavailable: " + g_reason;
+}
+
+#if defined(__linux__)
+
+static constexpr int kEvents = 4;
+
+static int OpenEvent(std::uint64_t config, int group_fd) {
+  perf_event_attr attr{};
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = config;
+  attr.disabled = group_fd == -1 ? 1 : 0;  // The leader starts once the whole group is open
+  attr.exclude_kernel = 1;                 // Allowed up to perf_event_paranoid 2
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  return static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0 /* this thread */, -1 /* any cpu */, group_fd, PERF_FLAG_FD_CLOEXEC));
+}
+
+static std::string Describe(int err) {
+  if (err == EACCES || err == EPERM) {
+    int paranoid = -99;
+    if (std::FILE* f = std::fopen("/proc/sys/kernel/perf_event_paranoid", "r")) {
+      if (std::fscanf(f, "%d", &paranoid) != 1) paranoid = -99;
+      std::fclose(f);
+    }
+    return paranoid == -99 ? std::string("permission denied") : "permission denied (perf_event_paranoid=" + std::to_string(paranoid) + ")";
+  }
+  if (err == ENOENT || err == EOPNOTSUPP || err == ENODEV) return "no hardware counters (VM or unsupported CPU)";
+  if (err == ENOSYS) return "perf_event_open not supported (kernel or seccomp)";
+  return std::strerror(err);
+}
+
+namespace {
+
+// The calling thread's group, closed when the thread exits
+struct ThreadGroup {
+  bool tried{false};
+  int fds[kEvents]{-1, -1, -1, -1};
+  int slot[kEvents]{-1, -1, -1, -1};  // Position of each event in the group read, -1 if it didn't open
+  int opened{0};
+
+  ~ThreadGroup() {
+    for (const int fd : fds) {
+      if (fd >= 0) ::close(fd);
+    }
+  }
+
+  void open() {
+    tried = true;
+    static constexpr std::uint64_t kConfigs[kEvents] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                        PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+    for (int i = 0; i < kEvents; ++i) {
+      fds[i] = OpenEvent(kConfigs[i], i == 0 ? -1 : fds[0]);
+      if (fds[i] < 0) {
+        if (i == 0) {
+          SetUnavailable(Describe(errno));
+          return;
+        }
+        continue;  // This one event is missing, the rest still count
+      }
+      slot[i] = opened++;
+    }
+    ::ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    if (::ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP) != 0) {
+      SetUnavailable(Describe(errno));
+      for (int& fd : fds) {
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+      }
+      return;
+    }
+    g_available.store(true, std::memory_order_relaxed);
+  }
+
+  PerfSample read() const {
+    PerfSample s;
+    if (fds[0] < 0) return s;
+    // nr, time_enabled, time_running, then one value per opened event in open order
+    std::uint64_t buf[3 + kEvents]{};
+    const ssize_t n = ::read(fds[0], buf, sizeof(buf));
+    if (n < static_cast<ssize_t>(3 * sizeof(std::uint64_t))) return s;
+    // Raw, multiplexing is scaled per interval in operator-
+    auto value = [&](int i) -> std::uint64_t {
+      if (slot[i] < 0 || static_cast<std::uint64_t>(slot[i]) >= buf[0]) return 0;
+      return buf[3 + slot[i]];
+    };
+    s.cycles = value(0);
+    s.instructions = value(1);
+    s.llc_misses = value(2);
+    s.branch_misses = value(3);
+    s.time_enabled = buf[1];
+    s.time_running = buf[2];
+    return s;
+  }
+};
+
+} // namespace
+
+PerfSample ThreadPerfNow() {
+  if (!PerfCountersEnabled()) return PerfSample{};
+  thread_local ThreadGroup group;
+  if (!group.tried) group.open();
+  return group.read();
+}
+
+#else
+
+PerfSample ThreadPerfNow() {
+  thread_local bool noted = false;
+  if (PerfCountersEnabled() && !noted) {
+    noted = true;
+    SetUnavailable("perf_event_open is Linux only");
+  }
+  return PerfSample{};
+}
+
+#endif
+
+} // namespace dcp
@@ -0,0 +1,70 @@
+#include "infra/process_stats.hpp"
+
+#include <cstdio>
+#include <ctime>
+
+#if defined(__linux__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+#if defined(__linux__)
+#include <unistd.h>
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#endif
+
+namespace dcp {
+
+std::uint64_t ProcessRssBytes() {
+#if defined(__linux__)
+  // statm: size resident shared ... in pages
+  std::FILE* f = std::fopen("/proc/self/statm", "r");
+  if (!f) return 0;
+  unsigned long size = 0;
+  unsigned long resident = 0;
+  const int n = std::fscanf(f, "%lu %lu", &size, &resident);
+  std::fclose(f);
+  if (n != 2) return 0;
+  return static_cast<std::uint64_t>(resident) * static_cast<std::uint64_t>(sysconf(_SC_PAGESIZE));
+#elif defined(__APPLE__)
+  mach_task_basic_info info{};
+  mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+  if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &count) != KERN_SUCCESS) return 0;
+  return static_cast<std::uint64_t>(info.resident_size);
+#else
+  return 0;
+#endif
+}
+
+std::uint64_t ProcessCpuNs() {
+#if defined(__linux__) || defined(__APPLE__)
+  rusage ru{};
+  if (getrusage(RUSAGE_SELF, &ru) != 0) return 0;
+  auto ns = [](const timeval& tv) {
+    return static_cast<std::uint64_t>(tv.tv_sec) * 1000000000ull + static_cast<std::uint64_t>(tv.tv_usec) * 1000ull;
+  };
+  return ns(ru.ru_utime) + ns(ru.ru_stime);
+#else
+  return 0;
+#endif
+}
+
+ThreadUsage ThreadUsageNow() {
+  ThreadUsage u;
+#if defined(__linux__) || defined(__APPLE__)
+  timespec ts{};
+  if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0) {
+    u.cpu_ns = static_cast<std::uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<std::uint64_t>(ts.tv_nsec);
+  }
+#endif
+#if defined(__linux__)
+  rusage ru{};
+  if (getrusage(RUSAGE_THREAD, &ru) == 0) {
+    u.voluntary_switches = static_cast<std::uint64_t>(ru.ru_nvcsw);
+    u.involuntary_switches = static_cast<std::uint64_t>(ru.ru_nivcsw);
+  }
+#endif
+  return u;
+}
+
+} // namespace dcp
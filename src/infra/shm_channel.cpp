@@ -0,0 +1,250 @@
+#include "infra/shm_channel.hpp"
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace dcp {
+
+static constexpr std::size_t kPage = 4096;
+
+static std::size_t RoundUp(std::size_t n, std::size_t to) {
+  return (n + to - 1) / to * to;
+}
+
+std::int64_t ShmNowNs() {
+  timespec ts{};
+  ::clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<std::int64_t>(ts.tv_sec) * 1'000'000'000 + ts.tv_nsec;
+}
+
+// Seqlock writer side. Odd while the slot is being written, the index is stored before the slot turns even again
+static std::uint64_t SeqBegin(ShmSlotHeader& h) {
+  const std::uint64_t s = h.seq.load(std::memory_order_relaxed);
+  h.seq.store(s + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  return s;
+}
+
+static void SeqEnd(ShmSlotHeader& h, std::uint64_t s, std::uint64_t index) {
+  h.index.store(index, std::memory_order_relaxed);
+  h.seq.store(s + 2, std::memory_order_release);
+}
+
+// Seqlock reader side: the sequence a read starts on (odd = writer inside), and whether it was still that at the end
+static bool SeqStable(const ShmSlotHeader& h, std::uint64_t s) {
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return h.seq.load(std::memory_order_relaxed) == s;
+}
+
+ShmWriter::ShmWriter(std::string name, std::size_t world_slots, std::size_t frame_slots, std::size_t frame_capacity)
+    : name_(std::move(name)) {
+  if (name_.size() < 2 || name_[0] != '/' || name_.find('/', 1) != std::string::npos) {
+    throw std::runtime_error("shm: name '" + name_ + "' must look like /name");
+  }
+  if (world_slots == 0 || frame_slots == 0) throw std::runtime_error("shm: world_slots and frame_slots must be > 0");
+
+  const std::size_t world_stride = RoundUp(sizeof(ShmSlotHeader) + sizeof(ShmWorldRecord), 64);
+  const std::size_t frame_stride = kShmFramePixelsOffset + RoundUp(frame_capacity, kPage);
+  const std::size_t world_offset = RoundUp(sizeof(ShmHeader), kPage);
+  const std::size_t frame_offset = RoundUp(world_offset + world_slots * world_stride, kPage);
+  size_ = frame_offset + frame_slots * frame_stride;
+
+  // A stale object from a crashed run is replaced, readers still mapping it notice the heartbeat stop
+  ::shm_unlink(name_.c_str());
+  const int fd = ::shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0644);
+  if (fd < 0) throw std::runtime_error("shm: shm_open '" + name_ + "' failed: " + std::strerror(errno));
+  if (::ftruncate(fd, static_cast<off_t>(size_)) != 0) {
+    const int err = errno;
+    ::close(fd);
+    ::shm_unlink(name_.c_str());
+    throw std::runtime_error("shm: sizing '" + name_ + "' failed: " + std::strerror(err));
+  }
+  void* mem = ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (mem == MAP_FAILED) {
+    ::shm_unlink(name_.c_str());
+    throw std::runtime_error("shm: mmap '" + name_ + "' failed: " + std::strerror(errno));
+  }
+  base_ = static_cast<std::uint8_t*>(mem);
+
+  hdr_ = new (base_) ShmHeader{};
+  hdr_->magic = kShmMagic;
+  hdr_->version = kShmVersion;
+  hdr_->writer_pid = static_cast<std::int32_t>(::getpid());
+  hdr_->world_slots = static_cast<std::uint32_t>(world_slots);
+  hdr_->frame_slots = static_cast<std::uint32_t>(frame_slots);
+  hdr_->world_offset = world_offset;
+  hdr_->world_stride = world_stride;
+  hdr_->frame_offset = frame_offset;
+  hdr_->frame_stride = frame_stride;
+  hdr_->frame_capacity = RoundUp(frame_capacity, kPage);
+  hdr_->total_bytes = size_;
+  for (std::size_t i = 0; i < world_slots; ++i) new (base_ + world_offset + i * world_stride) ShmSlotHeader{};
+  for (std::size_t i = 0; i < frame_slots; ++i) new (base_ + frame_offset + i * frame_stride) ShmSlotHeader{};
+
+  hdr_->heartbeat_ns.store(ShmNowNs(), std::memory_order_relaxed);
+  hdr_->ready.store(1, std::memory_order_release);
+}
+
+ShmWriter::~ShmWriter() {
+  if (base_) ::munmap(base_, size_);
+  ::shm_unlink(name_.c_str());
+}
+
+ShmSlotHeader* ShmWriter::world_slot(std::uint64_t index) const {
+  return reinterpret_cast<ShmSlotHeader*>(base_ + hdr_->world_offset + ((index - 1) % hdr_->world_slots) * hdr_->world_stride);
+}
+
+ShmSlotHeader* ShmWriter::frame_slot(std::uint64_t index) const {
+  return reinterpret_cast<ShmSlotHeader*>(base_ + hdr_->frame_offset + ((index - 1) % hdr_->frame_slots) * hdr_->frame_stride);
+}
+
+void ShmWriter::publish_world(ShmWorldRecord& rec) {
+  const std::uint64_t index = hdr_->world_published.load(std::memory_order_relaxed) + 1;
+  rec.index = index;
+  const std::size_t used = offsetof(ShmWorldRecord, tracks) + rec.track_count * sizeof(ShmTrack);
+
+  ShmSlotHeader* slot = world_slot(index);
+  const std::uint64_t s = SeqBegin(*slot);
+  std::memcpy(reinterpret_cast<std::uint8_t*>(slot) + sizeof(ShmSlotHeader), &rec, used);
+  SeqEnd(*slot, s, index);
+
+  hdr_->world_published.store(index, std::memory_order_release);
+  hdr_->heartbeat_ns.store(ShmNowNs(), std::memory_order_relaxed);
+}
+
+std::uint8_t* ShmWriter::begin_frame() {
+  open_index_ = hdr_->frame_published.load(std::memory_order_relaxed) + 1;
+  open_frame_ = frame_slot(open_index_);
+  open_seq_ = SeqBegin(*open_frame_);
+  return reinterpret_cast<std::uint8_t*>(open_frame_) + kShmFramePixelsOffset;
+}
+
+void ShmWriter::commit_frame(ShmFrameInfo info) {
+  if (!open_frame_) return;
+  info.index = open_index_;
+  std::memcpy(reinterpret_cast<std::uint8_t*>(open_frame_) + sizeof(ShmSlotHeader), &info, sizeof(info));
+  SeqEnd(*open_frame_, open_seq_, open_index_);
+  open_frame_ = nullptr;
+
+  hdr_->frame_published.store(open_index_, std::memory_order_release);
+  hdr_->heartbeat_ns.store(ShmNowNs(), std::memory_order_relaxed);
+}
+
+bool ShmFrameView::valid() const {
+  return slot_ && SeqStable(*slot_, seq_);
+}
+
+ShmReader::ShmReader(const std::string& name) {
+  const int fd = ::shm_open(name.c_str(), O_RDONLY | O_CLOEXEC, 0);
+  if (fd < 0) throw std::runtime_error("shm: can't open '" + name + "': " + std::strerror(errno));
+  struct stat st{};
+  if (::fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(ShmHeader)) {
+    ::close(fd);
+    throw std::runtime_error("shm: '" + name + "' is not initialized yet");
+  }
+  size_ = static_cast<std::size_t>(st.st_size);
+  void* mem = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (mem == MAP_FAILED) throw std::runtime_error("shm: mmap '" + name + "' failed: " + std::strerror(errno));
+  base_ = static_cast<std::uint8_t*>(mem);
+  hdr_ = reinterpret_cast<const ShmHeader*>(base_);
+
+  std::string error;
+  if (hdr_->ready.load(std::memory_order_acquire) != 1) error = "is not initialized yet";
+  else if (hdr_->magic != kShmMagic) error = "is not a dashcam publication";
+  else if (hdr_->version != kShmVersion) error = "has layout version " + std::to_string(hdr_->version) + ", expected " + std::to_string(kShmVersion);
+  else if (hdr_->total_bytes > size_) error = "is truncated";
+  if (!error.empty()) {
+    ::munmap(base_, size_);
+    throw std::runtime_error("shm: '" + name + "' " + error);
+  }
+}
+
+ShmReader::~ShmReader() {
+  if (base_) ::munmap(base_, size_);
+}
+
+bool ShmReader::writer_alive(std::int64_t max_age_ns) const {
+  return ShmNowNs() - hdr_->heartbeat_ns.load(std::memory_order_relaxed) <= max_age_ns;
+}
+
+ShmRead ShmReader::read_world(std::uint64_t index, ShmWorldRecord& out) const {
+  const auto* slot = reinterpret_cast<const ShmSlotHeader*>(base_ + hdr_->world_offset + ((index - 1) % hdr_->world_slots) * hdr_->world_stride);
+  const std::uint64_t s = slot->seq.load(std::memory_order_acquire);
+  if ((s & 1) || slot->index.load(std::memory_order_relaxed) != index) return ShmRead::Retry;
+
+  // Header first, then only the tracks it has. A torn count is caught by the sequence check below
+  const std::uint8_t* payload = reinterpret_cast<const std::uint8_t*>(slot) + sizeof(ShmSlotHeader);
+  std::memcpy(&out, payload, offsetof(ShmWorldRecord, tracks));
+  const std::size_t n = out.track_count < kShmMaxTracks ? out.track_count : kShmMaxTracks;
+  std::memcpy(out.tracks, payload + offsetof(ShmWorldRecord, tracks), n * sizeof(ShmTrack));
+
+  if (!SeqStable(*slot, s)) return ShmRead::Retry;
+  out.track_count = static_cast<std::uint32_t>(n);
+  return ShmRead::Ok;
+}
+
+ShmRead ShmReader::read_frame(std::uint64_t index, ShmFrameView& out) const {
+  const auto* slot = reinterpret_cast<const ShmSlotHeader*>(base_ + hdr_->frame_offset + ((index - 1) % hdr_->frame_slots) * hdr_->frame_stride);
+  const std::uint64_t s = slot->seq.load(std::memory_order_acquire);
+  if ((s & 1) || slot->index.load(std::memory_order_relaxed) != index) return ShmRead::Retry;
+
+  std::memcpy(&out.info, reinterpret_cast<const std::uint8_t*>(slot) + sizeof(ShmSlotHeader), sizeof(ShmFrameInfo));
+  if (!SeqStable(*slot, s)) return ShmRead::Retry;
+  if (out.info.bytes > hdr_->frame_capacity) return ShmRead::Retry;
+
+  out.pixels = reinterpret_cast<const std::uint8_t*>(slot) + kShmFramePixelsOffset;
+  out.slot_ = slot;
+  out.seq_ = s;
+  return ShmRead::Ok;
+}
+
+// In-order walk shared by both rings: start at the newest, skip (and count) what the writer already overwrote
+template <typename Read>
+static ShmRead NextInOrder(std::uint64_t published, std::uint64_t slots, std::uint64_t& next, std::uint64_t& overruns, Read&& read) {
+  if (published == 0) return ShmRead::Empty;
+  if (next == 0) next = published;
+  if (next > published) return ShmRead::Empty;
+
+  const std::uint64_t oldest = published > slots ? published - slots + 1 : 1;
+  if (next < oldest) {
+    overruns += oldest - next;
+    next = oldest;
+  }
+  const ShmRead r = read(next);
+  if (r == ShmRead::Ok) ++next;
+  return r;
+}
+
+ShmRead ShmReader::next_world(ShmWorldRecord& out) {
+  return NextInOrder(hdr_->world_published.load(std::memory_order_acquire), hdr_->world_slots, next_world_, world_overruns_,
+                     [&](std::uint64_t i) { return read_world(i, out); });
+}
+
+ShmRead ShmReader::latest_world(ShmWorldRecord& out) {
+  const std::uint64_t published = hdr_->world_published.load(std::memory_order_acquire);
+  return published == 0 ? ShmRead::Empty : read_world(published, out);
+}
+
+ShmRead ShmReader::next_frame(ShmFrameView& out) {
+  return NextInOrder(hdr_->frame_published.load(std::memory_order_acquire), hdr_->frame_slots, next_frame_, frame_overruns_,
+                     [&](std::uint64_t i) { return read_frame(i, out); });
+}
+
+ShmRead ShmReader::latest_frame(ShmFrameView& out) {
+  const std::uint64_t published = hdr_->frame_published.load(std::memory_order_acquire);
+  return published == 0 ? ShmRead::Empty : read_frame(published, out);
+}
+
+} // namespace dcp
@@ -0,0 +1,228 @@
+#include "infra/shm_infer_channel.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#endif
+
+#include "infra/shm_channel.hpp"
+
+namespace dcp {
+
+static constexpr std::size_t kPage = 4096;
+
+static std::size_t RoundUp(std::size_t n, std::size_t to) {
+  return (n + to - 1) / to * to;
+}
+
+static_assert(sizeof(std::atomic<std::uint32_t>) == sizeof(std::uint32_t), "futex words must be plain 32-bit");
+
+// Sleeps while word == expected, up to timeout_ns. Shared (not FUTEX_PRIVATE) so it works across processes. Wakeups
+// may be spurious, callers recheck
+static void WaitWhileEqual(const std::atomic<std::uint32_t>& word, std::uint32_t expected, std::int64_t timeout_ns) {
+#if defined(__linux__)
+  timespec ts{};
+  ts.tv_sec = static_cast<time_t>(timeout_ns / 1'000'000'000);
+  ts.tv_nsec = static_cast<long>(timeout_ns % 1'000'000'000);
+  ::syscall(SYS_futex, const_cast<std::atomic<std::uint32_t>*>(&word), FUTEX_WAIT, expected, &ts, nullptr, 0);
+#else
+  (void)word;
+  (void)expected;
+  std::this_thread::sleep_for(std::chrono::nanoseconds(std::min<std::int64_t>(timeout_ns, 100'000)));
+#endif
+}
+
+static void WakeAll(std::atomic<std::uint32_t>& word) {
+#if defined(__linux__)
+  ::syscall(SYS_futex, &word, FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+#else
+  (void)word;
+#endif
+}
+
+// Waits for pred() up to timeout_ns, sleeping on word while it still holds the value pred() last saw
+template <typename Pred>
+static bool WaitFor(const std::atomic<std::uint32_t>& word, std::int64_t timeout_ns, Pred pred) {
+  const std::int64_t deadline = ShmNowNs() + timeout_ns;
+  for (;;) {
+    const std::uint32_t seen = word.load(std::memory_order_acquire);
+    if (pred(seen)) return true;
+    const std::int64_t left = deadline - ShmNowNs();
+    if (left <= 0) return false;
+    WaitWhileEqual(word, seen, left);
+  }
+}
+
+ShmInferClient::ShmInferClient(std::string name, std::size_t max_batch, std::size_t frame_capacity, std::size_t max_detections)
+    : name_(std::move(name)) {
+  if (name_.size() < 2 || name_[0] != '/' || name_.find('/', 1) != std::string::npos) {
+    throw std::runtime_error("shm infer: name '" + name_ + "' must look like /name");
+  }
+  if (max_batch == 0 || max_batch > kShmInferMaxBatch) {
+    throw std::runtime_error("shm infer: max_batch must be in [1, " + std::to_string(kShmInferMaxBatch) + "]");
+  }
+  if (max_detections == 0) throw std::runtime_error("shm infer: max_detections must be > 0");
+
+  const std::size_t capacity = RoundUp(frame_capacity, kPage);
+  const std::size_t pixels_offset = RoundUp(sizeof(ShmInferHeader), kPage);
+  const std::size_t detections_offset = pixels_offset + max_batch * capacity;
+  size_ = RoundUp(detections_offset + max_batch * max_detections * sizeof(ShmDetection), kPage);
+
+  ::shm_unlink(name_.c_str());
+  const int fd = ::shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0600);
+  if (fd < 0) throw std::runtime_error("shm infer: shm_open '" + name_ + "' failed: " + std::strerror(errno));
+  if (::ftruncate(fd, static_cast<off_t>(size_)) != 0) {
+    const int err = errno;
+    ::close(fd);
+    ::shm_unlink(name_.c_str());
+    throw std::runtime_error("shm infer: sizing '" + name_ + "' failed: " + std::strerror(err));
+  }
+  void* mem = ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (mem == MAP_FAILED) {
+    ::shm_unlink(name_.c_str());
+    throw std::runtime_error("shm infer: mmap '" + name_ + "' failed: " + std::strerror(errno));
+  }
+  base_ = static_cast<std::uint8_t*>(mem);
+
+  hdr_ = new (base_) ShmInferHeader{};
+  hdr_->magic = kShmInferMagic;
+  hdr_->version = kShmInferVersion;
+  hdr_->max_batch = static_cast<std::uint32_t>(max_batch);
+  hdr_->max_detections = static_cast<std::uint32_t>(max_detections);
+  hdr_->frame_capacity = capacity;
+  hdr_->pixels_offset = pixels_offset;
+  hdr_->detections_offset = detections_offset;
+  hdr_->total_bytes = size_;
+  hdr_->ready.store(1, std::memory_order_release);
+}
+
+ShmInferClient::~ShmInferClient() {
+  if (base_) ::munmap(base_, size_);
+  ::shm_unlink(name_.c_str());
+}
+
+std::uint8_t* ShmInferClient::pixels(std::size_t i) {
+  return base_ + hdr_->pixels_offset + i * hdr_->frame_capacity;
+}
+
+ShmInferFrame& ShmInferClient::frame(std::size_t i) {
+  return hdr_->frames[i];
+}
+
+std::uint32_t ShmInferClient::submit(std::size_t count) {
+  hdr_->request_count = static_cast<std::uint32_t>(count);
+  const std::uint32_t seq = hdr_->request_seq.load(std::memory_order_relaxed) + 1;
+  hdr_->request_seq.store(seq, std::memory_order_release);
+  WakeAll(hdr_->request_seq);
+  return seq;
+}
+
+bool ShmInferClient::wait_response(std::uint32_t seq, std::int64_t timeout_ns) const {
+  return WaitFor(hdr_->response_seq, timeout_ns, [seq](std::uint32_t s) { return s == seq; });
+}
+
+const ShmDetection* ShmInferClient::detections(std::size_t i) const {
+  return reinterpret_cast<const ShmDetection*>(base_ + hdr_->detections_offset) + i * hdr_->max_detections;
+}
+
+void ShmInferClient::reset_worker() {
+  hdr_->worker_state.store(static_cast<std::uint32_t>(ShmWorkerState::Starting), std::memory_order_relaxed);
+  hdr_->worker_pid.store(0, std::memory_order_relaxed);
+  hdr_->batch_dynamic.store(0, std::memory_order_relaxed);
+  hdr_->shutdown.store(0, std::memory_order_relaxed);
+  hdr_->response_seq.store(hdr_->request_seq.load(std::memory_order_relaxed), std::memory_order_release);
+}
+
+void ShmInferClient::request_shutdown() {
+  hdr_->shutdown.store(1, std::memory_order_release);
+  // The worker waits on request_seq, nudge it without submitting anything
+  WakeAll(hdr_->request_seq);
+}
+
+ShmInferServer::ShmInferServer(const std::string& name) {
+  const int fd = ::shm_open(name.c_str(), O_RDWR | O_CLOEXEC, 0);
+  if (fd < 0) throw std::runtime_error("shm infer: shm_open '" + name + "' failed: " + std::strerror(errno));
+  struct stat st{};
+  if (::fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(ShmInferHeader)) {
+    ::close(fd);
+    throw std::runtime_error("shm infer: '" + name + "' is too small");
+  }
+  size_ = static_cast<std::size_t>(st.st_size);
+  void* mem = ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (mem == MAP_FAILED) throw std::runtime_error("shm infer: mmap '" + name + "' failed: " + std::strerror(errno));
+  base_ = static_cast<std::uint8_t*>(mem);
+  hdr_ = reinterpret_cast<ShmInferHeader*>(base_);
+
+  if (hdr_->ready.load(std::memory_order_acquire) == 0 || hdr_->magic != kShmInferMagic ||
+      hdr_->version != kShmInferVersion || hdr_->total_bytes != size_) {
+    ::munmap(base_, size_);
+    base_ = nullptr;
+    throw std::runtime_error("shm infer: '" + name + "' is not a compatible inference channel");
+  }
+
+  // A request left over from a previous worker is not ours to answer
+  handled_ = hdr_->request_seq.load(std::memory_order_acquire);
+  hdr_->worker_pid.store(static_cast<std::int32_t>(::getpid()), std::memory_order_relaxed);
+  hdr_->heartbeat_ns.store(ShmNowNs(), std::memory_order_relaxed);
+}
+
+ShmInferServer::~ShmInferServer() {
+  if (base_) ::munmap(base_, size_);
+}
+
+void ShmInferServer::set_ready(bool batch_dynamic) {
+  hdr_->batch_dynamic.store(batch_dynamic ? 1 : 0, std::memory_order_relaxed);
+  hdr_->worker_state.store(static_cast<std::uint32_t>(ShmWorkerState::Ready), std::memory_order_release);
+}
+
+void ShmInferServer::set_failed() {
+  hdr_->worker_state.store(static_cast<std::uint32_t>(ShmWorkerState::Failed), std::memory_order_release);
+}
+
+bool ShmInferServer::wait_request(std::int64_t timeout_ns) {
+  const std::uint32_t handled = handled_;
+  const bool got = WaitFor(hdr_->request_seq, timeout_ns, [this, handled](std::uint32_t s) {
+    return s != handled || shutdown_requested();
+  });
+  hdr_->heartbeat_ns.store(ShmNowNs(), std::memory_order_relaxed);
+  if (!got || shutdown_requested()) return false;
+  pending_ = hdr_->request_seq.load(std::memory_order_acquire);
+  return true;
+}
+
+const std::uint8_t* ShmInferServer::pixels(std::size_t i) const {
+  return base_ + hdr_->pixels_offset + i * hdr_->frame_capacity;
+}
+
+ShmDetection* ShmInferServer::detections(std::size_t i) {
+  return reinterpret_cast<ShmDetection*>(base_ + hdr_->detections_offset) + i * hdr_->max_detections;
+}
+
+void ShmInferServer::complete(std::size_t count, std::int32_t status, std::int64_t run_ns) {
+  hdr_->response_count = static_cast<std::uint32_t>(count);
+  hdr_->status = status;
+  hdr_->run_ns = run_ns;
+  handled_ = pending_;
+  hdr_->heartbeat_ns.store(ShmNowNs(), std::memory_order_relaxed);
+  hdr_->response_seq.store(pending_, std::memory_order_release);
+  WakeAll(hdr_->response_seq);
+}
+
+} // namespace dcp
@@ -0,0 +1,121 @@
+#include "infra/task_executor.hpp"
+
+#include <chrono>
+#include <utility>
+
+namespace dcp {
+
+// Which executor/worker the current thread belongs to, so submits from inside a task stay on the same worker
+static thread_local const TaskExecutor* tl_executor = nullptr;
+static thread_local std::size_t tl_worker = 0;
+
+TaskExecutor::TaskExecutor(std::size_t workers, std::string name, ThreadConfig thread_cfg) : name_(std::move(name)) {
+  if (workers == 0) workers = static_cast<std::size_t>(AvailableCpuCount());
+
+  workers_.reserve(workers);
+  for (std::size_t i = 0; i < workers; ++i) {
+    auto w = std::make_unique<Worker>();
+    w->runner = std::make_unique<ThreadRunner>(name_ + "#" + std::to_string(i));
+    w->runner->set_thread_config(thread_cfg);
+    workers_.push_back(std::move(w));
+  }
+
+  // Start only after every worker exists, thieves walk the whole vector
+  for (std::size_t i = 0; i < workers_.size(); ++i) {
+    workers_[i]->runner->start(stop_.token(), [this, i](const StopToken& g, const std::atomic_bool& l) {
+      worker_loop(i, g, l);
+    });
+  }
+}
+
+TaskExecutor::~TaskExecutor() {
+  stop();
+}
+
+void TaskExecutor::submit(TaskPriority prio, Task task) {
+  if (stop_.stop_requested()) return;
+
+  const std::size_t lane = static_cast<std::size_t>(prio);
+  const std::size_t target = (tl_executor == this)
+      ? tl_worker
+      : next_worker_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+
+  {
+    std::lock_guard<std::mutex> lock(workers_[target]->mu);
+    workers_[target]->lanes[lane].push_back(std::move(task));
+  }
+  pending_.fetch_add(1, std::memory_order_release);
+
+  // Take the sleep lock so a worker between its empty check and its wait can't miss this notify
+  { std::lock_guard<std::mutex> lock(sleep_mu_); }
+  sleep_cv_.notify_one();
+}
+
+void TaskExecutor::stop() {
+  if (!stop_.stop_requested()) {
+    stop_.request_stop();
+    { std::lock_guard<std::mutex> lock(sleep_mu_); }
+    sleep_cv_.notify_all();
+  }
+  for (auto& w : workers_) w->runner->join();
+}
+
+// Owner takes from the front (FIFO), so a task that keeps resubmitting itself can't starve older work
+bool TaskExecutor::pop_local(std::size_t self, std::size_t lane, Task& out) {
+  Worker& w = *workers_[self];
+  std::lock_guard<std::mutex> lock(w.mu);
+  if (w.lanes[lane].empty()) return false;
+  out = std::move(w.lanes[lane].front());
+  w.lanes[lane].pop_front();
+  return true;
+}
+
+// Thieves take from the back of other workers' deques, starting next to themselves to spread contention
+bool TaskExecutor::steal(std::size_t self, std::size_t lane, Task& out) {
+  const std::size_t n = workers_.size();
+  for (std::size_t k = 1; k < n; ++k) {
+    Worker& v = *workers_[(self + k) % n];
+    std::lock_guard<std::mutex> lock(v.mu);
+    if (v.lanes[lane].empty()) continue;
+    out = std::move(v.lanes[lane].back());
+    v.lanes[lane].pop_back();
+    stolen_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+  return false;
+}
+
+bool TaskExecutor::next_task(std::size_t self, Task& out) {
+  for (std::size_t lane = 0; lane < kLanes; ++lane) {
+    if (pop_local(self, lane, out) || steal(self, lane, out)) {
+      pending_.fetch_sub(1, std::memory_order_acq_rel);
+      return true;
+    }
+  }
+  return false;
+}
+
+void TaskExecutor::worker_loop(std::size_t self, const StopToken& global, const std::atomic_bool& local) {
+  tl_executor = this;
+  tl_worker = self;
+
+  Task task;
+  while (!global.stop_requested() && !local.load(std::memory_order_relaxed)) {
+    if (next_task(self, task)) {
+      task();
+      task = nullptr;
+      executed_.fetch_add(1, std::memory_order_relaxed);
+      continue;
+    }
+
+    // Nothing anywhere. Sleep until a submit, with a timeout as a safety net
+    std::unique_lock<std::mutex> lock(sleep_mu_);
+    sleep_cv_.wait_for(lock, std::chrono::milliseconds(10), [&] {
+      return pending_.load(std::memory_order_acquire) > 0 || global.stop_requested();
+    });
+  }
+
+  tl_executor = nullptr;
+}
+
+} // namespace dcp
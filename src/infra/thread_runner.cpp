@@ -1,5 +1,6 @@
 #include "infra/thread_runner.hpp"
 
+#include <iostream>
 #include <stdexcept>
 #include <utility>
 
@@ -23,10 +24,28 @@ void ThreadRunner::start(StopToken global_stop, Fn fn) {
   global_stop_ = global_stop;
 
   thread_ = std::thread([this, fn = std::move(fn)]() mutable {
+    // Name, pin and prioritize ourselves before doing any work, then report what the kernel actually gave us. Only
+    // threads whose config asked for something print it, the rest would just be a line per stage/worker/encoder
+    ThreadReport r = ApplyThreadConfig(name_, thread_cfg_);
+    if (ThreadConfigRequested(thread_cfg_) || !r.notes.empty()) {
+      static std::mutex print_mu;
+      std::lock_guard<std::mutex> lock(print_mu);
+      std::cout << "[thread] " << FormatThreadReport(r) << std::endl;
+    }
+    {
+      std::lock_guard<std::mutex> lock(report_mu_);
+      report_ = std::move(r);
+    }
+
     fn(global_stop_, local_stop_);
   });
 }
 
+ThreadReport ThreadRunner::report() const {
+  std::lock_guard<std::mutex> lock(report_mu_);
+  return report_;
+}
+
 // request_stop, simply update local_stop to true
 void ThreadRunner::request_stop() {
   local_stop_.store(true, std::memory_order_relaxed);
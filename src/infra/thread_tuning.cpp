@@ -0,0 +1,202 @@
+#include "infra/thread_tuning.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <thread>
+
+#include <pthread.h>
+
+#if defined(__linux__)
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace dcp {
+
+static void AddNote(ThreadReport& r, const std::string& note) {
+  if (!r.notes.empty()) r.notes += "; ";
+  r.notes += note;
+}
+
+// Kernel limit is 15 chars + NUL. "_stage" says nothing in top/perf, so it goes first. If that isn't enough the name
+// keeps its head (stream prefix, stage) and up to 4 chars of its "#..." suffix (helper or worker), and the end of the
+// head is cut: "front/preprocess_stage#3" -> "front/preproc#3", "front/camera_stage#decode" -> "front/camer#dec"
+static std::string ShortThreadName(const std::string& name) {
+  constexpr std::size_t kMax = 15;
+  std::string n = name;
+  for (std::size_t at; (at = n.find("_stage")) != std::string::npos;) n.erase(at, 6);
+  if (n.size() <= kMax) return n;
+
+  const std::size_t hash = n.rfind('#');
+  const std::string suffix = hash == std::string::npos ? std::string() : n.substr(hash, 4);
+  return n.substr(0, std::min(hash, kMax - suffix.size())) + suffix;
+}
+
+static void SetName(const std::string& name, ThreadReport& r) {
+  const std::string short_name = ShortThreadName(name);
+#if defined(__APPLE__)
+  const int rc = pthread_setname_np(short_name.c_str());
+#else
+  const int rc = pthread_setname_np(pthread_self(), short_name.c_str());
+#endif
+  if (rc != 0) AddNote(r, std::string("setname failed: ") + std::strerror(rc));
+}
+
+#if defined(__linux__)
+
+static int PolicyFromString(const std::string& s) {
+  if (s == "fifo") return SCHED_FIFO;
+  if (s == "rr") return SCHED_RR;
+  return SCHED_OTHER;
+}
+
+static std::string PolicyToString(int policy) {
+  switch (policy) {
+    case SCHED_FIFO: return "fifo";
+    case SCHED_RR: return "rr";
+    case SCHED_OTHER: return "other";
+#ifdef SCHED_BATCH
+    case SCHED_BATCH: return "batch";
+#endif
+#ifdef SCHED_IDLE
+    case SCHED_IDLE: return "idle";
+#endif
+    default: return "unknown";
+  }
+}
+
+static void ApplyAffinity(const ThreadConfig& cfg, ThreadReport& r) {
+  if (cfg.cpus.empty()) return;
+
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) CPU_ZERO(&allowed);
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  int count = 0;
+  for (int cpu : cfg.cpus) {
+    if (cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &allowed)) {
+      AddNote(r, "cpu " + std::to_string(cpu) + " not available, skipped");
+      continue;
+    }
+    CPU_SET(cpu, &set);
+    ++count;
+  }
+
+  if (count == 0) {
+    AddNote(r, "no configured cpu available, not pinned");
+    return;
+  }
+
+  const int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  if (rc != 0) AddNote(r, std::string("affinity failed: ") + std::strerror(rc));
+}
+
+static void ApplyPolicy(const ThreadConfig& cfg, ThreadReport& r) {
+  const int policy = PolicyFromString(cfg.policy);
+
+  if (policy != SCHED_OTHER) {
+    sched_param sp{};
+    sp.sched_priority = cfg.priority;
+    const int rc = pthread_setschedparam(pthread_self(), policy, &sp);
+    if (rc == 0) return;
+    AddNote(r, cfg.policy + " denied (" + std::string(std::strerror(rc)) + "), using other");
+  }
+
+  if (cfg.nice == 0) return;
+
+  // Linux nice is per thread when addressed by tid
+  const pid_t tid = static_cast<pid_t>(syscall(SYS_gettid));
+  if (setpriority(PRIO_PROCESS, static_cast<id_t>(tid), cfg.nice) != 0) {
+    AddNote(r, "nice " + std::to_string(cfg.nice) + " denied (" + std::string(std::strerror(errno)) + "), using 0");
+  }
+}
+
+static void ReadBack(ThreadReport& r) {
+  r.tid = static_cast<long>(syscall(SYS_gettid));
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (pthread_getaffinity_np(pthread_self(), sizeof(set), &set) == 0) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu, &set)) r.cpus.push_back(cpu);
+    }
+  }
+
+  int policy = SCHED_OTHER;
+  sched_param sp{};
+  if (pthread_getschedparam(pthread_self(), &policy, &sp) == 0) {
+    r.policy = PolicyToString(policy);
+    r.priority = sp.sched_priority;
+  }
+
+  errno = 0;
+  const int nice = getpriority(PRIO_PROCESS, static_cast<id_t>(r.tid));
+  if (errno == 0) r.nice = nice;
+}
+
+#endif
+
+ThreadReport ApplyThreadConfig(const std::string& name, const ThreadConfig& cfg) {
+  ThreadReport r;
+  r.name = name;
+
+  SetName(name, r);
+
+#if defined(__linux__)
+  ApplyAffinity(cfg, r);
+  ApplyPolicy(cfg, r);
+  ReadBack(r);
+#else
+  if (ThreadConfigRequested(cfg)) AddNote(r, "affinity/policy/nice unsupported on this platform");
+#endif
+
+  return r;
+}
+
+bool ThreadConfigRequested(const ThreadConfig& cfg) {
+  return !cfg.cpus.empty() || cfg.policy != "other" || cfg.nice != 0;
+}
+
+std::string FormatThreadReport(const ThreadReport& r) {
+  std::ostringstream os;
+  os << r.name << " tid=" << r.tid << " cpus=" << (r.cpus.empty() ? "?" : FormatCpuList(r.cpus));
+  os << " policy=" << r.policy;
+  if (r.policy == "fifo" || r.policy == "rr") os << ":" << r.priority;
+  os << " nice=" << r.nice;
+  if (!r.notes.empty()) os << " (" << r.notes << ")";
+  return os.str();
+}
+
+std::string FormatCpuList(const std::vector<int>& cpus) {
+  if (cpus.empty()) return "any";
+
+  // Collapse runs, "0-3,6" instead of "0,1,2,3,6"
+  std::ostringstream os;
+  for (std::size_t i = 0; i < cpus.size();) {
+    std::size_t j = i;
+    while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) ++j;
+    if (i > 0) os << ",";
+    os << cpus[i];
+    if (j > i) os << "-" << cpus[j];
+    i = j + 1;
+  }
+  return os.str();
+}
+
+int AvailableCpuCount() {
+#if defined(__linux__)
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) return CPU_COUNT(&set);
+#endif
+  const unsigned n = std::thread::hardware_concurrency();
+  return n == 0 ? 1 : static_cast<int>(n);
+}
+
+} // namespace dcp
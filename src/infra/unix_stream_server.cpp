@@ -0,0 +1,160 @@
+#include "infra/unix_stream_server.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace dcp {
+
+UnixStreamServer::UnixStreamServer(Options opts) : opts_(std::move(opts)) {
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  if (opts_.path.empty() || opts_.path.size() >= sizeof(addr.sun_path)) {
+    throw std::runtime_error("unix stream: socket path '" + opts_.path + "' is empty or too long");
+  }
+  std::memcpy(addr.sun_path, opts_.path.c_str(), opts_.path.size() + 1);
+
+  listen_fd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (listen_fd_ < 0) throw std::runtime_error(std::string("unix stream: socket failed: ") + std::strerror(errno));
+
+  // A previous run that didn't shut down cleanly leaves its socket file behind
+  ::unlink(opts_.path.c_str());
+  if (::bind(listen_fd_, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(listen_fd_, 16) != 0) {
+    const int err = errno;
+    ::close(listen_fd_);
+    throw std::runtime_error("unix stream: can't listen on '" + opts_.path + "': " + std::strerror(err));
+  }
+  clients_.reserve(opts_.max_clients);
+}
+
+UnixStreamServer::~UnixStreamServer() {
+  for (Client& c : clients_) close_client(c);
+  ::close(listen_fd_);
+  ::unlink(opts_.path.c_str());
+}
+
+void UnixStreamServer::accept_new() {
+  for (;;) {
+    const int fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR) continue;
+      return;  // EAGAIN: nobody else is waiting
+    }
+    if (clients_.size() >= opts_.max_clients) {
+      ::close(fd);
+      continue;
+    }
+    Client c;
+    c.fd = fd;
+    c.buf.reserve(opts_.buffer_bytes);
+    c.ends.reserve(64);
+    clients_.push_back(std::move(c));
+  }
+}
+
+bool UnixStreamServer::append(Client& c, const std::vector<std::uint8_t>& msg) {
+  // Offsets before the first message still being sent are dead, buf keeps [start, size)
+  const std::size_t start = c.first_end > 0 ? c.ends[c.first_end - 1] : 0;
+  if (c.buf.size() - start + msg.size() > opts_.buffer_bytes) return false;
+
+  if (start > 0) {
+    std::memmove(c.buf.data(), c.buf.data() + start, c.buf.size() - start);
+    c.buf.resize(c.buf.size() - start);
+    c.head -= start;
+    c.ends.erase(c.ends.begin(), c.ends.begin() + static_cast<std::ptrdiff_t>(c.first_end));
+    for (std::size_t& e : c.ends) e -= start;
+    c.first_end = 0;
+  }
+  c.buf.insert(c.buf.end(), msg.begin(), msg.end());
+  c.ends.push_back(c.buf.size());
+  return true;
+}
+
+void UnixStreamServer::drop_backlog(Client& c) {
+  if (c.first_end == c.ends.size()) return;
+  const std::size_t start = c.first_end > 0 ? c.ends[c.first_end - 1] : 0;
+  const std::size_t keep = c.head > start ? c.first_end + 1 : c.first_end;
+  dropped_.fetch_add(c.ends.size() - keep, std::memory_order_relaxed);
+  c.buf.resize(keep > 0 ? c.ends[keep - 1] : 0);
+  c.ends.resize(keep);
+}
+
+bool UnixStreamServer::flush(Client& c) {
+  while (c.head < c.buf.size()) {
+    const ssize_t n = ::send(c.fd, c.buf.data() + c.head, c.buf.size() - c.head, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (n > 0) {
+      c.head += static_cast<std::size_t>(n);
+      bytes_sent_.fetch_add(static_cast<std::uint64_t>(n), std::memory_order_relaxed);
+    } else if (n < 0 && errno == EINTR) {
+      continue;
+    } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+    } else {
+      close_client(c);
+      return false;
+    }
+  }
+
+  while (c.first_end < c.ends.size() && c.ends[c.first_end] <= c.head) ++c.first_end;
+  if (c.head == c.buf.size()) {
+    c.buf.clear();
+    c.ends.clear();
+    c.head = 0;
+    c.first_end = 0;
+  }
+  return true;
+}
+
+void UnixStreamServer::close_client(Client& c) {
+  if (c.fd < 0) return;
+  ::close(c.fd);
+  c.fd = -1;
+}
+
+void UnixStreamServer::poll() {
+  accept_new();
+  for (Client& c : clients_) {
+    if (c.fd >= 0) flush(c);
+  }
+  clients_.erase(std::remove_if(clients_.begin(), clients_.end(), [](const Client& c) { return c.fd < 0; }), clients_.end());
+  client_count_.store(clients_.size(), std::memory_order_relaxed);
+}
+
+void UnixStreamServer::publish(const std::vector<std::uint8_t>& delta, const KeyframeFn& keyframe) {
+  accept_new();
+
+  const std::vector<std::uint8_t>* key = nullptr;
+  for (Client& c : clients_) {
+    if (c.fd < 0) continue;
+    if (!c.need_keyframe) {
+      if (append(c, delta)) {
+        flush(c);
+        continue;
+      }
+      // Too far behind: what is queued is stale anyway, this frame's keyframe replaces all of it
+      drop_backlog(c);
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      c.need_keyframe = true;
+    }
+
+    if (!key) key = &keyframe();
+    if (append(c, *key)) {
+      c.need_keyframe = false;
+      keyframes_.fetch_add(1, std::memory_order_relaxed);
+    } else {
+      dropped_.fetch_add(1, std::memory_order_relaxed);  // Still draining a message bigger than what's left
+    }
+    flush(c);
+  }
+
+  clients_.erase(std::remove_if(clients_.begin(), clients_.end(), [](const Client& c) { return c.fd < 0; }), clients_.end());
+  client_count_.store(clients_.size(), std::memory_order_relaxed);
+}
+
+} // namespace dcp
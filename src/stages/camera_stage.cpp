@@ -3,12 +3,14 @@
 
 #include <opencv2/videoio.hpp>
 
+#include "core/mat_pool.hpp"
+#include "infra/thread_runner.hpp"
 #include "stages/camera_stage.hpp"
 
 namespace dcp {
 
-CameraStage::CameraStage(StageMetrics* metrics, CameraConfig cfg, std::shared_ptr<BoundedQueue<Frame>> out)
-    : Stage("camera_stage"), metrics_(metrics), cfg_(std::move(cfg)), out_(std::move(out)) {}
+CameraStage::CameraStage(StageMetrics* metrics, CameraConfig cfg, std::shared_ptr<BoundedQueue<Frame>> out, std::string name)
+    : Stage(std::move(name)), metrics_(metrics), cfg_(std::move(cfg)), out_(std::move(out)) {}
 
 void CameraStage::run(const StopToken& global, const std::atomic_bool& local) {
   using namespace std::chrono_literals;
@@ -38,13 +40,50 @@ void CameraStage::run(const StopToken& global, const std::atomic_bool& local) {
 
   auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / fps));
 
-auto next_tick = std::chrono::steady_clock::now();
+  // File sources decode on a separate thread, a few frames ahead of the paced loop below, so decoder jitter
+  // (keyframes, seeks, I/O hiccups) is hidden behind a small bounded buffer. The decoder blocks when the buffer is
+  // full instead of dropping, a file has no "live" frames to lose. Declared after cap so it is joined before cap dies.
+  const bool use_decode_ahead = (cfg_.source == "file" && cfg_.decode_ahead > 0);
+
+  // Frame buffers, filled by whichever thread decodes. Sized from the previous frame, the first one is a plain allocation
+  MatPool frame_pool(static_cast<std::size_t>(cfg_.frame_pool));
+
+  BoundedQueue<cv::Mat> decoded(use_decode_ahead ? static_cast<std::size_t>(cfg_.decode_ahead) : 1, DropPolicy::DropNewest);
+  ThreadRunner decoder(name() + "#decode");
+  decoder.set_thread_config(thread_config());
+
+  if (use_decode_ahead) {
+    decoder.start(global, [&cap, &decoded, &frame_pool](const StopToken& g, const std::atomic_bool& l) {
+      cv::Size last_size;
+      int last_type = 0;
+      while (!g.stop_requested() && !l.load(std::memory_order_relaxed)) {
+        if (!decoded.wait_for_space(std::chrono::milliseconds(5))) continue;
+
+        cv::Mat img = frame_pool.acquire(last_size.height, last_size.width, last_type);
+        if (!cap.read(img)) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(5));
+          continue;
+        }
+        last_size = img.size();
+        last_type = img.type();
+        decoded.try_push(std::move(img));
+      }
+    });
+  }
+
+  auto next_tick = std::chrono::steady_clock::now();
+  cv::Size last_size;
+  int last_type = 0;
+  std::size_t last_frame_bytes = 0;  // ItemBytes of the last frame pushed, what the next one will likely weigh
 
   while (!global.stop_requested() && !local.load(std::memory_order_relaxed)) {
     cv::Mat img;
 
-    // Read one frame from capture, if unable, try again
-    if (!cap.read(img)) {
+    // Get the next frame. For live sources only grab() here, the expensive decode happens in retrieve() below once
+    // we know someone will actually consume the frame
+    if (use_decode_ahead) {
+      if (!decoded.try_pop_for(img, std::chrono::milliseconds(5))) continue;
+    } else if (!cap.grab()) {
       std::this_thread::sleep_for(std::chrono::milliseconds(5));
       continue;
     }
@@ -57,8 +96,27 @@ auto next_tick = std::chrono::steady_clock::now();
       next_tick = now; // reset schedule if we’re far behind
     }
 
-    // Start work time
-    const auto t0 = std::chrono::steady_clock::now();
+    // Downstream has no room and its drop policy would reject this frame, so don't bother decoding it
+    if (cfg_.skip_retrieve_when_full && out_->would_drop_incoming(last_frame_bytes)) {
+      if (metrics_) {
+        if (use_decode_ahead) metrics_->on_wasted(); // Already decoded by the decode-ahead thread
+        else metrics_->on_skip();
+      }
+      continue;
+    }
+
+    // Start work time. No input queue, the flight record gets the depth of the one it feeds
+    StageMetrics::Item item(metrics_, 0, out_.get());
+
+    if (!use_decode_ahead) {
+      img = frame_pool.acquire(last_size.height, last_size.width, last_type);
+      if (!cap.retrieve(img)) {
+        item.cancel();
+        continue;
+      }
+      last_size = img.size();
+      last_type = img.type();
+    }
 
     // Immediately handle frame adjustments once, make new canonical frame
     if (cfg_.flip_vertical) cv::flip(img, img, 0);
@@ -67,16 +125,19 @@ auto next_tick = std::chrono::steady_clock::now();
     // Create frame variable
     Frame f;
     f.capture_time = std::chrono::steady_clock::now();
-    f.sequence_id = next_id_++;
+    const std::uint64_t seq = next_id_++;
+    f.sequence_id = seq;
+    item.set_sequence_id(seq);
     f.image = std::move(img); // Set frame data
 
-    // Push frame to next queue
-    out_->try_push(std::move(f));
-
-    // End work time, store in metrics
-    const auto work_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
-    if (metrics_) metrics_->on_item(static_cast<std::uint64_t>(work_ns));
+    // Push frame to next queue. What this push discards is decoding wasted: frames we decoded earlier being evicted
+    // unseen (DropOldest, or expired under DropOlderThan), or this one being rejected. Expirations on the consumer's
+    // pops are not counted here
+    std::size_t evicted = 0;
+    last_frame_bytes = ItemBytes(f);
+    out_->try_push(std::move(f), &evicted);
+    if (evicted > 0 && metrics_) metrics_->on_wasted(evicted);
   }
 }
 
-} // namespace dcp
\ No newline at end of file
+} // namespace dcp
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <chrono>
 #include <iostream>
 
@@ -5,10 +6,10 @@
 
 namespace dcp {
 
-InferenceStage::InferenceStage(StageMetrics* metrics, InferenceConfig cfg, std::shared_ptr<LatestStore<PreprocessedFrame>> preprocessed_latest_store, std::shared_ptr<LatestStore<Detections>> detections_latest_store)
-    : Stage("inference_stage"), metrics_(metrics), cfg_(std::move(cfg)), preprocessed_latest_store_(std::move(preprocessed_latest_store)), detections_latest_store_(std::move(detections_latest_store))
+InferenceStage::InferenceStage(StageMetrics* metrics, InferenceConfig cfg, std::vector<InferenceStream> streams, std::unique_ptr<InferenceWorker> worker)
+    : Stage("inference_stage"), metrics_(metrics), cfg_(std::move(cfg)), streams_(std::move(streams)), worker_(std::move(worker))
 {
-    if (!cfg_.enabled) return;
+    if (!cfg_.enabled || worker_) return;
 
     YoloDnn::Params p;
     p.onnx_path = cfg_.model.path;
@@ -20,45 +21,148 @@ InferenceStage::InferenceStage(StageMetrics* metrics, InferenceConfig cfg, std::
     yolo_ = std::make_unique<YoloDnn>(std::move(p));
     if (!yolo_->is_loaded()) {
         yolo_.reset();
+        return;
+    }
+
+    if (cfg_.max_batch > 1 && !yolo_->supports_batch()) {
+        std::cerr << "inference.max_batch=" << cfg_.max_batch << " ignored, model has a fixed batch axis\n";
     }
 }
 
+InferenceStage::InferenceStage(StageMetrics* metrics, InferenceConfig cfg, std::shared_ptr<LatestStore<PreprocessedFrame>> preprocessed_latest_store, std::shared_ptr<LatestStore<Detections>> detections_latest_store)
+    : InferenceStage(metrics, std::move(cfg), std::vector<InferenceStream>{InferenceStream{"front", 0, 0.f, nullptr, std::move(preprocessed_latest_store), std::move(detections_latest_store), nullptr}}) {}
+
 void InferenceStage::run(const StopToken& global, const std::atomic_bool& local) {
     using namespace std::chrono_literals;
 
-    std::uint64_t last_seen_version = 0;
+    // Nothing to run without a model, keep the thread alive so start/stop stays uniform
+    if (!yolo_ && !worker_) {
+        while (!global.stop_requested() && !local.load(std::memory_order_relaxed)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+        return;
+    }
+
+    const std::size_t n = streams_.size();
+    // The worker's model is only known once it is up, batches are capped per run below
+    const std::size_t max_batch = (worker_ || yolo_->supports_batch()) ? static_cast<std::size_t>(std::max(1, cfg_.max_batch)) : 1;
+
+    std::vector<std::uint64_t> last_seen_version(n, 0);
+    std::vector<std::uint64_t> last_run_ns(n, NowNs());
+
+    // Running average of one ORT run, used to time demand tickets so a fresh frame is ready just as we go idle
+    std::uint64_t avg_run_ns = 0;
+    const std::uint64_t lead_ns = static_cast<std::uint64_t>(std::max(0, cfg_.demand_lead_ms)) * 1000000ull;
+
+    struct Candidate {
+        std::size_t stream;
+        bool overdue;
+        double score;
+    };
+    std::vector<Candidate> ready;
+    ready.reserve(n);
+
+    std::vector<std::size_t> picked;
+    std::vector<PreprocessedFrame> batch;
+    picked.reserve(max_batch);
+    batch.reserve(max_batch);
+
+    // Results are filled in place and copied into the stores (LatestStore::assign), so both keep their item buffers
+    std::vector<Detections> results(max_batch);
 
     while (!global.stop_requested() && !local.load(std::memory_order_relaxed)) {
-        // Check if latest preprocessed frame has already been inferenced, if so, skip
-        const auto ver = preprocessed_latest_store_->version();
-        if (ver == last_seen_version) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        // Worker down or restarting: leave the frames, tracking keeps the last detections
+        if (worker_ && !worker_->poll()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
             continue;
         }
+        const std::size_t batch_limit = (worker_ && !worker_->supports_batch()) ? 1 : max_batch;
 
-        // Get next latest preprocessed frame and check that it exists
-        auto pf_opt = preprocessed_latest_store_->read_latest();
-        if (!pf_opt) {
+        const std::uint64_t now_ns = NowNs();
+
+        // Collect streams that have a frame we haven't inferred yet, and score them
+        ready.clear();
+        for (std::size_t i = 0; i < n; ++i) {
+            const auto& s = streams_[i];
+            if (s.preprocessed_latest_store->version() == last_seen_version[i]) continue;
+
+            const double staleness_ns = static_cast<double>(now_ns - last_run_ns[i]);
+            const bool overdue = s.min_fps > 0.f && staleness_ns > 1e9 / static_cast<double>(s.min_fps);
+            // Overdue streams rank by how many min_fps periods they are behind, the rest by weighted staleness
+            const double score = overdue ? staleness_ns * static_cast<double>(s.min_fps) / 1e9
+                                         : staleness_ns * (1.0 + std::max(0, s.priority));
+            ready.push_back({i, overdue, score});
+        }
+
+        if (ready.empty()) {
             std::this_thread::sleep_for(std::chrono::milliseconds(5));
             continue;
         }
 
-        // Start work time
-        const auto t0 = std::chrono::steady_clock::now();
+        // Overdue streams first (most periods behind), then stalest (priority weighted)
+        std::sort(ready.begin(), ready.end(), [](const Candidate& a, const Candidate& b) {
+            if (a.overdue != b.overdue) return a.overdue;
+            return a.score > b.score;
+        });
+
+        // Start work time. The batch as a whole goes to the stage's metrics, the flight records per stream below.
+        // Allocations here are mostly ORT's own, inside Run. CPU is this thread's only, ORT's intra-op pool and a
+        // worker process run on others, so CPU% well under BUSY% is expected there
+        StageMetrics::Item item(metrics_);
+
+        // Take a local stable snapshot of each picked stream's newest frame
+        picked.clear();
+        batch.clear();
+        for (const auto& c : ready) {
+            if (batch.size() >= batch_limit) break;
+            auto pf_opt = streams_[c.stream].preprocessed_latest_store->read_if_newer(last_seen_version[c.stream]);
+            if (!pf_opt) continue;
+            picked.push_back(c.stream);
+            batch.push_back(std::move(*pf_opt));
+        }
+        if (batch.empty()) {
+            item.cancel();
+            continue;
+        }
 
-        // Set for checking version against future frames
-        last_seen_version = ver;
+        // Ask every stream for its next frame, due shortly before this run should end. Any stream may be picked next
+        if (cfg_.demand_driven) {
+            const std::uint64_t start_ns = NowNs();
+            const std::uint64_t due_ns = (avg_run_ns > lead_ns) ? start_ns + avg_run_ns - lead_ns : 0;
+            for (auto& s : streams_) {
+                if (s.demand) s.demand->request(due_ns);
+            }
+        }
 
-        PreprocessedFrame pf = std::move(*pf_opt);   // local stable snapshot
-        dcp::Detections detections = yolo_->infer(pf);
+        bool answered = true;
+        if (worker_) {
+            answered = worker_->infer_batch_into(batch, results);
+        } else if (batch.size() == 1) {
+            yolo_->infer_into(batch.front(), results.front());
+        } else {
+            yolo_->infer_batch_into(batch, results);
+        }
+        if (!answered) {
+            item.cancel();  // Worker lost the request, these frames are skipped and the stores keep their last result
+            continue;
+        }
 
-        // Store detections in latest store
-        detections_latest_store_->write(std::move(detections));
+        const std::uint64_t work_ns = item.finish();
+        const std::uint64_t done_ns = NowNs();
+        avg_run_ns = (avg_run_ns == 0) ? work_ns : (avg_run_ns * 7 + work_ns) / 8;
 
-        // End work time, store in metrics
-        const auto work_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
-        if (metrics_) metrics_->on_item(static_cast<std::uint64_t>(work_ns));
+        // Store detections in each stream's latest store. Streams with a frame left out of this batch are the queue
+        const std::size_t waiting = ready.size() > picked.size() ? ready.size() - picked.size() : 0;
+        for (std::size_t k = 0; k < picked.size(); ++k) {
+            const auto& s = streams_[picked[k]];
+            s.detections_latest_store->assign(results[k]);
+            last_run_ns[picked[k]] = done_ns;
+            if (s.metrics) s.metrics->on_item(work_ns);
+            if (StageMetrics* fm = s.metrics ? s.metrics : metrics_) {
+                fm->on_frame(batch[k].source_frame_id, item.start(), work_ns, waiting);
+            }
+        }
     }
 }
 
-} // namespace dcp
\ No newline at end of file
+} // namespace dcp
@@ -0,0 +1,244 @@
+#include "stages/loop_recorder_stage.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <system_error>
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+namespace dcp {
+
+namespace fs = std::filesystem;
+
+// <dir>/<prefix>_<local wall time>_<seq><ext>. Wall time so files sort and read like a dashcam's, seq keeps names unique
+static std::string TimedName(const std::string& dir, const char* prefix, std::uint64_t seq, const char* ext) {
+  const std::time_t now = std::time(nullptr);
+  std::tm tm{};
+  localtime_r(&now, &tm);
+  char stamp[32];
+  std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+  char name[96];
+  std::snprintf(name, sizeof(name), "%s_%s_%llu%s", prefix, stamp, static_cast<unsigned long long>(seq), ext);
+  return (fs::path(dir) / name).string();
+}
+
+static std::uint64_t ToNs(std::chrono::steady_clock::duration d) {
+  return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+}
+
+LoopRecorderStage::LoopRecorderStage(StageMetrics* metrics, StageMetrics* flush_metrics, LoopRecorderConfig cfg, std::string directory, std::shared_ptr<AsyncWriter> writer, std::shared_ptr<BoundedQueue<RenderFrame>> in, std::string name)
+    : Stage(std::move(name)),
+      metrics_(metrics),
+      flush_metrics_(flush_metrics),
+      cfg_(std::move(cfg)),
+      dir_(std::move(directory)),
+      events_dir_((fs::path(dir_) / "events").string()),
+      writer_(std::move(writer)),
+      in_(std::move(in)),
+      ring_(static_cast<std::size_t>(cfg_.ring_mb) * 1024 * 1024,
+            static_cast<std::size_t>(cfg_.pre_event_s) * static_cast<std::size_t>(cfg_.max_fps) + 1) {
+  std::error_code ec;
+  fs::create_directories(events_dir_, ec);
+  if (ec) throw std::runtime_error("loop recorder: failed to create '" + events_dir_ + "': " + ec.message());
+
+  jpeg_params_ = {cv::IMWRITE_JPEG_QUALITY, cfg_.jpeg_quality};
+
+  // Segments left by earlier runs count against the quota too, oldest (by name, i.e. time) first
+  std::vector<std::pair<std::string, std::uint64_t>> existing;
+  for (const auto& e : fs::directory_iterator(dir_, ec)) {
+    const std::string fname = e.path().filename().string();
+    if (e.is_regular_file() && fname.rfind("loop_", 0) == 0 && e.path().extension() == ".mjpeg") {
+      existing.emplace_back(e.path().string(), static_cast<std::uint64_t>(e.file_size()));
+    }
+  }
+  std::sort(existing.begin(), existing.end());
+  for (auto& s : existing) {
+    segments_bytes_ += s.second;
+    segments_.push_back(std::move(s));
+  }
+  enforce_quota();
+}
+
+LoopRecorderStage::~LoopRecorderStage() {
+  end_event();
+  close_segment();
+  // The event's on_closed callback refers to this stage
+  writer_->drain();
+}
+
+void LoopRecorderStage::run(const StopToken& global, const std::atomic_bool& local) {
+  using namespace std::chrono_literals;
+
+  while (!global.stop_requested() && !local.load(std::memory_order_relaxed)) {
+    RenderFrame rf;
+    if (!in_->try_pop_for(rf, 5ms)) continue;
+    process(rf);
+  }
+
+  // A stop during the post-event window still leaves a complete (shorter) clip
+  pump_event();
+  end_event();
+  close_segment();
+}
+
+// A track matched this frame, confident, and tall enough in the frame to be close
+bool LoopRecorderStage::close_range(const RenderFrame& rf) const {
+  if (cfg_.trigger_box_height <= 0.f) return false;
+  const float min_h = cfg_.trigger_box_height * static_cast<float>(rf.frame.image.rows);
+  for (const auto& tr : rf.world.tracks) {
+    if (tr.missed_frames == 0 && tr.confidence >= cfg_.trigger_min_confidence && tr.bbox.h >= min_h) return true;
+  }
+  return false;
+}
+
+void LoopRecorderStage::open_segment(TimePoint t, std::uint64_t seq) {
+  segment_path_ = TimedName(dir_, "loop", seq, ".mjpeg");
+  if (!segment_.open(writer_.get(), segment_path_, MakeFileOptions(cfg_.segment_durability))) {
+    std::cerr << name() << ": failed to open segment '" << segment_path_ << "'\n";
+    return;
+  }
+  segment_start_ = t;
+  segments_.emplace_back(segment_path_, 0);
+}
+
+void LoopRecorderStage::close_segment() {
+  segment_.close();
+}
+
+void LoopRecorderStage::enforce_quota() {
+  const std::uint64_t quota = static_cast<std::uint64_t>(cfg_.disk_quota_mb) * 1024 * 1024;
+  // Never delete the segment being written
+  while (segments_bytes_ > quota && segments_.size() > (segment_.is_open() ? 1u : 0u)) {
+    std::error_code ec;
+    fs::remove(segments_.front().first, ec);
+    segments_bytes_ -= segments_.front().second;
+    segments_.pop_front();
+  }
+}
+
+void LoopRecorderStage::begin_event(TimePoint t, std::uint64_t seq, const char* reason) {
+  event_path_ = TimedName(events_dir_, "event", seq, ".mjpeg");
+  const std::string part = event_path_ + ".part";
+  if (!event_.open(writer_.get(), part, MakeFileOptions(cfg_.event_durability))) {
+    std::cerr << name() << ": failed to open event file '" << part << "'\n";
+    return;
+  }
+
+  event_trigger_ = std::chrono::steady_clock::now();
+  event_start_ = t;
+  event_until_ = t + std::chrono::seconds(cfg_.post_event_s);
+  event_next_seq_ = 0;   // The whole pre-event window, the triggering frame is already the newest chunk
+  event_caught_up_ = false;
+  event_frames_ = 0;
+
+  std::cout << name() << ": event (" << reason << "), saving " << ring_.size() << " pre-event frames to " << event_path_ << "\n";
+}
+
+bool LoopRecorderStage::pump_event() {
+  if (!event_.is_open()) return true;
+
+  bool caught_up = true;
+  ring_.for_each([&](const ChunkRing::Chunk& c) {
+    if (!caught_up || c.seq < event_next_seq_) return;
+    if (!event_.append(c.data, c.size)) {
+      caught_up = false;   // Writer full, the rest goes with the next frame
+      return;
+    }
+    event_next_seq_ = c.seq + 1;
+    ++event_frames_;
+  });
+
+  if (caught_up && !event_caught_up_) {
+    event_caught_up_ = true;
+    if (flush_metrics_) flush_metrics_->on_item(ToNs(std::chrono::steady_clock::now() - event_trigger_));
+  }
+  return caught_up;
+}
+
+void LoopRecorderStage::end_event() {
+  if (!event_.is_open()) return;
+
+  // The writer syncs per event_durability and only then renames, on its own thread
+  const std::string path = event_path_;
+  const std::size_t frames = event_frames_;
+  const std::uint64_t bytes = event_.bytes();
+  const TimePoint trigger = event_trigger_;
+  event_.close(path, [this, path, frames, bytes, trigger](bool ok) {
+    if (!ok) {
+      std::cerr << name() << ": failed to finalize '" << path << "'\n";
+      return;
+    }
+    events_.fetch_add(1, std::memory_order_relaxed);
+    if (flush_metrics_) flush_metrics_->on_age(ToNs(std::chrono::steady_clock::now() - trigger));
+    std::cout << name() << ": saved " << path << " (" << frames << " frames, " << std::fixed << std::setprecision(1)
+              << static_cast<double>(bytes) / (1024.0 * 1024.0) << " MB)\n";
+  });
+}
+
+void LoopRecorderStage::process(const RenderFrame& rf) {
+  const cv::Mat& src = rf.frame.image;
+  if (src.empty()) return;
+
+  const TimePoint t = rf.frame.capture_time;
+  const std::uint64_t seq = rf.frame.sequence_id;
+  StageMetrics::Item item(metrics_, seq, in_.get());
+  item.set_capture_time(t);
+
+  // Encode once, the same bytes go to the ring, the segment and an open event
+  const cv::Mat* img = &src;
+  if (cfg_.scale < 1.0) {
+    const cv::Size size(std::max(1, static_cast<int>(std::lround(src.cols * cfg_.scale))),
+                        std::max(1, static_cast<int>(std::lround(src.rows * cfg_.scale))));
+    cv::resize(src, scaled_, size, 0, 0, cv::INTER_AREA);
+    img = &scaled_;
+  }
+  if (!cv::imencode(".jpg", *img, jpeg_, jpeg_params_) || jpeg_.empty()) {
+    if (metrics_) metrics_->on_wasted();
+    item.cancel();
+    return;
+  }
+  const std::uint8_t* data = jpeg_.data();
+  const std::size_t size = jpeg_.size();
+
+  ring_.push(t, seq, data, size);
+  ring_.trim(t - std::chrono::seconds(cfg_.pre_event_s));
+
+  // Loop segment, rotated on capture time
+  if (segment_.is_open() && t - segment_start_ >= std::chrono::seconds(cfg_.segment_s)) close_segment();
+  if (!segment_.is_open()) open_segment(t, seq);
+  if (segment_.is_open()) {
+    if (segment_.append(data, size)) {
+      segments_.back().second += size;
+      segments_bytes_ += size;
+      enforce_quota();
+    } else if (metrics_) {
+      metrics_->on_wasted();   // Writer full, this frame is missing from the segment
+    }
+  }
+
+  // Post-event frames, until the window after the last trigger ends and the file caught up with the ring
+  if (event_.is_open() && pump_event() && t >= event_until_) end_event();
+
+  // Something staying close keeps extending the open event, but only a new approach starts another one
+  const bool external = external_trigger_.exchange(false, std::memory_order_relaxed);
+  const bool close = close_range(rf);
+  const bool close_edge = close && !was_close_;
+  was_close_ = close;
+
+  if (event_.is_open() && (external || close)) {
+    // Retrigger extends the window, up to max_event_s from the first trigger
+    event_until_ = std::min(t + std::chrono::seconds(cfg_.post_event_s), event_start_ + std::chrono::seconds(cfg_.max_event_s));
+  } else if (!event_.is_open() && (external || close_edge)) {
+    begin_event(t, seq, external ? "trigger" : "close range");
+    pump_event();
+  }
+}
+
+} // namespace dcp
@@ -1,63 +1,34 @@
+#include <algorithm>
 #include <chrono>
 #include <iostream>
 
-#include <opencv2/imgproc.hpp>
-
+#include "core/preprocess_ops.hpp"
 #include "stages/preprocess_stage.hpp"
 
 namespace dcp {
 
-// Simple helper functions to encapsulate ROI calculation logic (only used in preprocess stage)
-static cv::Rect ClampRect(const cv::Rect& r, int w, int h) {
-    cv::Rect bounds(0, 0, w, h);
-    cv::Rect out = r & bounds;
-    return out;
+PreprocessStage::PreprocessStage(StageMetrics* metrics, PreprocessConfig cfg, std::shared_ptr<BoundedQueue<Frame>> in, std::shared_ptr<BoundedQueue<Frame>> out, std::shared_ptr<LatestStore<PreprocessedFrame>> preprocessed_latest_store, std::shared_ptr<DemandSignal> inference_demand, std::string name)
+    : Stage(std::move(name)), metrics_(metrics), cfg_(std::move(cfg)), in_(std::move(in)), out_(std::move(out)), preprocessed_latest_store_(std::move(preprocessed_latest_store)), inference_demand_(std::move(inference_demand)) {
+  if (cfg_.workers > 1) {
+    reorder_ = std::make_unique<ReorderBuffer<Frame>>(
+        static_cast<std::size_t>(cfg_.reorder_window), std::chrono::milliseconds(cfg_.reorder_max_wait_ms));
+  }
+  for (int i = 0; i < std::max(1, cfg_.workers); ++i) resize_pools_.push_back(std::make_unique<MatPool>(kResizePoolSize));
 }
 
-static cv::Rect ComputeRoiRect(const cv::Mat& img, const RoiConfig& cfg) {
-    if (!cfg.enabled) return cv::Rect(0, 0, img.cols, img.rows);
-
-    cv::Rect roi;
-
-    if (cfg.use_normalized) {
-        auto clamp01 = [](float v) {
-            if (v < 0.f) return 0.f;
-            if (v > 1.f) return 1.f;
-            return v;
-        };
-
-        const float x0 = clamp01(cfg.x_norm);
-        const float y0 = clamp01(cfg.y_norm);
-        const float w0 = clamp01(cfg.w_norm);
-        const float h0 = clamp01(cfg.h_norm);
-
-        const int x = static_cast<int>(x0 * img.cols);
-        const int y = static_cast<int>(y0 * img.rows);
-        const int w = static_cast<int>(w0 * img.cols);
-        const int h = static_cast<int>(h0 * img.rows);
-
-        roi = cv::Rect(x, y, w, h);
-    } else {
-        roi = cv::Rect(cfg.x, cfg.y, cfg.width, cfg.height);
-    }
-
-    roi = ClampRect(roi, img.cols, img.rows);
-
-    if (roi.width <= 0 || roi.height <= 0) {
-        // Fallback values for invalid configurations, bottomg half of the frame
-        roi = cv::Rect(0, img.rows / 2, img.cols, img.rows - (img.rows / 2));
-        roi = ClampRect(roi, img.cols, img.rows);
-    }
-
-    return roi;
+void PreprocessStage::set_pool_metrics(std::vector<StageMetrics*> worker_metrics, StageMetrics* reorder_metrics) {
+  worker_metrics_ = std::move(worker_metrics);
+  reorder_metrics_ = reorder_metrics;
 }
 
-PreprocessStage::PreprocessStage(StageMetrics* metrics, PreprocessConfig cfg, std::shared_ptr<BoundedQueue<Frame>> in, std::shared_ptr<BoundedQueue<Frame>> out, std::shared_ptr<LatestStore<PreprocessedFrame>> preprocessed_latest_store)
-    : Stage("preprocess_stage"), metrics_(metrics), cfg_(std::move(cfg)), in_(std::move(in)), out_(std::move(out)), preprocessed_latest_store_(std::move(preprocessed_latest_store)) {}
-
 void PreprocessStage::run(const StopToken& global, const std::atomic_bool& local) {
   using namespace std::chrono_literals;
 
+  if (cfg_.workers > 1) {
+    run_pool(global, local);
+    return;
+  }
+
   while (!global.stop_requested() && !local.load(std::memory_order_relaxed)) {
     // Frame read from input queue
     Frame f;
@@ -70,47 +41,143 @@ void PreprocessStage::run(const StopToken& global, const std::atomic_bool& local
         continue; // Try again
     }
 
-    // If frame doesn't have data, skip
-    const cv::Mat& src = f.image;
-    if (src.empty()) {
-        continue;
-    }
+    process(f);
+  }
+}
 
-    // Start work time
-    const auto t0 = std::chrono::steady_clock::now();
+// Task mode, only for the single worker layout. The pool already owns its threads
+bool PreprocessStage::supports_tasks() const {
+  return cfg_.workers <= 1;
+}
 
-    // Push raw frame to output queue (fast path), copy
-    out_->try_push(f);
+void PreprocessStage::bind_wake(std::function<void()> wake) {
+  in_->set_on_push(std::move(wake));
+}
 
-    // Begin preprocess operation for inference stage (slow path)
+bool PreprocessStage::step() {
+  Frame f;
+  if (!in_->try_pop(f)) return false;
+  process(f);
+  return true;
+}
 
-    // Perform ROI crop, nothing changes if disabled
-    const cv::Rect roi = ComputeRoiRect(src, cfg_.crop_roi);
-    const cv::Mat roi_view = src(roi);
+void PreprocessStage::process(Frame& f) {
+  // If frame doesn't have data, skip
+  const cv::Mat& src = f.image;
+  if (src.empty()) {
+      return;
+  }
 
-    // Resize to configured size, nothing changes if disabled
-    cv::Mat resized;
-    cv::resize(roi_view, resized, cv::Size(cfg_.resize_width, cfg_.resize_height), 0, 0, cv::INTER_LINEAR);
+  // Work time and counters, reported when this returns
+  StageMetrics::Item item(metrics_, f.sequence_id, in_.get());
 
-    // Now that preprocessing is done, build new PreprocessedFrame and send it through to slow stream, even if no changes were made
-    PreprocessedFrame pf;
-    pf.source_frame_id = f.sequence_id;
-    pf.capture_time = f.capture_time;
-    pf.image = std::move(resized);
-    pf.info.roi_applied = cfg_.crop_roi.enabled;
-    pf.info.roi = roi;
-    pf.info.resize_width = cfg_.resize_width;
-    pf.info.resize_height = cfg_.resize_height;
+  // Push raw frame to output queue (fast path), copy
+  out_->try_push(f);
 
-    pf.preprocess_time = std::chrono::steady_clock::now();
+  // Begin preprocess operation for inference stage (slow path)
+  // Only if inference asked for a frame. Otherwise it would sit in the LatestStore and get overwritten unseen
+  if (inference_demand_ && !inference_demand_->try_take(NowNs())) {
+    if (metrics_) metrics_->on_skip();
+  } else {
+    // Perform ROI crop + resize, then build new PreprocessedFrame and send it through to slow stream, even if no changes were made
+    const cv::Mat buf = resize_pools_[0]->acquire(cfg_.resize_height, cfg_.resize_width, src.type());
+    PreprocessedFrame pf = BuildPreprocessedFrame(f, cfg_, buf);
 
     // Write preprocessed frame to preprocessed latest_store (slow path), move
     preprocessed_latest_store_->write(std::move(pf));
+  }
+}
+
+// Pooled mode. This thread is worker 0, workers 1..N-1 get their own ThreadRunner and watch this stage's local stop too
+void PreprocessStage::run_pool(const StopToken& global, const std::atomic_bool& local) {
+  std::vector<std::unique_ptr<ThreadRunner>> helpers;
+  for (int i = 1; i < cfg_.workers; ++i) {
+    helpers.push_back(std::make_unique<ThreadRunner>(name() + "#" + std::to_string(i)));
+    helpers.back()->set_thread_config(thread_config());
+    helpers.back()->start(global, [this, i, &local](const StopToken& g, const std::atomic_bool& l) {
+      // Stop on this helper's own flag, or when the stage itself is stopped
+      while (!g.stop_requested() && !l.load(std::memory_order_relaxed) && !local.load(std::memory_order_relaxed)) {
+        pool_worker(static_cast<std::size_t>(i), g, local);
+      }
+    });
+  }
+
+  while (!global.stop_requested() && !local.load(std::memory_order_relaxed)) {
+    pool_worker(0, global, local);
+  }
+
+  for (auto& h : helpers) h->join();
+}
+
+// One iteration of a pool worker: take a frame, hand the fast path to the reorder buffer, then do the slow path
+void PreprocessStage::pool_worker(std::size_t index, const StopToken& global, const std::atomic_bool& local) {
+  using namespace std::chrono_literals;
+
+  StageMetrics* wm = index < worker_metrics_.size() ? worker_metrics_[index] : nullptr;
+
+  // Releases go straight to tracking, in sequence order
+  auto emit = [this](Frame&& fr, std::uint64_t wait_ns) {
+    out_->try_push(std::move(fr));
+    if (reorder_metrics_) reorder_metrics_->on_item(wait_ns);
+  };
+
+  Frame f;
+  bool popped = false;
+  {
+    // Popping and registering the sequence number as in flight happen together, otherwise the reorder buffer
+    // could release a newer frame while an older one sits popped but unregistered in another worker. Non-blocking,
+    // so the lock is only held for the pop itself
+    std::lock_guard<std::mutex> lock(pop_mu_);
+    if (global.stop_requested() || local.load(std::memory_order_relaxed)) return;
+    if (in_->try_pop(f)) {
+      reorder_->begin(f.sequence_id);
+      popped = true;
+    }
+  }
+  if (!popped) {
+    // Wait for input outside the lock, an idle worker must not hold up the others
+    if (!in_->wait_for_item(5ms)) reorder_->drain(NowNs(), emit);
+    return;
+  }
 
-    // End work time, store in metrics
-    const auto work_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
-    if (metrics_) metrics_->on_item(static_cast<std::uint64_t>(work_ns));
+  const std::uint64_t seq = f.sequence_id;
+  if (f.image.empty()) {
+    reorder_->abandon(seq, NowNs(), emit);
+    return;
   }
+
+  // Work time and counters, per worker and for the stage as a whole. Workers overlap in time, so the flight recorder
+  // gets one track per worker rather than one for the stage
+  StageMetrics::Item item(wm ? wm : metrics_, seq, in_.get());
+  if (wm) item.also_report_to(metrics_);
+
+  // Fast path first, the raw frame is shared by refcount with the slow path below
+  Frame view;
+  view.sequence_id = seq;
+  view.capture_time = f.capture_time;
+  view.image = f.image;
+  if (!reorder_->complete(seq, std::move(f), NowNs(), emit)) {
+    if (reorder_metrics_) reorder_metrics_->on_wasted();
+  }
+
+  // Slow path, same demand rule as the single thread loop
+  if (inference_demand_ && !inference_demand_->try_take(NowNs())) {
+    if (metrics_) metrics_->on_skip();
+  } else {
+    const cv::Mat buf = resize_pools_[index]->acquire(cfg_.resize_height, cfg_.resize_width, view.image.type());
+    PreprocessedFrame pf = BuildPreprocessedFrame(view, cfg_, buf);
+
+    if (!PublishIfNewer(*preprocessed_latest_store_, inference_demand_.get(), std::move(pf), seq) && metrics_) {
+      metrics_->on_wasted();
+    }
+  }
+}
+
+bool PublishIfNewer(LatestStore<PreprocessedFrame>& store, DemandSignal* demand, PreprocessedFrame pf, std::uint64_t seq) {
+  if (store.write_if_newer(std::move(pf), seq)) return true;
+  // The ticket this frame took is still owed, inference only asks again after it ran a batch
+  if (demand) demand->request();
+  return false;
 }
 
-} // namespace dcp
\ No newline at end of file
+} // namespace dcp
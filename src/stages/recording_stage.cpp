@@ -0,0 +1,79 @@
+#include "stages/recording_stage.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+#include <opencv2/imgproc.hpp>
+
+namespace dcp {
+
+RecordingStage::RecordingStage(StageMetrics* metrics, RecordingConfig cfg, std::string output_path, std::shared_ptr<BoundedQueue<RenderFrame>> in, std::string name)
+    : Stage(std::move(name)), metrics_(metrics), cfg_(std::move(cfg)), output_path_(std::move(output_path)), in_(std::move(in)) {}
+
+void RecordingStage::run(const StopToken& global, const std::atomic_bool& local) {
+  using namespace std::chrono_literals;
+
+  while (!global.stop_requested() && !local.load(std::memory_order_relaxed)) {
+    report_drops();
+    RenderFrame rf;
+    if (!in_->try_pop_for(rf, 5ms)) continue;
+    process(rf);
+  }
+
+  report_drops();
+  if (writer_.isOpened()) writer_.release(); // Finalizes the container
+}
+
+// Queue drops (capacity, bytes or age) are frames that were produced but never recorded
+void RecordingStage::report_drops() {
+  const auto drops = in_->drops_total() + in_->expired_total();
+  if (metrics_ && drops > drops_seen_) metrics_->on_wasted(drops - drops_seen_);
+  drops_seen_ = drops;
+}
+
+bool RecordingStage::open_writer(cv::Size size) {
+  const auto& c = cfg_.codec;
+  const int fourcc = cv::VideoWriter::fourcc(c[0], c[1], c[2], c[3]);
+  if (!writer_.open(output_path_, fourcc, static_cast<double>(cfg_.fps), size, true)) {
+    std::cerr << name() << ": failed to open '" << output_path_ << "' with codec " << c << ", not recording\n";
+    open_failed_ = true;
+    return false;
+  }
+  frame_size_ = size;
+  std::cout << name() << ": recording " << size.width << "x" << size.height << " @ " << cfg_.fps << " fps to "
+            << output_path_ << "\n";
+  return true;
+}
+
+void RecordingStage::process(const RenderFrame& rf) {
+  const cv::Mat& src = rf.frame.image;
+  if (src.empty()) return;
+
+  StageMetrics::Item item(metrics_, rf.frame.sequence_id, in_.get());
+  item.set_capture_time(rf.frame.capture_time);
+
+  const bool scale = cfg_.scale < 1.0;
+  const cv::Size size = scale ? cv::Size(static_cast<int>(std::lround(src.cols * cfg_.scale)) & ~1,
+                                         static_cast<int>(std::lround(src.rows * cfg_.scale)) & ~1)
+                              : src.size();
+
+  if (!writer_.isOpened()) {
+    if (open_failed_ || !open_writer(size)) {
+      if (metrics_) metrics_->on_wasted();
+      item.cancel();
+      return;
+    }
+  }
+
+  // The container has one size, frames that don't match (camera mode switch) are resized to it
+  const cv::Mat* out = &src;
+  if (size != frame_size_ || scale) {
+    cv::resize(src, scaled_, frame_size_, 0, 0, cv::INTER_AREA);
+    out = &scaled_;
+  }
+
+  writer_.write(*out);
+}
+
+} // namespace dcp
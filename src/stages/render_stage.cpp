@@ -0,0 +1,161 @@
+#include "stages/render_stage.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+#include <opencv2/imgproc.hpp>
+
+#include "core/labels/general_labels.hpp"
+
+namespace dcp {
+
+static constexpr int kFont = cv::FONT_HERSHEY_SIMPLEX;
+static constexpr double kLabelScale = 0.45;
+static constexpr int kBoxThickness = 2;
+
+RenderStage::RenderStage(StageMetrics* metrics, VisualizationConfig cfg, std::shared_ptr<BoundedQueue<RenderFrame>> in, std::shared_ptr<LatestStore<Frame>> out, HudSources hud_sources, std::shared_ptr<BoundedQueue<RenderFrame>> tap, std::string name)
+    : Stage(std::move(name)), metrics_(metrics), cfg_(std::move(cfg)), in_(std::move(in)), out_(std::move(out)), hud_sources_(std::move(hud_sources)), tap_(std::move(tap)),
+      out_pool_(4 + (tap_ ? tap_->capacity() : 0)) {}
+
+void RenderStage::run(const StopToken& global, const std::atomic_bool& local) {
+  using namespace std::chrono_literals;
+
+  while (!global.stop_requested() && !local.load(std::memory_order_relaxed)) {
+    RenderFrame rf;
+    if (!in_->try_pop_for(rf, 5ms)) continue;
+    process(rf);
+  }
+}
+
+bool RenderStage::supports_tasks() const {
+  return true;
+}
+
+void RenderStage::bind_wake(std::function<void()> wake) {
+  in_->set_on_push(std::move(wake));
+}
+
+bool RenderStage::step() {
+  RenderFrame rf;
+  if (!in_->try_pop(rf)) return false;
+  process(rf);
+  return true;
+}
+
+static cv::Rect TrackRect(const Track& tr) {
+  return cv::Rect(static_cast<int>(tr.bbox.x), static_cast<int>(tr.bbox.y), static_cast<int>(tr.bbox.w),
+                  static_cast<int>(tr.bbox.h));
+}
+
+// Compares what the overlay shows for a track: box, color (matched or not) and label
+bool RenderStage::same_as_drawn(const WorldState& ws) const {
+  if (ws.tracks.size() != drawn_.size()) return false;
+  for (std::size_t i = 0; i < drawn_.size(); ++i) {
+    const Track& a = ws.tracks[i];
+    const Track& b = drawn_[i];
+    if (TrackRect(a) != TrackRect(b)) return false;
+    if (a.class_id != b.class_id || a.confidence != b.confidence) return false;
+    if ((a.missed_frames == 0) != (b.missed_frames == 0)) return false;
+  }
+  return true;
+}
+
+void RenderStage::rasterize(const WorldState& ws, cv::Size size) {
+  // Wipe only what the previous raster touched
+  for (const auto& r : dirty_) {
+    overlay_(r).setTo(cv::Scalar::all(0));
+    mask_(r).setTo(cv::Scalar::all(0));
+  }
+  dirty_.clear();
+
+  const cv::Rect bounds(0, 0, size.width, size.height);
+  const cv::Scalar opaque = cv::Scalar::all(255);
+
+  if (cfg_.show_boxes) {
+    for (const auto& tr : ws.tracks) {
+      // green = matched this frame, red = not matched
+      const cv::Scalar color = (tr.missed_frames == 0) ? cv::Scalar(0, 255, 0) : cv::Scalar(0, 0, 255);
+      const cv::Rect r = TrackRect(tr);
+
+      cv::rectangle(overlay_, r, color, kBoxThickness);
+      cv::rectangle(mask_, r, opaque, kBoxThickness);
+
+      label_.assign(GeneralClassLabel(tr.class_id));
+      if (cfg_.show_confidence) {
+        char conf[16];
+        std::snprintf(conf, sizeof(conf), " %.2f", tr.confidence);
+        label_.append(conf);
+      }
+
+      const cv::Point org(r.x, std::max(12, r.y - 6));
+      cv::putText(overlay_, label_, org, kFont, kLabelScale, color, 1, cv::LINE_AA);
+      cv::putText(mask_, label_, org, kFont, kLabelScale, opaque, 1, cv::LINE_AA);
+
+      int baseline = 0;
+      const cv::Size ts = cv::getTextSize(label_, kFont, kLabelScale, 1, &baseline);
+      const cv::Rect box_area(r.x - kBoxThickness, r.y - kBoxThickness, r.width + 2 * kBoxThickness, r.height + 2 * kBoxThickness);
+      const cv::Rect text_area(org.x, org.y - ts.height - 2, ts.width + 2, ts.height + baseline + 4);
+
+      const cv::Rect area = (box_area | text_area) & bounds;
+      if (!area.empty()) dirty_.push_back(area);
+    }
+  }
+
+  if (cfg_.show_hud) {
+    const cv::Rect hr = hud_.placement(size);
+    if (!hr.empty()) {
+      hud_.panel()(cv::Rect(0, 0, hr.width, hr.height)).copyTo(overlay_(hr));
+      mask_(hr).setTo(opaque);
+      dirty_.push_back(hr);
+    }
+  }
+
+  drawn_ = ws.tracks;
+  have_raster_ = true;
+}
+
+void RenderStage::process(RenderFrame& rf) {
+  const cv::Mat& src = rf.frame.image;
+  if (src.empty()) return;
+
+  StageMetrics::Item item(metrics_, rf.frame.sequence_id, in_.get());
+  item.set_capture_time(rf.frame.capture_time);
+
+  // A new frame size/type (first frame, camera mode switch) starts from a blank layer
+  if (overlay_.size() != src.size() || overlay_.type() != src.type()) {
+    overlay_.create(src.rows, src.cols, src.type());
+    overlay_.setTo(cv::Scalar::all(0));
+    mask_.create(src.rows, src.cols, CV_8UC1);
+    mask_.setTo(cv::Scalar::all(0));
+    dirty_.clear();
+    have_raster_ = false;
+  }
+
+  const bool hud_changed = cfg_.show_hud && hud_sources_.metrics &&
+                           hud_.refresh(*hud_sources_.metrics, hud_sources_.queues, hud_sources_.memory, src.type());
+
+  if (!have_raster_ || hud_changed || !same_as_drawn(rf.world)) {
+    rasterize(rf.world, src.size());
+  } else if (metrics_) {
+    metrics_->on_skip(); // Overlay reused as is
+  }
+
+  // Compose into a recycled buffer, the input frame stays untouched
+  Frame composed;
+  composed.capture_time = rf.frame.capture_time;
+  composed.sequence_id = rf.frame.sequence_id;
+  composed.image = out_pool_.acquire(src.rows, src.cols, src.type());
+  src.copyTo(composed.image);
+  for (const auto& r : dirty_) overlay_(r).copyTo(composed.image(r), mask_(r));
+
+  if (tap_) {
+    RenderFrame tapped;
+    tapped.frame = composed;
+    tapped.world = rf.world;
+    tap_->try_push(std::move(tapped));
+  }
+  out_->write(std::move(composed));
+}
+
+} // namespace dcp
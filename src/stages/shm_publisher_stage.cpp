@@ -0,0 +1,104 @@
+#include "stages/shm_publisher_stage.hpp"
+
+#include <chrono>
+#include <cstring>
+
+namespace dcp {
+
+static_assert(kMaxTracks <= kShmMaxTracks, "WorldState holds more tracks than a shared-memory record");
+
+ShmPublisherStage::ShmPublisherStage(StageMetrics* metrics, const ShmPublishConfig& cfg, std::string shm_name, std::size_t frame_capacity, std::shared_ptr<BoundedQueue<RenderFrame>> in, std::string name)
+    : Stage(std::move(name)),
+      metrics_(metrics),
+      publish_frames_(cfg.publish_frames),
+      in_(std::move(in)),
+      writer_(std::move(shm_name), static_cast<std::size_t>(cfg.world_slots), static_cast<std::size_t>(cfg.frame_slots),
+              cfg.publish_frames ? frame_capacity : 0) {}
+
+void ShmPublisherStage::run(const StopToken& global, const std::atomic_bool& local) {
+  using namespace std::chrono_literals;
+
+  while (!global.stop_requested() && !local.load(std::memory_order_relaxed)) {
+    RenderFrame rf;
+    if (!in_->try_pop_for(rf, 5ms)) continue;
+    process(rf);
+  }
+}
+
+bool ShmPublisherStage::supports_tasks() const {
+  return true;
+}
+
+void ShmPublisherStage::bind_wake(std::function<void()> wake) {
+  in_->set_on_push(std::move(wake));
+}
+
+bool ShmPublisherStage::step() {
+  RenderFrame rf;
+  if (!in_->try_pop(rf)) return false;
+  process(rf);
+  return true;
+}
+
+void ShmPublisherStage::process(const RenderFrame& rf) {
+  StageMetrics::Item item(metrics_, rf.frame.sequence_id, in_.get());
+  item.set_capture_time(rf.frame.capture_time);
+
+  // steady_clock is CLOCK_MONOTONIC, the same clock in every process on the box
+  const std::int64_t capture_ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(rf.frame.capture_time.time_since_epoch()).count();
+
+  // Frame first, so a reader that sees a world record can already find its frame
+  if (publish_frames_ && !rf.frame.image.empty() && !publish_frame(rf.frame, capture_ns)) {
+    if (metrics_) metrics_->on_wasted(); // Bigger than a slot, tracks only
+  }
+
+  record_.frame_id = rf.world.frame_id;
+  record_.sequence_id = rf.frame.sequence_id;
+  record_.capture_ns = capture_ns;
+  record_.track_count = static_cast<std::uint32_t>(rf.world.tracks.size());
+  for (std::size_t i = 0; i < rf.world.tracks.size(); ++i) {
+    const Track& tr = rf.world.tracks[i];
+    ShmTrack& out = record_.tracks[i];
+    out.id = tr.id;
+    out.x = tr.bbox.x;
+    out.y = tr.bbox.y;
+    out.w = tr.bbox.w;
+    out.h = tr.bbox.h;
+    out.confidence = tr.confidence;
+    out.class_id = tr.class_id;
+    out.missed_frames = tr.missed_frames;
+    out.age_frames = tr.age_frames;
+    out.confirmed = tr.confirmed ? 1u : 0u;
+    out.reserved = 0;
+  }
+  writer_.publish_world(record_);
+}
+
+bool ShmPublisherStage::publish_frame(const Frame& frame, std::int64_t capture_ns) {
+  const cv::Mat& img = frame.image;
+  const std::size_t row_bytes = img.cols * img.elemSize();
+  const std::size_t bytes = row_bytes * static_cast<std::size_t>(img.rows);
+  if (bytes > writer_.frame_capacity()) return false;
+
+  // The one copy: rows go straight into the slot, packed, whatever the source stride
+  std::uint8_t* dst = writer_.begin_frame();
+  if (img.isContinuous()) {
+    std::memcpy(dst, img.data, bytes);
+  } else {
+    for (int r = 0; r < img.rows; ++r) std::memcpy(dst + static_cast<std::size_t>(r) * row_bytes, img.ptr(r), row_bytes);
+  }
+
+  ShmFrameInfo info{};
+  info.sequence_id = frame.sequence_id;
+  info.capture_ns = capture_ns;
+  info.width = img.cols;
+  info.height = img.rows;
+  info.type = img.type();
+  info.stride = static_cast<std::int32_t>(row_bytes);
+  info.bytes = bytes;
+  writer_.commit_frame(info);
+  return true;
+}
+
+} // namespace dcp
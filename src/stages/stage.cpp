@@ -1,4 +1,6 @@
+#include <chrono>
 #include <iostream>
+#include <thread>
 #include <utility>
 
 #include "stages/stage.hpp"
@@ -18,11 +20,74 @@ void Stage::start(StopToken global_stop) {
   });
 }
 
+void Stage::start(StopToken global_stop, TaskExecutor& executor, TaskPriority prio) {
+  if (!supports_tasks()) {
+    start(std::move(global_stop));
+    return;
+  }
+
+  std::cout << name_ << " started (task, " << (prio == TaskPriority::High ? "high" : "normal") << " priority)" << std::endl;
+
+  executor_ = &executor;
+  prio_ = prio;
+  global_stop_ = std::move(global_stop);
+  stopping_.store(false);
+
+  bind_wake([this] { wake(); });
+  wake(); // Drain anything queued before we were hooked up
+}
+
 void Stage::stop() {
   std::cout << name_ << " stopped" << std::endl;
 
-  runner_.request_stop();
-  runner_.join();
+  if (!executor_) {
+    runner_.request_stop();
+    runner_.join();
+    return;
+  }
+
+  stopping_.store(true);
+  bind_wake({});
+
+  // Wait for a queued or running task to finish. If the executor is already stopped a queued task never runs
+  while ((scheduled_.load() && !executor_->stopped()) || running_.load() > 0) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  executor_ = nullptr;
+}
+
+void Stage::wake() {
+  if (stopping_.load()) return;
+  if (scheduled_.exchange(true)) {
+    rewake_.store(true);
+    return;
+  }
+  executor_->submit(prio_, [this] { run_task(); });
+}
+
+void Stage::run_task() {
+  running_.fetch_add(1);
+
+  for (int i = 0; i < kStepBudget; ++i) {
+    if (stopping_.load() || global_stop_.stop_requested()) {
+      scheduled_.store(false);
+      running_.fetch_sub(1);
+      return;
+    }
+
+    rewake_.store(false);
+    if (!step()) {
+      // Input drained. A push that raced with the empty check set rewake_, so look again instead of going idle
+      scheduled_.store(false);
+      if (rewake_.exchange(false)) wake();
+      running_.fetch_sub(1);
+      return;
+    }
+  }
+
+  // Budget used up with input still pending, requeue behind other work. scheduled_ stays set
+  executor_->submit(prio_, [this] { run_task(); });
+  running_.fetch_sub(1);
 }
 
-} // namespace dcp
\ No newline at end of file
+} // namespace dcp
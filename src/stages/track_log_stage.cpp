@@ -0,0 +1,77 @@
+#include "stages/track_log_stage.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <stdexcept>
+
+#include "core/labels/general_labels.hpp"
+
+namespace dcp {
+
+static constexpr char kHeader[] = "frame_id,capture_ms,track_id,class_id,class_name,confidence,x,y,w,h,missed_frames\n";
+static constexpr auto kFlushInterval = std::chrono::seconds(1);
+
+TrackLogStage::TrackLogStage(StageMetrics* metrics, std::shared_ptr<AsyncWriter> writer, std::string output_path, FileOptions file_opts, std::shared_ptr<BoundedQueue<RenderFrame>> in, std::string name)
+    : Stage(std::move(name)), metrics_(metrics), writer_(std::move(writer)), in_(std::move(in)) {
+  if (!out_.open(writer_.get(), output_path, file_opts)) throw std::runtime_error("track log: failed to open '" + output_path + "'");
+  out_.append(kHeader, sizeof(kHeader) - 1);
+  last_flush_ = std::chrono::steady_clock::now();
+}
+
+void TrackLogStage::run(const StopToken& global, const std::atomic_bool& local) {
+  using namespace std::chrono_literals;
+
+  while (!global.stop_requested() && !local.load(std::memory_order_relaxed)) {
+    RenderFrame rf;
+    if (!in_->try_pop_for(rf, 5ms)) continue;
+    process(rf);
+  }
+  out_.close();
+}
+
+bool TrackLogStage::supports_tasks() const {
+  return true;
+}
+
+void TrackLogStage::bind_wake(std::function<void()> wake) {
+  in_->set_on_push(std::move(wake));
+}
+
+bool TrackLogStage::step() {
+  RenderFrame rf;
+  if (!in_->try_pop(rf)) return false;
+  process(rf);
+  return true;
+}
+
+void TrackLogStage::process(const RenderFrame& rf) {
+  StageMetrics::Item item(metrics_, rf.frame.sequence_id, in_.get());
+  item.set_capture_time(rf.frame.capture_time);
+
+  // Capture times are relative to the first logged frame, steady_clock has no meaningful epoch
+  if (!have_first_) {
+    first_capture_ = rf.frame.capture_time;
+    have_first_ = true;
+  }
+  const double capture_ms =
+      std::chrono::duration<double, std::milli>(rf.frame.capture_time - first_capture_).count();
+
+  char row[192];
+  for (const auto& tr : rf.world.tracks) {
+    const int n = std::snprintf(row, sizeof(row), "%llu,%.1f,%llu,%d,%s,%.3f,%.1f,%.1f,%.1f,%.1f,%d\n",
+                                static_cast<unsigned long long>(rf.world.frame_id), capture_ms,
+                                static_cast<unsigned long long>(tr.id), tr.class_id, GeneralClassLabel(tr.class_id).c_str(),
+                                tr.confidence, tr.bbox.x, tr.bbox.y, tr.bbox.w, tr.bbox.h, tr.missed_frames);
+    if (n <= 0 || static_cast<std::size_t>(n) >= sizeof(row) || !out_.append(row, static_cast<std::size_t>(n))) {
+      if (metrics_) metrics_->on_wasted(); // Writer full, the row is dropped
+    }
+  }
+
+  const auto done = std::chrono::steady_clock::now();
+  if (done - last_flush_ >= kFlushInterval) {
+    out_.flush();
+    last_flush_ = done;
+  }
+}
+
+} // namespace dcp
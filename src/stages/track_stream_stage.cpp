@@ -0,0 +1,68 @@
+#include "stages/track_stream_stage.hpp"
+
+#include <chrono>
+
+namespace dcp {
+
+static UnixStreamServer::Options ServerOptions(const TrackStreamConfig& cfg, std::string socket_path) {
+  UnixStreamServer::Options o;
+  o.path = std::move(socket_path);
+  o.max_clients = static_cast<std::size_t>(cfg.max_subscribers);
+  o.buffer_bytes = static_cast<std::size_t>(cfg.send_buffer_kb) * 1024;
+  return o;
+}
+
+TrackStreamStage::TrackStreamStage(StageMetrics* metrics, StageMetrics* encode_metrics, const TrackStreamConfig& cfg, std::string socket_path, std::shared_ptr<BoundedQueue<RenderFrame>> in, std::string name)
+    : Stage(std::move(name)),
+      metrics_(metrics),
+      encode_metrics_(encode_metrics),
+      in_(std::move(in)),
+      server_(ServerOptions(cfg, std::move(socket_path))),
+      keyframe_([this]() -> const std::vector<std::uint8_t>& { return encoder_.keyframe(); }) {}
+
+void TrackStreamStage::run(const StopToken& global, const std::atomic_bool& local) {
+  using namespace std::chrono_literals;
+
+  while (!global.stop_requested() && !local.load(std::memory_order_relaxed)) {
+    RenderFrame rf;
+    if (!in_->try_pop_for(rf, 5ms)) {
+      server_.poll();
+      continue;
+    }
+    process(rf);
+  }
+}
+
+bool TrackStreamStage::supports_tasks() const {
+  return true;
+}
+
+void TrackStreamStage::bind_wake(std::function<void()> wake) {
+  in_->set_on_push(std::move(wake));
+}
+
+bool TrackStreamStage::step() {
+  RenderFrame rf;
+  if (!in_->try_pop(rf)) return false;
+  process(rf);
+  return true;
+}
+
+void TrackStreamStage::process(const RenderFrame& rf) {
+  StageMetrics::Item item(metrics_, rf.frame.sequence_id, in_.get());
+  item.set_capture_time(rf.frame.capture_time);
+
+  const std::int64_t capture_ns =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(rf.frame.capture_time.time_since_epoch()).count();
+  const std::vector<std::uint8_t>& delta = encoder_.encode(rf.world, capture_ns);
+  bytes_encoded_.fetch_add(delta.size(), std::memory_order_relaxed);
+  const auto encoded = std::chrono::steady_clock::now();
+
+  server_.publish(delta, keyframe_);
+
+  if (encode_metrics_) {
+    encode_metrics_->on_item(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(encoded - item.start()).count()));
+  }
+}
+
+} // namespace dcp
@@ -1,103 +1,141 @@
 #include "stages/tracking_stage.hpp"
 
+#include "core/preprocess_ops.hpp"
+
+#include <algorithm>
+#include <array>
 #include <chrono>
-#include <optional>
 
 namespace dcp {
 
-static BBoxF MapDetToRaw(const Detection& d, const PreprocessInfo& pi) {
-  const auto& roi = pi.roi;
-
-  const float rw = roi.width  > 0 ? static_cast<float>(roi.width)  : 1.f;
-  const float rh = roi.height > 0 ? static_cast<float>(roi.height) : 1.f;
-
-  const float sw = pi.resize_width  > 0 ? static_cast<float>(pi.resize_width)  : rw;
-  const float sh = pi.resize_height > 0 ? static_cast<float>(pi.resize_height) : rh;
-
-  const float sx = rw / sw;
-  const float sy = rh / sh;
-
-  BBoxF out;
-  out.x = static_cast<float>(roi.x) + d.bbox.x * sx;
-  out.y = static_cast<float>(roi.y) + d.bbox.y * sy;
-  out.w = d.bbox.w * sx;
-  out.h = d.bbox.h * sy;
-  return out;
-}
-
 TrackingStage::TrackingStage(StageMetrics* metrics,
                              TrackingConfig cfg,
                              std::shared_ptr<BoundedQueue<Frame>> in,
                              std::shared_ptr<LatestStore<Detections>> detections_latest_store,
-                             std::shared_ptr<BoundedQueue<RenderFrame>> out)
-    : Stage("tracking_stage"),
+                             std::vector<std::shared_ptr<BoundedQueue<RenderFrame>>> outs,
+                             std::string name)
+    : Stage(std::move(name)),
       metrics_(metrics),
       cfg_(std::move(cfg)),
       in_(std::move(in)),
       detections_latest_store_(std::move(detections_latest_store)),
-      out_(std::move(out)) {}
+      outs_(std::move(outs)) {}
 
 void TrackingStage::run(const StopToken& global, const std::atomic_bool& local) {
   using namespace std::chrono_literals;
 
-  std::optional<Detections> cached_dets;
-
-  std::uint64_t next_track_id = 1;
-
   while (!global.stop_requested() && !local.load(std::memory_order_relaxed)) {
     Frame f;
     if (!in_->try_pop_for(f, 5ms)) continue;
-    if (f.image.empty()) continue;
-
-    const auto t0 = std::chrono::steady_clock::now();
-
-    auto dets_opt = detections_latest_store_->read_latest();
-    if (dets_opt) {
-      cached_dets = std::move(*dets_opt);
-    }
+    process(f);
+  }
+}
 
-    WorldState ws;
-    ws.frame_id = f.sequence_id;
-    ws.timestamp = std::chrono::steady_clock::now();
+bool TrackingStage::supports_tasks() const {
+  return true;
+}
 
-    if (cached_dets) {
-      ws.detections_source_frame_id = cached_dets->source_frame_id;
-      ws.detections_inference_time = cached_dets->inference_time;
+void TrackingStage::bind_wake(std::function<void()> wake) {
+  in_->set_on_push(std::move(wake));
+}
 
-      ws.tracks.reserve(cached_dets->items.size());
+bool TrackingStage::step() {
+  Frame f;
+  if (!in_->try_pop(f)) return false;
+  process(f);
+  return true;
+}
 
-      for (const auto& d : cached_dets->items) {
-        Track t;
-        t.id = next_track_id++;
-        t.class_id = d.class_id;
-        t.confidence = d.confidence;
+void TrackingStage::process(Frame& f) {
+  if (f.image.empty()) return;
 
-        const BBoxF raw = MapDetToRaw(d, cached_dets->preprocess_info);
-        t.bbox = raw;
+  StageMetrics::Item item(metrics_, f.sequence_id, in_.get());
 
-        t.last_update_frame_id = f.sequence_id;
-        t.age_frames = 1;
-        t.missed_frames = 0;
-        t.confirmed = true;
+  // Only copies when inference produced something new, otherwise keeps using the cached result and its tracks
+  if (detections_latest_store_->read_into(cached_dets_, dets_version_)) {
+    have_dets_ = true;
+    associate(f.sequence_id);
+  }
 
-        ws.tracks.push_back(t);
-      }
-    } else {
-      ws.detections_source_frame_id = 0;
-      ws.detections_inference_time = {};
-    }
+  WorldState ws;
+  ws.frame_id = f.sequence_id;
+  ws.timestamp = std::chrono::steady_clock::now();
+
+  if (have_dets_) {
+    ws.detections_source_frame_id = cached_dets_.source_frame_id;
+    ws.detections_inference_time = cached_dets_.inference_time;
+    ws.tracks = tracks_;
+  } else {
+    ws.detections_source_frame_id = 0;
+    ws.detections_inference_time = {};
+  }
 
+  // Fan out, copying for all but the last consumer. Frame copies are Mat headers, tracks are inline
+  if (!outs_.empty()) {
     RenderFrame rf;
     rf.frame = std::move(f);
     rf.world = std::move(ws);
 
-    out_->try_push(std::move(rf));
+    for (std::size_t i = 0; i + 1 < outs_.size(); ++i) outs_[i]->try_push(RenderFrame(rf));
+    outs_.back()->try_push(std::move(rf));
+  }
+}
+
+static float IoU(const BBoxF& a, const BBoxF& b) {
+  const float iw = std::max(0.f, std::min(a.x + a.w, b.x + b.w) - std::max(a.x, b.x));
+  const float ih = std::max(0.f, std::min(a.y + a.h, b.y + b.h) - std::max(a.y, b.y));
+  const float inter = iw * ih;
+  const float uni = a.w * a.h + b.w * b.h - inter;
+  return uni > 0.f ? inter / uni : 0.f;
+}
+
+void TrackingStage::associate(std::uint64_t frame_id) {
+  FixedVector<Track, kMaxTracks> next;
+  std::array<bool, kMaxTracks> matched{};
+
+  // Detections arrive sorted by score, so the strongest pick their track first. Each takes the unmatched track of
+  // its class it overlaps most, or starts a new one
+  for (const auto& d : cached_dets_.items) {
+    const BBoxF raw = MapDetToRaw(d, cached_dets_.preprocess_info);
+
+    std::size_t best = tracks_.size();
+    float best_iou = 0.f;
+    for (std::size_t i = 0; i < tracks_.size(); ++i) {
+      if (matched[i] || tracks_[i].class_id != d.class_id) continue;
+      const float iou = IoU(raw, tracks_[i].bbox);
+      if (iou >= cfg_.iou_threshold && iou > best_iou) {
+        best = i;
+        best_iou = iou;
+      }
+    }
 
-    const auto work_ns =
-        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t0).count();
+    Track t;
+    if (best < tracks_.size()) {
+      matched[best] = true;
+      t = tracks_[best];
+    } else {
+      t.id = next_track_id_++;
+      t.class_id = d.class_id;
+    }
+    t.bbox = raw;
+    t.confidence = d.confidence;
+    t.last_update_frame_id = frame_id;
+    t.age_frames += 1;
+    t.missed_frames = 0;
+    t.confirmed = t.age_frames >= cfg_.min_confirmed_frames;
+
+    if (!next.push_back(t)) break; // kMaxTracks reached, the rest score lower
+  }
 
-    if (metrics_) metrics_->on_item(static_cast<std::uint64_t>(work_ns));
+  // Tracks this result didn't see are kept, at their last box, for up to max_missed_frames results
+  for (std::size_t i = 0; i < tracks_.size(); ++i) {
+    if (matched[i] || tracks_[i].missed_frames >= cfg_.max_missed_frames) continue;
+    Track t = tracks_[i];
+    t.missed_frames += 1;
+    if (!next.push_back(t)) break;
   }
+
+  tracks_ = next;
 }
 
-} // namespace dcp
\ No newline at end of file
+} // namespace dcp
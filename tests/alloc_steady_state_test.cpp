@@ -0,0 +1,179 @@
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+#include "core/config.hpp"
+#include "core/detections.hpp"
+#include "core/frame.hpp"
+#include "core/mat_pool.hpp"
+#include "core/render_frame.hpp"
+#include "infra/alloc_counter.hpp"
+#include "infra/bounded_queue.hpp"
+#include "infra/latest_store.hpp"
+#include "infra/metrics.hpp"
+#include "stages/preprocess_stage.hpp"
+#include "stages/tracking_stage.hpp"
+#include "test_util.hpp"
+
+// Regression test for the allocation-free steady state. After a warm-up, these per-frame paths must make zero heap
+// allocations: MatPool frame buffers (what camera and preprocess fill) through the queues and stores, then the real
+// preprocess and tracking stages. Not covered: camera decode (needs a video source), inference (needs a model and
+// ORT's own allocator) and render, where OpenCV's text drawing allocates on every redraw.
+// The target links dcp_alloc_counter, so counting is always on. Exits non-zero on failure
+
+template <typename Pred>
+static bool WaitFor(Pred pred, std::chrono::milliseconds timeout) {
+  const auto deadline = std::chrono::steady_clock::now() + timeout;
+  while (!pred()) {
+    if (std::chrono::steady_clock::now() > deadline) return false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return true;
+}
+
+// Inference stand-in: a few detections, count varying per result so the item buffers see different sizes
+static void FakeDetections(dcp::Detections& d, std::uint64_t seq) {
+  d.inference_time = std::chrono::steady_clock::now();
+  d.source_frame_id = seq;
+  d.items.clear();
+  for (std::uint64_t i = 0; i < 2 + seq % 5; ++i) {
+    dcp::Detection det;
+    det.class_id = static_cast<int>(i);
+    det.confidence = 0.9f;
+    det.bbox = {10.f * i, 10.f, 20.f, 20.f};
+    d.items.push_back(det);
+  }
+}
+
+int main() {
+  using namespace std::chrono_literals;
+
+  // Without counting every check below would pass on zeros
+  if (!dcp::AllocCountingEnabled()) {
+    Expect(false, "allocations are counted (dcp_alloc_counter linked ahead of dashcam_core)");
+    return TestResult();
+  }
+  {
+    const auto before = dcp::ThreadAllocations();
+    int* volatile probe = new int(1);  // volatile so the new/delete pair can't be optimized away
+    delete probe;
+    const auto counted = dcp::ThreadAllocations() - before;  // Before Expect's message string allocates
+    Expect(counted == 1, "counter sees an allocation");
+  }
+
+  constexpr int kRows = 180;
+  constexpr int kCols = 320;
+  constexpr int kWarmup = 100;
+  constexpr int kMeasured = 500;
+
+  // Queues, stores and pools on their own, all on this thread
+  {
+    dcp::MatPool pool(8);
+    dcp::BoundedQueue<dcp::Frame> frames(4, dcp::DropPolicy::DropOldest);
+    dcp::BoundedQueue<dcp::RenderFrame> render(4, dcp::DropPolicy::DropOldest);
+    dcp::LatestStore<dcp::Detections> store;
+    dcp::Detections produced;
+    dcp::Detections consumed;
+    std::uint64_t seen = 0;
+    dcp::Frame f_out;
+    dcp::RenderFrame rf_out;
+
+    auto one_frame = [&](std::uint64_t seq) {
+      dcp::Frame f;
+      f.sequence_id = seq;
+      f.capture_time = std::chrono::steady_clock::now();
+      f.image = pool.acquire(kRows, kCols, CV_8UC3);
+      frames.try_push(std::move(f));
+
+      FakeDetections(produced, seq);
+      store.assign(produced);
+      store.read_into(consumed, seen);
+
+      frames.try_pop(f_out);
+      dcp::RenderFrame rf;
+      rf.frame = std::move(f_out);
+      for (const auto& d : consumed.items) {
+        dcp::Track t;
+        t.class_id = d.class_id;
+        rf.world.tracks.push_back(t);
+      }
+      render.try_push(std::move(rf));
+      render.try_pop(rf_out);
+    };
+
+    for (int i = 0; i < kWarmup; ++i) one_frame(static_cast<std::uint64_t>(i));
+    const auto before = dcp::ThreadAllocations();
+    for (int i = 0; i < kMeasured; ++i) one_frame(static_cast<std::uint64_t>(kWarmup + i));
+    const auto allocs = dcp::ThreadAllocations() - before;
+
+    std::cout << "infra path: " << allocs << " allocations over " << kMeasured << " frames, pool misses "
+              << pool.misses() << "\n";
+    Expect(allocs == 0, "queues/stores/pool allocate nothing in steady state");
+  }
+
+  // Real preprocess + tracking stages on their own threads, fed like the camera would
+  {
+    dcp::StopSource stop;
+    dcp::Metrics metrics;
+    dcp::StageMetrics* pre_m = metrics.make_stage("preprocess");
+    dcp::StageMetrics* trk_m = metrics.make_stage("tracking");
+
+    auto cam_to_pre = std::make_shared<dcp::BoundedQueue<dcp::Frame>>(8, dcp::DropPolicy::DropOldest);
+    auto pre_to_trk = std::make_shared<dcp::BoundedQueue<dcp::Frame>>(8, dcp::DropPolicy::DropOldest);
+    auto trk_out = std::make_shared<dcp::BoundedQueue<dcp::RenderFrame>>(8, dcp::DropPolicy::DropOldest);
+    auto pf_store = std::make_shared<dcp::LatestStore<dcp::PreprocessedFrame>>();
+    auto det_store = std::make_shared<dcp::LatestStore<dcp::Detections>>();
+
+    dcp::PreprocessConfig pcfg;
+    pcfg.resize_width = 160;
+    pcfg.resize_height = 90;
+
+    dcp::PreprocessStage pre(pre_m, pcfg, cam_to_pre, pre_to_trk, pf_store, nullptr);
+    dcp::TrackingStage trk(trk_m, dcp::TrackingConfig{}, pre_to_trk, det_store, {trk_out});
+    pre.start(stop.token());
+    trk.start(stop.token());
+
+    dcp::MatPool pool(32);
+    dcp::Detections dets;
+    dcp::RenderFrame shown;
+
+    // One frame in, let both stages finish it, and keep the newest result like the display does
+    auto feed = [&](std::uint64_t seq) {
+      dcp::Frame f;
+      f.sequence_id = seq;
+      f.capture_time = std::chrono::steady_clock::now();
+      f.image = pool.acquire(kRows, kCols, CV_8UC3);
+      const auto done = trk_m->count.value() + 1;
+      cam_to_pre->try_push(std::move(f));
+      if (seq % 3 == 0) {
+        FakeDetections(dets, seq);
+        det_store->assign(dets);
+      }
+      WaitFor([&] { return trk_m->count.value() >= done; }, 1000ms);
+      while (trk_out->try_pop(shown)) {}
+    };
+
+    for (int i = 0; i < kWarmup; ++i) feed(static_cast<std::uint64_t>(i));
+    const auto pre_allocs0 = pre_m->allocs.value();
+    const auto trk_allocs0 = trk_m->allocs.value();
+    const auto trk_count0 = trk_m->count.value();
+    for (int i = 0; i < kMeasured; ++i) feed(static_cast<std::uint64_t>(kWarmup + i));
+
+    const auto pre_allocs = pre_m->allocs.value() - pre_allocs0;
+    const auto trk_allocs = trk_m->allocs.value() - trk_allocs0;
+    const auto frames = trk_m->count.value() - trk_count0;
+
+    pre.stop();
+    trk.stop();
+
+    std::cout << "stages: " << frames << " frames, preprocess " << pre_allocs << " allocations, tracking " << trk_allocs
+              << " allocations, pool misses " << pool.misses() << "\n";
+    Expect(frames >= kMeasured / 2, "stages processed the measured frames");
+    Expect(pre_allocs == 0, "preprocess allocates nothing per frame");
+    Expect(trk_allocs == 0, "tracking allocates nothing per frame");
+  }
+
+  return TestResult();
+}
@@ -28,7 +28,11 @@ int main(int argc, char** argv) {
     bq.try_push(f1);
     bq.try_push(f2);
     bq.try_push(f3);
-    bq.try_push(f4);
+
+    // Full, f4 evicts f1
+    std::size_t discarded = 0;
+    bq.try_push(f4, &discarded);
+    std::cout << discarded << std::endl;
 
     dcp::Frame out;
 
@@ -45,6 +49,45 @@ int main(int argc, char** argv) {
 
     std::cout << bq.drops_total() << std::endl;
 
+    // DropOlderThan: f5 was captured 200 ms ago, f6 just now. f5 expires instead of being popped
+    dcp::BoundedQueue<dcp::Frame> aged(3, dcp::DropPolicy::DropOlderThan, std::chrono::milliseconds(100));
+
+    dcp::Frame f5, f6;
+    f5.sequence_id = 5;
+    f5.capture_time = std::chrono::steady_clock::now() - std::chrono::milliseconds(200);
+    f6.sequence_id = 6;
+    f6.capture_time = std::chrono::steady_clock::now();
+
+    aged.try_push(f5);
+    aged.try_push(f6, &discarded);
+    std::cout << discarded << std::endl;
+
+    aged.try_pop(out);
+    std::cout << out.sequence_id << std::endl;
+
+    // Expired count is kept apart from capacity drops
+    std::cout << aged.expired_total() << " " << aged.drops_total() << std::endl;
+
+    // Byte bound of two small frames. A frame bigger than the bound is rejected without evicting anything, even when
+    // the queue is full under DropOldest
+    dcp::Frame small, big;
+    small.image = cv::Mat(10, 10, CV_8UC3);
+    big.image = cv::Mat(100, 100, CV_8UC3);
+    dcp::BoundedQueue<dcp::Frame> sized(2, dcp::DropPolicy::DropOldest, std::chrono::milliseconds(0),
+                                        2 * dcp::ItemBytes(small));
+    sized.try_push(small);
+    sized.try_push(small);
+    std::cout << sized.try_push(big, &discarded) << " " << discarded << " " << sized.size() << std::endl;
+
+    // DropNewest over the byte bound: the producer is told before it builds the next frame
+    dcp::BoundedQueue<dcp::Frame> sized_newest(4, dcp::DropPolicy::DropNewest, std::chrono::milliseconds(0),
+                                               2 * dcp::ItemBytes(small));
+    sized_newest.try_push(small);
+    std::cout << sized_newest.would_drop_incoming(dcp::ItemBytes(small)) << " ";
+    sized_newest.try_push(small);
+    std::cout << sized_newest.would_drop_incoming(dcp::ItemBytes(small)) << " "
+              << sized_newest.would_drop_incoming() << std::endl;
+
 
   } catch (const std::exception& e) {
     std::cerr << e.what() << "\n";
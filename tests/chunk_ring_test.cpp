@@ -0,0 +1,89 @@
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "infra/chunk_ring.hpp"
+#include "test_util.hpp"
+
+// Checks eviction by bytes, by count and by age, wrap-around at the arena end and oversize rejects. Exits non-zero on failure
+
+// Chunk payload: every byte is the seq, so a corrupted chunk is easy to spot
+static std::vector<std::uint8_t> Payload(std::uint64_t seq, std::size_t n) {
+  return std::vector<std::uint8_t>(n, static_cast<std::uint8_t>(seq));
+}
+
+static std::vector<std::uint64_t> Seqs(const dcp::ChunkRing& ring, bool* intact = nullptr) {
+  std::vector<std::uint64_t> out;
+  if (intact) *intact = true;
+  ring.for_each([&](const dcp::ChunkRing::Chunk& c) {
+    out.push_back(c.seq);
+    for (std::size_t i = 0; i < c.size; ++i) {
+      if (intact && c.data[i] != static_cast<std::uint8_t>(c.seq)) *intact = false;
+    }
+  });
+  return out;
+}
+
+int main() {
+  using namespace std::chrono_literals;
+  const auto t0 = std::chrono::steady_clock::now();
+
+  auto push = [&](dcp::ChunkRing& ring, std::uint64_t seq, std::size_t n, std::chrono::milliseconds at) {
+    const auto p = Payload(seq, n);
+    return ring.push(t0 + at, seq, p.data(), p.size());
+  };
+
+  // Byte bound evicts oldest first
+  {
+    dcp::ChunkRing ring(100, 16);
+    for (std::uint64_t s = 1; s <= 4; ++s) push(ring, s, 30, std::chrono::milliseconds(s));
+    Expect((Seqs(ring) == std::vector<std::uint64_t>{2, 3, 4}), "byte bound keeps the newest that fit");
+    Expect(ring.bytes() == 90, "bytes counts live payloads");
+  }
+
+  // Count bound
+  {
+    dcp::ChunkRing ring(1000, 3);
+    for (std::uint64_t s = 1; s <= 5; ++s) push(ring, s, 10, std::chrono::milliseconds(s));
+    Expect((Seqs(ring) == std::vector<std::uint64_t>{3, 4, 5}), "count bound keeps the newest 3");
+  }
+
+  // Wrap with uneven sizes keeps payloads intact and in order
+  {
+    dcp::ChunkRing ring(100, 64);
+    bool all_intact = true;
+    bool ordered = true;
+    for (std::uint64_t s = 1; s <= 200; ++s) {
+      push(ring, s, 7 + (s * 13) % 40, std::chrono::milliseconds(s));
+      bool intact = true;
+      const auto seqs = Seqs(ring, &intact);
+      all_intact = all_intact && intact;
+      for (std::size_t i = 1; i < seqs.size(); ++i) ordered = ordered && seqs[i] == seqs[i - 1] + 1;
+      ordered = ordered && !seqs.empty() && seqs.back() == s;
+      if (ring.bytes() > ring.max_bytes()) all_intact = false;
+    }
+    Expect(all_intact, "payloads survive wrap-around");
+    Expect(ordered, "contiguous newest run, oldest first");
+  }
+
+  // Age trim and span
+  {
+    dcp::ChunkRing ring(1000, 16);
+    for (std::uint64_t s = 0; s < 10; ++s) push(ring, s, 10, std::chrono::milliseconds(s * 100));
+    Expect(ring.span() == 900ms, "span newest minus oldest");
+    ring.trim(t0 + 500ms);
+    Expect((Seqs(ring) == std::vector<std::uint64_t>{5, 6, 7, 8, 9}), "trim drops older than cutoff");
+  }
+
+  // A chunk bigger than the arena is rejected without touching what's stored
+  {
+    dcp::ChunkRing ring(50, 4);
+    push(ring, 1, 20, 1ms);
+    Expect(!push(ring, 2, 51, 2ms), "oversize rejected");
+    Expect(ring.oversize_total() == 1, "oversize counted");
+    Expect((Seqs(ring) == std::vector<std::uint64_t>{1}), "existing chunks kept");
+  }
+
+  return TestResult();
+}
@@ -0,0 +1,167 @@
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "infra/bounded_queue.hpp"
+#include "infra/flight_recorder.hpp"
+#include "infra/metrics.hpp"
+#include "test_util.hpp"
+
+// Checks the flight recorder: records survive the writer being killed, the ring keeps the newest capacity records,
+// concurrent writers never interleave inside a record, a restart keeps the previous file as .prev, stages record
+// through StageMetrics::on_frame, and the CSV/trace output. Exits non-zero on failure
+
+static std::size_t CountLines(const std::string& s) {
+  std::size_t n = 0;
+  for (const char c : s) n += (c == '\n');
+  return n;
+}
+
+int main() {
+  const std::string path = "/tmp/dcp_flight_test_" + std::to_string(::getpid()) + ".dcpf";
+  const std::string prev = path + ".prev";
+  std::remove(path.c_str());
+  std::remove(prev.c_str());
+
+  // Killed writer, no destructor, no msync: what was stored is in the file. Forked before any thread exists
+  {
+    const pid_t child = ::fork();
+    if (child == 0) {
+      dcp::FlightRecorder rec(path, 64, 0);
+      const auto stage = rec.add_stage("camera");
+      for (std::uint64_t i = 0; i < 100; ++i) rec.record(stage, i, static_cast<std::int64_t>(i * 1000), 500, i % 3);
+      ::kill(::getpid(), SIGKILL);
+    }
+    int status = 0;
+    ::waitpid(child, &status, 0);
+    Expect(WIFSIGNALED(status) && WTERMSIG(status) == SIGKILL, "writer was killed");
+
+    const auto d = dcp::ReadFlightFile(path);
+    Expect(d.written == 100 && d.capacity == 64, "cursor and capacity survive");
+    Expect(d.events.size() == 64 && d.events.front().index == 36 && d.events.back().index == 99, "newest 64 records kept, in order");
+    Expect(d.stages.size() == 1 && d.stages[0] == "camera", "stage names survive");
+    bool fields = true;
+    for (const auto& e : d.events) {
+      fields = fields && e.sequence_id == e.index && e.start_ns == static_cast<std::int64_t>(e.index * 1000) &&
+               e.end_ns == e.start_ns + 500 && e.queue_depth == e.index % 3 && e.stage == 0;
+    }
+    Expect(fields, "record fields intact");
+    Expect(d.torn == 0, "nothing torn");
+  }
+
+  // Restart keeps the previous run, concurrent writers, stages through the registry
+  {
+    dcp::FlightRecorder rec(path, 100000, 20);
+    Expect(rec.capacity() == 131072, "capacity rounded up to a power of two");
+    Expect(dcp::ReadFlightFile(prev).written == 100, "previous file kept as .prev");
+    Expect(rec.add_stage("a") == rec.add_stage("a") && rec.add_stage("a") != rec.add_stage("b"), "stage ids per name");
+
+    constexpr int kThreads = 4;
+    constexpr std::uint64_t kPerThread = 50000;
+    std::vector<std::thread> writers;
+    for (int t = 0; t < kThreads; ++t) {
+      writers.emplace_back([&rec, t]() {
+        const auto stage = rec.add_stage("w" + std::to_string(t));
+        for (std::uint64_t n = 0; n < kPerThread; ++n) {
+          const std::uint64_t seq = (static_cast<std::uint64_t>(t) << 32) | n;
+          rec.record(stage, seq, static_cast<std::int64_t>(seq ^ 0x5555), n % 1000, static_cast<std::size_t>(t));
+        }
+      });
+    }
+    for (auto& w : writers) w.join();
+
+    const auto d = dcp::ReadFlightFile(path);
+    Expect(d.written == kThreads * kPerThread && d.events.size() == rec.capacity(), "every slot written by some thread");
+    bool consistent = true;
+    for (const auto& e : d.events) {
+      const auto t = static_cast<int>(e.sequence_id >> 32);
+      const std::uint64_t n = e.sequence_id & 0xffffffffu;
+      consistent = consistent && t < kThreads && d.stages[e.stage] == "w" + std::to_string(t) && e.queue_depth == t &&
+                   e.start_ns == static_cast<std::int64_t>(e.sequence_id ^ 0x5555) && e.end_ns - e.start_ns == static_cast<std::int64_t>(n % 1000);
+    }
+    Expect(consistent, "no record mixes two writers");
+
+    // Saturation
+    const auto big = rec.add_stage("big");
+    rec.record(big, 1, 0, 10'000'000'000ull, 100000);
+    const auto last = dcp::ReadFlightFile(path).events.back();
+    Expect(last.end_ns == UINT32_MAX && last.queue_depth == UINT16_MAX, "duration and depth saturate");
+
+    // Overflowing the stage table
+    for (std::size_t i = 0; i < dcp::kFlightMaxStages + 5; ++i) rec.add_stage("s" + std::to_string(i));
+    const auto over = rec.add_stage("one too many");
+    Expect(over == dcp::kFlightMaxStages - 1 && dcp::ReadFlightFile(path).stages.back() == "other", "extra stages share 'other'");
+  }
+
+  // Stages record through the registry, then the outputs
+  {
+    dcp::FlightRecorder rec(path, 1024, 0);
+    dcp::Metrics metrics;
+    auto* before = metrics.make_stage("before");
+    metrics.set_flight_recorder(&rec);
+    auto* tracking = metrics.make_stage("tracking");
+    before->on_frame(1, dcp::SteadyClock::now(), 1000, 0);
+    const auto t0 = dcp::SteadyClock::now();
+    for (std::uint64_t i = 0; i < 10; ++i) tracking->on_frame(i, t0 + std::chrono::milliseconds(i), 2'000'000, i);
+
+    // An item scope records its frame with the queue depth at the end
+    dcp::BoundedQueue<int> queue(8, dcp::DropPolicy::DropOldest);
+    {
+      dcp::StageMetrics::Item item(tracking, 42, &queue);
+      queue.try_push(1);
+      queue.try_push(2);
+    }
+    {
+      dcp::StageMetrics::Item no_seq(tracking);
+    }
+
+    auto d = dcp::ReadFlightFile(path);
+    Expect(d.events.size() == 11 && d.events.back().sequence_id == 42 && d.events.back().queue_depth == 2,
+           "item records its frame and the queue depth, only with a sequence id");
+    d.events.pop_back();
+    Expect(d.events.size() == 10 && d.stages.size() == 1 && d.stages[0] == "tracking", "only stages made after attach record");
+    Expect(d.events[3].sequence_id == 3 && d.events[3].end_ns - d.events[3].start_ns == 2'000'000 && d.events[3].queue_depth == 3,
+           "on_frame fields");
+
+    std::ostringstream csv;
+    dcp::WriteFlightCsv(d, csv);
+    Expect(CountLines(csv.str()) == 11 && csv.str().rfind("sequence_id,stage,start_ms,end_ms,duration_ms,queue_depth\n", 0) == 0,
+           "CSV header and one row per record");
+    Expect(csv.str().find("\n3,tracking,") != std::string::npos && csv.str().find(",2.000,3\n") != std::string::npos, "CSV row");
+
+    std::ostringstream trace;
+    dcp::WriteFlightTrace(d, trace);
+    const std::string t = trace.str();
+    Expect(t.find("\"traceEvents\":[") != std::string::npos && t.find("\"thread_name\"") != std::string::npos &&
+               t.find("\"ph\":\"X\",\"name\":\"tracking\"") != std::string::npos && t.find("\"dur\":2000.000") != std::string::npos &&
+               t.rfind("]}\n") == t.size() - 3,
+           "trace has stage tracks and complete events");
+  }
+
+  // Not a flight recorder file
+  {
+    { std::ofstream junk(prev, std::ios::trunc); junk << std::string(8192, 'x'); }
+    bool threw = false;
+    try {
+      dcp::ReadFlightFile(prev);
+    } catch (const std::runtime_error&) {
+      threw = true;
+    }
+    Expect(threw, "other files are rejected");
+  }
+
+  std::remove(path.c_str());
+  std::remove(prev.c_str());
+  return TestResult();
+}
@@ -0,0 +1,242 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+#include "apps/ansi_dashboard.hpp"
+#include "apps/metrics_http_server.hpp"
+#include "infra/bounded_queue.hpp"
+#include "test_util.hpp"
+
+// Checks the /metrics endpoint (format, status codes, loopback only) and load-tests it: a stage-like thread runs a
+// fixed amount of work per item while a client scrapes 10 times a second (10x a 1 s Prometheus interval), and its
+// per-item latency up to p99 is compared to windows without scrapes. p99 is compared as the median over windows of
+// each window's p99, so one window hit by unrelated noise on the machine doesn't decide it. Not proven: the items that
+// overlap a scrape. On a single core they wait for it, at 10 scrapes/s that is well under 1% of items, so p99.9 and
+// max are printed but not asserted. Exits non-zero on failure
+
+struct Item {
+  std::uint64_t seq{0};
+};
+
+// One request, whole response back ("" if the connection failed)
+static std::string Fetch(int port, const std::string& request) {
+  const int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(static_cast<std::uint16_t>(port));
+  if (::connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+    ::close(fd);
+    return std::string();
+  }
+  ::send(fd, request.data(), request.size(), MSG_NOSIGNAL);
+  std::string out;
+  char buf[8192];
+  for (;;) {
+    const ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+    if (n <= 0) break;
+    out.append(buf, static_cast<std::size_t>(n));
+  }
+  ::close(fd);
+  return out;
+}
+
+// Every sample line is "name[{labels}] value" with a numeric value
+static bool WellFormed(const std::string& body) {
+  std::size_t at = 0;
+  int samples = 0;
+  while (at < body.size()) {
+    const std::size_t end = body.find('\n', at);
+    if (end == std::string::npos) return false;
+    const std::string line = body.substr(at, end - at);
+    at = end + 1;
+    if (line.rfind("# HELP ", 0) == 0 || line.rfind("# TYPE ", 0) == 0) continue;
+    const std::size_t space = line.rfind(' ');
+    if (space == std::string::npos || space == 0) return false;
+    char* parse_end = nullptr;
+    std::strtod(line.c_str() + space + 1, &parse_end);
+    if (*parse_end != '\0') return false;
+    ++samples;
+  }
+  return samples > 0;
+}
+
+// The same work every item, so its duration only changes when something else takes the CPU or the cache
+static std::uint64_t Work() {
+  std::uint64_t x = 0x9e3779b97f4a7c15ull;
+  for (int i = 0; i < 40000; ++i) {
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+  }
+  return x;
+}
+
+static void SetNice(int nice) {
+#if defined(__linux__)
+  ::setpriority(PRIO_PROCESS, static_cast<id_t>(::syscall(SYS_gettid)), nice);
+#else
+  (void)nice;
+#endif
+}
+
+// A stage loop running for window_ms: pop, work, push on, report to metrics. Appends the item latencies to lat
+static void RunStage(dcp::StageMetrics* m, dcp::BoundedQueue<Item>& in, dcp::BoundedQueue<Item>& out, int window_ms,
+                     std::vector<std::uint64_t>& lat) {
+  volatile std::uint64_t sink = 0;
+  const std::uint64_t end = dcp::NowNs() + static_cast<std::uint64_t>(window_ms) * 1000000;
+  for (std::uint64_t i = 0; dcp::NowNs() < end; ++i) {
+    const std::uint64_t t0 = dcp::NowNs();
+    in.try_push(Item{i});
+    Item it;
+    in.try_pop(it);
+    sink = sink + Work();
+    out.try_push(it);
+    const std::uint64_t dt = dcp::NowNs() - t0;
+    m->on_item(dt);
+    lat.push_back(dt);
+  }
+}
+
+// pct in tenths of a percent, 990 = p99
+static std::uint64_t Pct(const std::vector<std::uint64_t>& sorted, int permille) {
+  return sorted[sorted.size() * static_cast<std::size_t>(permille) / 1000];
+}
+
+// Runs one window and appends its p99 to p99s as well
+static void RunWindow(dcp::StageMetrics* m, dcp::BoundedQueue<Item>& in, dcp::BoundedQueue<Item>& out, int window_ms,
+                      std::vector<std::uint64_t>& lat, std::vector<std::uint64_t>& p99s) {
+  const std::size_t from = lat.size();
+  RunStage(m, in, out, window_ms, lat);
+  std::vector<std::uint64_t> window(lat.begin() + static_cast<std::ptrdiff_t>(from), lat.end());
+  std::sort(window.begin(), window.end());
+  p99s.push_back(Pct(window, 990));
+}
+
+int main() {
+  dcp::Metrics metrics;
+  auto* stage = metrics.make_stage("front/preprocess", {{"stage", "preprocess"}, {"camera", "front"}});
+  metrics.make_stage("odd \"name\"\\with\nnewline");
+  auto in = std::make_shared<dcp::BoundedQueue<Item>>(4, dcp::DropPolicy::DropOldest);
+  auto out = std::make_shared<dcp::BoundedQueue<Item>>(2, dcp::DropPolicy::DropOldest);
+
+  std::vector<dcp::QueueView> queues;
+  for (const auto& q : {in, out}) {
+    queues.push_back({q == in ? "cam->pre" : "pre->trk", [q]() { return q->size(); }, [q]() { return q->capacity(); },
+                      [q]() { return q->drops_total(); }, [q]() { return q->expired_total(); }});
+  }
+  std::vector<dcp::MemoryView> memory{{"pre->trk", [out]() { return out->bytes(); }, nullptr}};
+  std::vector<dcp::RateView> rates{{"stream sent", []() { return std::uint64_t{12345}; }, "KB", 1024.0}};
+
+  dcp::HttpMetricsConfig cfg;
+  cfg.port = 0;
+  dcp::RegisterViews(metrics, queues, memory, rates);
+  dcp::MetricsHttpServer server(cfg, metrics);
+  dcp::StopSource stop;
+  std::thread serve([&] { server.run(stop.token()); });
+
+  // Format and routing
+  const std::string ok = Fetch(server.port(), "GET /metrics HTTP/1.1\r\nHost: localhost\r\n\r\n");
+  const std::size_t split = ok.find("\r\n\r\n");
+  const std::string body = split == std::string::npos ? std::string() : ok.substr(split + 4);
+  Expect(ok.rfind("HTTP/1.1 200 OK\r\n", 0) == 0 && ok.find("version=0.0.4") != std::string::npos, "GET /metrics is 200 in Prometheus text format");
+  Expect(ok.find("Content-Length: " + std::to_string(body.size()) + "\r\n") != std::string::npos, "Content-Length matches the body");
+  Expect(WellFormed(body), "every sample line parses");
+  Expect(body.find("dcp_stage_items_total{stage=\"preprocess\",camera=\"front\"} 0\n") != std::string::npos, "stage counters labelled by stage and camera");
+  Expect(body.find("# TYPE dcp_stage_latency_seconds histogram\n") != std::string::npos &&
+         body.find("dcp_stage_latency_seconds_bucket{stage=\"preprocess\",camera=\"front\",le=\"+Inf\"} 0\n") != std::string::npos,
+         "latency histogram with +Inf bucket");
+  Expect(body.find("{stage=\"odd \\\"name\\\"\\\\with\\nnewline\"}") != std::string::npos, "label values escaped");
+  Expect(body.find("dcp_queue_capacity{queue=\"cam->pre\"} 4\n") != std::string::npos, "queue stats");
+  Expect(body.find("dcp_counter_total{name=\"stream sent\"} 12345\n") != std::string::npos, "rate totals exported raw");
+  Expect(body.find("process_resident_memory_bytes ") != std::string::npos, "process stats");
+  Expect(Fetch(server.port(), "GET / HTTP/1.1\r\n\r\n").rfind("HTTP/1.1 404", 0) == 0, "other paths are 404");
+  Expect(Fetch(server.port(), "POST /metrics HTTP/1.1\r\n\r\n").rfind("HTTP/1.1 405", 0) == 0, "other methods are 405");
+  const std::string head = Fetch(server.port(), "HEAD /metrics HTTP/1.1\r\n\r\n");
+  Expect(head.rfind("HTTP/1.1 200", 0) == 0 && head.size() == head.find("\r\n\r\n") + 4, "HEAD has no body");
+
+  // Load test: same work with and without a scraper. Windows alternate so drift on the machine hits both alike
+  const int window_ms = 200;
+  const int windows = 10;
+  const int scrape_every_ms = 100;
+  std::vector<std::uint64_t> base;
+  std::vector<std::uint64_t> loaded;
+  std::vector<std::uint64_t> base_p99s;
+  std::vector<std::uint64_t> loaded_p99s;
+  base.reserve(static_cast<std::size_t>(window_ms * windows) * 20);
+  loaded.reserve(base.capacity());
+  RunStage(stage, *in, *out, 200, base);   // Warm up
+  base.clear();
+
+  std::atomic_bool scraping{false};
+  std::atomic_bool done{false};
+  std::atomic<std::uint64_t> scraped{0};
+  std::thread scraper([&] {
+    SetNice(19);  // A local scraper is another low-priority process on the unit
+    while (!done.load()) {
+      if (!scraping.load()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        continue;
+      }
+      const auto next = std::chrono::steady_clock::now() + std::chrono::milliseconds(scrape_every_ms);
+      if (!Fetch(server.port(), "GET /metrics HTTP/1.1\r\n\r\n").empty()) scraped.fetch_add(1);
+      std::this_thread::sleep_until(next);
+    }
+  });
+  for (int w = 0; w < windows; ++w) {
+    RunWindow(stage, *in, *out, window_ms, base, base_p99s);
+    scraping.store(true);
+    RunWindow(stage, *in, *out, window_ms, loaded, loaded_p99s);
+    scraping.store(false);
+  }
+  done.store(true);
+  scraper.join();
+  std::sort(base.begin(), base.end());
+  std::sort(loaded.begin(), loaded.end());
+  std::sort(base_p99s.begin(), base_p99s.end());
+  std::sort(loaded_p99s.begin(), loaded_p99s.end());
+  const std::uint64_t base_p99 = base_p99s[base_p99s.size() / 2];
+  const std::uint64_t loaded_p99 = loaded_p99s[loaded_p99s.size() / 2];
+
+  auto us = [](std::uint64_t ns) { return ns / 1000.0; };
+  std::cout << "stage item latency (us) without / with " << 1000 / scrape_every_ms << " scrapes/s over " << base.size()
+            << " / " << loaded.size() << " items:";
+  for (int p : {500, 900, 990, 999}) {
+    std::cout << " p" << p / 10.0 << " " << us(Pct(base, p)) << " / " << us(Pct(loaded, p)) << ",";
+  }
+  std::cout << " max " << us(base.back()) << " / " << us(loaded.back()) << ", median window p99 " << us(base_p99)
+            << " / " << us(loaded_p99) << ", " << scraped.load() << " scrapes, " << body.size() << " B each\n";
+  Expect(scraped.load() >= static_cast<std::uint64_t>(window_ms * windows / scrape_every_ms * 3 / 4),
+         "scrapes kept up across the window");
+  Expect(Pct(loaded, 500) <= Pct(base, 500) * 11 / 10 + 5000, "scraping leaves median stage latency within 10% + 5 us");
+  Expect(Pct(loaded, 900) <= Pct(base, 900) * 5 / 4 + 20000, "and p90 within 25% + 20 us");
+  Expect(loaded_p99 <= base_p99 * 5 / 4 + 20000, "and p99 (median over windows) within 25% + 20 us");
+
+  const std::string after = Fetch(server.port(), "GET /metrics HTTP/1.1\r\n\r\n");
+  const std::string total = std::to_string(stage->count.value());
+  Expect(after.find("dcp_stage_latency_seconds_count{stage=\"preprocess\",camera=\"front\"} " + total + "\n") != std::string::npos &&
+         after.find("dcp_stage_latency_seconds_bucket{stage=\"preprocess\",camera=\"front\",le=\"+Inf\"} " + total + "\n") != std::string::npos,
+         "histogram count matches items");
+
+  stop.request_stop();
+  serve.join();
+  Expect(server.scrapes() >= scraped.load(), "server counted the scrapes");
+
+  return TestResult();
+}
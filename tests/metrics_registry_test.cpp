@@ -0,0 +1,194 @@
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "infra/metrics.hpp"
+#include "test_util.hpp"
+
+// Checks the Metrics registry: idempotent and concurrent registration, sharded counters and histograms summed on read,
+// quantiles, callback series and type conflicts, the thread CPU/context-switch sampling stages report through
+// on_usage, and StageMetrics::Item reporting an item when its scope ends. Exits non-zero on failure
+
+static const dcp::MetricFamily* FindFamily(const dcp::Metrics& metrics, const std::string& name) {
+  const dcp::MetricFamily* found = nullptr;
+  metrics.for_each_family([&](const dcp::MetricFamily& f) {
+    if (f.name == name) found = &f;
+  });
+  return found;
+}
+
+int main() {
+  dcp::Metrics metrics;
+
+  // Same name and labels, same series
+  auto& a = metrics.counter("dcp_test_total", "Test.", {{"worker", "0"}});
+  auto& b = metrics.counter("dcp_test_total", "Test.", {{"worker", "0"}});
+  auto& c = metrics.counter("dcp_test_total", "Test.", {{"worker", "1"}});
+  Expect(&a == &b && &a != &c, "registration is idempotent per name and labels");
+
+  // Writers on every shard, one total
+  const int threads = 16;
+  const int adds = 100000;
+  {
+    std::vector<std::thread> ts;
+    for (int t = 0; t < threads; ++t) {
+      ts.emplace_back([&] {
+        for (int i = 0; i < adds; ++i) a.add();
+      });
+    }
+    for (auto& t : ts) t.join();
+  }
+  Expect(a.value() == static_cast<std::uint64_t>(threads) * adds, "counter shards sum to every add");
+
+  // Threads registering (and writing) the same and their own series at once
+  {
+    std::vector<std::thread> ts;
+    std::vector<dcp::Counter*> shared(threads);
+    for (int t = 0; t < threads; ++t) {
+      ts.emplace_back([&, t] {
+        shared[static_cast<std::size_t>(t)] = &metrics.counter("dcp_race_total", "Race.", {{"camera", "front"}});
+        metrics.counter("dcp_race_total", "Race.", {{"camera", "cam" + std::to_string(t)}}).add(2);
+        metrics.make_stage("stage" + std::to_string(t), {{"stage", "preprocess"}, {"worker", std::to_string(t)}})->on_item(1000);
+        shared[static_cast<std::size_t>(t)]->add();
+      });
+    }
+    for (auto& t : ts) t.join();
+    bool same = true;
+    for (auto* p : shared) same = same && p == shared[0];
+    Expect(same && shared[0]->value() == static_cast<std::uint64_t>(threads), "concurrent registration shares one series");
+    const auto* f = FindFamily(metrics, "dcp_race_total");
+    Expect(f && f->series.size() == static_cast<std::size_t>(threads) + 1, "and adds one per new label set");
+    Expect(metrics.stage_count() == static_cast<std::size_t>(threads), "concurrent make_stage");
+    const auto* items = FindFamily(metrics, "dcp_stage_items_total");
+    Expect(items && items->series.size() == static_cast<std::size_t>(threads) && items->series[0]->labels.size() == 2,
+           "stage series carry the given labels");
+  }
+
+  // Histogram: bucket edges, sum, sharded writers, quantile
+  {
+    auto& h = metrics.histogram("dcp_test_seconds", "Test.", {}, {10, 20, 40}, 1e-9);
+    h.observe(0);
+    h.observe(10);   // <= 10
+    h.observe(11);   // <= 20
+    h.observe(40);   // <= 40
+    h.observe(41);   // +Inf
+    std::vector<std::uint64_t> counts;
+    const auto sum = h.read(counts);
+    Expect(counts == std::vector<std::uint64_t>({2, 1, 1, 1}) && sum == 102, "histogram buckets are upper-inclusive, sum kept");
+
+    auto& h2 = metrics.histogram("dcp_test_seconds", "Test.", {{"stage", "x"}}, {1, 2, 3});
+    Expect(h2.bounds() == h.bounds(), "a family's series share its first buckets");
+
+    std::vector<std::thread> ts;
+    for (int t = 0; t < 8; ++t) {
+      ts.emplace_back([&] {
+        for (int i = 0; i < 10000; ++i) h2.observe(static_cast<std::uint64_t>(i % 40));
+      });
+    }
+    for (auto& t : ts) t.join();
+    h2.read(counts);
+    std::uint64_t n = 0;
+    for (const auto x : counts) n += x;
+    Expect(n == 80000, "histogram shards sum to every observation");
+
+    const std::vector<std::uint64_t> bounds{100, 200, 400};
+    Expect(std::abs(dcp::HistogramQuantile(bounds, {0, 100, 0, 0}, 0.5) - 150.0) < 1e-9, "quantile interpolates inside the bucket");
+    Expect(dcp::HistogramQuantile(bounds, {0, 0, 0, 5}, 0.99) == 400.0, "quantile past the last bound is the last bound");
+    Expect(dcp::HistogramQuantile(bounds, {0, 0, 0, 0}, 0.99) == 0.0, "quantile of nothing is 0");
+  }
+
+  // Stage bundles: latency into the histogram and EWMA, idle as a callback
+  {
+    auto* s = metrics.make_stage("tracking");
+    s->on_item(3'000'000);
+    std::vector<std::uint64_t> counts;
+    s->latency_hist.read(counts);
+    Expect(s->count.value() == 1 && s->avg_latency_ns.value() == 3'000'000 && counts[6] == 1, "on_item feeds count, EWMA and histogram");
+    Expect(s->labels == dcp::MetricLabels({{"stage", "tracking"}}), "stage label defaults to the name");
+    const auto* idle = FindFamily(metrics, "dcp_stage_idle_seconds");
+    Expect(idle && idle->type == dcp::MetricType::Gauge && !idle->series.empty() && idle->series[0]->fn, "idle is a callback gauge");
+  }
+
+  // Thread usage: a spin is CPU, a sleep is wall time and a voluntary switch. 1-CPU boxes may preempt either
+  {
+    using namespace std::chrono;
+    auto* s = metrics.make_stage("usage");
+    const auto u0 = dcp::ThreadUsageNow();
+    const auto spin_until = steady_clock::now() + milliseconds(50);
+    volatile std::uint64_t x = 0;
+    while (steady_clock::now() < spin_until) x = x + 1;
+    const auto spun = dcp::ThreadUsageNow() - u0;
+    std::this_thread::sleep_for(milliseconds(50));
+    const auto slept = dcp::ThreadUsageNow() - u0 - spun;
+    s->on_usage(spun);
+    s->on_usage(slept);
+    std::cout << "spin 50 ms: cpu " << spun.cpu_ns / 1e6 << " ms, sleep 50 ms: cpu " << slept.cpu_ns / 1e6 << " ms, "
+              << slept.voluntary_switches << " voluntary / " << spun.involuntary_switches + slept.involuntary_switches << " involuntary switches\n";
+#if defined(__linux__)
+    Expect(spun.cpu_ns > 25'000'000 && slept.cpu_ns < 10'000'000, "thread CPU counts a spin, not a sleep");
+    Expect(slept.voluntary_switches >= 1, "a sleep is a voluntary switch");
+    Expect(s->cpu_ns_total.value() == spun.cpu_ns + slept.cpu_ns &&
+           s->voluntary_switches.value() == spun.voluntary_switches + slept.voluntary_switches, "on_usage adds up");
+#endif
+  }
+
+  // Item: one report per scope, to a second bundle too, none when cancelled, only timing for a null stage
+  {
+    auto* stage = metrics.make_stage("item_stage");
+    auto* total = metrics.make_stage("item_total");
+    {
+      dcp::StageMetrics::Item item(stage);
+      item.also_report_to(total);
+      item.set_capture_time(dcp::SteadyClock::now() - std::chrono::milliseconds(50));
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    Expect(stage->count.value() == 1 && total->count.value() == 1, "item reported once to each bundle");
+    Expect(stage->work_ns_total.value() >= 2'000'000 && stage->work_ns_total.value() == total->work_ns_total.value(),
+           "item latency covers the scope");
+    Expect(stage->avg_age_ns.value() >= 50'000'000, "item age from the capture time");
+    Expect(stage->cpu_ns_total.value() > 0 || stage->voluntary_switches.value() > 0, "item sampled thread usage");
+    {
+      dcp::StageMetrics::Item item(stage);
+      Expect(item.finish() > 0 && item.finish() == 0, "finish reports once");
+    }
+    {
+      dcp::StageMetrics::Item item(stage);
+      item.cancel();
+    }
+    Expect(stage->count.value() == 2, "finished early counts once, cancelled not at all");
+    dcp::StageMetrics::Item timing_only(nullptr);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    Expect(timing_only.finish() >= 1'000'000, "null stage still times the item");
+  }
+
+  // Callback series and conflicts
+  {
+    std::uint64_t depth = 3;
+    metrics.callback(dcp::MetricType::Gauge, "dcp_test_depth", "Test.", {{"queue", "q"}}, [&depth]() { return depth; });
+    depth = 5;
+    const auto* f = FindFamily(metrics, "dcp_test_depth");
+    Expect(f && f->series[0]->value() == 5.0, "callback series read at collection time");
+
+    bool threw = false;
+    try {
+      metrics.gauge("dcp_test_total", "Test.");
+    } catch (const std::logic_error&) {
+      threw = true;
+    }
+    Expect(threw, "same name with another type throws");
+    threw = false;
+    try {
+      metrics.gauge("dcp_test_depth", "Test.", {{"queue", "q"}});
+    } catch (const std::logic_error&) {
+      threw = true;
+    }
+    Expect(threw, "stored series over a callback throws");
+  }
+
+  return TestResult();
+}
@@ -0,0 +1,81 @@
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "infra/metrics.hpp"
+#include "infra/perf_counters.hpp"
+#include "test_util.hpp"
+
+// Checks the opt-in hardware counters: nothing is sampled or registered while off, and once on a spin loop either
+// counts cycles and instructions (and lands in the stage's series), or perf is unavailable here and every sample is 0
+// with a reason. Passes both ways, since CI runners often restrict perf. Exits non-zero on failure
+
+static std::uint64_t Spin(std::uint64_t n) {
+  volatile std::uint64_t x = 0;
+  for (std::uint64_t i = 0; i < n; ++i) x = x + i * 3;
+  return x;
+}
+
+int main() {
+  // Differences: multiplexing is scaled by the interval's own ratio, and a counter never goes below 0
+  {
+    const dcp::PerfSample a{1000, 2000, 10, 20, 1000, 1000};  // Always on the PMU so far
+    const dcp::PerfSample b{1500, 3000, 15, 30, 2000, 1500};  // On for half of the next 1000 ns
+    const auto d = b - a;
+    Expect(d.cycles == 1000 && d.instructions == 2000 && d.llc_misses == 10 && d.branch_misses == 20,
+           "multiplexed interval scaled by its enabled/running");
+    const auto back = a - b;
+    Expect(back.cycles == 0 && back.instructions == 0 && back.time_enabled == 0, "differences clamp at 0");
+    const dcp::PerfSample scaled_now{10, 20, 1, 2}, scaled_before{4, 5, 1, 1};
+    Expect((scaled_now - scaled_before).instructions == 15, "already scaled totals subtract as is");
+  }
+
+  // Off: no series, zero samples
+  {
+    dcp::Metrics metrics;
+    auto* m = metrics.make_stage("off");
+    Expect(!m->cycles && !m->instructions, "no perf series while disabled");
+    Expect(dcp::ThreadPerfNow().cycles == 0, "no samples while disabled");
+    Expect(dcp::PerfCountersStatus() == "off", "status is off");
+  }
+
+  dcp::EnablePerfCounters(true);
+  dcp::Metrics metrics;
+  auto* m = metrics.make_stage("spin");
+  Expect(m->cycles && m->instructions && m->llc_misses && m->branch_misses, "perf series registered once enabled");
+
+  const auto p0 = dcp::ThreadPerfNow();
+  Spin(5000000);
+  const auto d = dcp::ThreadPerfNow() - p0;
+  m->on_perf(d);
+  const std::string status = dcp::PerfCountersStatus();
+  std::cout << "       status: " << status << "\n";
+
+  if (dcp::PerfCountersAvailable()) {
+    Expect(status == "on", "status is on");
+    Expect(d.instructions >= 5000000, "spin loop counts at least one instruction per iteration");
+    Expect(d.cycles > 0, "spin loop counts cycles");
+    const double ipc = d.cycles ? static_cast<double>(d.instructions) / static_cast<double>(d.cycles) : 0.0;
+    std::cout << "       ipc=" << ipc << " llc_misses=" << d.llc_misses << " branch_misses=" << d.branch_misses << "\n";
+    Expect(ipc > 0.0, "IPC is positive");
+    Expect(m->cycles->value() == d.cycles && m->instructions->value() == d.instructions, "on_perf adds to the stage");
+
+    // A second thread opens its own group and doesn't see this one's work
+    dcp::PerfSample other;
+    std::thread t([&other]() {
+      const auto q0 = dcp::ThreadPerfNow();
+      Spin(1000);
+      other = dcp::ThreadPerfNow() - q0;
+    });
+    t.join();
+    Expect(other.instructions > 0 && other.instructions < d.instructions, "counters are per thread");
+  } else {
+    Expect(status.rfind("unavailable", 0) == 0, "status says unavailable with a reason");
+    Expect(d.cycles == 0 && d.instructions == 0, "samples are 0 when unavailable");
+    Expect(m->cycles->value() == 0, "nothing added to the stage when unavailable");
+  }
+
+  dcp::EnablePerfCounters(false);
+  return TestResult();
+}
@@ -0,0 +1,68 @@
+#include <cstdint>
+#include <iostream>
+#include <optional>
+
+#include "core/preprocessed_frame.hpp"
+#include "infra/demand_signal.hpp"
+#include "infra/latest_store.hpp"
+#include "stages/preprocess_stage.hpp"
+#include "test_util.hpp"
+
+// Checks how pool workers publish inference frames when they finish out of order. Exits non-zero on failure
+
+namespace {
+
+dcp::PreprocessedFrame Make(std::uint64_t seq) {
+  dcp::PreprocessedFrame pf;
+  pf.source_frame_id = seq;
+  return pf;
+}
+
+// What InferenceStage does each iteration: consume the newest frame if there is one, then ask for the next
+bool Consume(dcp::LatestStore<dcp::PreprocessedFrame>& store, dcp::DemandSignal& demand, std::uint64_t& last_seen,
+             std::uint64_t& got) {
+  std::optional<dcp::PreprocessedFrame> pf = store.read_if_newer(last_seen);
+  if (!pf) return false;
+  got = pf->source_frame_id;
+  demand.request();
+  return true;
+}
+
+} // namespace
+
+int main() {
+  dcp::LatestStore<dcp::PreprocessedFrame> store;
+  dcp::DemandSignal demand;
+  std::uint64_t last_seen = 0;
+  std::uint64_t got = 0;
+
+  // In order: the worker holding the ticket publishes and inference gets its frame
+  Expect(demand.try_take(0), "worker for seq 2 takes the first ticket");
+  Expect(dcp::PublishIfNewer(store, &demand, Make(2), 2), "seq 2 published");
+  Expect(!demand.armed(), "ticket consumed");
+  Expect(Consume(store, demand, last_seen, got) && got == 2, "inference got seq 2 and asked again");
+
+  // Out of order: seq 1 was popped before seq 2 but its worker is slow. It takes the new ticket after seq 2 was
+  // published, so its frame is dropped. The ticket has to come back, otherwise nobody builds a frame for inference
+  // again and the stream stalls
+  Expect(demand.try_take(0), "slow worker for seq 1 takes the ticket");
+  Expect(!dcp::PublishIfNewer(store, &demand, Make(1), 1), "seq 1 dropped behind seq 2");
+  Expect(demand.armed(), "ticket handed back after the drop");
+  Expect(!Consume(store, demand, last_seen, got), "nothing new for inference yet");
+
+  // The next worker takes the returned ticket and inference carries on
+  Expect(demand.try_take(0), "worker for seq 3 takes the returned ticket");
+  Expect(dcp::PublishIfNewer(store, &demand, Make(3), 3), "seq 3 published");
+  Expect(Consume(store, demand, last_seen, got) && got == 3, "inference got seq 3");
+
+  // Without a demand signal (every frame is built) a drop just drops
+  {
+    dcp::LatestStore<dcp::PreprocessedFrame> s;
+    Expect(dcp::PublishIfNewer(s, nullptr, Make(5), 5), "seq 5 published without demand");
+    Expect(!dcp::PublishIfNewer(s, nullptr, Make(4), 4), "seq 4 dropped without demand");
+    const std::optional<dcp::PreprocessedFrame> pf = s.read_latest();
+    Expect(pf && pf->source_frame_id == 5, "store still holds seq 5");
+  }
+
+  return TestResult();
+}
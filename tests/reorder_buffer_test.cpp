@@ -0,0 +1,68 @@
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include "infra/reorder_buffer.hpp"
+#include "test_util.hpp"
+
+// Checks in-order release, gap handling, window-forced release and late drops. Exits non-zero on failure
+
+int main() {
+  using namespace std::chrono_literals;
+
+  std::vector<int> out;
+  auto emit = [&](int v, std::uint64_t) { out.push_back(v); };
+
+  // Out of order completion is released in order
+  {
+    dcp::ReorderBuffer<int> rb(8, 1s);
+    out.clear();
+    rb.begin(1); rb.begin(2); rb.begin(3);
+    rb.complete(3, 3, 0, emit);
+    rb.complete(2, 2, 0, emit);
+    Expect(out.empty(), "held while seq 1 in flight");
+    rb.complete(1, 1, 0, emit);
+    Expect((out == std::vector<int>{1, 2, 3}), "released 1,2,3 in order");
+  }
+
+  // Gaps from upstream drops don't stall anything: seq 5 was never taken
+  {
+    dcp::ReorderBuffer<int> rb(8, 1s);
+    out.clear();
+    rb.begin(4); rb.begin(6);
+    rb.complete(6, 6, 0, emit);
+    rb.complete(4, 4, 0, emit);
+    Expect((out == std::vector<int>{4, 6}), "gap does not block release");
+  }
+
+  // Window forces release past a straggler, which is then dropped as late
+  {
+    dcp::ReorderBuffer<int> rb(2, 1s);
+    out.clear();
+    for (int s = 10; s <= 13; ++s) rb.begin(s);
+    rb.complete(11, 11, 0, emit);
+    rb.complete(12, 12, 0, emit);
+    Expect(out.empty(), "window not exceeded yet");
+    rb.complete(13, 13, 0, emit);
+    // Once 11 is forced out, 10 can only be late, so it no longer blocks 12 and 13
+    Expect((out == std::vector<int>{11, 12, 13}), "window exceeded releases past straggler");
+    Expect(rb.forced_total() == 1, "forced release counted");
+    Expect(!rb.complete(10, 10, 0, emit), "straggler dropped as late");
+    Expect(rb.late_drops_total() == 1, "late drop counted");
+  }
+
+  // max_wait releases without any further completions
+  {
+    dcp::ReorderBuffer<int> rb(8, 5ms);
+    out.clear();
+    rb.begin(1); rb.begin(2);
+    rb.complete(2, 2, 0, emit);
+    rb.drain(1'000'000, emit);
+    Expect(out.empty(), "held before max_wait");
+    rb.drain(6'000'000, emit);
+    Expect((out == std::vector<int>{2}), "released after max_wait");
+  }
+
+  return TestResult();
+}
@@ -0,0 +1,113 @@
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "infra/shm_channel.hpp"
+#include "test_util.hpp"
+
+// Checks in-order reads and overrun counting on both rings, view invalidation when the writer laps a frame, and a
+// forked reader that never accepts a torn frame while the writer keeps publishing. Exits non-zero on failure
+
+static void PublishWorld(dcp::ShmWriter& w, std::uint64_t frame_id, std::uint32_t tracks) {
+  dcp::ShmWorldRecord rec{};
+  rec.frame_id = frame_id;
+  rec.track_count = tracks;
+  for (std::uint32_t i = 0; i < tracks; ++i) rec.tracks[i].id = frame_id * 1000 + i;
+  w.publish_world(rec);
+}
+
+// Every byte of frame n is n & 0xff, so a frame mixing two publications is easy to spot
+static void PublishFrame(dcp::ShmWriter& w, std::uint64_t n, std::size_t bytes) {
+  std::uint8_t* px = w.begin_frame();
+  std::memset(px, static_cast<int>(n & 0xff), bytes);
+  dcp::ShmFrameInfo info{};
+  info.sequence_id = n;
+  info.width = static_cast<std::int32_t>(bytes);
+  info.height = 1;
+  info.stride = static_cast<std::int32_t>(bytes);
+  info.bytes = bytes;
+  w.commit_frame(info);
+}
+
+int main() {
+  const std::string name = "/dcp_shm_test_" + std::to_string(::getpid());
+  constexpr std::size_t kBytes = 64 * 1024;
+
+  {
+    bool threw = false;
+    try {
+      dcp::ShmReader missing(name);
+    } catch (const std::runtime_error&) {
+      threw = true;
+    }
+    Expect(threw, "reader refuses a missing object");
+  }
+
+  // World ring: the reader starts at the newest record, then walks in order and counts what it missed
+  {
+    dcp::ShmWriter w(name, 4, 2, kBytes);
+    dcp::ShmReader r(name);
+    dcp::ShmWorldRecord rec{};
+    Expect(r.next_world(rec) == dcp::ShmRead::Empty, "nothing published yet");
+
+    for (std::uint64_t f = 1; f <= 3; ++f) PublishWorld(w, f, 2);
+    Expect(r.next_world(rec) == dcp::ShmRead::Ok && rec.frame_id == 3, "starts at the newest");
+    Expect(rec.track_count == 2 && rec.tracks[1].id == 3001, "tracks copied");
+    Expect(r.next_world(rec) == dcp::ShmRead::Empty, "then nothing new");
+
+    for (std::uint64_t f = 4; f <= 13; ++f) PublishWorld(w, f, 1);
+    Expect(r.next_world(rec) == dcp::ShmRead::Ok && rec.frame_id == 10, "lapped reader resumes at the oldest kept");
+    Expect(r.world_overruns() == 6, "overrun counts the records it missed");
+    std::uint64_t last = rec.frame_id;
+    while (r.next_world(rec) == dcp::ShmRead::Ok) last = rec.frame_id;
+    Expect(last == 13, "reads up to the newest");
+    Expect(r.latest_world(rec) == dcp::ShmRead::Ok && rec.index == 13, "latest is the newest index");
+
+    // Frame views stay valid until the writer comes back around to their slot
+    PublishFrame(w, 1, kBytes);
+    dcp::ShmFrameView v;
+    Expect(r.latest_frame(v) == dcp::ShmRead::Ok && v.pixels[0] == 1 && v.valid(), "zero-copy view of the newest frame");
+    PublishFrame(w, 2, kBytes);
+    Expect(v.valid(), "view survives a publish into the other slot");
+    PublishFrame(w, 3, kBytes);
+    Expect(!v.valid(), "view invalid once its slot is rewritten");
+    Expect(r.writer_alive(), "heartbeat fresh");
+  }
+
+  // Another process reading while this one writes as fast as it can: every accepted frame is whole
+  {
+    dcp::ShmWriter w(name, 8, 3, kBytes);
+    PublishFrame(w, 1, kBytes);
+
+    const pid_t child = ::fork();
+    if (child == 0) {
+      int bad = 0;
+      std::uint64_t accepted = 0;
+      dcp::ShmReader r(name);
+      while (accepted < 2000) {
+        dcp::ShmFrameView v;
+        if (r.latest_frame(v) != dcp::ShmRead::Ok) continue;
+        const std::uint8_t first = v.pixels[0];
+        bool uniform = true;
+        for (std::size_t i = 0; i < v.info.bytes; i += 997) uniform = uniform && v.pixels[i] == first;
+        uniform = uniform && v.pixels[v.info.bytes - 1] == first;
+        if (!v.valid()) continue;   // Lapped while reading, discarded
+        if (!uniform || first != static_cast<std::uint8_t>(v.info.sequence_id & 0xff)) ++bad;
+        ++accepted;
+      }
+      ::_exit(bad == 0 ? 0 : 1);
+    }
+
+    int status = 0;
+    std::uint64_t n = 2;
+    while (::waitpid(child, &status, WNOHANG) == 0) PublishFrame(w, n++, kBytes);
+    Expect(WIFEXITED(status) && WEXITSTATUS(status) == 0, "forked reader never accepted a torn frame");
+  }
+
+  return TestResult();
+}
@@ -0,0 +1,106 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "infra/shm_channel.hpp"
+#include "infra/shm_infer_channel.hpp"
+#include "test_util.hpp"
+
+// Runs a fake worker in a child process and checks the request/response round trip, that a worker dying mid-request
+// leaves the channel usable for its replacement (which ignores the stale request), and shutdown. Prints the round trip
+// latency, the IPC cost InferenceWorker adds on top of the model. Exits non-zero on failure
+
+// Answers every request with one detection per frame whose x is the frame's first pixel. With crash_after > 0 it
+// exits without answering the request after that many
+static int FakeWorker(const std::string& name, int crash_after) {
+  dcp::ShmInferServer server(name);
+  server.set_ready(true);
+  int answered = 0;
+  while (!server.shutdown_requested()) {
+    if (!server.wait_request(100'000'000)) continue;
+    if (crash_after > 0 && answered == crash_after) ::_exit(3);
+    const std::size_t n = server.request_count();
+    for (std::size_t k = 0; k < n; ++k) {
+      server.detections(k)[0] = dcp::ShmDetection{static_cast<float>(server.pixels(k)[0]), 0.f, 1.f, 1.f, 2, 0.9f};
+      server.result(k) = dcp::ShmInferResult{server.frame(k).source_frame_id, 1, 0};
+    }
+    server.complete(n, 0, 0);
+    ++answered;
+  }
+  return 0;
+}
+
+static pid_t StartWorker(dcp::ShmInferClient& client, int crash_after) {
+  client.reset_worker();
+  const pid_t pid = ::fork();
+  if (pid == 0) ::_exit(FakeWorker(client.name(), crash_after));
+  while (client.worker_state() != dcp::ShmWorkerState::Ready) ::usleep(1000);
+  return pid;
+}
+
+static std::uint32_t Submit(dcp::ShmInferClient& client, std::uint64_t id, std::size_t batch) {
+  for (std::size_t k = 0; k < batch; ++k) {
+    std::memset(client.pixels(k), static_cast<int>((id + k) & 0xff), 640 * 3);
+    client.frame(k).source_frame_id = id + k;
+    client.frame(k).bytes = 640 * 3;
+  }
+  return client.submit(batch);
+}
+
+int main() {
+  const std::string name = "/dcp_infer_test_" + std::to_string(::getpid());
+  dcp::ShmInferClient client(name, 4, 640 * 360 * 3, 16);
+
+  // Round trips against a live worker
+  pid_t pid = StartWorker(client, 0);
+  std::vector<std::int64_t> rtt;
+  bool all_ok = true;
+  for (std::uint64_t i = 1; i <= 2000; ++i) {
+    const std::size_t batch = (i % 4) + 1;
+    const std::int64_t t0 = dcp::ShmNowNs();
+    const std::uint32_t seq = Submit(client, i * 10, batch);
+    const bool got = client.wait_response(seq, 1'000'000'000);
+    rtt.push_back(dcp::ShmNowNs() - t0);
+    all_ok = all_ok && got && client.status() == 0 && client.response_count() == batch;
+    for (std::size_t k = 0; got && k < batch; ++k) {
+      all_ok = all_ok && client.result(k).source_frame_id == i * 10 + k && client.result(k).detection_count == 1 &&
+               client.detections(k)[0].x == static_cast<float>((i * 10 + k) & 0xff);
+    }
+  }
+  Expect(all_ok, "2000 requests answered with the right frames and detections");
+  std::sort(rtt.begin(), rtt.end());
+  std::cout << "round trip p50 " << rtt[rtt.size() / 2] / 1000.0 << " us, p99 " << rtt[rtt.size() * 99 / 100] / 1000.0
+            << " us, batches of 1-4 frames of 640x3 bytes\n";
+
+  client.request_shutdown();
+  int status = 0;
+  ::waitpid(pid, &status, 0);
+  Expect(WIFEXITED(status) && WEXITSTATUS(status) == 0, "worker exits when asked");
+
+  // A worker that dies mid-request: no response, and its replacement doesn't answer the stale request
+  pid = StartWorker(client, 2);
+  Expect(client.wait_response(Submit(client, 100, 1), 1'000'000'000), "first request answered");
+  Expect(client.wait_response(Submit(client, 200, 1), 1'000'000'000), "second request answered");
+  const std::uint32_t lost = Submit(client, 300, 1);
+  Expect(!client.wait_response(lost, 200'000'000), "crashed worker leaves the request unanswered");
+  ::waitpid(pid, &status, 0);
+  Expect(WIFEXITED(status) && WEXITSTATUS(status) == 3, "worker gone");
+
+  pid = StartWorker(client, 0);
+  ::usleep(50'000);
+  Expect(client.result(0).source_frame_id == 200, "replacement ignores the stale request");
+  const std::uint32_t seq = Submit(client, 400, 2);
+  Expect(client.wait_response(seq, 1'000'000'000) && client.result(1).source_frame_id == 401, "replacement answers new requests");
+
+  client.request_shutdown();
+  ::waitpid(pid, &status, 0);
+  Expect(WIFEXITED(status) && WEXITSTATUS(status) == 0, "replacement exits when asked");
+
+  return TestResult();
+}
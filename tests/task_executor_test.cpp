@@ -0,0 +1,133 @@
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "infra/bounded_queue.hpp"
+#include "infra/task_executor.hpp"
+#include "stages/stage.hpp"
+#include "test_util.hpp"
+
+// Checks that the executor runs every task, steals, serves the high lane first, and that a task-mode stage
+// drains its input exactly once and never runs on two workers at the same time. Exits non-zero on failure
+
+template <typename Pred>
+static bool WaitFor(Pred pred, std::chrono::milliseconds timeout) {
+  const auto deadline = std::chrono::steady_clock::now() + timeout;
+  while (!pred()) {
+    if (std::chrono::steady_clock::now() > deadline) return false;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return true;
+}
+
+// Sums its input. Counts overlapping step() calls, which task scheduling must never allow
+class SumStage final : public dcp::Stage {
+public:
+  explicit SumStage(std::shared_ptr<dcp::BoundedQueue<int>> in) : Stage("sum_stage"), in_(std::move(in)) {}
+
+  std::atomic<std::int64_t> sum{0};
+  std::atomic<int> items{0};
+  std::atomic<int> overlaps{0};
+
+protected:
+  void run(const dcp::StopToken& global, const std::atomic_bool& local) override {
+    while (!global.stop_requested() && !local.load()) {
+      int v;
+      if (in_->try_pop_for(v, std::chrono::milliseconds(5))) add(v);
+    }
+  }
+
+  bool supports_tasks() const override { return true; }
+  void bind_wake(std::function<void()> wake) override { in_->set_on_push(std::move(wake)); }
+  bool step() override {
+    int v;
+    if (!in_->try_pop(v)) return false;
+    add(v);
+    return true;
+  }
+
+private:
+  void add(int v) {
+    if (inside_.exchange(true)) ++overlaps;
+    sum += v;
+    ++items;
+    inside_.store(false);
+  }
+
+  std::shared_ptr<dcp::BoundedQueue<int>> in_;
+  std::atomic_bool inside_{false};
+};
+
+int main() {
+  using namespace std::chrono_literals;
+
+  // Every task runs once
+  {
+    dcp::TaskExecutor ex(4);
+    std::atomic<int> ran{0};
+    for (int i = 0; i < 1000; ++i) ex.submit(dcp::TaskPriority::Normal, [&] { ++ran; });
+    Expect(WaitFor([&] { return ran.load() == 1000; }, 2000ms), "1000 tasks ran");
+    Expect(ex.executed_total() == 1000, "executed_total matches");
+  }
+
+  // A task that fans out from one worker gets its children stolen by the others
+  {
+    dcp::TaskExecutor ex(4);
+    std::atomic<int> ran{0};
+    ex.submit(dcp::TaskPriority::Normal, [&] {
+      for (int i = 0; i < 64; ++i) {
+        ex.submit(dcp::TaskPriority::Normal, [&] { std::this_thread::sleep_for(1ms); ++ran; });
+      }
+    });
+    Expect(WaitFor([&] { return ran.load() == 64; }, 2000ms), "fan-out tasks ran");
+    Expect(ex.stolen_total() > 0, "some fan-out tasks were stolen");
+  }
+
+  // With one worker busy, queued high priority work runs before earlier normal work
+  {
+    dcp::TaskExecutor ex(1);
+    std::atomic_bool release{false};
+    std::mutex mu;
+    std::vector<int> order;
+    ex.submit(dcp::TaskPriority::Normal, [&] { while (!release.load()) std::this_thread::sleep_for(1ms); });
+    std::this_thread::sleep_for(10ms);
+    for (int i = 0; i < 3; ++i) ex.submit(dcp::TaskPriority::Normal, [&, i] { std::lock_guard<std::mutex> l(mu); order.push_back(i); });
+    ex.submit(dcp::TaskPriority::High, [&] { std::lock_guard<std::mutex> l(mu); order.push_back(100); });
+    release.store(true);
+    Expect(WaitFor([&] { std::lock_guard<std::mutex> l(mu); return order.size() == 4; }, 2000ms), "all lane tasks ran");
+    std::lock_guard<std::mutex> l(mu);
+    Expect(!order.empty() && order.front() == 100, "high lane served first");
+  }
+
+  // Task-mode stage drains several producers exactly once, one step at a time
+  {
+    dcp::StopSource stop;
+    dcp::TaskExecutor ex(4);
+    auto q = std::make_shared<dcp::BoundedQueue<int>>(100000, dcp::DropPolicy::DropNewest);
+    SumStage stage(q);
+    stage.start(stop.token(), ex, dcp::TaskPriority::High);
+    Expect(stage.task_mode(), "stage runs as a task");
+
+    std::vector<std::thread> producers;
+    for (int p = 0; p < 4; ++p) {
+      producers.emplace_back([&] { for (int i = 1; i <= 5000; ++i) q->try_push(i); });
+    }
+    for (auto& t : producers) t.join();
+
+    Expect(WaitFor([&] { return stage.items.load() == 20000; }, 5000ms), "all items processed");
+    Expect(stage.sum.load() == 4ll * 5000 * 5001 / 2, "sum matches");
+    Expect(stage.overlaps.load() == 0, "never ran on two workers at once");
+
+    stage.stop();
+    q->try_push(1);
+    std::this_thread::sleep_for(10ms);
+    Expect(stage.items.load() == 20000, "no work after stop");
+  }
+
+  return TestResult();
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+
+// Shared by the self-checking tests: Expect() prints one [ok]/[FAIL] line per check, TestResult() prints the verdict
+// and is main's return value, non-zero if any check failed, which is what CTest looks at
+
+inline int g_failures = 0;
+
+inline void Expect(bool ok, const std::string& what) {
+  std::cout << (ok ? "[ok]   " : "[FAIL] ") << what << "\n";
+  if (!ok) ++g_failures;
+}
+
+inline int TestResult() {
+  std::cout << (g_failures == 0 ? "all passed" : "FAILED") << "\n";
+  return g_failures == 0 ? 0 : 1;
+}
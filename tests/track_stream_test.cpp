@@ -0,0 +1,328 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "core/track_stream.hpp"
+#include "infra/unix_stream_server.hpp"
+#include "test_util.hpp"
+
+// Checks the track stream end to end: decoded tracks stay within half a quantization step of the real ones over a
+// long random walk, unchanged tracks cost nothing, a keyframe joins the delta stream bit for bit, and through the
+// socket a stalled subscriber loses its backlog and comes back on a keyframe while a live one sees every delta.
+// Prints the encode cost and message sizes. Exits non-zero on failure
+
+static bool SameTracks(const std::vector<dcp::TrackFullRecord>& a, const std::vector<dcp::TrackFullRecord>& b) {
+  if (a.size() != b.size()) return false;
+  for (const auto& r : a) {
+    auto it = std::find_if(b.begin(), b.end(), [&](const dcp::TrackFullRecord& s) { return s.id == r.id; });
+    if (it == b.end() || std::memcmp(&r, &*it, sizeof(r)) != 0) return false;
+  }
+  return true;
+}
+
+// Worst distance between the decoded set and the real one, infinity if the ids don't match
+static double MaxError(const dcp::WorldState& ws, const std::vector<dcp::TrackFullRecord>& decoded) {
+  if (ws.tracks.size() != decoded.size()) return INFINITY;
+  double worst = 0.0;
+  for (const dcp::Track& t : ws.tracks) {
+    auto it = std::find_if(decoded.begin(), decoded.end(), [&](const dcp::TrackFullRecord& r) { return r.id == t.id; });
+    if (it == decoded.end() || it->class_id != t.class_id || it->missed_frames != t.missed_frames) return INFINITY;
+    worst = std::max({worst, double(std::fabs(it->x - t.bbox.x)), double(std::fabs(it->y - t.bbox.y)),
+                      double(std::fabs(it->w - t.bbox.w)), double(std::fabs(it->h - t.bbox.h))});
+    if (std::fabs(it->confidence - t.confidence) > 0.5f / 255.f + 1e-6f) return INFINITY;
+  }
+  return worst;
+}
+
+// A scene where tracks drift, some stand still, some come and go
+class Scene {
+public:
+  explicit Scene(std::size_t tracks, std::uint32_t seed) : rng_(seed) {
+    for (std::size_t i = 0; i < tracks; ++i) add();
+  }
+
+  void step(bool move_all) {
+    std::uniform_real_distribution<float> jitter(-3.f, 3.f);
+    std::uniform_real_distribution<float> conf(0.3f, 1.f);
+    std::uniform_int_distribution<int> pick(0, 99);
+    for (std::size_t i = 0; i < ws_.tracks.size(); ++i) {
+      dcp::Track& t = ws_.tracks[i];
+      if (!move_all && t.id % 3 == 0) continue;   // Parked cars
+      t.bbox.x += jitter(rng_);
+      t.bbox.y += jitter(rng_);
+      t.bbox.w = std::max(4.f, t.bbox.w + jitter(rng_) * 0.2f);
+      t.bbox.h = std::max(4.f, t.bbox.h + jitter(rng_) * 0.2f);
+      t.confidence = conf(rng_);
+      t.missed_frames = pick(rng_) < 10 ? t.missed_frames + 1 : 0;
+      t.confirmed = t.age_frames++ > 3;
+      if (pick(rng_) == 0) t.bbox.x += 5000.f;   // Too far for a delta
+    }
+    if (pick(rng_) < 20 && !ws_.tracks.empty()) {
+      // Remove one, keep the rest in order
+      const std::size_t victim = static_cast<std::size_t>(pick(rng_)) % ws_.tracks.size();
+      dcp::FixedVector<dcp::Track, dcp::kMaxTracks> kept;
+      for (std::size_t i = 0; i < ws_.tracks.size(); ++i) {
+        if (i != victim) kept.push_back(ws_.tracks[i]);
+      }
+      ws_.tracks = kept;
+    }
+    if (pick(rng_) < 20) add();
+    ++ws_.frame_id;
+  }
+
+  const dcp::WorldState& world() const { return ws_; }
+
+private:
+  void add() {
+    if (ws_.tracks.full()) return;
+    std::uniform_real_distribution<float> pos(0.f, 1920.f);
+    dcp::Track t;
+    t.id = next_id_++;
+    t.bbox = dcp::BBoxF{pos(rng_), pos(rng_) * 0.5f, 40.f + pos(rng_) * 0.05f, 30.f + pos(rng_) * 0.05f};
+    t.class_id = static_cast<int>(t.id % 5);
+    t.confidence = 0.8f;
+    ws_.tracks.push_back(t);
+  }
+
+  std::mt19937 rng_;
+  dcp::WorldState ws_;
+  std::uint64_t next_id_{1};
+};
+
+static std::int64_t NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void TestCodec() {
+  Scene scene(60, 7);
+  dcp::TrackStreamEncoder enc;
+  dcp::TrackStreamDecoder live;    // Every message from the first keyframe on
+  dcp::TrackStreamDecoder late;    // Joins on a keyframe half way
+
+  scene.step(false);
+  enc.encode(scene.world(), 0);
+  const auto& k0 = enc.keyframe();
+  Expect(live.apply(k0.data(), k0.size()) == dcp::TrackStreamApply::Ok, "first keyframe applies");
+
+  double worst = 0.0;
+  bool in_sync = true;
+  for (int f = 0; f < 3000; ++f) {
+    scene.step(false);
+    const auto& delta = enc.encode(scene.world(), f);
+    in_sync = in_sync && live.apply(delta.data(), delta.size()) == dcp::TrackStreamApply::Ok;
+    if (f == 1500) {
+      const auto& key = enc.keyframe();
+      in_sync = in_sync && late.apply(key.data(), key.size()) == dcp::TrackStreamApply::Ok;
+    } else if (f > 1500) {
+      in_sync = in_sync && late.apply(delta.data(), delta.size()) == dcp::TrackStreamApply::Ok;
+    }
+    worst = std::max(worst, MaxError(scene.world(), live.tracks()));
+  }
+  Expect(in_sync, "3000 deltas apply in order");
+  Expect(worst <= 0.5 / 16.0 + 1e-3, "decoded boxes within 1/32 px over 3000 frames (worst " + std::to_string(worst) + ")");
+  Expect(SameTracks(live.tracks(), late.tracks()), "keyframe joiner matches the delta stream bit for bit");
+
+  // Nothing changed, nothing sent
+  dcp::WorldState still = scene.world();
+  still.frame_id += 1;
+  enc.encode(still, 0);
+  still.frame_id += 1;
+  const auto& idle = enc.encode(still, 0);
+  Expect(idle.size() == sizeof(dcp::TrackStreamHeader), "unchanged tracks cost no bytes (" + std::to_string(idle.size()) + " B message)");
+
+  // A gap is refused until the next keyframe
+  still.frame_id += 1;
+  enc.encode(still, 0);
+  still.frame_id += 1;
+  const auto skipped_to = enc.encode(still, 0);
+  Expect(live.apply(skipped_to.data(), skipped_to.size()) == dcp::TrackStreamApply::NeedKeyframe, "delta after a gap asks for a keyframe");
+  const auto& key = enc.keyframe();
+  Expect(live.apply(key.data(), key.size()) == dcp::TrackStreamApply::Ok && live.synced(), "keyframe resyncs");
+
+  std::vector<std::uint8_t> bad(key.begin(), key.end());
+  bad[0] ^= 0xff;
+  Expect(live.apply(bad.data(), bad.size()) == dcp::TrackStreamApply::Malformed, "bad magic is malformed");
+  Expect(live.apply(key.data(), key.size() - 4) == dcp::TrackStreamApply::Malformed, "truncated message is malformed");
+}
+
+// Ids past 32 bits: a moving track goes as full records, removal still matches the whole id
+static void TestWideIds() {
+  dcp::WorldState ws;
+  for (std::uint64_t id : {std::uint64_t{1} << 40, (std::uint64_t{1} << 40) + 1, std::uint64_t{5}}) {
+    dcp::Track t;
+    t.id = id;
+    t.bbox = dcp::BBoxF{100.f, 100.f, 40.f, 30.f};
+    t.class_id = 2;
+    t.confidence = 0.8f;
+    ws.tracks.push_back(t);
+  }
+
+  dcp::TrackStreamEncoder enc;
+  dcp::TrackStreamDecoder dec;
+  enc.encode(ws, 0);
+  const auto& key = enc.keyframe();
+  bool ok = dec.apply(key.data(), key.size()) == dcp::TrackStreamApply::Ok;
+
+  for (dcp::Track& t : ws.tracks) t.bbox.x += 3.f;
+  ws.frame_id = 1;
+  const auto& moved = enc.encode(ws, 0);
+  dcp::TrackStreamHeader h;
+  std::memcpy(&h, moved.data(), sizeof(h));
+  ok = ok && dec.apply(moved.data(), moved.size()) == dcp::TrackStreamApply::Ok;
+  Expect(ok && h.full_count == 2 && h.delta_count == 1, "wide ids move as full records, small ids as deltas");
+
+  // Drop the second wide id, it differs from the first only above bit 32
+  dcp::WorldState next = ws;
+  next.tracks.clear();
+  next.tracks.push_back(ws.tracks[0]);
+  next.tracks.push_back(ws.tracks[2]);
+  next.frame_id = 2;
+  const auto& removed = enc.encode(next, 0);
+  ok = dec.apply(removed.data(), removed.size()) == dcp::TrackStreamApply::Ok;
+  Expect(ok && MaxError(next, dec.tracks()) <= 0.5 / 16.0 + 1e-3, "removing a wide id removes only that track");
+}
+
+static void Bench() {
+  for (bool move_all : {false, true}) {
+    Scene scene(dcp::kMaxTracks, 11);
+    dcp::TrackStreamEncoder enc;
+    std::uint64_t bytes = 0;
+    const int frames = 20000;
+    std::int64_t encode_ns = 0;
+    for (int f = 0; f < frames; ++f) {
+      scene.step(move_all);
+      const std::int64_t s = NowNs();
+      bytes += enc.encode(scene.world(), f).size();
+      encode_ns += NowNs() - s;
+    }
+    std::cout << "encode " << scene.world().tracks.size() << " tracks" << (move_all ? ", all moving" : ", a third parked")
+              << ": " << encode_ns / frames << " ns/frame, " << bytes / frames << " B/frame vs "
+              << sizeof(dcp::TrackStreamHeader) + scene.world().tracks.size() * sizeof(dcp::TrackFullRecord) << " B keyframe\n";
+  }
+}
+
+static int Connect(const std::string& path) {
+  sockaddr_un addr{};
+  addr.sun_family = AF_UNIX;
+  std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+  const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (::connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0) {
+    ::close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Reads whatever is there without blocking and applies every whole message
+struct Subscriber {
+  int fd{-1};
+  std::vector<std::uint8_t> buf;
+  dcp::TrackStreamDecoder decoder;
+  int keyframes{0};
+  int deltas{0};
+  int refused{0};
+  int malformed{0};
+
+  bool drain() {
+    bool got = false;
+    for (;;) {
+      pollfd p{fd, POLLIN, 0};
+      if (::poll(&p, 1, 0) <= 0) return got;
+      std::uint8_t tmp[65536];
+      const ssize_t n = ::recv(fd, tmp, sizeof(tmp), 0);
+      if (n <= 0) return got;
+      got = true;
+      buf.insert(buf.end(), tmp, tmp + n);
+      std::size_t at = 0;
+      for (;;) {
+        const std::size_t size = dcp::TrackStreamDecoder::MessageSize(buf.data() + at, buf.size() - at);
+        if (size == 0 || buf.size() - at < size) break;
+        dcp::TrackStreamHeader h;
+        std::memcpy(&h, buf.data() + at, sizeof(h));
+        switch (decoder.apply(buf.data() + at, size)) {
+          case dcp::TrackStreamApply::Ok: (h.kind == 1 ? keyframes : deltas)++; break;
+          case dcp::TrackStreamApply::NeedKeyframe: ++refused; break;
+          case dcp::TrackStreamApply::Malformed: ++malformed; break;
+        }
+        at += size;
+      }
+      buf.erase(buf.begin(), buf.begin() + static_cast<std::ptrdiff_t>(at));
+    }
+  }
+};
+
+static void TestServer() {
+  const std::string path = "/tmp/dcp_track_stream_test_" + std::to_string(::getpid());
+  dcp::UnixStreamServer::Options opts;
+  opts.path = path;
+  opts.max_clients = 2;
+  opts.buffer_bytes = 16 * 1024;
+  dcp::UnixStreamServer server(opts);
+
+  Subscriber fast, stalled;
+  fast.fd = Connect(path);
+  stalled.fd = Connect(path);
+  const int extra = Connect(path);   // Past max_clients
+  server.poll();
+  Expect(fast.fd >= 0 && stalled.fd >= 0 && server.clients() == 2, "two subscribers accepted");
+  char c;
+  Expect(extra < 0 || ::recv(extra, &c, 1, 0) == 0, "third subscriber turned away");
+  if (extra >= 0) ::close(extra);
+
+  Scene scene(100, 3);
+  dcp::TrackStreamEncoder enc;
+  dcp::UnixStreamServer::KeyframeFn keyframe = [&enc]() -> const std::vector<std::uint8_t>& { return enc.keyframe(); };
+
+  // Everything moves, about 1.6 KB per frame: the stalled one fills the kernel buffer and then its own 16 KB
+  for (int f = 0; f < 1500; ++f) {
+    scene.step(true);
+    server.publish(enc.encode(scene.world(), f), keyframe);
+    fast.drain();
+  }
+  Expect(server.messages_dropped() > 0, "stalled subscriber dropped " + std::to_string(server.messages_dropped()) + " messages");
+
+  // Wakes up: drains the kernel buffer, then what the server kept, then live deltas
+  for (int f = 0; f < 200; ++f) {
+    stalled.drain();
+    server.poll();
+    stalled.drain();
+    scene.step(true);
+    server.publish(enc.encode(scene.world(), 1500 + f), keyframe);
+    fast.drain();
+  }
+  stalled.drain();
+  fast.drain();
+
+  Expect(fast.keyframes == 1 && fast.refused == 0 && fast.malformed == 0 && fast.deltas == 1699,
+         "live subscriber: one keyframe then every delta (" + std::to_string(fast.deltas) + ")");
+  Expect(stalled.refused == 0 && stalled.malformed == 0 && stalled.keyframes >= 2,
+         "stalled subscriber resynced on a keyframe without ever seeing a gap (" + std::to_string(stalled.keyframes) + " keyframes)");
+  Expect(SameTracks(fast.decoder.tracks(), stalled.decoder.tracks()) && MaxError(scene.world(), fast.decoder.tracks()) <= 0.5 / 16.0 + 1e-3,
+         "both end on the current tracks");
+
+  ::close(fast.fd);
+  scene.step(true);
+  server.publish(enc.encode(scene.world(), 0), keyframe);
+  server.poll();
+  Expect(server.clients() == 1, "closed subscriber is dropped");
+  ::close(stalled.fd);
+}
+
+int main() {
+  TestCodec();
+  TestWideIds();
+  TestServer();
+  Bench();
+  return TestResult();
+}
@@ -0,0 +1,201 @@
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "core/config.hpp"
+#include "core/detections.hpp"
+#include "core/frame.hpp"
+#include "core/render_frame.hpp"
+#include "core/track_stream.hpp"
+#include "core/world_state.hpp"
+#include "infra/bounded_queue.hpp"
+#include "infra/latest_store.hpp"
+#include "stages/tracking_stage.hpp"
+#include "test_util.hpp"
+
+// Runs the real TrackingStage: objects keep their track id across frames and inference results, a lost object is
+// kept for max_missed_frames results and then dropped, and the track stream of that output is mostly deltas.
+// Exits non-zero on failure
+
+namespace {
+
+struct Object {
+  int class_id;
+  float x, y;
+};
+
+class Harness {
+public:
+  explicit Harness(const dcp::TrackingConfig& cfg)
+      : in_(std::make_shared<dcp::BoundedQueue<dcp::Frame>>(4, dcp::DropPolicy::DropNewest)),
+        out_(std::make_shared<dcp::BoundedQueue<dcp::RenderFrame>>(4, dcp::DropPolicy::DropNewest)),
+        dets_(std::make_shared<dcp::LatestStore<dcp::Detections>>()),
+        stage_(nullptr, cfg, in_, dets_, {out_}) {
+    stage_.start(stop_.token());
+  }
+
+  ~Harness() { stage_.stop(); }
+
+  // An inference result for the next frame, sorted by score like the detector's
+  void detect(const std::vector<Object>& objects) {
+    dcp::Detections d;
+    d.source_frame_id = seq_ + 1;
+    d.inference_time = std::chrono::steady_clock::now();
+    float score = 0.9f;
+    for (const Object& o : objects) {
+      dcp::Detection det;
+      det.class_id = o.class_id;
+      det.confidence = score;
+      det.bbox = {o.x, o.y, 40.f, 30.f};
+      d.items.push_back(det);
+      score -= 0.01f;
+    }
+    dets_->write(std::move(d));
+  }
+
+  // One frame through the stage, false if it didn't come out
+  bool frame(dcp::WorldState& ws) {
+    dcp::Frame f;
+    f.sequence_id = ++seq_;
+    f.capture_time = std::chrono::steady_clock::now();
+    f.image = cv::Mat(8, 8, CV_8UC3);
+    in_->try_push(std::move(f));
+
+    dcp::RenderFrame rf;
+    if (!out_->try_pop_for(rf, std::chrono::seconds(1))) return false;
+    ws = rf.world;
+    return true;
+  }
+
+private:
+  dcp::StopSource stop_;
+  std::shared_ptr<dcp::BoundedQueue<dcp::Frame>> in_;
+  std::shared_ptr<dcp::BoundedQueue<dcp::RenderFrame>> out_;
+  std::shared_ptr<dcp::LatestStore<dcp::Detections>> dets_;
+  dcp::TrackingStage stage_;
+  std::uint64_t seq_{0};
+};
+
+const dcp::Track* Find(const dcp::WorldState& ws, int class_id) {
+  for (const dcp::Track& t : ws.tracks) {
+    if (t.class_id == class_id) return &t;
+  }
+  return nullptr;
+}
+
+} // namespace
+
+int main() {
+  dcp::TrackingConfig cfg;
+  cfg.iou_threshold = 0.3f;
+  cfg.max_missed_frames = 2;
+  cfg.min_confirmed_frames = 3;
+
+  // Ids across frames and inference results
+  {
+    Harness h(cfg);
+    dcp::WorldState ws;
+
+    h.detect({{0, 100.f, 100.f}, {1, 400.f, 200.f}});
+    bool ok = h.frame(ws);
+    const dcp::Track* a = Find(ws, 0);
+    const dcp::Track* b = Find(ws, 1);
+    Expect(ok && ws.tracks.size() == 2 && a && b && a->id != b->id, "two objects, two tracks");
+    const std::uint64_t id_a = a ? a->id : 0;
+    const std::uint64_t id_b = b ? b->id : 0;
+    Expect(a && !a->confirmed && a->age_frames == 1, "new track not confirmed yet");
+
+    // Cached detections: same tracks on every frame until the next result
+    bool same = true;
+    for (int i = 0; i < 3; ++i) {
+      ok = h.frame(ws) && ok;
+      same = same && Find(ws, 0) && Find(ws, 0)->id == id_a && Find(ws, 1) && Find(ws, 1)->id == id_b;
+    }
+    Expect(ok && same, "ids kept while detections are reused");
+
+    // Objects move a little between results, still the same tracks
+    for (int r = 1; r <= 3; ++r) {
+      h.detect({{0, 100.f + 4.f * r, 100.f}, {1, 400.f, 200.f - 3.f * r}});
+      ok = h.frame(ws) && ok;
+      same = same && Find(ws, 0) && Find(ws, 0)->id == id_a && Find(ws, 1) && Find(ws, 1)->id == id_b;
+    }
+    Expect(ok && same, "ids kept across new inference results");
+    Expect(Find(ws, 0) && Find(ws, 0)->confirmed && Find(ws, 0)->age_frames == 4,
+           "confirmed after min_confirmed_frames results");
+
+    // Object 1 is lost: kept at its last box for max_missed_frames results, then dropped
+    h.detect({{0, 116.f, 100.f}});
+    ok = h.frame(ws) && ok;
+    Expect(ok && Find(ws, 1) && Find(ws, 1)->id == id_b && Find(ws, 1)->missed_frames == 1,
+           "lost object kept as missed");
+    h.detect({{0, 120.f, 100.f}});
+    ok = h.frame(ws) && ok;
+    Expect(ok && Find(ws, 1) && Find(ws, 1)->missed_frames == 2, "still kept at max_missed_frames");
+    h.detect({{0, 124.f, 100.f}});
+    ok = h.frame(ws) && ok;
+    Expect(ok && !Find(ws, 1) && ws.tracks.size() == 1, "dropped after max_missed_frames");
+
+    // A new object far away, and the same class jumping too far to overlap, both get new ids
+    h.detect({{0, 1200.f, 600.f}, {2, 500.f, 500.f}});
+    ok = h.frame(ws) && ok;
+    const dcp::Track* c = Find(ws, 2);
+    bool fresh = c && c->id != id_a && c->id != id_b;
+    for (const dcp::Track& t : ws.tracks) {
+      if (t.class_id == 0 && t.missed_frames == 0) fresh = fresh && t.id != id_a;
+    }
+    Expect(ok && fresh, "non-overlapping detections start new tracks");
+  }
+
+  // The track stream of real tracking output: half the objects moving, half parked, a new object now and then
+  {
+    Harness h(cfg);
+    dcp::TrackStreamEncoder enc;
+    dcp::TrackStreamDecoder dec;
+    dcp::WorldState ws;
+    std::vector<Object> objects;
+    for (int i = 0; i < 20; ++i) objects.push_back({i % 5, 60.f * i, 20.f * i});
+
+    bool ok = true;
+    bool synced = true;
+    std::size_t delta_bytes = 0;
+    std::size_t key_bytes = 0;
+    std::size_t between_bytes = 0;
+    int results = 0;
+    for (int f = 0; f < 300; ++f) {
+      const bool new_result = f % 3 == 0;  // Inference at a third of the frame rate
+      if (new_result) {
+        for (std::size_t i = 0; i < objects.size(); i += 2) objects[i].x += 2.f;
+        if (f % 60 == 0) objects.push_back({7, 50.f + f, 700.f});
+        h.detect(objects);
+        ++results;
+      }
+      ok = h.frame(ws) && ok;
+      const auto& msg = enc.encode(ws, f);
+      if (f == 0) {
+        const auto& key = enc.keyframe();
+        synced = dec.apply(key.data(), key.size()) == dcp::TrackStreamApply::Ok;
+        continue;
+      }
+      synced = synced && dec.apply(msg.data(), msg.size()) == dcp::TrackStreamApply::Ok;
+      if (new_result) {
+        delta_bytes += msg.size();
+        key_bytes += enc.keyframe().size();
+      } else {
+        between_bytes += msg.size();
+      }
+    }
+    Expect(ok && synced, "decoder follows the real tracking output");
+    Expect(dec.tracks().size() == ws.tracks.size(), "decoded track count matches");
+    Expect(between_bytes == (300 - results) * sizeof(dcp::TrackStreamHeader),
+           "frames between inference results cost a header only");
+    Expect(delta_bytes * 2 < key_bytes, "deltas on new results under half a keyframe (" +
+                                            std::to_string(delta_bytes / (results - 1)) + " B vs " +
+                                            std::to_string(key_bytes / (results - 1)) + " B)");
+  }
+
+  return TestResult();
+}